@@ -0,0 +1,401 @@
+#include "Baseline.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+namespace Baseline
+{
+    namespace
+    {
+        // Scale of the MAD to the standard deviation of a normal distribution
+        constexpr double MAD_TO_SIGMA = 1.4826;
+
+        // Deltas below the timestamp resolution are never regressions
+        constexpr double MIN_DELTA_MS = 0.01;
+
+        /**
+         * Just enough JSON for the files written by ocean_bench
+         */
+        struct Value
+        {
+            enum class Type
+            {
+                Null,
+                Bool,
+                Number,
+                String,
+                Array,
+                Object,
+            };
+
+            Type type     = Type::Null;
+            double number = 0.0;
+            std::string string;
+            std::vector<Value> array;
+            std::vector<std::pair<std::string, Value>> object;
+
+            const Value* Find(const std::string& key) const
+            {
+                for (const auto& [name, value] : object)
+                {
+                    if (name == key)
+                    {
+                        return &value;
+                    }
+                }
+                return nullptr;
+            }
+
+            double GetNumber(const std::string& key) const
+            {
+                const Value* value = Find(key);
+                return value && value->type == Type::Number ? value->number : 0.0;
+            }
+        };
+
+        class Parser
+        {
+        public:
+            explicit Parser(const std::string& text) : mText(text) {}
+
+            bool Parse(Value& value)
+            {
+                if (!ParseValue(value))
+                {
+                    return false;
+                }
+                SkipWhitespace();
+                return mPos == mText.size();
+            }
+
+        private:
+            void SkipWhitespace()
+            {
+                while (mPos < mText.size() && std::isspace(static_cast<unsigned char>(mText[mPos])))
+                {
+                    ++mPos;
+                }
+            }
+
+            bool Consume(char c)
+            {
+                SkipWhitespace();
+                if (mPos < mText.size() && mText[mPos] == c)
+                {
+                    ++mPos;
+                    return true;
+                }
+                return false;
+            }
+
+            bool ConsumeWord(const char* word)
+            {
+                std::string_view rest(mText.data() + mPos, mText.size() - mPos);
+                if (rest.starts_with(word))
+                {
+                    mPos += std::string_view(word).size();
+                    return true;
+                }
+                return false;
+            }
+
+            bool ParseString(std::string& string)
+            {
+                if (!Consume('"'))
+                {
+                    return false;
+                }
+                while (mPos < mText.size() && mText[mPos] != '"')
+                {
+                    char c = mText[mPos++];
+                    if (c == '\\' && mPos < mText.size())
+                    {
+                        c = mText[mPos++];
+                        if (c == 'n')
+                        {
+                            c = '\n';
+                        }
+                        else if (c == 't')
+                        {
+                            c = '\t';
+                        }
+                        else if (c == 'u')
+                        {
+                            // Not written by the benchmark, keep a placeholder
+                            mPos = std::min(mPos + 4, mText.size());
+                            c    = '?';
+                        }
+                    }
+                    string += c;
+                }
+                return Consume('"');
+            }
+
+            bool ParseValue(Value& value)
+            {
+                SkipWhitespace();
+                if (mPos >= mText.size())
+                {
+                    return false;
+                }
+
+                char c = mText[mPos];
+                if (c == '{')
+                {
+                    value.type = Value::Type::Object;
+                    ++mPos;
+                    if (Consume('}'))
+                    {
+                        return true;
+                    }
+                    do
+                    {
+                        auto& [name, member] = value.object.emplace_back();
+                        if (!ParseString(name) || !Consume(':') || !ParseValue(member))
+                        {
+                            return false;
+                        }
+                    } while (Consume(','));
+                    return Consume('}');
+                }
+                if (c == '[')
+                {
+                    value.type = Value::Type::Array;
+                    ++mPos;
+                    if (Consume(']'))
+                    {
+                        return true;
+                    }
+                    do
+                    {
+                        if (!ParseValue(value.array.emplace_back()))
+                        {
+                            return false;
+                        }
+                    } while (Consume(','));
+                    return Consume(']');
+                }
+                if (c == '"')
+                {
+                    value.type = Value::Type::String;
+                    return ParseString(value.string);
+                }
+                if (ConsumeWord("true"))
+                {
+                    value.type   = Value::Type::Bool;
+                    value.number = 1.0;
+                    return true;
+                }
+                if (ConsumeWord("false"))
+                {
+                    value.type = Value::Type::Bool;
+                    return true;
+                }
+                if (ConsumeWord("null"))
+                {
+                    return true;
+                }
+
+                const char* begin = mText.c_str() + mPos;
+                char* end         = nullptr;
+                value.type        = Value::Type::Number;
+                value.number      = std::strtod(begin, &end);
+                mPos += end - begin;
+                return end != begin;
+            }
+
+        private:
+            const std::string& mText;
+            size_t mPos = 0;
+        };
+
+        Statistic ReadStatistic(const Value& value)
+        {
+            return {value.GetNumber("median"), value.GetNumber("mad")};
+        }
+
+        const Statistic* FindMetric(const Preset& preset, const std::string& name)
+        {
+            for (const auto& [metric, statistic] : preset.metrics)
+            {
+                if (metric == name)
+                {
+                    return &statistic;
+                }
+            }
+            return nullptr;
+        }
+    }  // namespace
+
+    Statistic Summarize(std::vector<double> values)
+    {
+        auto median = [](std::vector<double>& values)
+        {
+            if (values.empty())
+            {
+                return 0.0;
+            }
+            std::sort(values.begin(), values.end());
+            size_t half = values.size() / 2;
+            return values.size() % 2 ? values[half] : 0.5 * (values[half - 1] + values[half]);
+        };
+
+        Statistic statistic;
+        statistic.median = median(values);
+        for (double& value : values)
+        {
+            value = std::abs(value - statistic.median);
+        }
+        statistic.mad = median(values);
+        return statistic;
+    }
+
+    bool Load(const std::string& path, std::vector<Preset>& presets)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "Failed to open baseline " << path << std::endl;
+            return false;
+        }
+
+        std::stringstream stream;
+        stream << file.rdbuf();
+        std::string text = stream.str();
+
+        Value root;
+        if (!Parser(text).Parse(root) || root.type != Value::Type::Object)
+        {
+            std::cerr << "Failed to parse baseline " << path << std::endl;
+            return false;
+        }
+
+        const Value* results = root.Find("results");
+        if (!results || results->type != Value::Type::Array)
+        {
+            std::cerr << "Baseline " << path << " has no results" << std::endl;
+            return false;
+        }
+
+        for (const Value& result : results->array)
+        {
+            Preset& preset = presets.emplace_back();
+            if (const Value* simulation = result.Find("simulation"))
+            {
+                preset.simulation = simulation->string;
+            }
+            preset.numParticles = static_cast<int>(result.GetNumber("numParticles"));
+
+            if (const Value* statistics = result.Find("statistics"))
+            {
+                for (const auto& [name, value] : statistics->object)
+                {
+                    if (name != "gpuStageMs")
+                    {
+                        preset.metrics.emplace_back(name, ReadStatistic(value));
+                    }
+                }
+                if (const Value* stages = statistics->Find("gpuStageMs"))
+                {
+                    for (const auto& [name, value] : stages->object)
+                    {
+                        preset.metrics.emplace_back("gpuStageMs/" + name, ReadStatistic(value));
+                    }
+                }
+                continue;
+            }
+
+            // Single run
+            if (const Value* frameTime = result.Find("frameTimeMs"))
+            {
+                preset.metrics.emplace_back("frameTimeP50Ms",
+                                            Statistic {frameTime->GetNumber("p50"), 0.0});
+            }
+            preset.metrics.emplace_back("gpuFrameMs",
+                                        Statistic {result.GetNumber("gpuFrameMs"), 0.0});
+            if (const Value* stages = result.Find("gpuStageMs"))
+            {
+                for (const auto& [name, value] : stages->object)
+                {
+                    Statistic statistic {value.number, 0.0};
+                    preset.metrics.emplace_back("gpuStageMs/" + name, statistic);
+                }
+            }
+        }
+        return true;
+    }
+
+    int Compare(const std::vector<Preset>& baseline,
+                const std::vector<Preset>& current,
+                double tolerance,
+                FILE* out)
+    {
+        int regressions = 0;
+
+        fprintf(out, "Comparison against baseline (tolerance %.1f%%):\n", 100.0 * tolerance);
+        for (const Preset& preset : current)
+        {
+            auto it = std::find_if(baseline.begin(),
+                                   baseline.end(),
+                                   [&](const Preset& other)
+                                   {
+                                       return other.simulation == preset.simulation
+                                              && other.numParticles == preset.numParticles;
+                                   });
+            if (it == baseline.end())
+            {
+                fprintf(out,
+                        "%s %d particles: not in baseline\n",
+                        preset.simulation.c_str(),
+                        preset.numParticles);
+                continue;
+            }
+
+            fprintf(out, "%s %d particles:\n", preset.simulation.c_str(), preset.numParticles);
+            for (const auto& [name, now] : preset.metrics)
+            {
+                const Statistic* base = FindMetric(*it, name);
+                if (!base || base->median <= 0.0 || now.median <= 0.0)
+                {
+                    continue;
+                }
+
+                double delta     = now.median - base->median;
+                double noise     = MAD_TO_SIGMA * std::hypot(base->mad, now.mad);
+                double threshold = std::max({tolerance * base->median, 3.0 * noise, MIN_DELTA_MS});
+
+                const char* verdict = "";
+                if (delta > threshold)
+                {
+                    verdict = "REGRESSION";
+                    ++regressions;
+                }
+                else if (-delta > threshold)
+                {
+                    verdict = "improved";
+                }
+
+                fprintf(out,
+                        " - %-28s %9.3f -> %9.3f ms (%+6.1f%%, noise %.3f) %s\n",
+                        name.c_str(),
+                        base->median,
+                        now.median,
+                        100.0 * delta / base->median,
+                        noise,
+                        verdict);
+            }
+        }
+
+        if (regressions > 0)
+        {
+            fprintf(out, "%d metric(s) regressed beyond tolerance\n", regressions);
+        }
+        return regressions;
+    }
+}  // namespace Baseline
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Comparison of ocean_bench results against a stored baseline JSON. Every metric is the median
+ * over repeated runs of a preset with its median absolute deviation (MAD) as noise estimate.
+ */
+namespace Baseline
+{
+    struct Statistic
+    {
+        double median = 0.0;
+        double mad    = 0.0;
+    };
+
+    struct Preset
+    {
+        std::string simulation;
+        int numParticles = 0;
+
+        // End-to-end metrics first, then "gpuStageMs/<stage>"
+        std::vector<std::pair<std::string, Statistic>> metrics;
+    };
+
+    Statistic Summarize(std::vector<double> values);
+
+    /**
+     * Read the presets of an ocean_bench JSON. Files written without repeats fall back to the
+     * single run values with a MAD of 0.
+     */
+    bool Load(const std::string& path, std::vector<Preset>& presets);
+
+    /**
+     * Print the delta of every metric found in both runs and return the number of regressions.
+     * A metric regresses when it grows by more than `tolerance` (relative) and by more than three
+     * standard deviations of the combined noise.
+     */
+    int Compare(const std::vector<Preset>& baseline,
+                const std::vector<Preset>& current,
+                double tolerance,
+                FILE* out);
+}  // namespace Baseline
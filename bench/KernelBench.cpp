@@ -0,0 +1,632 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Application.h"
+#include "GPUProfiler.h"
+#include "ResourceManager.h"
+#include "WebGPUUtils.h"
+
+/**
+ * Isolated per-kernel benchmarks. Every kernel is timed on its own after replaying the stages
+ * it depends on, on synthetic particle distributions of increasing size.
+ */
+
+namespace
+{
+    enum class Distribution
+    {
+        Uniform,
+        DamBreakColumn,
+        CompressedPool,
+    };
+
+    const char* GetDistributionName(Distribution distribution)
+    {
+        switch (distribution)
+        {
+            case Distribution::Uniform:
+                return "uniform";
+            case Distribution::DamBreakColumn:
+                return "dam-break column";
+            case Distribution::CompressedPool:
+                return "compressed pool";
+        }
+        return "";
+    }
+
+    struct KernelBenchOptions
+    {
+        std::vector<int> sizes = {10000, 100000, 1000000};
+        int repeats            = 10;
+        bool fallbackAdapter   = false;
+        std::string output     = "ocean_kernel_bench.json";
+    };
+
+    struct KernelResult
+    {
+        std::string kernel;
+        std::string distribution;
+        int numParticles;
+        int elements;
+        double ms;
+        double bytesPerElement;
+    };
+
+    struct Context
+    {
+        wgpu::Instance instance;
+        wgpu::Device device;
+        wgpu::Queue queue;
+        std::unique_ptr<GPUProfiler> profiler;
+        std::string adapterName;
+    };
+
+    using EncodeFunction = std::function<void(wgpu::ComputePassEncoder&)>;
+
+    void PrintUsage(const char* program)
+    {
+        std::cout << "Usage: " << program << " [options]\n"
+                  << "  --sizes N,N,...      Particle counts (default 10000,100000,1000000)\n"
+                  << "  --repeats N          Repetitions per kernel (default 10)\n"
+                  << "  --fallback-adapter   Use the fallback (CPU) adapter\n"
+                  << "  --output FILE        JSON output path (default ocean_kernel_bench.json)\n"
+                  << "  --help               Show this message" << std::endl;
+    }
+
+    bool Parse(int argc, char* argv[], KernelBenchOptions& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool valid      = true;
+
+            auto nextValue = [&]() -> const char*
+            {
+                if (i + 1 >= argc)
+                {
+                    valid = false;
+                    return "";
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--help" || arg == "-h")
+            {
+                PrintUsage(argv[0]);
+                return false;
+            }
+            else if (arg == "--sizes")
+            {
+                options.sizes.clear();
+                std::stringstream list(nextValue());
+                std::string item;
+                while (std::getline(list, item, ','))
+                {
+                    int size = std::atoi(item.c_str());
+                    valid    = valid && size > 0;
+                    options.sizes.push_back(size);
+                }
+                valid = valid && !options.sizes.empty();
+            }
+            else if (arg == "--repeats")
+            {
+                options.repeats = std::atoi(nextValue());
+                valid           = valid && options.repeats > 0;
+            }
+            else if (arg == "--fallback-adapter")
+            {
+                options.fallbackAdapter = true;
+            }
+            else if (arg == "--output")
+            {
+                options.output = nextValue();
+                valid          = valid && !options.output.empty();
+            }
+            else
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                PrintUsage(argv[0]);
+                return false;
+            }
+
+            if (!valid)
+            {
+                std::cerr << "Invalid value for " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool InitializeContext(Context& context, const KernelBenchOptions& options)
+    {
+        static const auto kTimeoutWaitAny = wgpu::InstanceFeatureName::TimedWaitAny;
+        wgpu::InstanceDescriptor instanceDescriptor {
+            .nextInChain          = nullptr,
+            .requiredFeatureCount = 1,
+            .requiredFeatures     = &kTimeoutWaitAny,
+        };
+        context.instance = wgpu::CreateInstance(&instanceDescriptor);
+
+        wgpu::RequestAdapterOptions adapterOptions {};
+        adapterOptions.forceFallbackAdapter = options.fallbackAdapter;
+        wgpu::Adapter adapter = WebGPUUtils::RequestAdapterSync(context.instance, &adapterOptions);
+        if (!adapter)
+        {
+            return false;
+        }
+
+        wgpu::AdapterInfo adapterInfo;
+        adapter.GetInfo(&adapterInfo);
+        context.adapterName = std::string(std::string_view(adapterInfo.device));
+
+        std::vector<wgpu::FeatureName> requiredFeatures;
+        bool timestampQuery = adapter.HasFeature(wgpu::FeatureName::TimestampQuery);
+        if (timestampQuery)
+        {
+            requiredFeatures.push_back(wgpu::FeatureName::TimestampQuery);
+        }
+
+        // The largest sizes need the adapter's storage buffer limits
+        wgpu::Limits requiredLimits;
+        adapter.GetLimits(&requiredLimits);
+
+        wgpu::DeviceDescriptor deviceDesc {};
+        deviceDesc.label                = WebGPUUtils::GenerateString("kernel bench device");
+        deviceDesc.requiredFeatureCount = requiredFeatures.size();
+        deviceDesc.requiredFeatures     = requiredFeatures.data();
+        deviceDesc.requiredLimits       = &requiredLimits;
+        deviceDesc.SetUncapturedErrorCallback(
+            [](const wgpu::Device&, wgpu::ErrorType type, wgpu::StringView message)
+            {
+                printf("Uncaptured device error: type 0x%08X\n", type);
+                if (message.data)
+                {
+                    printf(" - message: %s\n", message.data);
+                }
+            });
+
+        context.device = WebGPUUtils::RequestDeviceSync(context.instance, adapter, &deviceDesc);
+        if (!context.device)
+        {
+            return false;
+        }
+        context.queue = context.device.GetQueue();
+
+        context.profiler = std::make_unique<GPUProfiler>(context.device, timestampQuery);
+        context.profiler->SetEnabled(timestampQuery);
+
+        return true;
+    }
+
+    void Wait(Context& context)
+    {
+        WebGPUUtils::WaitForSubmittedWork(context.instance, context.queue);
+        context.device.Tick();
+        // Delivers the profiler's readbacks
+        context.instance.ProcessEvents();
+    }
+
+    /**
+     * Average milliseconds of `kernel`. Each repetition resets the input and replays the
+     * prerequisite stages untimed. Uses timestamp queries when available, wall clock otherwise.
+     */
+    double Measure(Context& context,
+                   const char* name,
+                   int repeats,
+                   const std::function<void()>& reset,
+                   const EncodeFunction& prerequisites,
+                   const EncodeFunction& kernel)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        GPUProfiler& profiler = *context.profiler;
+        profiler.ResetStatistics();
+
+        double wallMs = 0.0;
+        for (int i = 0; i < repeats; ++i)
+        {
+            reset();
+
+            wgpu::CommandEncoder encoder = context.device.CreateCommandEncoder();
+            wgpu::ComputePassDescriptor computePassDesc {};
+            wgpu::ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+            prerequisites(computePass);
+            computePass.End();
+
+            if (!profiler.IsEnabled())
+            {
+                wgpu::CommandBuffer command = encoder.Finish();
+                context.queue.Submit(1, &command);
+                Wait(context);
+                encoder = context.device.CreateCommandEncoder();
+            }
+
+            profiler.BeginFrame();
+            wgpu::ComputePassDescriptor timedPassDesc {
+                .label           = WebGPUUtils::GenerateString(name),
+                .timestampWrites = profiler.Allocate(name),
+            };
+            computePass = encoder.BeginComputePass(&timedPassDesc);
+            kernel(computePass);
+            computePass.End();
+            profiler.Resolve(encoder);
+
+            wgpu::CommandBuffer command = encoder.Finish();
+            auto start                  = Clock::now();
+            context.queue.Submit(1, &command);
+            profiler.EndFrame();
+            Wait(context);
+            wallMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+
+        for (const GPUProfiler::StageTiming& stage : profiler.GetStageTimings())
+        {
+            if (stage.name == name && stage.sampleCount > 0)
+            {
+                return stage.totalMs / stage.sampleCount;
+            }
+        }
+        return wallMs / repeats;
+    }
+
+    /**
+     * Uniformly random positions inside the region of the box occupied by `distribution`
+     */
+    std::vector<glm::vec3> GeneratePositions(Distribution distribution,
+                                             int count,
+                                             const glm::vec3& boxMin,
+                                             const glm::vec3& boxMax)
+    {
+        glm::vec3 regionMax = boxMax;
+        if (distribution == Distribution::DamBreakColumn)
+        {
+            regionMax.x = boxMin.x + 0.3f * (boxMax.x - boxMin.x);
+            regionMax.z = boxMin.z + 0.3f * (boxMax.z - boxMin.z);
+        }
+        else if (distribution == Distribution::CompressedPool)
+        {
+            regionMax.y = boxMin.y + 0.1f * (boxMax.y - boxMin.y);
+        }
+
+        std::mt19937 generator(12345);
+        std::uniform_real_distribution<float> random(0.0f, 1.0f);
+
+        std::vector<glm::vec3> positions(count);
+        for (glm::vec3& position : positions)
+        {
+            glm::vec3 t(random(generator), random(generator), random(generator));
+            position = glm::mix(boxMin, regionMax, t);
+        }
+        return positions;
+    }
+
+    /**
+     * Approximate compulsory memory traffic per element, neighbour reads are not included
+     */
+    double GetBytesPerElement(SPHSimulator::Stage stage)
+    {
+        const double particle = sizeof(SPHParticle);
+        switch (stage)
+        {
+            case SPHSimulator::Stage::GridClear:
+                return 4.0;
+            case SPHSimulator::Stage::GridBuild:
+                return 16.0 + 4.0 + 8.0;  // position, offset, atomic
+            case SPHSimulator::Stage::PrefixSum:
+                return 8.0;
+            case SPHSimulator::Stage::Reorder:
+                return 2.0 * particle + 8.0;
+            case SPHSimulator::Stage::Density:
+                return 16.0 + 8.0;
+            case SPHSimulator::Stage::Force:
+                return particle + 16.0;
+            case SPHSimulator::Stage::Integrate:
+                return particle + 32.0;
+            case SPHSimulator::Stage::CopyPosition:
+                return 32.0 + sizeof(PosVel);
+        }
+        return 0.0;
+    }
+
+    double GetBytesPerElement(MlsMpmSimulator::Stage stage)
+    {
+        const double particle = sizeof(MlsMpmParticle);
+        const double cell     = sizeof(Cell);
+        switch (stage)
+        {
+            case MlsMpmSimulator::Stage::ClearGrid:
+                return cell;
+            case MlsMpmSimulator::Stage::P2G1:
+                return particle + 27.0 * 2.0 * cell;  // 3x3x3 atomic read-modify-writes
+            case MlsMpmSimulator::Stage::P2G2:
+                return particle + 27.0 * (4.0 + 2.0 * 12.0);
+            case MlsMpmSimulator::Stage::UpdateGrid:
+                return 2.0 * cell;
+            case MlsMpmSimulator::Stage::G2P:
+                return 2.0 * particle + 27.0 * cell;
+            case MlsMpmSimulator::Stage::CopyPosition:
+                return 32.0 + sizeof(PosVel);
+        }
+        return 0.0;
+    }
+
+    bool IsPerCell(SPHSimulator::Stage stage)
+    {
+        return stage == SPHSimulator::Stage::GridClear || stage == SPHSimulator::Stage::PrefixSum;
+    }
+
+    bool IsPerCell(MlsMpmSimulator::Stage stage)
+    {
+        return stage == MlsMpmSimulator::Stage::ClearGrid
+               || stage == MlsMpmSimulator::Stage::UpdateGrid;
+    }
+
+    wgpu::Buffer CreateStorageBuffer(Context& context, const char* label, uint64_t size)
+    {
+        wgpu::BufferDescriptor bufferDesc {};
+        bufferDesc.label            = WebGPUUtils::GenerateString(label);
+        bufferDesc.size             = size;
+        bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage;
+        bufferDesc.mappedAtCreation = false;
+        return context.device.CreateBuffer(&bufferDesc);
+    }
+
+    /**
+     * Time every stage of one simulator substep. The stage order of the simulator is replayed
+     * up to the measured stage, each stage is measured at its first occurrence.
+     */
+    template <typename Simulator>
+    void BenchmarkSimulator(Context& context,
+                            Simulator& simulator,
+                            const std::function<void()>& reset,
+                            Distribution distribution,
+                            int numParticles,
+                            int repeats,
+                            std::vector<KernelResult>& results)
+    {
+        using Stage      = typename Simulator::Stage;
+        const auto& list = Simulator::SUBSTEP_STAGES;
+
+        for (size_t k = 0; k < list.size(); ++k)
+        {
+            Stage stage = list[k];
+            if (std::find(list.begin(), list.begin() + k, stage) != list.begin() + k)
+            {
+                continue;
+            }
+
+            auto prerequisites = [&](wgpu::ComputePassEncoder& computePass)
+            {
+                for (size_t i = 0; i < k; ++i)
+                {
+                    simulator.ComputeStage(list[i], computePass);
+                }
+            };
+
+            auto kernel = [&](wgpu::ComputePassEncoder& computePass)
+            { simulator.ComputeStage(stage, computePass); };
+
+            const char* name = Simulator::GetStageName(stage);
+            double ms        = Measure(context, name, repeats, reset, prerequisites, kernel);
+
+            int elements = IsPerCell(stage) ? simulator.GetGridCount() : numParticles;
+            results.push_back({
+                name,
+                GetDistributionName(distribution),
+                numParticles,
+                elements,
+                ms,
+                GetBytesPerElement(stage),
+            });
+        }
+    }
+
+    void BenchmarkSPH(Context& context,
+                      Distribution distribution,
+                      int numParticles,
+                      int repeats,
+                      std::vector<KernelResult>& results)
+    {
+        wgpu::Buffer particleBuffer = CreateStorageBuffer(context,
+                                                          "particle storage buffer",
+                                                          sizeof(SPHParticle) * numParticles);
+        wgpu::Buffer posvelBuffer =
+            CreateStorageBuffer(context, "position storage buffer", sizeof(PosVel) * numParticles);
+
+        SPHSimulator simulator(
+            context.device, particleBuffer, {posvelBuffer, posvelBuffer}, 0.08f, numParticles);
+
+        glm::vec3 halfBoxSize(1.4f, 2.0f, 1.4f);
+        glm::vec3 boxMin = -0.95f * halfBoxSize;
+        glm::vec3 boxMax = 0.95f * halfBoxSize;
+        std::vector<glm::vec3> positions =
+            GeneratePositions(distribution, numParticles, boxMin, boxMax);
+
+        std::vector<SPHParticle> particles(numParticles);
+        for (int i = 0; i < numParticles; ++i)
+        {
+            particles[i]          = {};
+            particles[i].position = positions[i];
+        }
+
+        auto reset = [&]() { simulator.SetParticles(particles, halfBoxSize); };
+        BenchmarkSimulator(context, simulator, reset, distribution, numParticles, repeats, results);
+    }
+
+    void BenchmarkMlsMpm(Context& context,
+                         Distribution distribution,
+                         int numParticles,
+                         int repeats,
+                         std::vector<KernelResult>& results)
+    {
+        wgpu::Buffer particleBuffer = CreateStorageBuffer(context,
+                                                          "particle storage buffer",
+                                                          sizeof(MlsMpmParticle) * numParticles);
+        wgpu::Buffer posvelBuffer =
+            CreateStorageBuffer(context, "position storage buffer", sizeof(PosVel) * numParticles);
+
+        MlsMpmSimulator simulator(
+            particleBuffer, {posvelBuffer, posvelBuffer}, 1.2f, context.device);
+
+        // Keep particles two cells away from the walls like the dam break setup does
+        glm::vec3 boxSize(50.0f, 50.0f, 80.0f);
+        std::vector<glm::vec3> positions =
+            GeneratePositions(distribution, numParticles, glm::vec3(2.0f), boxSize - 2.0f);
+
+        std::vector<MlsMpmParticle> particles(numParticles);
+        for (int i = 0; i < numParticles; ++i)
+        {
+            particles[i]          = {};
+            particles[i].position = positions[i];
+        }
+
+        auto reset = [&]() { simulator.SetParticles(particles, boxSize); };
+        BenchmarkSimulator(context, simulator, reset, distribution, numParticles, repeats, results);
+    }
+
+    void BenchmarkPrefixSum(Context& context,
+                            int count,
+                            int repeats,
+                            std::vector<KernelResult>& results)
+    {
+        wgpu::Buffer buffer =
+            CreateStorageBuffer(context, "prefix sum buffer", sizeof(uint32_t) * count);
+
+        std::mt19937 generator(12345);
+        std::uniform_int_distribution<uint32_t> random(0, 8);
+        std::vector<uint32_t> data(count);
+        for (uint32_t& value : data)
+        {
+            value = random(generator);
+        }
+
+        PrefixSumKernel prefixSumKernel(context.device, buffer, count);
+
+        auto reset = [&]()
+        { context.queue.WriteBuffer(buffer, 0, data.data(), sizeof(uint32_t) * count); };
+
+        auto prerequisites = [](wgpu::ComputePassEncoder&) {};
+
+        auto kernel = [&](wgpu::ComputePassEncoder& computePass)
+        { prefixSumKernel.Dispatch(computePass); };
+
+        double ms = Measure(context, "prefix sum", repeats, reset, prerequisites, kernel);
+        results.push_back({"prefix sum", "random counts", count, count, ms, 8.0});
+    }
+
+    std::string Escape(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            if (static_cast<unsigned char>(c) >= 0x20)
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    void WriteJSON(std::ostream& out,
+                   const Context& context,
+                   const KernelBenchOptions& options,
+                   const std::vector<KernelResult>& results)
+    {
+        out << "{\n";
+        out << "  \"adapter\": \"" << Escape(context.adapterName) << "\",\n";
+        out << "  \"timer\": \"" << (context.profiler->IsEnabled() ? "timestamp" : "wallclock")
+            << "\",\n";
+        out << "  \"repeats\": " << options.repeats << ",\n";
+        out << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const KernelResult& result = results[i];
+            double seconds             = result.ms * 1e-3;
+            out << "    {\"kernel\": \"" << result.kernel << "\", \"distribution\": \""
+                << result.distribution << "\", \"numParticles\": " << result.numParticles
+                << ", \"elements\": " << result.elements << ", \"ms\": " << result.ms
+                << ", \"nsPerElement\": " << 1e9 * seconds / result.elements
+                << ", \"bytesPerSecond\": " << result.bytesPerElement * result.elements / seconds
+                << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    KernelBenchOptions options;
+    if (!Parse(argc, argv, options))
+    {
+        return 1;
+    }
+
+    Context context;
+    if (!InitializeContext(context, options))
+    {
+        std::cerr << "Failed to create a WebGPU device" << std::endl;
+        return 1;
+    }
+
+    if (!context.profiler->IsEnabled())
+    {
+        std::cout << "Timestamp queries unavailable, falling back to wall clock" << std::endl;
+    }
+
+    const Distribution distributions[] = {
+        Distribution::Uniform,
+        Distribution::DamBreakColumn,
+        Distribution::CompressedPool,
+    };
+
+    std::vector<KernelResult> results;
+    for (int size : options.sizes)
+    {
+        for (Distribution distribution : distributions)
+        {
+            std::cout << "SPH / MLS-MPM: " << size << " particles, "
+                      << GetDistributionName(distribution) << std::endl;
+            BenchmarkSPH(context, distribution, size, options.repeats, results);
+            BenchmarkMlsMpm(context, distribution, size, options.repeats, results);
+        }
+        BenchmarkPrefixSum(context, size, options.repeats, results);
+    }
+    ResourceManager::ReleaseShaderModules();
+
+    for (const KernelResult& result : results)
+    {
+        printf("%-20s %-18s %8d %10.4f ms %8.3f ns/elem\n",
+               result.kernel.c_str(),
+               result.distribution.c_str(),
+               result.numParticles,
+               result.ms,
+               1e6 * result.ms / result.elements);
+    }
+
+    std::ofstream out(options.output);
+    if (!out)
+    {
+        std::cerr << "Failed to open " << options.output << std::endl;
+        return 1;
+    }
+    WriteJSON(out, context, options, results);
+
+    std::cout << "Wrote " << options.output << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,620 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Application.h"
+#include "Baseline.h"
+
+/**
+ * Headless throughput benchmark over every SPH and MLS-MPM particle preset
+ */
+
+namespace
+{
+    struct BenchOptions
+    {
+        ApplicationOptions app;
+
+        int warmupFrames   = 60;
+        int frames         = 300;
+        double budgetMs    = 16.0;
+        std::string output = "ocean_bench.json";
+
+        // Runs per preset, the statistics are the median and MAD over the runs
+        int repeat = 1;
+
+        // Compare against this ocean_bench JSON and fail on regressions
+        std::string baseline;
+        double tolerance = 0.05;
+    };
+
+    struct StageResult
+    {
+        std::string name;
+        double ms;
+    };
+
+    struct MetricResult
+    {
+        double mean;
+        double p50;
+        double p99;
+        double max;
+        std::vector<int> histogram;  // HISTOGRAM_BINS bins of width binWidth
+        double binWidth;
+    };
+
+    struct PresetResult
+    {
+        const char* simulation;
+        int numParticles;
+        double substeps;  // mean over the measured frames, varies with adaptive substeps
+        double wallSeconds;
+        double meanMs;
+        double p50Ms;
+        double p90Ms;
+        double p99Ms;
+        double maxMs;
+        double particleSubstepsPerSecond;
+        double gpuFrameMs;
+        std::vector<StageResult> stages;
+        MetricResult encodeMs;
+        MetricResult latencyMs;
+        MetricResult framesInFlight;
+        AlgorithmCounters counters;
+
+        // Median and MAD of the compared metrics over the repeated runs
+        Baseline::Preset statistics;
+
+        // Particle state after the run, deterministic mode only
+        uint64_t checksum;
+    };
+
+    constexpr int HISTOGRAM_BINS = 20;
+
+    void PrintUsage(const char* program)
+    {
+        std::cout << "Usage: " << program << " [options]\n"
+                  << "  --frames N           Measured frames per preset (default 300)\n"
+                  << "  --warmup N           Warm-up frames per preset (default 60)\n"
+                  << "  --budget-ms MS       Frame budget used for sizing (default 16)\n"
+                  << "  --size WxH           Render target size (default 1024x768)\n"
+                  << "  --fallback-adapter   Use the fallback (CPU) adapter\n"
+                  << "  --output FILE        JSON output path (default ocean_bench.json)\n"
+                  << "  --deterministic      Reproducible runs, records a particle checksum\n"
+                  << "  --adaptive-substeps  Choose substeps per frame from the particle speeds\n"
+                  << "  --no-pipeline-cache  Measure cold startups without the pipeline cache\n"
+                  << "  --camera-path FILE   Replay a camera path recorded with --record-camera\n"
+                  << "  --repeat N           Runs per preset, reports median and MAD (default 1)\n"
+                  << "  --baseline FILE      Compare with a JSON, exit with 2 on regressions\n"
+                  << "  --tolerance PCT      Relative regression tolerance (default 5)\n"
+                  << "  --help               Show this message" << std::endl;
+    }
+
+    bool Parse(int argc, char* argv[], BenchOptions& options)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool valid      = true;
+
+            auto nextValue = [&]() -> const char*
+            {
+                if (i + 1 >= argc)
+                {
+                    valid = false;
+                    return "";
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--help" || arg == "-h")
+            {
+                PrintUsage(argv[0]);
+                return false;
+            }
+            else if (arg == "--frames")
+            {
+                options.frames = std::atoi(nextValue());
+                valid          = valid && options.frames > 0;
+            }
+            else if (arg == "--warmup")
+            {
+                options.warmupFrames = std::atoi(nextValue());
+                valid                = valid && options.warmupFrames >= 0;
+            }
+            else if (arg == "--budget-ms")
+            {
+                options.budgetMs = std::atof(nextValue());
+                valid            = valid && options.budgetMs > 0.0;
+            }
+            else if (arg == "--size")
+            {
+                unsigned int w = 0, h = 0;
+                valid = std::sscanf(nextValue(), "%ux%u", &w, &h) == 2 && w > 0 && h > 0;
+                options.app.width  = w;
+                options.app.height = h;
+            }
+            else if (arg == "--fallback-adapter")
+            {
+                options.app.fallbackAdapter = true;
+            }
+            else if (arg == "--output")
+            {
+                options.output = nextValue();
+                valid          = valid && !options.output.empty();
+            }
+            else if (arg == "--deterministic")
+            {
+                options.app.deterministic = true;
+            }
+            else if (arg == "--adaptive-substeps")
+            {
+                options.app.adaptiveSubsteps = true;
+            }
+            else if (arg == "--no-pipeline-cache")
+            {
+                options.app.pipelineCache.clear();
+            }
+            else if (arg == "--camera-path")
+            {
+                options.app.replayCamera = nextValue();
+                valid                    = valid && !options.app.replayCamera.empty();
+            }
+            else if (arg == "--repeat")
+            {
+                options.repeat = std::atoi(nextValue());
+                valid          = valid && options.repeat > 0;
+            }
+            else if (arg == "--baseline")
+            {
+                options.baseline = nextValue();
+                valid            = valid && !options.baseline.empty();
+            }
+            else if (arg == "--tolerance")
+            {
+                options.tolerance = std::atof(nextValue()) / 100.0;
+                valid             = valid && options.tolerance >= 0.0;
+            }
+            else
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                PrintUsage(argv[0]);
+                return false;
+            }
+
+            if (!valid)
+            {
+                std::cerr << "Invalid value for " << arg << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    double Percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+        {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+        return values[std::min(index, values.size() - 1)];
+    }
+
+    // Without an explicit bin width the histogram spans four times the median
+    MetricResult Summarize(const FrameTelemetry::Metric& metric, double binWidth = 0.0)
+    {
+        MetricResult result {};
+        result.mean     = metric.Mean();
+        result.p50      = metric.Percentile(0.50);
+        result.p99      = metric.Percentile(0.99);
+        result.max      = metric.Max();
+        result.binWidth = binWidth > 0.0 ? binWidth : 4.0 * result.p50 / HISTOGRAM_BINS;
+        if (result.binWidth <= 0.0)
+        {
+            result.binWidth = 1.0;
+        }
+
+        // The last bin collects everything above the histogram range
+        result.histogram.assign(HISTOGRAM_BINS, 0);
+        metric.LifetimeHistogram(result.histogram.data(), HISTOGRAM_BINS, result.binWidth);
+        return result;
+    }
+
+    void WriteMetric(std::ostream& out, const char* name, const MetricResult& metric, bool last)
+    {
+        out << "      \"" << name << "\": {\"mean\": " << metric.mean << ", \"p50\": " << metric.p50
+            << ", \"p99\": " << metric.p99 << ", \"max\": " << metric.max
+            << ", \"histogram\": {\"binWidth\": " << metric.binWidth << ", \"counts\": [";
+        for (size_t i = 0; i < metric.histogram.size(); ++i)
+        {
+            out << (i == 0 ? "" : ", ") << metric.histogram[i];
+        }
+        out << "]}}" << (last ? "" : ",") << "\n";
+    }
+
+    void WriteCounters(std::ostream& out, const AlgorithmCounters& counters)
+    {
+        if (!counters.valid)
+        {
+            out << "      \"counters\": null\n";
+            return;
+        }
+
+        out << "      \"counters\": {";
+        if (counters.sph)
+        {
+            out << "\"densityCandidatesPerParticle\": " << counters.densityCandidates
+                << ", \"densityNeighborsPerParticle\": " << counters.densityNeighbors
+                << ", \"forceCandidatesPerParticle\": " << counters.forceCandidates
+                << ", \"forceNeighborsPerParticle\": " << counters.forceNeighbors << ", ";
+        }
+        else
+        {
+            out << "\"maxScatterFanIn\": " << counters.maxScatterFanIn << ", ";
+        }
+        out << "\"maxCellOccupancy\": " << counters.maxCellOccupancy
+            << ", \"emptyCells\": " << counters.emptyCells << ", \"occupancyHistogram\": [";
+        for (size_t i = 0; i < counters.occupancyHistogram.size(); ++i)
+        {
+            out << (i == 0 ? "" : ", ") << counters.occupancyHistogram[i];
+        }
+        out << "]}\n";
+    }
+
+    void WriteStatistic(std::ostream& out, const Baseline::Statistic& statistic)
+    {
+        out << "{\"median\": " << statistic.median << ", \"mad\": " << statistic.mad << "}";
+    }
+
+    std::string Escape(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                escaped += '\\';
+            }
+            if (static_cast<unsigned char>(c) >= 0x20)
+            {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    void WriteStatistics(std::ostream& out, const Baseline::Preset& statistics)
+    {
+        out << "      \"statistics\": {";
+        bool stages = false;
+        for (size_t i = 0; i < statistics.metrics.size(); ++i)
+        {
+            const auto& [name, statistic] = statistics.metrics[i];
+
+            // Stages follow the end-to-end metrics
+            std::string_view stage = name;
+            if (stage.starts_with("gpuStageMs/"))
+            {
+                stage.remove_prefix(std::string_view("gpuStageMs/").size());
+                out << (stages ? ", " : ", \"gpuStageMs\": {") << "\"" << Escape(std::string(stage))
+                    << "\": ";
+                stages = true;
+            }
+            else
+            {
+                out << (i == 0 ? "" : ", ") << "\"" << name << "\": ";
+            }
+            WriteStatistic(out, statistic);
+        }
+        out << (stages ? "}" : "") << "},\n";
+    }
+
+    // Median and MAD of the compared metrics, the result of the median run is reported
+    PresetResult CombineRuns(const std::vector<PresetResult>& runs)
+    {
+        auto collect = [&](auto&& getter)
+        {
+            std::vector<double> values;
+            for (const PresetResult& run : runs)
+            {
+                values.push_back(getter(run));
+            }
+            return Baseline::Summarize(values);
+        };
+
+        std::vector<PresetResult> sorted = runs;
+        std::sort(sorted.begin(),
+                  sorted.end(),
+                  [](const PresetResult& a, const PresetResult& b) { return a.p50Ms < b.p50Ms; });
+        PresetResult result = sorted[sorted.size() / 2];
+
+        for (const PresetResult& run : runs)
+        {
+            if (run.checksum != result.checksum)
+            {
+                std::cout << "Warning: " << result.simulation << " " << result.numParticles
+                          << " particles is not deterministic, the checksums differ" << std::endl;
+                break;
+            }
+        }
+
+        Baseline::Preset& statistics = result.statistics;
+        statistics.simulation        = result.simulation;
+        statistics.numParticles      = result.numParticles;
+        statistics.metrics.emplace_back("frameTimeP50Ms",
+                                        collect([](const PresetResult& run) { return run.p50Ms; }));
+        statistics.metrics.emplace_back(
+            "gpuFrameMs", collect([](const PresetResult& run) { return run.gpuFrameMs; }));
+
+        for (size_t i = 0; i < result.stages.size(); ++i)
+        {
+            // Every run records the stages in the same order
+            statistics.metrics.emplace_back(
+                "gpuStageMs/" + result.stages[i].name,
+                collect([i](const PresetResult& run)
+                        { return i < run.stages.size() ? run.stages[i].ms : 0.0; }));
+        }
+        return result;
+    }
+
+    PresetResult RunPreset(Application& app, const BenchOptions& options, bool sph, int index)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        app.SelectPreset(sph, index);
+
+        // Counters are only sampled during the warm-up so the counting kernels do not skew the
+        // measured frames
+        app.SetCountersEnabled(true);
+        for (int i = 0; i < options.warmupFrames; ++i)
+        {
+            app.RunFrame();
+        }
+        app.WaitForGPU();
+
+        AlgorithmCounters counters = app.GetAlgorithmCounters();
+        app.SetCountersEnabled(false);
+
+        GPUProfiler& profiler = app.GetProfiler();
+        profiler.ResetStatistics();
+
+        FrameTelemetry& telemetry = app.GetTelemetry();
+        telemetry.ResetStatistics();
+
+        std::vector<double> frameMs;
+        frameMs.reserve(options.frames);
+        int substeps = 0;
+
+        auto start    = Clock::now();
+        auto previous = start;
+        for (int i = 0; i < options.frames; ++i)
+        {
+            app.RunFrame();
+            auto now = Clock::now();
+            frameMs.push_back(std::chrono::duration<double, std::milli>(now - previous).count());
+            previous = now;
+            substeps += app.GetSubsteps();
+        }
+        app.WaitForGPU();
+        auto end = Clock::now();
+
+        uint64_t checksum = options.app.deterministic ? app.ComputeParticleChecksum() : 0;
+
+        PresetResult result {};
+        result.simulation   = sph ? "sph" : "mpm";
+        result.numParticles = app.GetSimulationVariables().numParticles;
+        result.substeps     = static_cast<double>(substeps) / options.frames;
+        result.wallSeconds  = std::chrono::duration<double>(end - start).count();
+        result.counters     = counters;
+        result.checksum     = checksum;
+
+        double sum = 0.0;
+        for (double ms : frameMs)
+        {
+            sum += ms;
+        }
+        result.meanMs = sum / frameMs.size();
+        result.p50Ms  = Percentile(frameMs, 0.50);
+        result.p90Ms  = Percentile(frameMs, 0.90);
+        result.p99Ms  = Percentile(frameMs, 0.99);
+        result.maxMs  = *std::max_element(frameMs.begin(), frameMs.end());
+
+        double particleSubsteps = static_cast<double>(result.numParticles) * result.substeps;
+        result.particleSubstepsPerSecond = particleSubsteps * options.frames / result.wallSeconds;
+
+        for (const GPUProfiler::StageTiming& stage : profiler.GetStageTimings())
+        {
+            double ms = stage.sampleCount > 0 ? stage.totalMs / stage.sampleCount : 0.0;
+            result.stages.push_back({stage.name, ms});
+            result.gpuFrameMs += ms;
+        }
+
+        {
+            auto lock             = telemetry.Lock();
+            result.encodeMs       = Summarize(telemetry.GetEncodeMs());
+            result.latencyMs      = Summarize(telemetry.GetLatencyMs());
+            result.framesInFlight = Summarize(telemetry.GetFramesInFlightMetric(), 1.0);
+        }
+
+        std::cout << result.simulation << " " << result.numParticles << " particles: p50 "
+                  << result.p50Ms << " ms, " << result.particleSubstepsPerSecond
+                  << " particle-substeps/s, submit to GPU done p50 " << result.latencyMs.p50
+                  << " ms" << std::endl;
+
+        return result;
+    }
+
+    void WriteJSON(std::ostream& out,
+                   const Application& app,
+                   const BenchOptions& options,
+                   bool timestampQuery,
+                   const std::vector<PresetResult>& results)
+    {
+        // Largest preset of each simulation whose median frame fits the budget
+        int sphWithinBudget = 0, mpmWithinBudget = 0;
+        for (const PresetResult& result : results)
+        {
+            if (result.p50Ms <= options.budgetMs)
+            {
+                int& within = std::string(result.simulation) == "sph" ? sphWithinBudget
+                                                                      : mpmWithinBudget;
+                within = std::max(within, result.numParticles);
+            }
+        }
+
+        out << "{\n";
+        out << "  \"adapter\": \"" << Escape(app.GetAdapterName()) << "\",\n";
+        out << "  \"timestampQuery\": " << (timestampQuery ? "true" : "false") << ",\n";
+
+        const StartupProfiler& startup = app.GetStartupProfiler();
+        out << "  \"startupMs\": " << startup.GetTotalMs() << ",\n";
+        out << "  \"startupPhasesMs\": {";
+        for (size_t i = 0; i < startup.GetPhases().size(); ++i)
+        {
+            const StartupProfiler::Phase& phase = startup.GetPhases()[i];
+            out << (i == 0 ? "" : ", ") << "\"" << Escape(phase.name) << "\": " << phase.ms;
+        }
+        out << "},\n";
+        if (PipelineCache* cache = app.GetPipelineCache())
+        {
+            PipelineCache::Statistics statistics = cache->GetStatistics();
+            out << "  \"pipelineCache\": {\"hits\": " << statistics.hits
+                << ", \"misses\": " << statistics.misses << ", \"stores\": " << statistics.stores
+                << "},\n";
+        }
+        out << "  \"width\": " << options.app.width << ",\n";
+        out << "  \"height\": " << options.app.height << ",\n";
+        out << "  \"warmupFrames\": " << options.warmupFrames << ",\n";
+        out << "  \"frames\": " << options.frames << ",\n";
+        out << "  \"budgetMs\": " << options.budgetMs << ",\n";
+        out << "  \"repeat\": " << options.repeat << ",\n";
+        out << "  \"cameraPath\": \"" << Escape(options.app.replayCamera) << "\",\n";
+        out << "  \"maxParticlesWithinBudget\": {\"sph\": " << sphWithinBudget
+            << ", \"mpm\": " << mpmWithinBudget << "},\n";
+        out << "  \"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const PresetResult& result = results[i];
+            out << "    {\n";
+            out << "      \"simulation\": \"" << result.simulation << "\",\n";
+            out << "      \"numParticles\": " << result.numParticles << ",\n";
+            out << "      \"substeps\": " << result.substeps << ",\n";
+            out << "      \"wallTimeSeconds\": " << result.wallSeconds << ",\n";
+            out << "      \"frameTimeMs\": {\"mean\": " << result.meanMs
+                << ", \"p50\": " << result.p50Ms << ", \"p90\": " << result.p90Ms
+                << ", \"p99\": " << result.p99Ms << ", \"max\": " << result.maxMs << "},\n";
+            out << "      \"particleSubstepsPerSecond\": " << result.particleSubstepsPerSecond
+                << ",\n";
+            out << "      \"withinBudget\": "
+                << (result.p50Ms <= options.budgetMs ? "true" : "false") << ",\n";
+            out << "      \"gpuFrameMs\": " << result.gpuFrameMs << ",\n";
+            out << "      \"gpuStageMs\": {";
+            for (size_t j = 0; j < result.stages.size(); ++j)
+            {
+                out << (j == 0 ? "" : ", ") << "\"" << Escape(result.stages[j].name)
+                    << "\": " << result.stages[j].ms;
+            }
+            out << "},\n";
+            WriteMetric(out, "cpuEncodeMs", result.encodeMs, false);
+            WriteMetric(out, "submitToGPUDoneMs", result.latencyMs, false);
+            WriteMetric(out, "framesInFlight", result.framesInFlight, false);
+            WriteStatistics(out, result.statistics);
+            if (options.app.deterministic)
+            {
+                char checksum[17];
+                std::snprintf(checksum,
+                              sizeof(checksum),
+                              "%016llx",
+                              static_cast<unsigned long long>(result.checksum));
+                out << "      \"checksum\": \"" << checksum << "\",\n";
+            }
+            WriteCounters(out, result.counters);
+            out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!Parse(argc, argv, options))
+    {
+        return 1;
+    }
+
+    options.app.headless = true;
+    options.app.profile  = true;
+
+    // Fail before the run on an unreadable baseline
+    std::vector<Baseline::Preset> baseline;
+    if (!options.baseline.empty() && !Baseline::Load(options.baseline, baseline))
+    {
+        return 1;
+    }
+
+    Application app(options.app);
+    if (!app.Initialize())
+    {
+        return 1;
+    }
+
+    bool timestampQuery = app.GetProfiler().IsSupported();
+    if (!timestampQuery)
+    {
+        std::cout << "Timestamp queries unavailable, reporting wall time only" << std::endl;
+    }
+
+    // Both simulations have the same number of presets
+    const int numPresets = std::size(app.GetSimulationVariables().sphNumParticles);
+
+    std::vector<PresetResult> results;
+    for (bool sph : {true, false})
+    {
+        for (int index = 0; index < numPresets; ++index)
+        {
+            std::vector<PresetResult> runs;
+            for (int run = 0; run < options.repeat; ++run)
+            {
+                runs.push_back(RunPreset(app, options, sph, index));
+            }
+            results.push_back(CombineRuns(runs));
+        }
+    }
+
+    std::ofstream out(options.output);
+    if (!out)
+    {
+        std::cerr << "Failed to open " << options.output << std::endl;
+        return 1;
+    }
+    WriteJSON(out, app, options, timestampQuery, results);
+
+    std::cout << "Wrote " << options.output << std::endl;
+
+    if (!options.baseline.empty())
+    {
+        std::vector<Baseline::Preset> current;
+        for (const PresetResult& result : results)
+        {
+            current.push_back(result.statistics);
+        }
+        if (Baseline::Compare(baseline, current, options.tolerance, stdout) > 0)
+        {
+            return 2;
+        }
+    }
+
+    return 0;
+}
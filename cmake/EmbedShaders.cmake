@@ -0,0 +1,47 @@
+# Writes OUTPUT, a C++ source defining EmbeddedShaders::GetShaders() with every .wgsl file under
+# SHADER_DIR as a constexpr char array. The paths are recorded relative to the project root by
+# prefixing them with SHADER_PREFIX.
+#
+#   cmake -DSHADER_DIR=<dir> -DSHADER_PREFIX=resources/shader -DOUTPUT=<file> -P EmbedShaders.cmake
+
+file(GLOB_RECURSE SHADERS RELATIVE ${SHADER_DIR} ${SHADER_DIR}/*.wgsl)
+list(SORT SHADERS)
+
+string(REPEAT "[0-9a-f]" 32 LINE_PATTERN)
+
+set(ARRAYS "")
+set(TABLE "")
+set(INDEX 0)
+foreach(SHADER ${SHADERS})
+    file(READ ${SHADER_DIR}/${SHADER} BYTES HEX)
+    string(LENGTH "${BYTES}" SIZE)
+    math(EXPR SIZE "${SIZE} / 2")
+
+    # 16 bytes per line
+    string(REGEX REPLACE "(${LINE_PATTERN})" "\\1\n" BYTES "${BYTES}")
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "'\\\\x\\1', " BYTES "${BYTES}")
+    string(REGEX REPLACE " \n" "\n        " BYTES "${BYTES}")
+
+    string(APPEND ARRAYS "    // ${SHADER_PREFIX}/${SHADER}\n")
+    string(APPEND ARRAYS "    constexpr char SOURCE_${INDEX}[] = {\n        ${BYTES}'\\0'};\n\n")
+    string(APPEND TABLE "        {\"${SHADER_PREFIX}/${SHADER}\", {SOURCE_${INDEX}, ${SIZE}}},\n")
+
+    math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+file(WRITE ${OUTPUT}
+"// Generated by cmake/EmbedShaders.cmake from ${SHADER_PREFIX}, do not edit
+
+#include \"EmbeddedShaders.h\"
+
+namespace
+{
+${ARRAYS}    constexpr EmbeddedShaders::Shader SHADERS[] = {
+${TABLE}    };
+}  // namespace
+
+std::span<const EmbeddedShaders::Shader> EmbeddedShaders::GetShaders()
+{
+    return SHADERS;
+}
+")
@@ -0,0 +1,20 @@
+// Algorithm counters shared by both simulations, see GPUCounters. Only the COUNTERS permutation
+// writes them. countOccupancy requires the index `MAX_CELL_OCCUPANCY`
+const HISTOGRAM_BINS = 16u;
+
+@group(1) @binding(0) var<storage, read_write> counters: array<atomic<u32>>;
+
+// Move a cell from the bin of `previous` particles to the bin of `previous + 1` of the histogram
+// starting at counter `histogram`, so it holds the final occupancy of every non-empty cell once
+// all particles are inserted
+fn countOccupancy(previous: u32, histogram: u32) {
+    let count = previous + 1u;
+    atomicMax(&counters[MAX_CELL_OCCUPANCY], count);
+    let bin = min(count, HISTOGRAM_BINS) - 1u;
+    if (previous == 0u) {
+        atomicAdd(&counters[histogram + bin], 1u);
+    } else if (min(previous, HISTOGRAM_BINS) - 1u != bin) {
+        atomicSub(&counters[histogram + bin - 1u], 1u);
+        atomicAdd(&counters[histogram + bin], 1u);
+    }
+}
@@ -0,0 +1,10 @@
+// Fixed point encoding of the atomically accumulated grid values, requires
+// `constants: Constants`
+
+fn encodeFixedPoint(floating_point: f32) -> i32 {
+    return i32(floating_point * constants.fixed_point_multiplier);
+}
+
+fn decodeFixedPoint(fixed_point: i32) -> f32 {
+    return f32(fixed_point) / constants.fixed_point_multiplier;
+}
@@ -0,0 +1,34 @@
+// MLS-MPM particle, cell and constant layouts, see MlsMpmParticle, Cell and Constants in
+// src/mpm/MlsMpmSimulator.h
+
+struct Particle {
+    position: vec3f,
+    v: vec3f,
+    C: mat3x3f,
+}
+
+struct Constants {
+    stiffness: f32,
+    rest_density: f32,
+    dynamic_viscosity: f32,
+    dt: f32,
+    fixed_point_multiplier: f32,
+}
+
+// The kernels scattering into the grid and clearing it define ATOMIC_CELL, the ones reading the
+// accumulated values use plain loads
+#ifdef ATOMIC_CELL
+struct Cell {
+    vx: atomic<i32>,
+    vy: atomic<i32>,
+    vz: atomic<i32>,
+    mass: atomic<i32>,
+}
+#else
+struct Cell {
+    vx: i32,
+    vy: i32,
+    vz: i32,
+    mass: i32,
+}
+#endif
@@ -0,0 +1,6 @@
+// Algorithm counters, see MlsMpmSimulator::Counter. Only the COUNTERS permutation writes them.
+#include "include/counters.wgsl"
+
+const MAX_CELL_OCCUPANCY = 0u;
+const MAX_SCATTER_FAN_IN = 1u;
+const OCCUPANCY_HISTOGRAM = 2u;
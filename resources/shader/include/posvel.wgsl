@@ -0,0 +1,6 @@
+// Position and velocity read by the renderers, PosVel in src/Application.h
+
+struct PosVel {
+    position: vec3f,
+    v: vec3f,
+}
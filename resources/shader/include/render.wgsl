@@ -0,0 +1,11 @@
+// Camera and screen uniforms of the fluid renderer, RenderUniforms in src/Application.h
+
+struct RenderUniforms {
+    inv_projection_matrix: mat4x4f,
+    projection_matrix: mat4x4f,
+    view_matrix: mat4x4f,
+    inv_view_matrix: mat4x4f,
+    screen_size: vec2f,
+    texel_size: vec2f,
+    sphere_size: f32,
+}
@@ -0,0 +1,9 @@
+// Algorithm counters, see SPHSimulator::Counter. Only the COUNTERS permutation writes them.
+#include "include/counters.wgsl"
+
+const DENSITY_CANDIDATES = 0u;
+const DENSITY_NEIGHBORS = 1u;
+const FORCE_CANDIDATES = 2u;
+const FORCE_NEIGHBORS = 3u;
+const MAX_CELL_OCCUPANCY = 4u;
+const OCCUPANCY_HISTOGRAM = 5u;
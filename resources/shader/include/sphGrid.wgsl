@@ -0,0 +1,12 @@
+// Grid cell lookup, requires `env: Environment`
+
+fn cellPosition(v: vec3f) -> vec3i {
+    let xi = i32(floor((v.x + env.xHalf + env.offset) / env.cellSize));
+    let yi = i32(floor((v.y + env.yHalf + env.offset) / env.cellSize));
+    let zi = i32(floor((v.z + env.zHalf + env.offset) / env.cellSize));
+    return vec3i(xi, yi, zi);
+}
+
+fn cellNumberFromId(xi: i32, yi: i32, zi: i32) -> i32 {
+    return xi + yi * env.xGrids + zi * env.xGrids * env.yGrids;
+}
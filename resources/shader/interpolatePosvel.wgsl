@@ -0,0 +1,23 @@
+// Blends the previous and the current simulation state for rendering between two steps
+
+#include "include/posvel.wgsl"
+
+struct Params {
+    n: u32,
+    weight: f32,
+}
+
+@group(0) @binding(0) var<storage, read> previous: array<PosVel>;
+@group(0) @binding(1) var<storage, read> current: array<PosVel>;
+@group(0) @binding(2) var<storage, read_write> interpolated: array<PosVel>;
+@group(0) @binding(3) var<uniform> params: Params;
+
+@compute @workgroup_size(64)
+fn interpolatePosvel(@builtin(global_invocation_id) id: vec3<u32>) {
+    if (id.x < params.n) {
+        let a = previous[id.x];
+        let b = current[id.x];
+        interpolated[id.x].position = mix(a.position, b.position, params.weight);
+        interpolated[id.x].v = mix(a.v, b.v, params.weight);
+    }
+}
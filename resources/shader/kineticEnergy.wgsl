@@ -0,0 +1,40 @@
+// Kinetic energy of the rendered particles for the convergence monitor, one partial sum per
+// workgroup. Unit mass, the monitor only compares the energy with its own peak.
+
+#include "include/posvel.wgsl"
+
+struct Params {
+    n: u32,
+}
+
+const WORKGROUP_SIZE = 256u;
+
+@group(0) @binding(0) var<storage, read> posvel: array<PosVel>;
+@group(0) @binding(1) var<storage, read_write> partialSums: array<f32>;
+@group(0) @binding(2) var<uniform> params: Params;
+
+var<workgroup> sums: array<f32, WORKGROUP_SIZE>;
+
+@compute @workgroup_size(WORKGROUP_SIZE)
+fn kineticEnergy(@builtin(global_invocation_id) id: vec3<u32>,
+                 @builtin(local_invocation_index) localIndex: u32,
+                 @builtin(workgroup_id) workgroupId: vec3<u32>) {
+    var energy = 0.0;
+    if (id.x < params.n) {
+        let v = posvel[id.x].v;
+        energy = 0.5 * dot(v, v);
+    }
+    sums[localIndex] = energy;
+    workgroupBarrier();
+
+    for (var stride = WORKGROUP_SIZE / 2u; stride > 0u; stride /= 2u) {
+        if (localIndex < stride) {
+            sums[localIndex] += sums[localIndex + stride];
+        }
+        workgroupBarrier();
+    }
+
+    if (localIndex == 0u) {
+        partialSums[workgroupId.x] = sums[0];
+    }
+}
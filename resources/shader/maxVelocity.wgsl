@@ -0,0 +1,35 @@
+// Maximum particle speed for the adaptive time step, shared by both simulators. The particle
+// buffer is read as vec4s, `stride` vec4s per particle with the velocity in the second one.
+
+struct Params {
+    n: u32,
+    stride: u32,
+}
+
+@group(0) @binding(0) var<storage, read> particles: array<vec4f>;
+@group(0) @binding(1) var<storage, read_write> result: atomic<u32>;
+@group(0) @binding(2) var<uniform> params: Params;
+
+var<workgroup> workgroupMax: atomic<u32>;
+
+@compute @workgroup_size(64)
+fn maxVelocity(@builtin(global_invocation_id) id: vec3<u32>,
+               @builtin(local_invocation_index) localIndex: u32) {
+    if (localIndex == 0u) {
+        atomicStore(&workgroupMax, 0u);
+    }
+    workgroupBarrier();
+
+    if (id.x < params.n) {
+        let speed = length(particles[id.x * params.stride + 1u].xyz);
+        // Non-negative floats order like their bits, NaN is skipped
+        if (speed == speed) {
+            atomicMax(&workgroupMax, bitcast<u32>(speed));
+        }
+    }
+    workgroupBarrier();
+
+    if (localIndex == 0u) {
+        atomicMax(&result, atomicLoad(&workgroupMax));
+    }
+}
@@ -1,18 +1,20 @@
-struct Cell {
-    vx: i32,
-    vy: i32,
-    vz: i32,
-    mass: i32,
-}
+#define ATOMIC_CELL
+#include "include/mpm.wgsl"
 
 @group(0) @binding(0) var<storage, read_write> cells: array<Cell>;
 
+// Only the COUNTERS permutation clears the particle count per cell
+@group(1) @binding(1) var<storage, read_write> cellCounts: array<u32>;
+
 @compute @workgroup_size(64)
 fn clearGrid(@builtin(global_invocation_id) id: vec3<u32>) {
     if (id.x < arrayLength(&cells)) {
-        cells[id.x].mass = 0;
-        cells[id.x].vx = 0;
-        cells[id.x].vy = 0;
-        cells[id.x].vz = 0;
+        atomicStore(&cells[id.x].mass, 0);
+        atomicStore(&cells[id.x].vx, 0);
+        atomicStore(&cells[id.x].vy, 0);
+        atomicStore(&cells[id.x].vz, 0);
+#ifdef COUNTERS
+        cellCounts[id.x] = 0u;
+#endif
     }
 }
@@ -1,13 +1,5 @@
-struct Particle {
-    position: vec3f,
-    v: vec3f,
-    C: mat3x3f,
-}
-
-struct PosVel {
-    position: vec3f, 
-    v: vec3f, 
-}
+#include "include/mpm.wgsl"
+#include "include/posvel.wgsl"
 
 @group(0) @binding(0) var<storage, read> particles: array<Particle>;
 @group(0) @binding(1) var<storage, read_write> posvel: array<PosVel>;
@@ -1,23 +1,5 @@
-struct Particle {
-    position: vec3f,
-    v: vec3f,
-    C: mat3x3f,
-}
-
-struct Cell {
-    vx: i32,
-    vy: i32,
-    vz: i32,
-    mass: i32,
-}
-
-struct Constants {
-    stiffness: f32,
-    rest_density: f32,
-    dynamic_viscosity: f32,
-    dt: f32,
-    fixed_point_multiplier: f32,
-}
+#include "include/mpm.wgsl"
+#include "include/fixedPoint.wgsl"
 
 @group(0) @binding(0) var<storage, read_write> particles: array<Particle>;
 @group(0) @binding(1) var<storage, read> cells: array<Cell>;
@@ -25,10 +7,6 @@ struct Constants {
 @group(0) @binding(3) var<uniform> init_box_size: vec3f;
 @group(0) @binding(4) var<uniform> constants: Constants;
 
-fn decodeFixedPoint(fixed_point: i32) -> f32 {
-    return f32(fixed_point) / constants.fixed_point_multiplier;
-}
-
 @compute @workgroup_size(64)
 fn g2p(@builtin(global_invocation_id) id: vec3<u32>) {
     if (id.x < arrayLength(&particles)) {
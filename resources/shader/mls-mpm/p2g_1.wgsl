@@ -1,32 +1,15 @@
-struct Particle {
-    position: vec3f,
-    v: vec3f,
-    C: mat3x3f,
-}
-
-struct Cell {
-    vx: atomic<i32>,
-    vy: atomic<i32>,
-    vz: atomic<i32>,
-    mass: atomic<i32>,
-}
-
-struct Constants {
-    stiffness: f32,
-    rest_density: f32,
-    dynamic_viscosity: f32,
-    dt: f32,
-    fixed_point_multiplier: f32,
-}
+#define ATOMIC_CELL
+#include "include/mpm.wgsl"
+#include "include/fixedPoint.wgsl"
 
 @group(0) @binding(0) var<storage, read> particles: array<Particle>;
 @group(0) @binding(1) var<storage, read_write> cells: array<Cell>;
 @group(0) @binding(2) var<uniform> init_box_size: vec3f;
 @group(0) @binding(3) var<uniform> constants: Constants;
 
-fn encodeFixedPoint(floating_point: f32) -> i32 {
-    return i32(floating_point * constants.fixed_point_multiplier);
-}
+#include "include/mpmCounters.wgsl"
+
+@group(1) @binding(1) var<storage, read_write> cellCounts: array<atomic<u32>>;
 
 @compute @workgroup_size(64)
 fn p2g_1(@builtin(global_invocation_id) id: vec3<u32>) {
@@ -42,6 +25,14 @@ fn p2g_1(@builtin(global_invocation_id) id: vec3<u32>) {
 
         let C: mat3x3f = particle.C;
 
+#ifdef COUNTERS
+        let center: i32 = 
+            i32(cell_idx.x) * i32(init_box_size.y) * i32(init_box_size.z) + 
+            i32(cell_idx.y) * i32(init_box_size.z) + 
+            i32(cell_idx.z);
+        countOccupancy(atomicAdd(&cellCounts[center], 1u), OCCUPANCY_HISTOGRAM);
+#endif
+
         for (var gx = 0; gx < 3; gx++) {
             for (var gy = 0; gy < 3; gy++) {
                 for (var gz = 0; gz < 3; gz++) {
@@ -1,36 +1,15 @@
-struct Particle {
-    position: vec3f,
-    v: vec3f,
-    C: mat3x3f,
-}
-
-struct Cell {
-    vx: atomic<i32>,
-    vy: atomic<i32>,
-    vz: atomic<i32>,
-    mass: i32,
-}
-
-struct Constants {
-    stiffness: f32,
-    rest_density: f32,
-    dynamic_viscosity: f32,
-    dt: f32,
-    fixed_point_multiplier: f32,
-}
+#define ATOMIC_CELL
+#include "include/mpm.wgsl"
+#include "include/fixedPoint.wgsl"
 
 @group(0) @binding(0) var<storage, read> particles: array<Particle>;
 @group(0) @binding(1) var<storage, read_write> cells: array<Cell>;
 @group(0) @binding(2) var<uniform> init_box_size: vec3f;
 @group(0) @binding(3) var<uniform> constants: Constants;
 
-fn encodeFixedPoint(floating_point: f32) -> i32 {
-    return i32(floating_point * constants.fixed_point_multiplier);
-}
+#include "include/mpmCounters.wgsl"
 
-fn decodeFixedPoint(fixed_point: i32) -> f32 {
-    return f32(fixed_point) / constants.fixed_point_multiplier;
-}
+@group(1) @binding(1) var<storage, read_write> cellCounts: array<u32>;
 
 @compute @workgroup_size(64)
 fn p2g_2(@builtin(global_invocation_id) id: vec3<u32>) {
@@ -45,6 +24,9 @@ fn p2g_2(@builtin(global_invocation_id) id: vec3<u32>) {
         weights[2] = 0.5f * (0.5f + cell_diff) * (0.5f + cell_diff);
 
         var density: f32 = 0.;
+#ifdef COUNTERS
+        var fanIn = 0u;
+#endif
         for (var gx = 0; gx < 3; gx++) {
             for (var gy = 0; gy < 3; gy++) {
                 for (var gz = 0; gz < 3; gz++) {
@@ -58,11 +40,19 @@ fn p2g_2(@builtin(global_invocation_id) id: vec3<u32>) {
                         i32(cell_x.x) * i32(init_box_size.y) * i32(init_box_size.z) + 
                         i32(cell_x.y) * i32(init_box_size.z) + 
                         i32(cell_x.z);
-                    density += decodeFixedPoint(cells[cell_index].mass) * weight;
+                    density += decodeFixedPoint(atomicLoad(&cells[cell_index].mass)) * weight;
+#ifdef COUNTERS
+                    fanIn += cellCounts[cell_index];
+#endif
                 }
             }
         }
 
+        // Particles scattering into the cells this particle scatters into
+#ifdef COUNTERS
+        atomicMax(&counters[MAX_SCATTER_FAN_IN], fanIn);
+#endif
+
         let volume: f32 = 1.0 / density; // particle.mass = 1.0;
 
         let pressure: f32 = max(-0.0, constants.stiffness * (pow(density / constants.rest_density, 5.) - 1));
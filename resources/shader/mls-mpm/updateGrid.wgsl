@@ -1,31 +1,11 @@
-struct Cell {
-    vx: i32,
-    vy: i32,
-    vz: i32,
-    mass: i32,
-}
-
-struct Constants {
-    stiffness: f32,
-    rest_density: f32,
-    dynamic_viscosity: f32,
-    dt: f32,
-    fixed_point_multiplier: f32,
-}
+#include "include/mpm.wgsl"
+#include "include/fixedPoint.wgsl"
 
 @group(0) @binding(0) var<storage, read_write> cells: array<Cell>;
 @group(0) @binding(1) var<uniform> real_box_size: vec3f;
 @group(0) @binding(2) var<uniform> init_box_size: vec3f;
 @group(0) @binding(3) var<uniform> constants: Constants;
 
-fn encodeFixedPoint(floating_point: f32) -> i32 {
-    return i32(floating_point * constants.fixed_point_multiplier);
-}
-
-fn decodeFixedPoint(fixed_point: i32) -> f32 {
-    return f32(fixed_point) / constants.fixed_point_multiplier;
-}
-
 @compute @workgroup_size(64)
 fn updateGrid(@builtin(global_invocation_id) id: vec3<u32>) {
     if (id.x < arrayLength(&cells)) {
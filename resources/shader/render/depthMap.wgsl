@@ -1,3 +1,6 @@
+#include "include/render.wgsl"
+#include "include/posvel.wgsl"
+
 struct VertexOutput {
     @builtin(position) position: vec4f, 
     @location(0) uv: vec2f, 
@@ -14,21 +17,6 @@ struct FragmentOutput {
     @builtin(frag_depth) frag_depth: f32, 
 }
 
-struct RenderUniforms {
-    inv_projection_matrix: mat4x4f,
-    projection_matrix: mat4x4f,
-    view_matrix: mat4x4f,
-    inv_view_matrix: mat4x4f,
-    screen_size: vec2f,
-    texel_size: vec2f,
-    sphere_size: f32,
-}
-
-struct PosVel {
-    position: vec3f,
-    v: vec3f,
-}
-
 @group(0) @binding(0) var<uniform> uniforms: RenderUniforms;
 @group(0) @binding(1) var<storage, read> particles: array<PosVel>;
 
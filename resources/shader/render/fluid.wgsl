@@ -1,19 +1,11 @@
+#include "include/render.wgsl"
+
 @group(0) @binding(0) var<uniform> uniforms: RenderUniforms;
 @group(0) @binding(1) var texture: texture_2d<f32>;
 @group(0) @binding(2) var texture_sampler: sampler;
 @group(0) @binding(3) var thickness_texture: texture_2d<f32>;
 @group(0) @binding(4) var envmap_texture: texture_cube<f32>;
 
-struct RenderUniforms {
-    inv_projection_matrix: mat4x4f, 
-    projection_matrix: mat4x4f, 
-    view_matrix: mat4x4f, 
-    inv_view_matrix: mat4x4f, 
-    screen_size: vec2f,
-    texel_size: vec2f, 
-    sphere_size: f32, 
-}
-
 struct FragmentInput {
     @location(0) uv: vec2f,
     @location(1) iuv: vec2f,
@@ -1,3 +1,5 @@
+#include "include/render.wgsl"
+
 @group(0) @binding(0) var<uniform> uniforms: RenderUniforms;
 
 struct VertexOutput {
@@ -6,16 +8,6 @@ struct VertexOutput {
   @location(1) iuv : vec2f,
 }
 
-struct RenderUniforms {
-    inv_projection_matrix: mat4x4f, 
-    projection_matrix: mat4x4f, 
-    view_matrix: mat4x4f, 
-    inv_view_matrix: mat4x4f,
-    screen_size: vec2f,
-    texel_size: vec2f, 
-    sphere_size: f32, 
-}
-
 @vertex
 fn vs(@builtin(vertex_index) vertex_index : u32) -> VertexOutput {
     var out: VertexOutput;
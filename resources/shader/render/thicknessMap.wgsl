@@ -1,12 +1,5 @@
-struct RenderUniforms {
-    inv_projection_matrix: mat4x4f, 
-    projection_matrix: mat4x4f, 
-    view_matrix: mat4x4f, 
-    inv_view_matrix: mat4x4f, 
-    screen_size: vec2f,
-    texel_size: vec2f, 
-    sphere_size: f32, 
-}
+#include "include/render.wgsl"
+#include "include/posvel.wgsl"
 
 struct VertexOutput {
     @builtin(position) position: vec4f, 
@@ -17,11 +10,6 @@ struct FragmentInput {
     @location(0) uv: vec2f, 
 }
 
-struct PosVel {
-    position: vec3f, 
-    v: vec3f, 
-}
-
 @group(0) @binding(0) var<uniform> uniforms: RenderUniforms;
 @group(0) @binding(1) var<storage, read> particles: array<PosVel>;
 
@@ -1,30 +1,5 @@
-struct Particle {
-    position: vec3f, 
-    v: vec3f, 
-    force: vec3f, 
-    density: f32, 
-    nearDensity: f32, 
-}
-
-struct PosVel {
-    position: vec3f, 
-    v: vec3f, 
-}
-
-struct SPHParams {
-    mass: f32, 
-    kernelRadius: f32, 
-    kernelRadiusPow2: f32, 
-    kernelRadiusPow5: f32, 
-    kernelRadiusPow6: f32,  
-    kernelRadiusPow9: f32, 
-    dt: f32, 
-    stiffness: f32, 
-    nearStiffness: f32, 
-    restDensity: f32, 
-    viscosity: f32, 
-    n: u32
-}
+#include "include/sph.wgsl"
+#include "include/posvel.wgsl"
 
 @group(0) @binding(0) var<storage, read> particles: array<Particle>;
 @group(0) @binding(1) var<storage, read_write> posvel: array<PosVel>;
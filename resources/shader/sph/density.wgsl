@@ -1,36 +1,5 @@
-struct Particle {
-    position: vec3f, 
-    v: vec3f, 
-    force: vec3f, 
-    density: f32, 
-    nearDensity: f32, 
-}
-
-struct Environment {
-    xGrids: i32, 
-    yGrids: i32, 
-    zGrids: i32, 
-    cellSize: f32, 
-    xHalf: f32, 
-    yHalf: f32, 
-    zHalf: f32, 
-    offset: f32, 
-}
-
-struct SPHParams {
-    mass: f32, 
-    kernelRadius: f32, 
-    kernelRadiusPow2: f32, 
-    kernelRadiusPow5: f32, 
-    kernelRadiusPow6: f32,  
-    kernelRadiusPow9: f32, 
-    dt: f32, 
-    stiffness: f32, 
-    nearStiffness: f32, 
-    restDensity: f32, 
-    viscosity: f32, 
-    n: u32
-}
+#include "include/sph.wgsl"
+#include "include/sphGrid.wgsl"
 
 @group(0) @binding(0) var<storage, read_write> particles: array<Particle>;
 @group(0) @binding(1) var<storage, read> sortedParticles: array<Particle>;
@@ -38,6 +7,8 @@ struct SPHParams {
 @group(0) @binding(3) var<uniform> env: Environment;
 @group(0) @binding(4) var<uniform> params: SPHParams;
 
+#include "include/sphCounters.wgsl"
+
 fn nearDensityKernel(r: f32) -> f32 {
     let scale = 15.0 / (3.1415926535 * params.kernelRadiusPow6);
     let d = params.kernelRadius - r;
@@ -50,17 +21,6 @@ fn densityKernel(r: f32) -> f32 {
     return scale * dd * dd * dd;
 }
 
-fn cellPosition(v: vec3f) -> vec3i {
-    let xi = i32(floor((v.x + env.xHalf + env.offset) / env.cellSize));
-    let yi = i32(floor((v.y + env.yHalf + env.offset) / env.cellSize));
-    let zi = i32(floor((v.z + env.zHalf + env.offset) / env.cellSize));
-    return vec3i(xi, yi, zi);
-}
-
-fn cellNumberFromId(xi: i32, yi: i32, zi: i32) -> i32 {
-    return xi + yi * env.xGrids + zi * env.xGrids * env.yGrids;
-}
-
 @compute @workgroup_size(64)
 fn computeDensity(@builtin(global_invocation_id) id: vec3<u32>) {
     if (id.x < params.n) {
@@ -69,6 +29,11 @@ fn computeDensity(@builtin(global_invocation_id) id: vec3<u32>) {
         let pos_i = particles[id.x].position;
         let n = params.n;
 
+#ifdef COUNTERS
+        var candidates = 0u;
+        var neighbors = 0u;
+#endif
+
         let v = cellPosition(pos_i);
         if (v.x < env.xGrids && 0 <= v.x && 
             v.y < env.yGrids && 0 <= v.y && 
@@ -82,10 +47,16 @@ fn computeDensity(@builtin(global_invocation_id) id: vec3<u32>) {
                     let endCellNum = cellNumberFromId(v.x + dxMax, v.y + dy, v.z + dz);
                     let start = prefixSum[startCellNum];
                     let end = prefixSum[endCellNum + 1];
+#ifdef COUNTERS
+                    candidates += end - start;
+#endif
                     for (var j = start; j < end; j++) {
                         let pos_j = sortedParticles[j].position;
                         let r2 = dot(pos_i - pos_j, pos_i - pos_j);
                         if (r2 < params.kernelRadiusPow2) {
+#ifdef COUNTERS
+                            neighbors++;
+#endif
                             particles[id.x].density += params.mass * densityKernel(sqrt(r2));
                             particles[id.x].nearDensity += params.mass * nearDensityKernel(sqrt(r2));
                         }
@@ -93,5 +64,10 @@ fn computeDensity(@builtin(global_invocation_id) id: vec3<u32>) {
                 }
             }
         }
+
+#ifdef COUNTERS
+        atomicAdd(&counters[DENSITY_CANDIDATES], candidates);
+        atomicAdd(&counters[DENSITY_NEIGHBORS], neighbors);
+#endif
     }
-}
\ No newline at end of file
+}
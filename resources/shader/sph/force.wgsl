@@ -1,36 +1,5 @@
-struct Particle {
-    position: vec3f, 
-    v: vec3f, 
-    force: vec3f, 
-    density: f32, 
-    nearDensity: f32, 
-}
-
-struct Environment {
-    xGrids: i32,
-    yGrids: i32, 
-    zGrids: i32, 
-    cellSize: f32, 
-    xHalf: f32, 
-    yHalf: f32, 
-    zHalf: f32, 
-    offset: f32, 
-}
-
-struct SPHParams {
-    mass: f32, 
-    kernelRadius: f32, 
-    kernelRadiusPow2: f32, 
-    kernelRadiusPow5: f32, 
-    kernelRadiusPow6: f32,  
-    kernelRadiusPow9: f32, 
-    dt: f32, 
-    stiffness: f32, 
-    nearStiffness: f32, 
-    restDensity: f32, 
-    viscosity: f32, 
-    n: u32
-}
+#include "include/sph.wgsl"
+#include "include/sphGrid.wgsl"
 
 @group(0) @binding(0) var<storage, read_write> particles: array<Particle>;
 @group(0) @binding(1) var<storage, read> sortedParticles: array<Particle>;
@@ -38,6 +7,8 @@ struct SPHParams {
 @group(0) @binding(3) var<uniform> env: Environment;
 @group(0) @binding(4) var<uniform> params: SPHParams;
 
+#include "include/sphCounters.wgsl"
+
 fn densityKernelGradient(r: f32) -> f32 {
     let scale: f32 = 45.0 / (3.1415926535 * params.kernelRadiusPow6); // pow 使うと遅いかも
     let d = params.kernelRadius - r;
@@ -58,17 +29,6 @@ fn viscosityKernelLaplacian(r: f32) -> f32 {
     return scale * d;
 }
 
-fn cellPosition(v: vec3f) -> vec3i {
-    let xi = i32(floor((v.x + env.xHalf + env.offset) / env.cellSize));
-    let yi = i32(floor((v.y + env.yHalf + env.offset) / env.cellSize));
-    let zi = i32(floor((v.z + env.zHalf + env.offset) / env.cellSize));
-    return vec3i(xi, yi, zi);
-}
-
-fn cellNumberFromId(xi: i32, yi: i32, zi: i32) -> i32 {
-    return xi + yi * env.xGrids + zi * env.xGrids * env.yGrids;
-}
-
 @compute @workgroup_size(64)
 fn computeForce(@builtin(global_invocation_id) id: vec3<u32>) {
     if (id.x < params.n) {
@@ -78,6 +38,10 @@ fn computeForce(@builtin(global_invocation_id) id: vec3<u32>) {
         let pos_i = particles[id.x].position;
         var fPress = vec3(0.0, 0.0, 0.0);
         var fVisc = vec3(0.0, 0.0, 0.0);
+#ifdef COUNTERS
+        var candidates = 0u;
+        var neighbors = 0u;
+#endif
 
         let v = cellPosition(pos_i);
         if (v.x < env.xGrids && 0 <= v.x && 
@@ -93,6 +57,9 @@ fn computeForce(@builtin(global_invocation_id) id: vec3<u32>) {
                         let endCellNum = cellNumberFromId(v.x + dxMax, v.y + dy, v.z + dz);
                         let start = prefixSum[startCellNum];
                         let end = prefixSum[endCellNum + 1];
+#ifdef COUNTERS
+                        candidates += end - start;
+#endif
                         for (var j = start; j < end; j++) {
                             let density_j = sortedParticles[j].density;
                             let nearDensity_j = sortedParticles[j].nearDensity;
@@ -102,6 +69,9 @@ fn computeForce(@builtin(global_invocation_id) id: vec3<u32>) {
                                 continue;
                             }
                             if (r2 < params.kernelRadiusPow2 && 1e-64 < r2) {
+#ifdef COUNTERS
+                                neighbors++;
+#endif
                                 let r = sqrt(r2);
                                 let pressure_i = params.stiffness * (density_i - params.restDensity);
                                 let pressure_j = params.stiffness * (density_j - params.restDensity);
@@ -124,5 +94,10 @@ fn computeForce(@builtin(global_invocation_id) id: vec3<u32>) {
         fVisc *= params.viscosity;
         let fGrv: vec3f = density_i * vec3f(0.0, -9.8, 0.0);
         particles[id.x].force = fPress + fVisc + fGrv;
+
+#ifdef COUNTERS
+        atomicAdd(&counters[FORCE_CANDIDATES], candidates);
+        atomicAdd(&counters[FORCE_NEIGHBORS], neighbors);
+#endif
     }
 }
@@ -1,25 +1,4 @@
-struct Particle {
-    position: vec3f, 
-    v: vec3f, 
-    force: vec3f, 
-    density: f32, 
-    nearDensity: f32, 
-}
-
-struct SPHParams {
-    mass: f32, 
-    kernelRadius: f32, 
-    kernelRadiusPow2: f32, 
-    kernelRadiusPow5: f32, 
-    kernelRadiusPow6: f32,  
-    kernelRadiusPow9: f32, 
-    dt: f32, 
-    stiffness: f32, 
-    nearStiffness: f32, 
-    restDensity: f32, 
-    viscosity: f32, 
-    n: u32
-}
+#include "include/sph.wgsl"
 
 @group(0) @binding(0) var<storage, read> sourceParticles: array<Particle>;
 @group(0) @binding(1) var<storage, read_write> targetParticles: array<Particle>;
@@ -28,16 +7,10 @@ struct SPHParams {
 @group(0) @binding(4) var<uniform> env : Environment;
 @group(0) @binding(5) var<uniform> params : SPHParams;
 
-struct Environment {
-    xGrids: i32, 
-    yGrids: i32, 
-    zGrids: i32, 
-    cellSize: f32, 
-    xHalf: f32, 
-    yHalf: f32, 
-    zHalf: f32, 
-    offset: f32,
-}
+// Deterministic mode, the source index of every sorted particle for the within-cell sort
+override DETERMINISTIC: bool = false;
+
+@group(1) @binding(0) var<storage, read_write> sortedIndices : array<u32>;
 
 fn cellId(position: vec3f) -> i32 {
     let xi: i32 = i32(floor((position.x + env.xHalf + env.offset) / env.cellSize));
@@ -57,6 +30,9 @@ fn main(@builtin(global_invocation_id) id : vec3<u32>) {
             let targetIndex = cellParticleCount[cellId + 1] - particleCellOffset[id.x] - 1;
             if (targetIndex < params.n) {
                 targetParticles[targetIndex] = sourceParticles[id.x];
+                if (DETERMINISTIC) {
+                    sortedIndices[targetIndex] = id.x;
+                }
             }
         }
     }
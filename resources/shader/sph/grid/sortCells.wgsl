@@ -0,0 +1,33 @@
+#include "include/sph.wgsl"
+
+@group(0) @binding(0) var<storage, read_write> sortedParticles: array<Particle>;
+@group(0) @binding(1) var<storage, read_write> sortedIndices: array<u32>;
+@group(0) @binding(2) var<storage, read> prefixSum: array<u32>;
+@group(0) @binding(3) var<uniform> env: Environment;
+
+// Deterministic mode only. The order inside a cell depends on the atomicAdd order in gridBuild,
+// sort every cell by source index so the density and force sums run in the same order each run.
+// Cells hold few particles, an insertion sort per cell is enough.
+@compute
+@workgroup_size(64)
+fn main(@builtin(global_invocation_id) id : vec3<u32>) {
+    let cellCount = u32(env.xGrids * env.yGrids * env.zGrids);
+    if (id.x >= cellCount) {
+        return;
+    }
+
+    let start = prefixSum[id.x];
+    let end = prefixSum[id.x + 1];
+    for (var i = start + 1u; i < end; i++) {
+        let index = sortedIndices[i];
+        let particle = sortedParticles[i];
+        var j = i;
+        while (j > start && sortedIndices[j - 1u] > index) {
+            sortedIndices[j] = sortedIndices[j - 1u];
+            sortedParticles[j] = sortedParticles[j - 1u];
+            j--;
+        }
+        sortedIndices[j] = index;
+        sortedParticles[j] = particle;
+    }
+}
@@ -0,0 +1,182 @@
+#include "AdaptiveTimestep.h"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "GPUMemory.h"
+#include "PipelineBatch.h"
+#include "ResourceManager.h"
+#include "WebGPUUtils.h"
+
+AdaptiveTimestep::AdaptiveTimestep(wgpu::Device device,
+                                   wgpu::Buffer particleBuffer,
+                                   uint32_t particleStride,
+                                   const Settings& settings,
+                                   const char* owner) :
+    mDevice(device),
+    mSettings(settings),
+    mStride(particleStride / 16)
+{
+    wgpu::BufferDescriptor bufferDesc {
+        .label = WebGPUUtils::GenerateString("max speed buffer"),
+        .usage =
+            wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst,
+        .size = sizeof(uint32_t),
+    };
+
+    mResultBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, owner, this);
+
+    bufferDesc.label = WebGPUUtils::GenerateString("max speed params buffer");
+    bufferDesc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+    bufferDesc.size  = sizeof(Params);
+
+    mParamsBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, owner, this);
+
+    mReadback.Create(mDevice, sizeof(uint32_t), "max speed readback buffer", owner, this);
+
+    wgpu::ShaderModule module =
+        ResourceManager::LoadShaderModule("resources/shader/maxVelocity.wgsl", mDevice);
+
+    std::vector<wgpu::BindGroupLayoutEntry> bindingLayoutEntries(3);
+    const wgpu::BufferBindingType types[] = {wgpu::BufferBindingType::ReadOnlyStorage,
+                                             wgpu::BufferBindingType::Storage,
+                                             wgpu::BufferBindingType::Uniform};
+    for (uint32_t i = 0; i < bindingLayoutEntries.size(); ++i)
+    {
+        wgpu::BindGroupLayoutEntry& bindingLayout = bindingLayoutEntries[i];
+        WebGPUUtils::SetDefaultBindGroupLayout(bindingLayout);
+        bindingLayout.binding     = i;
+        bindingLayout.visibility  = wgpu::ShaderStage::Compute;
+        bindingLayout.buffer.type = types[i];
+    }
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEntries.data();
+    wgpu::BindGroupLayout bindGroupLayout = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = &bindGroupLayout;
+    wgpu::PipelineLayout layout     = mDevice.CreatePipelineLayout(&layoutDesc);
+
+    wgpu::ComputePipelineDescriptor computePipelineDesc {
+        .label  = WebGPUUtils::GenerateString("max velocity pipeline"),
+        .layout = layout,
+        .compute =
+            {
+                .module     = module,
+                .entryPoint = "maxVelocity",
+            },
+    };
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mPipeline);
+
+    std::vector<wgpu::BindGroupEntry> bindings(3);
+    const wgpu::Buffer buffers[] = {particleBuffer, mResultBuffer, mParamsBuffer};
+    for (uint32_t i = 0; i < bindings.size(); ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].buffer  = buffers[i];
+        bindings[i].offset  = 0;
+        bindings[i].size    = buffers[i].GetSize();
+    }
+
+    wgpu::BindGroupDescriptor bindGroupDesc {
+        .label      = WebGPUUtils::GenerateString("max velocity bind group"),
+        .layout     = bindGroupLayout,
+        .entryCount = static_cast<uint32_t>(bindings.size()),
+        .entries    = bindings.data(),
+    };
+    mBindGroup = mDevice.CreateBindGroup(&bindGroupDesc);
+}
+
+AdaptiveTimestep::~AdaptiveTimestep()
+{
+    GPUMemory::Release(this);
+}
+
+void AdaptiveTimestep::SetEnabled(bool enabled)
+{
+    mEnabled = enabled;
+    if (!enabled)
+    {
+        mMaxSpeed = 0.0f;
+    }
+}
+
+void AdaptiveTimestep::Select(int& substeps, float& dt) const
+{
+    float stableDt = mSettings.courant * mSettings.cellSize / (mSettings.soundSpeed + mMaxSpeed);
+
+    int count = static_cast<int>(std::min(std::ceil(mSettings.frameTime / stableDt), 1024.0f));
+    substeps  = std::clamp(count, mSettings.minSubsteps, mSettings.maxSubsteps);
+    dt        = mSettings.frameTime / substeps;
+}
+
+void AdaptiveTimestep::BeginFrame(wgpu::CommandEncoder& commandEncoder)
+{
+    mCurrentSlot = nullptr;
+    if (!mEnabled)
+    {
+        return;
+    }
+
+    mCurrentSlot = mReadback.Acquire();
+    if (mCurrentSlot)
+    {
+        mCurrentSlot->info.frame = mFrameIndex;
+        commandEncoder.ClearBuffer(mResultBuffer, 0, sizeof(uint32_t));
+    }
+
+    ++mFrameIndex;
+}
+
+void AdaptiveTimestep::Dispatch(wgpu::ComputePassEncoder& computePass, uint32_t numParticles)
+{
+    if (!mCurrentSlot)
+    {
+        return;
+    }
+
+    if (numParticles != mNumParticles)
+    {
+        Params params {.n = numParticles, .stride = mStride};
+        mDevice.GetQueue().WriteBuffer(mParamsBuffer, 0, &params, sizeof(Params));
+        mNumParticles = numParticles;
+    }
+
+    computePass.SetBindGroup(0, mBindGroup, 0, nullptr);
+    computePass.SetPipeline(mPipeline);
+    computePass.DispatchWorkgroups(std::ceil(numParticles / 64.0f));
+}
+
+void AdaptiveTimestep::Resolve(wgpu::CommandEncoder& commandEncoder)
+{
+    if (!mCurrentSlot)
+    {
+        return;
+    }
+
+    commandEncoder.CopyBufferToBuffer(mResultBuffer, 0, mCurrentSlot->buffer, 0, sizeof(uint32_t));
+}
+
+void AdaptiveTimestep::EndFrame()
+{
+    if (!mCurrentSlot)
+    {
+        return;
+    }
+
+    mReadback.Map(*mCurrentSlot,
+                  sizeof(uint32_t),
+                  [this](const Readback::Slot& slot, const void* data)
+                  {
+                      if (mEnabled && slot.info.frame >= mSpeedFrame)
+                      {
+                          std::memcpy(&mMaxSpeed, data, sizeof(float));
+                          mSpeedFrame = slot.info.frame;
+                      }
+                  });
+    mCurrentSlot = nullptr;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <algorithm>
+#include <cstdint>
+
+#include "ReadbackRing.h"
+
+/**
+ * CFL-driven substepping. Each frame a reduction finds the maximum particle speed, which is read
+ * back asynchronously and used one or two frames later to choose the substep count. The simulated
+ * time per frame stays fixed, only its split into substeps changes:
+ *
+ *   dt = courant * cellSize / (soundSpeed + maxSpeed), substeps = ceil(frameTime / dt)
+ *
+ * clamped to [minSubsteps, maxSubsteps], then dt = frameTime / substeps.
+ *
+ * The particle speed alone knows nothing of the stiffness, which bounds stability as well: a
+ * pressure wave travels at the sound speed c, c^2 = dp/drho of the equation of state, and may not
+ * cross a cell in one substep either. With it a resting scene still gets a bounded dt, which can
+ * exceed the tuned default for soft materials and drop to a single substep.
+ */
+class AdaptiveTimestep
+{
+public:
+    struct Settings
+    {
+        float frameTime;  // simulated time per frame, the default substeps times the default dt
+        float cellSize;   // distance a particle may not cross in `courant` substeps
+        float courant;
+        float soundSpeed;  // in cell size units per time unit
+        int minSubsteps;
+        int maxSubsteps;
+    };
+
+    /**
+     * `particleStride` is the size of a particle in bytes, a multiple of 16 with the velocity
+     * at byte offset 16
+     */
+    AdaptiveTimestep(wgpu::Device device,
+                     wgpu::Buffer particleBuffer,
+                     uint32_t particleStride,
+                     const Settings& settings,
+                     const char* owner);
+    ~AdaptiveTimestep();
+
+    bool IsEnabled() const
+    {
+        return mEnabled;
+    }
+
+    void SetEnabled(bool enabled);
+
+    void SetMaxSubsteps(int substeps)
+    {
+        mSettings.maxSubsteps = std::max(substeps, mSettings.minSubsteps);
+    }
+
+    const Settings& GetSettings() const
+    {
+        return mSettings;
+    }
+
+    // Substeps and dt for the next frame from the latest readback
+    void Select(int& substeps, float& dt) const;
+
+    // Clear the result if a readback slot is free
+    void BeginFrame(wgpu::CommandEncoder& commandEncoder);
+
+    // Reduce the particle speeds, record after the last substep
+    void Dispatch(wgpu::ComputePassEncoder& computePass, uint32_t numParticles);
+
+    // Copy the result for readback, call after the compute pass
+    void Resolve(wgpu::CommandEncoder& commandEncoder);
+
+    // Start the readback, call after the frame has been submitted
+    void EndFrame();
+
+    // Latest maximum speed read back, 0 until the first readback
+    float GetMaxSpeed() const
+    {
+        return mMaxSpeed;
+    }
+
+private:
+    struct ReadbackInfo
+    {
+        uint64_t frame = 0;
+    };
+
+    // Covers the frames in flight, every frame is measured while a slot is free
+    using Readback = ReadbackRing<ReadbackInfo, 3>;
+
+    struct Params
+    {
+        uint32_t n;
+        uint32_t stride;
+    };
+
+private:
+    wgpu::Device mDevice;
+    Settings mSettings;
+    uint32_t mStride;
+
+    wgpu::Buffer mResultBuffer;
+    wgpu::Buffer mParamsBuffer;
+    wgpu::ComputePipeline mPipeline;
+    wgpu::BindGroup mBindGroup;
+    Readback mReadback;
+
+    bool mEnabled                = false;
+    Readback::Slot* mCurrentSlot = nullptr;
+    uint64_t mFrameIndex         = 0;
+    uint32_t mNumParticles       = UINT32_MAX;
+
+    float mMaxSpeed      = 0.0f;
+    uint64_t mSpeedFrame = 0;
+};
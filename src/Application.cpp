@@ -5,34 +5,94 @@
 #include <imgui_impl_wgpu.h>
 
 #include <sdl3webgpu.h>
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
 #include <iostream>
 #include <fstream>
 #include <random>
+#include <thread>
+#include <vector>
 
 #include "WebGPUUtils.h"
+#include "GPUMemory.h"
+#include "PipelineBatch.h"
 #include "ResourceManager.h"
+#include "GPUProfiler.h"
+#include "Trace.h"
 
-Application::Application() : mWindow(nullptr) {}
+Application::Application(const ApplicationOptions& options) :
+    mWindow(nullptr),
+    mOptions(options)
+{
+}
+
+namespace
+{
+    std::mt19937_64 gGenerator(std::random_device {}());
+    std::optional<uint64_t> gSeed;
+
+    // Counted in the device callbacks, which may fire on any thread
+    std::atomic<uint32_t> gDeviceLostCount {0};
+    std::atomic<uint32_t> gDeviceErrorCount {0};
+
+    // ImGui's index of an SDL mouse button, -1 for the buttons the GUI ignores
+    int GUIMouseButton(uint8_t button)
+    {
+        switch (button)
+        {
+            case SDL_BUTTON_LEFT:
+                return 0;
+            case SDL_BUTTON_RIGHT:
+                return 1;
+            case SDL_BUTTON_MIDDLE:
+                return 2;
+            default:
+                return -1;
+        }
+    }
+}  // namespace
 
 bool Application::Initialize()
 {
-    // initialize
-    if (!SDL_Init(SDL_INIT_VIDEO))
+    if (!mOptions.tracePath.empty())
     {
-        return false;
+        Trace::Start(mOptions.tracePath);
     }
 
-    // create window
-    glm::vec2 windowSize(1024.0f, 768.0f);
-    mWindow = SDL_CreateWindow("WebGPU Ocean", (int)windowSize.x, (int)windowSize.y, 0);
-    if (!mWindow)
+    TRACE_SCOPE("Application::Initialize");
+    mStartup.Start();
+
+    if (!mOptions.shaderDirectory.empty())
     {
-        SDL_Quit();
-        return false;
+        ResourceManager::SetShaderOverrideDirectory(mOptions.shaderDirectory);
+    }
+
+    glm::vec2 windowSize((float)mOptions.width, (float)mOptions.height);
+
+    if (!mOptions.headless)
+    {
+        mStartup.Begin("SDL");
+
+        // initialize
+        if (!SDL_Init(SDL_INIT_VIDEO))
+        {
+            return false;
+        }
+
+        // create window
+        mWindow = SDL_CreateWindow("WebGPU Ocean", (int)windowSize.x, (int)windowSize.y, 0);
+        if (!mWindow)
+        {
+            SDL_Quit();
+            return false;
+        }
+        SDL_SetWindowResizable(mWindow, false);
     }
-    SDL_SetWindowResizable(mWindow, false);
 
     // create instance
+    mStartup.Begin("Instance");
     static const auto kTimeoutWaitAny = wgpu::InstanceFeatureName::TimedWaitAny;
     wgpu::InstanceDescriptor instanceDescriptor {
         .nextInChain          = nullptr,
@@ -42,25 +102,41 @@ bool Application::Initialize()
     mInstance = wgpu::CreateInstance(&instanceDescriptor);
 
     // create surface
-    mSurface = SDL_GetWGPUSurface(mInstance, mWindow);
+    if (!mOptions.headless)
+    {
+        mSurface = SDL_GetWGPUSurface(mInstance, mWindow);
+    }
 
     // get adaptor
+    mStartup.Begin("Adapter");
     std::cout << "Requesting adapter..." << std::endl;
-    wgpu::RequestAdapterOptions adapterOptions {
-        .nextInChain       = nullptr,
-        .compatibleSurface = mSurface,
-    };
+    wgpu::RequestAdapterOptions adapterOptions {};
+    adapterOptions.nextInChain          = nullptr;
+    adapterOptions.forceFallbackAdapter = mOptions.fallbackAdapter;
+    adapterOptions.compatibleSurface    = mSurface;
     wgpu::Adapter adapter = WebGPUUtils::RequestAdapterSync(mInstance, &adapterOptions);
     std::cout << "Got adapter: " << adapter.Get() << std::endl;
 
     WebGPUUtils::InspectAdapter(adapter);
 
+    wgpu::AdapterInfo adapterInfo;
+    adapter.GetInfo(&adapterInfo);
+    mAdapterName = std::string(std::string_view(adapterInfo.device));
+
     // get device
+    mStartup.Begin("Device");
     std::cout << "Requesting device..." << std::endl;
     wgpu::DeviceDescriptor deviceDesc   = {};
     deviceDesc.nextInChain              = nullptr;
     deviceDesc.label                    = WebGPUUtils::GenerateString("My Device");
-    deviceDesc.requiredFeatureCount     = 0;
+    std::vector<wgpu::FeatureName> requiredFeatures;
+    bool timestampQuery = adapter.HasFeature(wgpu::FeatureName::TimestampQuery);
+    if (timestampQuery)
+    {
+        requiredFeatures.push_back(wgpu::FeatureName::TimestampQuery);
+    }
+    deviceDesc.requiredFeatureCount     = requiredFeatures.size();
+    deviceDesc.requiredFeatures         = requiredFeatures.data();
     wgpu::Limits requiredLimits         = GetRequiredLimits(adapter);
     deviceDesc.requiredLimits           = &requiredLimits;
     deviceDesc.defaultQueue.nextInChain = nullptr;
@@ -69,6 +145,7 @@ bool Application::Initialize()
     auto deviceLostCallback =
         [](const wgpu::Device&, wgpu::DeviceLostReason reason, wgpu::StringView message)
     {
+        ++gDeviceLostCount;
         printf("Device lost: reason 0x%08X\n", reason);
         if (message.data)
         {
@@ -81,6 +158,7 @@ bool Application::Initialize()
     auto uncapturedErrorCallback =
         [](const wgpu::Device&, wgpu::ErrorType type, wgpu::StringView message)
     {
+        ++gDeviceErrorCount;
         printf("Uncaptured device error: type 0x%08X\n", type);
         if (message.data)
         {
@@ -90,88 +168,207 @@ bool Application::Initialize()
 
     deviceDesc.SetUncapturedErrorCallback(uncapturedErrorCallback);
 
+    if (!mOptions.pipelineCache.empty())
+    {
+        uint64_t maxBytes = static_cast<uint64_t>(mOptions.pipelineCacheMB) * 1024 * 1024;
+        mPipelineCache    = std::make_unique<PipelineCache>(mOptions.pipelineCache, maxBytes);
+        if (mPipelineCache->Open())
+        {
+            mPipelineCache->Attach(deviceDesc, adapterInfo);
+        }
+        else
+        {
+            mPipelineCache.reset();
+        }
+    }
+
     mDevice = WebGPUUtils::RequestDeviceSync(mInstance, adapter, &deviceDesc);
 
     WebGPUUtils::InspectDevice(mDevice);
 
     mQueue = mDevice.GetQueue();
 
-    mSurfaceFormat = WebGPUUtils::GetTextureFormat(mSurface, adapter);
+    mStartup.Begin("Profilers");
+    mProfiler = std::make_unique<GPUProfiler>(mDevice, timestampQuery);
+    mProfiler->SetEnabled(mOptions.profile);
+    if (!mOptions.profileCSV.empty())
+    {
+        mProfiler->OpenCSV(mOptions.profileCSV);
+    }
 
-    // Configure the surface
-    wgpu::SurfaceConfiguration config {
-        .nextInChain     = nullptr,
-        .device          = mDevice,
-        .format          = mSurfaceFormat,
-        .usage           = wgpu::TextureUsage::RenderAttachment,
-        .width           = (uint32_t)windowSize.x,
-        .height          = (uint32_t)windowSize.y,
-        .viewFormatCount = 0,
-        .viewFormats     = nullptr,
-        .alphaMode       = wgpu::CompositeAlphaMode::Auto,
-        .presentMode     = wgpu::PresentMode::Fifo,
-    };
+    mTelemetry = std::make_unique<FrameTelemetry>(mInstance, mQueue);
+
+    if (mOptions.metricsPort > 0)
+    {
+        mMetricsServer = std::make_unique<MetricsServer>();
+        if (!mMetricsServer->Start(mOptions.metricsPort))
+        {
+            mMetricsServer.reset();
+        }
+    }
+
+    mStartup.Begin(mOptions.headless ? "Offscreen target" : "Surface configuration");
+    if (mOptions.headless)
+    {
+        mSurfaceFormat = wgpu::TextureFormat::RGBA8Unorm;
+        InitializeOffscreenTarget(windowSize);
+    }
+    else
+    {
+        mSurfaceFormat = WebGPUUtils::GetTextureFormat(mSurface, adapter);
 
-    mSurface.Configure(&config);
+        // Copying the surface lets a settled simulation present its last frame again
+        wgpu::SurfaceCapabilities capabilities;
+        mSurface.GetCapabilities(adapter, &capabilities);
+        wgpu::TextureUsage copyUsage = wgpu::TextureUsage::CopySrc | wgpu::TextureUsage::CopyDst;
+        wgpu::TextureUsage usage     = wgpu::TextureUsage::RenderAttachment;
+
+        bool copyable = mOptions.idle && (capabilities.usages & copyUsage) == copyUsage;
+        if (copyable)
+        {
+            usage |= copyUsage;
+        }
 
+        // Configure the surface
+        wgpu::SurfaceConfiguration config {
+            .nextInChain     = nullptr,
+            .device          = mDevice,
+            .format          = mSurfaceFormat,
+            .usage           = usage,
+            .width           = (uint32_t)windowSize.x,
+            .height          = (uint32_t)windowSize.y,
+            .viewFormatCount = 0,
+            .viewFormats     = nullptr,
+            .alphaMode       = wgpu::CompositeAlphaMode::Auto,
+            .presentMode     = SelectPresentMode(adapter),
+        };
+
+        mSurface.Configure(&config);
+
+        if (copyable)
+        {
+            wgpu::TextureDescriptor textureDesc {};
+            textureDesc.label         = WebGPUUtils::GenerateString("last frame texture");
+            textureDesc.dimension     = wgpu::TextureDimension::e2D;
+            textureDesc.size          = {config.width, config.height, 1};
+            textureDesc.format        = mSurfaceFormat;
+            textureDesc.usage         = copyUsage;
+            textureDesc.mipLevelCount = 1;
+            textureDesc.sampleCount   = 1;
+
+            mLastFrameTexture = GPUMemory::CreateTexture(mDevice, textureDesc, "Application", this);
+        }
+    }
+
+    GPUMemory::SetBudget(static_cast<uint64_t>(mOptions.vramBudgetMB) * 1024 * 1024);
+
+    mStartup.Begin("Buffers");
     InitializeBuffers();
 
+    // Stepping per displayed frame keeps headless and deterministic runs frame-reproducible
+    if (mOptions.simulationRate > 0 && !mOptions.headless && !mOptions.deterministic)
+    {
+        mSimulationClock.SetStepsPerSecond(mOptions.simulationRate);
+        mInterpolator = std::make_unique<PositionInterpolator>(
+            mDevice, mPosvelBuffers, NUM_PARTICLES_MAX, mProfiler.get());
+    }
+
+    if (mOptions.idle && !mOptions.headless && !mOptions.deterministic)
+    {
+        ConvergenceMonitor::Settings convergenceSettings {
+            .threshold      = mOptions.idleThreshold,
+            .holdSamples    = 3,
+            .sampleInterval = 4,
+        };
+        mConvergence = std::make_unique<ConvergenceMonitor>(
+            mDevice, mPosvelBuffers, NUM_PARTICLES_MAX, convergenceSettings, mProfiler.get());
+    }
+
+    mCountersEnabled  = mOptions.counters;
+    mAdaptiveSubsteps = mOptions.adaptiveSubsteps && !mOptions.deterministic;
+
     mRenderUniforms.screenSize = windowSize;
     mRenderUniforms.texelSize  = glm::vec2(1.0f / windowSize.x, 1.0 / windowSize.y);
 
-    // Setup SPH
+    // Fixed initial conditions, every simulator reset restarts the sequence
+    if (mOptions.deterministic)
+    {
+        SetRandomSeed(mOptions.seed);
+    }
+
+    mCamera      = std::make_unique<Camera>();
+    mTexturePool = std::make_unique<TexturePool>(mDevice);
+
+    // Only the initial simulation is built, the other one on its first use
     {
         float fov          = mSimulationVariables.fov;
         float initDistance = mSimulationVariables.sphInitDistances[1];
         glm::vec3 boxSize  = mSimulationVariables.sphBoxSizes[1];
         glm::vec3 target(0.0f, -boxSize[1] + 0.1, 0.0f);
         float zoomRate = SimulationVariables::SPH_ZOOM_RATE;
-        float radius   = 0.04f;
-        float diameter = 2.0f * radius;
 
-        mSPHSimulator =
-            std::make_unique<SPHSimulator>(mDevice, mParticleBuffer, mPosvelBuffer, diameter);
+        // Warns before anything is created if the pairs would not fit the budget
+        UpdateMemoryEstimates(true);
 
-        mSPHRenderer = std::make_unique<FluidRenderer>(mDevice,
-                                                       mRenderUniforms.screenSize,
-                                                       mSurfaceFormat,
-                                                       radius,
-                                                       fov,
-                                                       mRenderUniformBuffer,
-                                                       mPosvelBuffer);
+        mStartup.Begin("SPHSimulator and FluidRenderer");
+        if (!ActivateSimulation(true))
+        {
+            return false;
+        }
 
+        mStartup.Begin("SPH reset");
         mSPHSimulator->Reset(mSimulationVariables.numParticles,
                              mSimulationVariables.boxSize,
                              mRenderUniforms);
 
-        mCamera = std::make_unique<Camera>();
         mCamera->Reset(mRenderUniforms, initDistance, target, fov, zoomRate);
+        ++mCameraGeneration;
+        mStartup.End();
     }
 
-    // Setup MLS-MPM
+    // The input side starts from the same camera, later it follows PublishView()
+    mInputCamera            = *mCamera;
+    mInput.cameraGeneration = mCameraGeneration;
+    if (!mOptions.headless)
     {
-        float fov          = mSimulationVariables.fov;
-        float initDistance = mSimulationVariables.mpmInitDistances[1];
-        glm::vec3 target   = mSimulationVariables.mpmBoxSizes[1] * glm::vec3(0.5f, 0.25f, 0.5f);
-        float zoomRate     = SimulationVariables::MPM_ZOOM_RATE;
-        float radius       = 0.6f;
-        float diameter     = 2.0f * radius;
-
-        mMlsMpmSimulator =
-            std::make_unique<MlsMpmSimulator>(mParticleBuffer, mPosvelBuffer, diameter, mDevice);
+        SDL_GetWindowSize(mWindow, &mInput.windowWidth, &mInput.windowHeight);
+        SDL_GetWindowSizeInPixels(mWindow, &mInput.pixelWidth, &mInput.pixelHeight);
+    }
 
-        mMlsMpmRenderer = std::make_unique<FluidRenderer>(mDevice,
-                                                          mRenderUniforms.screenSize,
-                                                          mSurfaceFormat,
-                                                          radius,
-                                                          fov,
-                                                          mRenderUniformBuffer,
-                                                          mPosvelBuffer);
+    if (!mOptions.replayCamera.empty() && !mCameraPath.Load(mOptions.replayCamera))
+    {
+        return false;
+    }
+    if (!mOptions.recordCamera.empty() && !mCameraPath.OpenRecording(mOptions.recordCamera))
+    {
+        return false;
     }
 
     mQueue.WriteBuffer(mRenderUniformBuffer, 0, &mRenderUniforms, sizeof(RenderUniforms));
 
-    InitializeGUI();
+    if (mOptions.adaptiveSubsteps && mOptions.deterministic)
+    {
+        // The substeps would depend on when the speed readbacks complete
+        printf("Warning: --adaptive-substeps is ignored in deterministic mode\n");
+    }
+
+    GPUMemory::PrintReport();
+
+    if (!mOptions.headless)
+    {
+        mStartup.Begin("ImGui");
+        InitializeGUI();
+    }
+
+    mStartup.End();
+    mStartup.PrintReport();
+    if (mPipelineCache)
+    {
+        mPipelineCache->PrintReport();
+    }
+
+    mRunStartTime  = std::chrono::steady_clock::now();
+    mLastFrameTime = mRunStartTime;
 
     return true;
 }
@@ -192,20 +389,245 @@ void Application::RunLoop()
     };
     emscripten_set_main_loop_arg(callback, this, 0, true);
 #else
-    while (!ShouldClose())
+    if (mOptions.singleThread || mOptions.headless)
+    {
+        while (!ShouldClose())
+        {
+            Loop();
+        }
+    }
+    else
     {
-        Loop();
+        RunThreadedLoop();
     }
     Shutdown();
 #endif
 }
 
+#ifndef __EMSCRIPTEN__
+void Application::RunThreadedLoop()
+{
+    // Longest the input thread sleeps without events
+    constexpr int INPUT_WAIT_MS = 4;
+
+    // SDL wants its events polled on the main thread, so the GPU work moves instead
+    std::thread renderThread(
+        [this]()
+        {
+            while (!ShouldClose())
+            {
+                RenderFrame();
+            }
+        });
+
+    while (!ShouldClose())
+    {
+        // Sleep until an event arrives, with a timeout to pick up the render thread's camera
+        SDL_WaitEventTimeout(nullptr, INPUT_WAIT_MS);
+        ProcessInput();
+    }
+
+    renderThread.join();
+}
+#endif
+
 float Application::Random()
 {
-    static std::random_device device;
-    static std::mt19937_64 generator(device());
     static std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
-    return distribution(generator);
+    return distribution(gGenerator);
+}
+
+void Application::SetRandomSeed(uint64_t seed)
+{
+    gSeed = seed;
+    gGenerator.seed(seed);
+}
+
+void Application::RestartRandom()
+{
+    if (gSeed)
+    {
+        gGenerator.seed(*gSeed);
+    }
+}
+
+uint64_t Application::ComputeParticleChecksum()
+{
+    TRACE_SCOPE("Application::ComputeParticleChecksum");
+
+    uint64_t particleSize = mSimulationVariables.sph ? sizeof(SPHParticle) : sizeof(MlsMpmParticle);
+    uint64_t size         = particleSize * mSimulationVariables.numParticles;
+
+    wgpu::BufferDescriptor bufferDesc {
+        .label = WebGPUUtils::GenerateString("checksum readback buffer"),
+        .usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst,
+        .size  = size,
+    };
+    wgpu::Buffer readbackBuffer = mDevice.CreateBuffer(&bufferDesc);
+
+    wgpu::CommandEncoder commandEncoder = mDevice.CreateCommandEncoder();
+    commandEncoder.CopyBufferToBuffer(mParticleBuffer, 0, readbackBuffer, 0, size);
+    wgpu::CommandBuffer command = commandEncoder.Finish();
+    mQueue.Submit(1, &command);
+
+    bool mapped = false;
+    wgpu::Future future =
+        readbackBuffer.MapAsync(wgpu::MapMode::Read,
+                                0,
+                                size,
+                                wgpu::CallbackMode::WaitAnyOnly,
+                                [&mapped](wgpu::MapAsyncStatus status, wgpu::StringView)
+                                { mapped = status == wgpu::MapAsyncStatus::Success; });
+    mInstance.WaitAny(future, UINT64_MAX);
+    if (!mapped)
+    {
+        readbackBuffer.Destroy();
+        return 0;
+    }
+
+    // FNV-1a over the particle fields, the padding is not guaranteed to be preserved
+    uint64_t hash = 14695981039346656037ull;
+    auto add      = [&hash](const void* data, size_t bytes)
+    {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < bytes; ++i)
+        {
+            hash = (hash ^ p[i]) * 1099511628211ull;
+        }
+    };
+
+    const void* data = readbackBuffer.GetConstMappedRange(0, size);
+    for (int i = 0; i < mSimulationVariables.numParticles; ++i)
+    {
+        if (mSimulationVariables.sph)
+        {
+            const SPHParticle& particle = static_cast<const SPHParticle*>(data)[i];
+            add(&particle.position, sizeof(glm::vec3));
+            add(&particle.v, sizeof(glm::vec3));
+            add(&particle.force, sizeof(glm::vec3));
+            add(&particle.density, sizeof(float));
+            add(&particle.nearDensity, sizeof(float));
+        }
+        else
+        {
+            const MlsMpmParticle& particle = static_cast<const MlsMpmParticle*>(data)[i];
+            add(&particle.position, sizeof(glm::vec3));
+            add(&particle.v, sizeof(glm::vec3));
+            add(&particle.C1, sizeof(glm::vec3));
+            add(&particle.C2, sizeof(glm::vec3));
+            add(&particle.C3, sizeof(glm::vec3));
+        }
+    }
+
+    readbackBuffer.Unmap();
+    readbackBuffer.Destroy();
+    return hash;
+}
+
+void Application::SelectPreset(bool sph, int index)
+{
+    mSimulationVariables.sph     = sph;
+    mSimulationVariables.index   = index;
+    mSimulationVariables.changed = true;
+    UpdateGame();
+    mSimulationVariables.changed = false;
+}
+
+void Application::RunFrame()
+{
+    Loop();
+}
+
+void Application::WaitForGPU()
+{
+    WebGPUUtils::WaitForSubmittedWork(mInstance, mQueue);
+#ifndef __EMSCRIPTEN__
+    mDevice.Tick();
+#endif
+    mInstance.ProcessEvents();
+}
+
+void Application::SetCountersEnabled(bool enabled)
+{
+    mCountersEnabled = enabled;
+    if (mSPHSimulator)
+    {
+        mSPHSimulator->GetCounters().SetEnabled(enabled);
+    }
+    if (mMlsMpmSimulator)
+    {
+        mMlsMpmSimulator->GetCounters().SetEnabled(enabled);
+    }
+}
+
+void Application::SetAdaptiveSubsteps(bool enabled)
+{
+    mAdaptiveSubsteps = enabled;
+    if (mSPHSimulator)
+    {
+        mSPHSimulator->GetAdaptiveTimestep().SetEnabled(enabled);
+    }
+    if (mMlsMpmSimulator)
+    {
+        mMlsMpmSimulator->GetAdaptiveTimestep().SetEnabled(enabled);
+    }
+}
+
+AlgorithmCounters Application::GetAlgorithmCounters() const
+{
+    AlgorithmCounters result;
+    result.sph = mSimulationVariables.sph;
+
+    const GPUCounters& counters =
+        result.sph ? mSPHSimulator->GetCounters() : mMlsMpmSimulator->GetCounters();
+    const std::vector<uint32_t>& values = counters.GetValues();
+    if (values.empty())
+    {
+        return result;
+    }
+
+    // The counters accumulate over all substeps the sampled frame ran
+    double substeps  = std::max(counters.GetValuesSubsteps(), 1u);
+    double particles = std::max(substeps * mSimulationVariables.numParticles, 1.0);
+
+    uint32_t histogram = 0;
+    int gridCount      = 0;
+    if (result.sph)
+    {
+        result.densityCandidates = values[SPHSimulator::DensityCandidates] / particles;
+        result.densityNeighbors  = values[SPHSimulator::DensityNeighbors] / particles;
+        result.forceCandidates   = values[SPHSimulator::ForceCandidates] / particles;
+        result.forceNeighbors    = values[SPHSimulator::ForceNeighbors] / particles;
+        result.maxCellOccupancy  = values[SPHSimulator::MaxCellOccupancy];
+
+        histogram = SPHSimulator::OccupancyHistogram;
+        gridCount = mSPHSimulator->GetGridCount();
+    }
+    else
+    {
+        result.maxCellOccupancy = values[MlsMpmSimulator::MaxCellOccupancy];
+        result.maxScatterFanIn  = values[MlsMpmSimulator::MaxScatterFanIn];
+
+        histogram = MlsMpmSimulator::OccupancyHistogram;
+        gridCount = mMlsMpmSimulator->GetGridCount();
+    }
+
+    double occupied = 0.0;
+    for (uint32_t i = 0; i < GPUCounters::HISTOGRAM_BINS; ++i)
+    {
+        result.occupancyHistogram[i] = values[histogram + i] / substeps;
+        occupied += result.occupancyHistogram[i];
+    }
+    result.emptyCells = std::max(gridCount - occupied, 0.0);
+    result.valid      = true;
+
+    return result;
+}
+
+int Application::GetSubsteps() const
+{
+    return mSimulationVariables.sph ? mSPHSimulator->GetSubsteps()
+                                    : mMlsMpmSimulator->GetSubsteps();
 }
 
 void Application::InitializeBuffers()
@@ -217,170 +639,831 @@ void Application::InitializeBuffers()
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
     bufferDesc.mappedAtCreation = false;
 
-    mRenderUniformBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mRenderUniformBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "Application", this);
 
     // particle storage buffer
     auto maxParticleSize        = std::max(sizeof(SPHParticle), sizeof(MlsMpmParticle));
-    bufferDesc.label            = WebGPUUtils::GenerateString("particle storage buffer");
-    bufferDesc.size             = maxParticleSize * NUM_PARTICLES_MAX;
-    bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage;
+    bufferDesc.label = WebGPUUtils::GenerateString("particle storage buffer");
+    bufferDesc.size  = maxParticleSize * NUM_PARTICLES_MAX;
+    bufferDesc.usage =
+        wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::Storage;
     bufferDesc.mappedAtCreation = false;
 
-    mParticleBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mParticleBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "Application", this);
 
-    // position storage buffer
-    bufferDesc.label            = WebGPUUtils::GenerateString("position storage buffer");
-    bufferDesc.size             = sizeof(PosVel) * NUM_PARTICLES_MAX;
-    bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage;
+    // position storage buffers, one label each so validation errors can tell them apart
+    bufferDesc.size  = sizeof(PosVel) * NUM_PARTICLES_MAX;
+    bufferDesc.usage =
+        wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::Storage;
     bufferDesc.mappedAtCreation = false;
 
-    mPosvelBuffer = mDevice.CreateBuffer(&bufferDesc);
+    const char* posvelLabels[] = {"position storage buffer 0", "position storage buffer 1"};
+    for (size_t i = 0; i < mPosvelBuffers.size(); ++i)
+    {
+        bufferDesc.label  = WebGPUUtils::GenerateString(posvelLabels[i]);
+        mPosvelBuffers[i] = GPUMemory::CreateBuffer(mDevice, bufferDesc, "Application", this);
+    }
+}
+
+void Application::InitializeOffscreenTarget(const glm::vec2& size)
+{
+    wgpu::TextureDescriptor textureDesc {};
+    textureDesc.label         = WebGPUUtils::GenerateString("offscreen color texture");
+    textureDesc.dimension     = wgpu::TextureDimension::e2D;
+    textureDesc.size          = {(uint32_t)size.x, (uint32_t)size.y, 1};
+    textureDesc.format        = mSurfaceFormat;
+    textureDesc.usage         = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopySrc;
+    textureDesc.mipLevelCount = 1;
+    textureDesc.sampleCount   = 1;
+
+    mOffscreenTexture     = GPUMemory::CreateTexture(mDevice, textureDesc, "Application", this);
+    mOffscreenTextureView = mOffscreenTexture.CreateView();
+}
+
+wgpu::PresentMode Application::SelectPresentMode(wgpu::Adapter adapter) const
+{
+    wgpu::PresentMode mode = wgpu::PresentMode::Fifo;
+    if (mOptions.presentMode == "mailbox")
+    {
+        mode = wgpu::PresentMode::Mailbox;
+    }
+    else if (mOptions.presentMode == "immediate")
+    {
+        mode = wgpu::PresentMode::Immediate;
+    }
+
+    wgpu::SurfaceCapabilities capabilities;
+    mSurface.GetCapabilities(adapter, &capabilities);
+    for (size_t i = 0; i < capabilities.presentModeCount; ++i)
+    {
+        if (capabilities.presentModes[i] == mode)
+        {
+            return mode;
+        }
+    }
+
+    // Fifo is the one mode every surface supports
+    std::cerr << "Present mode " << mOptions.presentMode << " is not supported, using fifo"
+              << std::endl;
+    return wgpu::PresentMode::Fifo;
 }
 
 void Application::Loop()
 {
+    TRACE_SCOPE("Application::Loop");
+
     ProcessInput();
+    RenderFrame();
+}
+
+void Application::RenderFrame()
+{
+    ApplyInput();
     UpdateGame();
+    UpdateCameraPath();
     GenerateOutput();
+    PublishView();
+}
+
+void Application::ProcessInput()
+{
+    TRACE_SCOPE("Application::ProcessInput");
+
+    if (mOptions.headless)
+    {
+        return;
+    }
+
+    // Follow the camera whenever the render thread moved it, keeping an ongoing drag
+    ViewSnapshot view;
+    if (mViewHandoff.Consume(view))
+    {
+        if (view.cameraGeneration != mInput.cameraGeneration)
+        {
+            Camera camera           = view.camera;
+            camera.isDragging       = mInputCamera.isDragging;
+            camera.prevX            = mInputCamera.prevX;
+            camera.prevY            = mInputCamera.prevY;
+            mInputCamera            = camera;
+            mInput.cameraGeneration = view.cameraGeneration;
+        }
+        mGUIWantsMouse = view.guiWantsMouse;
+
+        if (view.guiWantsText != mTextInputActive)
+        {
+            mTextInputActive = view.guiWantsText;
+            if (mTextInputActive)
+            {
+                SDL_StartTextInput(mWindow);
+            }
+            else
+            {
+                SDL_StopTextInput(mWindow);
+            }
+        }
+    }
+
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+        ++mInput.events;
+        switch (event.type)
+        {
+            case SDL_EVENT_QUIT:
+                mIsRunning = false;
+                break;
+
+            case SDL_EVENT_MOUSE_MOTION:
+                mInput.mouseX = event.motion.x;
+                mInput.mouseY = event.motion.y;
+                OnMouseMove();
+                break;
+
+            case SDL_EVENT_MOUSE_WHEEL:
+                mInput.wheelX += event.wheel.x;
+                mInput.wheelY += event.wheel.y;
+                OnScroll(event);
+                break;
+
+            case SDL_EVENT_MOUSE_BUTTON_DOWN:
+            case SDL_EVENT_MOUSE_BUTTON_UP:
+            {
+                int button = GUIMouseButton(event.button.button);
+                if (button >= 0)
+                {
+                    uint32_t mask = 1u << button;
+                    if (event.button.down)
+                    {
+                        mInput.buttons |= mask;
+                        ++mInput.presses[button];
+                    }
+                    else
+                    {
+                        mInput.buttons &= ~mask;
+                    }
+                }
+                OnMouseButton(event);
+                break;
+            }
+
+            case SDL_EVENT_KEY_DOWN:
+            case SDL_EVENT_KEY_UP:
+                QueueGUIEvent(event);
+                OnKeyAction(event);
+                break;
+
+            case SDL_EVENT_TEXT_INPUT:
+            case SDL_EVENT_WINDOW_FOCUS_GAINED:
+            case SDL_EVENT_WINDOW_FOCUS_LOST:
+                QueueGUIEvent(event);
+                break;
+
+            case SDL_EVENT_WINDOW_MOUSE_LEAVE:
+                mInput.mouseX = -FLT_MAX;
+                mInput.mouseY = -FLT_MAX;
+                break;
+
+            case SDL_EVENT_WINDOW_RESIZED:
+            case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+                SDL_GetWindowSize(mWindow, &mInput.windowWidth, &mInput.windowHeight);
+                SDL_GetWindowSizeInPixels(mWindow, &mInput.pixelWidth, &mInput.pixelHeight);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    mInput.xTheta   = mInputCamera.currentXTheta;
+    mInput.yTheta   = mInputCamera.currentYTheta;
+    mInput.distance = mInputCamera.currentDistance;
+    mInputHandoff.Publish(mInput);
 }
 
-void Application::ProcessInput()
-{
-    SDL_Event event;
-    while (SDL_PollEvent(&event))
+void Application::QueueGUIEvent(const SDL_Event& event)
+{
+    std::lock_guard<std::mutex> lock(mGUIEventsMutex);
+    GUIEvent& guiEvent = mGUIEvents.emplace_back(GUIEvent {.event = event});
+    if (event.type == SDL_EVENT_TEXT_INPUT)
+    {
+        guiEvent.text = event.text.text;
+    }
+}
+
+void Application::ApplyInput()
+{
+    TRACE_SCOPE("Application::ApplyInput");
+
+    if (ImGui::GetCurrentContext() != nullptr)
+    {
+        ApplyGUIEvents();
+    }
+
+    InputSnapshot input;
+    if (!mInputHandoff.Consume(input))
+    {
+        return;
+    }
+
+    if (input.events != mAppliedInput.events)
+    {
+        WakeFromIdle(false);
+    }
+
+    // An orbit based on a camera that has since been reset or replayed is dropped
+    if (input.cameraGeneration == mCameraGeneration
+        && (input.xTheta != mCamera->currentXTheta || input.yTheta != mCamera->currentYTheta
+            || input.distance != mCamera->currentDistance))
+    {
+        mCamera->currentXTheta   = input.xTheta;
+        mCamera->currentYTheta   = input.yTheta;
+        mCamera->currentDistance = input.distance;
+        mCamera->RecalculateView(mRenderUniforms);
+    }
+
+    if (ImGui::GetCurrentContext() != nullptr)
+    {
+        ImGuiIO& io    = ImGui::GetIO();
+        io.DisplaySize = ImVec2(input.windowWidth, input.windowHeight);
+        if (input.windowWidth > 0 && input.windowHeight > 0)
+        {
+            io.DisplayFramebufferScale =
+                ImVec2(static_cast<float>(input.pixelWidth) / input.windowWidth,
+                       static_cast<float>(input.pixelHeight) / input.windowHeight);
+        }
+        io.AddMousePosEvent(input.mouseX, input.mouseY);
+        for (int button = 0; button < 3; ++button)
+        {
+            bool down    = (input.buttons >> button) & 1;
+            bool wasDown = (mAppliedInput.buttons >> button) & 1;
+            if (input.presses[button] != mAppliedInput.presses[button])
+            {
+                // Pressed since the last snapshot, and possibly released again already
+                if (wasDown)
+                {
+                    io.AddMouseButtonEvent(button, false);
+                }
+                io.AddMouseButtonEvent(button, true);
+                wasDown = true;
+            }
+            if (down != wasDown)
+            {
+                io.AddMouseButtonEvent(button, down);
+            }
+        }
+        io.AddMouseWheelEvent(input.wheelX - mAppliedInput.wheelX,
+                              input.wheelY - mAppliedInput.wheelY);
+    }
+
+    mAppliedInput = input;
+}
+
+void Application::ApplyGUIEvents()
+{
+    {
+        std::lock_guard<std::mutex> lock(mGUIEventsMutex);
+        mAppliedGUIEvents.swap(mGUIEvents);
+    }
+    for (GUIEvent& guiEvent : mAppliedGUIEvents)
+    {
+        if (guiEvent.event.type == SDL_EVENT_TEXT_INPUT)
+        {
+            guiEvent.event.text.text = guiEvent.text.c_str();
+        }
+        ImGui_ImplSDL3_ProcessEvent(&guiEvent.event);
+    }
+    mAppliedGUIEvents.clear();
+
+    // The rest of ImGui_ImplSDL3_NewFrame(), the display size and mouse come with the snapshot
+    auto now                 = std::chrono::steady_clock::now();
+    float deltaTime          = std::chrono::duration<float>(now - mGUITime).count();
+    ImGui::GetIO().DeltaTime = std::max(deltaTime, 1e-6f);
+    mGUITime                 = now;
+}
+
+void Application::PublishView()
+{
+    bool hasGUI        = ImGui::GetCurrentContext() != nullptr;
+    bool guiWantsMouse = hasGUI && ImGui::GetIO().WantCaptureMouse;
+    bool guiWantsText  = hasGUI && ImGui::GetIO().WantTextInput;
+
+    ViewSnapshot view {
+        .cameraGeneration = mCameraGeneration,
+        .camera           = *mCamera,
+        .guiWantsMouse    = guiWantsMouse,
+        .guiWantsText     = guiWantsText,
+    };
+    mViewHandoff.Publish(view);
+}
+
+void Application::UpdateGame()
+{
+    TRACE_SCOPE("Application::UpdateGame");
+
+    // A replayed path starts over with every reset of the camera
+    if (mSimulationVariables.simulationChnaged || mSimulationVariables.changed)
+    {
+        if (!ActivateSimulation(mSimulationVariables.sph))
+        {
+            mIsRunning = false;
+        }
+        mCameraPath.Restart();
+        mPosvelReady = false;
+        ++mCameraGeneration;
+        WakeFromIdle(true);
+
+        // Show the new particles right away instead of blending from the old ones
+        if (mInterpolator)
+        {
+            mSimulationClock.Reset();
+            mInterpolator->Invalidate();
+        }
+    }
+
+    if (mSimulationVariables.simulationChnaged)
+    {
+        if (mSimulationVariables.sph)
+        {
+            ResetToSPH();
+        }
+        else
+        {
+            ResetToMlsMpm();
+        }
+    }
+
+    if (mSimulationVariables.changed)
+    {
+        mSimulationVariables.Refresh();
+        if (mSimulationVariables.sph)
+        {
+            mSPHSimulator->Reset(mSimulationVariables.numParticles,
+                                 mSimulationVariables.boxSize,
+                                 mRenderUniforms);
+            glm::vec3 target(0.0f, -mSimulationVariables.boxSize[1] + 0.1, 0.0f);
+            mCamera->Reset(mRenderUniforms,
+                           mSimulationVariables.initDistance,
+                           target,
+                           mSimulationVariables.fov,
+                           SimulationVariables::SPH_ZOOM_RATE);
+        }
+        else
+        {
+            mMlsMpmSimulator->Reset(mSimulationVariables.numParticles,
+                                    mSimulationVariables.boxSize,
+                                    mRenderUniforms);
+            glm::vec3 target = mSimulationVariables.boxSize * glm::vec3(0.5f, 0.25f, 0.5f);
+            mCamera->Reset(mRenderUniforms,
+                           mSimulationVariables.initDistance,
+                           target,
+                           mSimulationVariables.fov,
+                           SimulationVariables::MPM_ZOOM_RATE);
+        }
+    }
+
+    if (mSimulationVariables.boxWidthChanged)
+    {
+        WakeFromIdle(true);
+        glm::vec3 realBoxSize = mSimulationVariables.boxSize;
+        realBoxSize.z *= mSimulationVariables.boxWidthRatio;
+        if (mSimulationVariables.sph)
+        {
+            mSPHSimulator->ChangeBoxSize(realBoxSize);
+        }
+        else
+        {
+            mMlsMpmSimulator->ChangeBoxSize(realBoxSize);
+        }
+    }
+}
+
+void Application::UpdateCameraPath()
+{
+    if (mCameraPath.IsReplaying())
+    {
+        mCameraPath.Replay(*mCamera, mRenderUniforms, mSimulationVariables.sph);
+        ++mCameraGeneration;
+        mViewChanged = true;
+    }
+    else if (mCameraPath.IsRecording())
+    {
+        mCameraPath.Record(*mCamera, mSimulationVariables.sph);
+    }
+}
+
+void Application::GenerateOutput()
+{
+    TRACE_SCOPE("Application::GenerateOutput");
+
+    {
+        TRACE_SCOPE("Queue::WriteBuffer render uniforms");
+        mQueue.WriteBuffer(mRenderUniformBuffer, 0, &mRenderUniforms, sizeof(RenderUniforms));
+    }
+
+    // Get the next target texture view
+    wgpu::Texture targetTexture  = mOffscreenTexture;
+    wgpu::TextureView targetView =
+        mOptions.headless ? mOffscreenTextureView : GetNextSurfaceTextureView(targetTexture);
+    if (!targetView)
+    {
+        return;
+    }
+
+    // Create the command encoders of the simulation steps and the draw call
+    wgpu::CommandEncoderDescriptor encoderDesc {
+        .nextInChain = nullptr,
+        .label       = WebGPUUtils::GenerateString("Simulation command encoder"),
+    };
+    wgpu::CommandEncoder simulationEncoder = mDevice.CreateCommandEncoder(&encoderDesc);
+    encoderDesc.label = WebGPUUtils::GenerateString("Render command encoder");
+    wgpu::CommandEncoder renderEncoder = mDevice.CreateCommandEncoder(&encoderDesc);
+
+    mTelemetry->BeginFrame();
+    mProfiler->BeginFrame();
+
+    // The draw reads the previous frame's positions, so it is recorded before the steps advance
+    // the clock and submitted first
+    bool overlap = mPosvelReady;
+    if (!overlap)
+    {
+        EncodeSimulation(simulationEncoder);
+    }
+    EncodeRender(renderEncoder, targetTexture, targetView);
+    if (overlap)
+    {
+        EncodeSimulation(simulationEncoder);
+    }
+
+    mProfiler->Resolve(overlap ? simulationEncoder : renderEncoder);
+
+    // Finally encode and submit the command buffers
+    wgpu::CommandBufferDescriptor cmdBufferDescriptor {
+        .nextInChain = nullptr,
+        .label       = WebGPUUtils::GenerateString("Simulation command buffer"),
+    };
+    wgpu::CommandBuffer simulationCommand = simulationEncoder.Finish(&cmdBufferDescriptor);
+    cmdBufferDescriptor.label = WebGPUUtils::GenerateString("Render command buffer");
+    wgpu::CommandBuffer renderCommand = renderEncoder.Finish(&cmdBufferDescriptor);
+    mTelemetry->EndEncode();
+
+    if (mOptions.headless)
+    {
+        // Without presentation nothing throttles the CPU, so keep at most one frame in flight
+        if (mPreviousFrameDone)
+        {
+            TRACE_SCOPE("Wait previous frame");
+            mInstance.WaitAny(*mPreviousFrameDone, UINT64_MAX);
+        }
+    }
+
+    {
+        TRACE_SCOPE("Queue::Submit");
+        const wgpu::CommandBuffer& first  = overlap ? renderCommand : simulationCommand;
+        const wgpu::CommandBuffer& second = overlap ? simulationCommand : renderCommand;
+        mQueue.Submit(1, &first);
+        mQueue.Submit(1, &second);
+    }
+
+    mTelemetry->Submitted();
+    mProfiler->EndFrame();
+    if (mSPHSimulator)
+    {
+        mSPHSimulator->EndFrame();
+    }
+    if (mMlsMpmSimulator)
+    {
+        mMlsMpmSimulator->EndFrame();
+    }
+    if (mConvergence)
+    {
+        mConvergence->EndFrame();
+    }
+
+    PublishMetrics();
+
+    if (mOptions.headless)
     {
-        switch (event.type)
-        {
-            case SDL_EVENT_QUIT:
-                mIsRunning = false;
-                break;
+        mPreviousFrameDone =
+            mQueue.OnSubmittedWorkDone(wgpu::CallbackMode::WaitAnyOnly,
+                                       [](wgpu::QueueWorkDoneStatus, auto&&...) {});
+    }
 
-            case SDL_EVENT_MOUSE_MOTION:
-                OnMouseMove();
-                break;
+#ifndef __EMSCRIPTEN__
+    if (!mOptions.headless)
+    {
+        TRACE_SCOPE("Surface::Present");
+        mSurface.Present();
+    }
+    {
+        TRACE_SCOPE("Device::Tick");
+        mDevice.Tick();
+    }
+#endif
+    {
+        // Readback callbacks run here, on the thread that records the frames and reads the results
+        TRACE_SCOPE("Instance::ProcessEvents");
+        mInstance.ProcessEvents();
+    }
 
-            case SDL_EVENT_MOUSE_WHEEL:
-                OnScroll(event);
-                break;
+    ++mFrameCount;
+    if (mOptions.frames > 0 && mFrameCount >= mOptions.frames)
+    {
+        mIsRunning = false;
+    }
+}
 
-            case SDL_EVENT_MOUSE_BUTTON_DOWN:
-            case SDL_EVENT_MOUSE_BUTTON_UP:
-                OnMouseButton(event);
-                break;
+void Application::PublishMetrics()
+{
+    auto now       = std::chrono::steady_clock::now();
+    auto elapsed   = std::chrono::duration<double, std::milli>(now - mLastFrameTime);
+    mLastFrameTime = now;
+    if (!mMetricsServer)
+    {
+        return;
+    }
 
-            case SDL_EVENT_KEY_DOWN:
-            case SDL_EVENT_KEY_UP:
-                OnKeyAction(event);
-                break;
+    // Reused between frames, publishing must not allocate
+    MetricsSnapshot& snapshot = mMetricsSnapshot;
+    snapshot.frames           = mFrameCount + 1;
+    snapshot.frameMs          = elapsed.count();
+    snapshot.simulation       = mSimulationVariables.sph ? "sph" : "mpm";
+    snapshot.particles        = mSimulationVariables.numParticles;
+    snapshot.substeps         = GetSubsteps();
+    snapshot.gpuMemory        = GPUMemory::GetTotal();
+    snapshot.gpuBudget        = GPUMemory::GetBudget();
+    snapshot.deviceLost       = gDeviceLostCount;
+    snapshot.deviceErrors     = gDeviceErrorCount;
 
-            default:
-                break;
-        }
+    {
+        auto lock               = mTelemetry->Lock();
+        snapshot.encodeMs       = mTelemetry->GetEncodeMs().last;
+        snapshot.latencyMs      = mTelemetry->GetLatencyMs().last;
+        snapshot.framesInFlight = static_cast<int>(mTelemetry->GetFramesInFlightMetric().last);
+    }
 
-        ImGui_ImplSDL3_ProcessEvent(&event);
+    const std::vector<GPUProfiler::StageTiming>& stages = mProfiler->GetStageTimings();
+    snapshot.stageCount = std::min(stages.size(), MetricsSnapshot::MAX_STAGES);
+    for (size_t i = 0; i < snapshot.stageCount; ++i)
+    {
+        std::snprintf(snapshot.stages[i].name,
+                      MetricsSnapshot::STAGE_NAME_SIZE,
+                      "%s",
+                      stages[i].name.c_str());
+        snapshot.stages[i].ms = stages[i].averageMs;
     }
+
+    mMetricsServer->Publish(snapshot);
 }
 
-void Application::UpdateGame()
+bool Application::ActivateSimulation(bool sph)
 {
-    if (mSimulationVariables.simulationChnaged)
+    // The pipelines of the pair compile in parallel, waited for once they are all requested
+    bool created = true;
+    if ((sph && !mSPHSimulator) || (!sph && !mMlsMpmSimulator))
     {
-        if (mSimulationVariables.sph)
+        PipelineBatch::Begin();
+        if (sph)
         {
-            ResetToSPH();
+            CreateSPH();
         }
         else
         {
-            ResetToMlsMpm();
+            CreateMlsMpm();
         }
+        created = PipelineBatch::End(mInstance);
     }
 
-    if (mSimulationVariables.changed)
+    // The shared particle and posvel buffers are kept, the next reset refills them
+    if (mOptions.releaseInactive)
     {
-        mSimulationVariables.Refresh();
-        if (mSimulationVariables.sph)
+        if (sph)
         {
-            mSPHSimulator->Reset(mSimulationVariables.numParticles,
-                                 mSimulationVariables.boxSize,
-                                 mRenderUniforms);
-            glm::vec3 target(0.0f, -mSimulationVariables.boxSize[1] + 0.1, 0.0f);
-            mCamera->Reset(mRenderUniforms,
-                           mSimulationVariables.initDistance,
-                           target,
-                           mSimulationVariables.fov,
-                           SimulationVariables::SPH_ZOOM_RATE);
+            mMlsMpmSimulator.reset();
+            mMlsMpmRenderer.reset();
         }
         else
         {
-            mMlsMpmSimulator->Reset(mSimulationVariables.numParticles,
-                                    mSimulationVariables.boxSize,
-                                    mRenderUniforms);
-            glm::vec3 target = mSimulationVariables.boxSize * glm::vec3(0.5f, 0.25f, 0.5f);
-            mCamera->Reset(mRenderUniforms,
-                           mSimulationVariables.initDistance,
-                           target,
-                           mSimulationVariables.fov,
-                           SimulationVariables::MPM_ZOOM_RATE);
+            mSPHSimulator.reset();
+            mSPHRenderer.reset();
         }
     }
 
-    if (mSimulationVariables.boxWidthChanged)
+    // A kept renderer hands its pool textures back, they would only pad the active one's
+    FluidRenderer* inactiveRenderer = sph ? mMlsMpmRenderer.get() : mSPHRenderer.get();
+    if (inactiveRenderer)
     {
-        glm::vec3 realBoxSize = mSimulationVariables.boxSize;
-        realBoxSize.z *= mSimulationVariables.boxWidthRatio;
-        if (mSimulationVariables.sph)
-        {
-            mSPHSimulator->ChangeBoxSize(realBoxSize);
-        }
-        else
+        inactiveRenderer->ReleaseTransientTextures();
+    }
+
+    UpdateMemoryEstimates(sph);
+    return created;
+}
+
+void Application::UpdateMemoryEstimates(bool sph)
+{
+    uint64_t renderer = FluidRenderer::EstimateMemory();
+    uint64_t sphFull  = SPHSimulator::EstimateMemory(NUM_PARTICLES_MAX) + renderer;
+    uint64_t mpmFull  = MlsMpmSimulator::EstimateMemory() + renderer;
+    uint64_t sphPair  = mSPHSimulator ? 0 : sphFull;
+    uint64_t mpmPair  = mMlsMpmSimulator ? 0 : mpmFull;
+
+    // Released pairs never coexist, switching only adds what the inactive one needs beyond
+    // the active one
+    if (mOptions.releaseInactive)
+    {
+        uint64_t& inactive = sph ? mpmPair : sphPair;
+        uint64_t active    = sph ? sphFull : mpmFull;
+        inactive           = inactive > active ? inactive - active : 0;
+    }
+
+    GPUMemory::SetEstimate("SPH pair", sphPair);
+    GPUMemory::SetEstimate("MLS-MPM pair", mpmPair);
+}
+
+void Application::CreateSPH()
+{
+    TRACE_SCOPE("Application::CreateSPH");
+
+    float radius   = 0.04f;
+    float diameter = 2.0f * radius;
+
+    mSPHSimulator = std::make_unique<SPHSimulator>(
+        mDevice, mParticleBuffer, mPosvelBuffers, diameter, NUM_PARTICLES_MAX);
+    mSPHSimulator->SetDeterministic(mOptions.deterministic);
+    ConfigureSimulator(*mSPHSimulator);
+
+    mSPHRenderer = std::make_unique<FluidRenderer>(mDevice,
+                                                   mRenderUniforms.screenSize,
+                                                   mSurfaceFormat,
+                                                   radius,
+                                                   mSimulationVariables.fov,
+                                                   mRenderUniformBuffer,
+                                                   GetRenderPosvelBuffers(),
+                                                   mTexturePool.get());
+    ConfigureRenderer(*mSPHRenderer);
+}
+
+void Application::CreateMlsMpm()
+{
+    TRACE_SCOPE("Application::CreateMlsMpm");
+
+    float radius   = 0.6f;
+    float diameter = 2.0f * radius;
+
+    mMlsMpmSimulator =
+        std::make_unique<MlsMpmSimulator>(mParticleBuffer, mPosvelBuffers, diameter, mDevice);
+    ConfigureSimulator(*mMlsMpmSimulator);
+
+    mMlsMpmRenderer = std::make_unique<FluidRenderer>(mDevice,
+                                                      mRenderUniforms.screenSize,
+                                                      mSurfaceFormat,
+                                                      radius,
+                                                      mSimulationVariables.fov,
+                                                      mRenderUniformBuffer,
+                                                      GetRenderPosvelBuffers(),
+                                                      mTexturePool.get());
+    ConfigureRenderer(*mMlsMpmRenderer);
+}
+
+template <typename Simulator>
+void Application::ConfigureSimulator(Simulator& simulator)
+{
+    simulator.SetProfiler(mProfiler.get());
+    simulator.GetCounters().SetInterval(mOptions.countersInterval);
+    simulator.GetCounters().SetEnabled(mCountersEnabled);
+    simulator.GetAdaptiveTimestep().SetMaxSubsteps(mOptions.maxSubsteps);
+    simulator.GetAdaptiveTimestep().SetEnabled(mAdaptiveSubsteps);
+}
+
+void Application::ConfigureRenderer(FluidRenderer& renderer)
+{
+    renderer.SetProfiler(mProfiler.get());
+    renderer.SetGUICallback(
+        [this]()
         {
-            mMlsMpmSimulator->ChangeBoxSize(realBoxSize);
-        }
+            UpdateProfilerGUI();
+            UpdateTelemetryGUI();
+            UpdateMemoryGUI();
+            UpdateCountersGUI();
+        });
+}
+
+std::array<wgpu::Buffer, 2> Application::GetRenderPosvelBuffers() const
+{
+    if (mInterpolator)
+    {
+        return {mInterpolator->GetOutputBuffer(), mInterpolator->GetOutputBuffer()};
     }
+    return mPosvelBuffers;
 }
 
-void Application::GenerateOutput()
+void Application::EncodeSimulation(wgpu::CommandEncoder& commandEncoder)
 {
-    mQueue.WriteBuffer(mRenderUniformBuffer, 0, &mRenderUniforms, sizeof(RenderUniforms));
+    bool idle = IsIdle();
+    int steps = 0;
+    if (idle)
+    {
+        // The occasional step lets the monitor notice the energy rising again
+        steps = ++mIdleFrames % mOptions.idleInterval == 0 ? 1 : 0;
+    }
+    else
+    {
+        // The clock would otherwise spend the idle time as a hitch
+        if (mWasIdle)
+        {
+            mSimulationClock.Reset();
+        }
+        steps = mInterpolator ? mSimulationClock.Advance() : 1;
+    }
+    mWasIdle = idle;
 
-    // Get the next target texture view
-    wgpu::TextureView targetView = GetNextSurfaceTextureView();
-    if (!targetView)
+    if (steps <= 0)
     {
         return;
     }
 
-    // Create a command encoder for the draw call
-    wgpu::CommandEncoderDescriptor encoderDesc {
-        .nextInChain = nullptr,
-        .label       = WebGPUUtils::GenerateString("My command encoder"),
-    };
-    wgpu::CommandEncoder commandEncoder = mDevice.CreateCommandEncoder(&encoderDesc);
+    uint32_t numParticles = mSimulationVariables.numParticles;
+    if (mInterpolator)
+    {
+        mInterpolator->SetPosvelIndex(1 - mPosvelIndex);
+        mInterpolator->BeginSteps(commandEncoder, numParticles, steps);
+    }
 
     if (mSimulationVariables.sph)
     {
-        mSPHSimulator->Compute(commandEncoder);
-        mSPHRenderer->Draw(commandEncoder, targetView, mSimulationVariables);
+        mSPHSimulator->SetPosvelIndex(mPosvelIndex);
+        mSPHSimulator->Compute(commandEncoder, steps);
     }
     else
     {
-        mMlsMpmSimulator->Compute(commandEncoder);
-        mMlsMpmRenderer->Draw(commandEncoder, targetView, mSimulationVariables);
+        mMlsMpmSimulator->SetPosvelIndex(mPosvelIndex);
+        mMlsMpmSimulator->Compute(commandEncoder, steps);
     }
 
-    // Finally encode and submit the render pass
-    wgpu::CommandBufferDescriptor cmdBufferDescriptor {
-        .nextInChain = nullptr,
-        .label       = WebGPUUtils::GenerateString("Command buffer"),
-    };
-    wgpu::CommandBuffer command = commandEncoder.Finish(&cmdBufferDescriptor);
+    if (mConvergence)
+    {
+        mConvergence->Record(commandEncoder, mPosvelIndex, numParticles);
+    }
 
-    mQueue.Submit(1, &command);
+    mPosvelIndex = 1 - mPosvelIndex;
+    mPosvelReady = true;
+    ++mPosvelVersion;
+}
 
-#ifndef __EMSCRIPTEN__
-    mSurface.Present();
-    mDevice.Tick();
-#endif
+void Application::EncodeRender(wgpu::CommandEncoder& commandEncoder,
+                               const wgpu::Texture& targetTexture,
+                               wgpu::TextureView targetView)
+{
+    wgpu::Extent3D size {targetTexture.GetWidth(), targetTexture.GetHeight(), 1};
+
+    // Settled and nothing on screen changed since the last draw, present that frame again
+    bool idle = IsIdle();
+    if (idle && mLastFrameValid && !mViewChanged && mPosvelVersion == mDrawnPosvelVersion)
+    {
+        wgpu::TexelCopyTextureInfo source {.texture = mLastFrameTexture};
+        wgpu::TexelCopyTextureInfo destination {.texture = targetTexture};
+        commandEncoder.CopyTextureToTexture(&source, &destination, &size);
+        ++mReusedFrames;
+        return;
+    }
+
+    uint32_t readIndex = 1 - mPosvelIndex;
+    if (mInterpolator)
+    {
+        mInterpolator->SetPosvelIndex(readIndex);
+        mInterpolator->Interpolate(
+            commandEncoder, mSimulationVariables.numParticles, mSimulationClock.GetAlpha());
+    }
+
+    FluidRenderer& renderer = mSimulationVariables.sph ? *mSPHRenderer : *mMlsMpmRenderer;
+    renderer.SetPosvelIndex(readIndex);
+    renderer.Draw(commandEncoder, targetView, mSimulationVariables);
+
+    mDrawnPosvelVersion = mPosvelVersion;
+    mViewChanged        = false;
+
+    // Only a settled simulation will reuse the frame
+    mLastFrameValid = idle && mLastFrameTexture && !mOptions.headless;
+    if (mLastFrameValid)
+    {
+        wgpu::TexelCopyTextureInfo source {.texture = targetTexture};
+        wgpu::TexelCopyTextureInfo destination {.texture = mLastFrameTexture};
+        commandEncoder.CopyTextureToTexture(&source, &destination, &size);
+    }
+}
+
+bool Application::IsIdle() const
+{
+    return mConvergence && mConvergence->IsConverged();
+}
+
+void Application::WakeFromIdle(bool restart)
+{
+    mViewChanged = true;
+    if (mConvergence)
+    {
+        mConvergence->Wake(restart);
+    }
 }
 
 void Application::ResetToSPH()
@@ -420,8 +1503,10 @@ void Application::ResetToMlsMpm()
     mCamera->Reset(mRenderUniforms, initDistance, target, fov, zoomRate);
 }
 
-wgpu::TextureView Application::GetNextSurfaceTextureView()
+wgpu::TextureView Application::GetNextSurfaceTextureView(wgpu::Texture& texture)
 {
+    TRACE_SCOPE("Surface::GetCurrentTexture");
+
     // Get the surface texture
     wgpu::SurfaceTexture surfaceTexture;
     mSurface.GetCurrentTexture(&surfaceTexture);
@@ -447,6 +1532,7 @@ wgpu::TextureView Application::GetNextSurfaceTextureView()
 
     wgpu::TextureView targetView = surfaceTexture.texture.CreateView(&viewDescriptor);
 
+    texture = surfaceTexture.texture;
     return targetView;
 }
 
@@ -474,11 +1560,10 @@ wgpu::Limits Application::GetRequiredLimits(wgpu::Adapter adapter) const
 
 void Application::OnMouseMove()
 {
-    if (!mCamera->isDragging)
+    if (!mInputCamera.isDragging)
         return;
 
-    ImGuiIO& io = ImGui::GetIO();
-    if (io.WantCaptureMouse)
+    if (mGUIWantsMouse)
     {
         return;
     }
@@ -486,25 +1571,23 @@ void Application::OnMouseMove()
     float xpos = 0, ypos = 0;
     SDL_GetMouseState(&xpos, &ypos);
 
-    float deltaX = mCamera->prevX - xpos;
-    float deltaY = mCamera->prevY - ypos;
-    mCamera->currentXTheta += mCamera->sensitivity * deltaX;
-    mCamera->currentYTheta += mCamera->sensitivity * deltaY;
-    if (mCamera->currentYTheta > mCamera->maxYTheta)
-        mCamera->currentYTheta = mCamera->maxYTheta;
-    if (mCamera->currentYTheta < mCamera->minYTheta)
-        mCamera->currentYTheta = mCamera->minYTheta;
-    mCamera->prevX = xpos;
-    mCamera->prevY = ypos;
-    mCamera->RecalculateView(mRenderUniforms);
+    float deltaX = mInputCamera.prevX - xpos;
+    float deltaY = mInputCamera.prevY - ypos;
+    mInputCamera.currentXTheta += mInputCamera.sensitivity * deltaX;
+    mInputCamera.currentYTheta += mInputCamera.sensitivity * deltaY;
+    if (mInputCamera.currentYTheta > mInputCamera.maxYTheta)
+        mInputCamera.currentYTheta = mInputCamera.maxYTheta;
+    if (mInputCamera.currentYTheta < mInputCamera.minYTheta)
+        mInputCamera.currentYTheta = mInputCamera.minYTheta;
+    mInputCamera.prevX = xpos;
+    mInputCamera.prevY = ypos;
 }
 
 void Application::OnMouseButton(SDL_Event& event)
 {
     assert(event.type == SDL_EVENT_MOUSE_BUTTON_DOWN || event.type == SDL_EVENT_MOUSE_BUTTON_UP);
 
-    ImGuiIO& io = ImGui::GetIO();
-    if (io.WantCaptureMouse)
+    if (mGUIWantsMouse)
     {
         return;
     }
@@ -518,17 +1601,17 @@ void Application::OnMouseButton(SDL_Event& event)
         {
             case SDL_EVENT_MOUSE_BUTTON_DOWN:
             {
-                mCamera->isDragging = true;
+                mInputCamera.isDragging = true;
                 float xpos, ypos;
                 SDL_GetMouseState(&xpos, &ypos);
-                mCamera->prevX = xpos;
-                mCamera->prevY = ypos;
+                mInputCamera.prevX = xpos;
+                mInputCamera.prevY = ypos;
                 break;
             }
 
             case SDL_EVENT_MOUSE_BUTTON_UP:
             {
-                mCamera->isDragging = false;
+                mInputCamera.isDragging = false;
                 break;
             }
 
@@ -544,13 +1627,12 @@ void Application::OnScroll(SDL_Event& event)
 
     float yoffset = static_cast<float>(event.wheel.y);
 
-    mCamera->currentDistance += ((yoffset > 0.0) ? 1.0 : -1.0) * mCamera->zoomRate;
-    if (mCamera->currentDistance < mCamera->minDistance)
-        mCamera->currentDistance = mCamera->minDistance;
-    if (mCamera->currentDistance > mCamera->maxDistance)
-        mCamera->currentDistance = mCamera->maxDistance;
+    mInputCamera.currentDistance += ((yoffset > 0.0) ? 1.0 : -1.0) * mInputCamera.zoomRate;
+    if (mInputCamera.currentDistance < mInputCamera.minDistance)
+        mInputCamera.currentDistance = mInputCamera.minDistance;
+    if (mInputCamera.currentDistance > mInputCamera.maxDistance)
+        mInputCamera.currentDistance = mInputCamera.maxDistance;
 
-    mCamera->RecalculateView(mRenderUniforms);
 }
 
 void Application::OnKeyAction(SDL_Event& event)
@@ -569,12 +1651,12 @@ void Application::OnKeyAction(SDL_Event& event)
 
     if ((down || repeat) && (key == SDL_SCANCODE_W || key == SDL_SCANCODE_S))
     {
-        mCamera->currentDistance += (key == SDL_SCANCODE_W ? 1.0f : -1.0f) * mCamera->zoomRate;
-        if (mCamera->currentDistance < mCamera->minDistance)
-            mCamera->currentDistance = mCamera->minDistance;
-        if (mCamera->currentDistance > mCamera->maxDistance)
-            mCamera->currentDistance = mCamera->maxDistance;
-        mCamera->RecalculateView(mRenderUniforms);
+        float direction = key == SDL_SCANCODE_W ? 1.0f : -1.0f;
+        mInputCamera.currentDistance += direction * mInputCamera.zoomRate;
+        if (mInputCamera.currentDistance < mInputCamera.minDistance)
+            mInputCamera.currentDistance = mInputCamera.minDistance;
+        if (mInputCamera.currentDistance > mInputCamera.maxDistance)
+            mInputCamera.currentDistance = mInputCamera.maxDistance;
     }
 }
 
@@ -590,14 +1672,24 @@ void Application::InitializeGUI()
     mSurface.GetCurrentTexture(&surfaceTexture);
     wgpu::TextureFormat format = surfaceTexture.texture.GetFormat();
 
-    // Setup platform/Renderer backends
+    // Setup platform/Renderer backends. The GUI runs on the render thread, where the backend's
+    // clipboard and IME hooks would call SDL, so ImGui keeps its own
+    ImGuiPlatformIO& platformIO = ImGui::GetPlatformIO();
+    auto getClipboardText       = platformIO.Platform_GetClipboardTextFn;
+    auto setClipboardText       = platformIO.Platform_SetClipboardTextFn;
+    auto setImeData             = platformIO.Platform_SetImeDataFn;
     ImGui_ImplSDL3_InitForOther(mWindow);
+    platformIO.Platform_GetClipboardTextFn = getClipboardText;
+    platformIO.Platform_SetClipboardTextFn = setClipboardText;
+    platformIO.Platform_SetImeDataFn       = setImeData;
     ImGui_ImplWGPU_InitInfo initInfo;
     initInfo.Device             = mDevice.Get();
     initInfo.DepthStencilFormat = WGPUTextureFormat::WGPUTextureFormat_Depth32Float;
     initInfo.RenderTargetFormat = (WGPUTextureFormat)format;
     initInfo.NumFramesInFlight  = 3;
     ImGui_ImplWGPU_Init(&initInfo);
+
+    mGUITime = std::chrono::steady_clock::now();
 }
 
 void Application::TerminateGUI()
@@ -606,8 +1698,256 @@ void Application::TerminateGUI()
     ImGui_ImplSDL3_Shutdown();
 }
 
+void Application::UpdateProfilerGUI()
+{
+    if (!mProfiler->IsSupported())
+    {
+        return;
+    }
+
+    ImGui::Begin("GPU Profiler");
+
+    bool enabled = mProfiler->IsEnabled();
+    if (ImGui::Checkbox("Enabled", &enabled))
+    {
+        mProfiler->SetEnabled(enabled);
+        mProfiler->ResetStatistics();
+    }
+
+    if (enabled)
+    {
+        ImGui::Separator();
+        for (const GPUProfiler::StageTiming& stage : mProfiler->GetStageTimings())
+        {
+            ImGui::Text("%-20s %7.3f ms", stage.name.c_str(), stage.averageMs);
+        }
+        ImGui::Separator();
+        ImGui::Text("%-20s %7.3f ms", "total", mProfiler->GetFrameAverageMs());
+    }
+
+    ImGui::End();
+}
+
+void Application::UpdateTelemetryGUI()
+{
+    static constexpr int BIN_COUNT = 32;
+
+    ImGui::Begin("Frame Telemetry");
+
+    auto lock = mTelemetry->Lock();
+
+    auto plot = [](const char* label, const FrameTelemetry::Metric& metric, const char* unit)
+    {
+        // Scale the histogram to the slowest recent sample so outliers stay visible
+        float upper = 0.0f;
+        for (size_t i = 0; i < metric.historyCount; ++i)
+        {
+            upper = std::max(upper, metric.history[i]);
+        }
+        upper = std::max(upper * 1.05f, 1.0f);
+
+        float bins[BIN_COUNT];
+        metric.Histogram(bins, BIN_COUNT, upper);
+
+        ImGui::Text("%s: %.2f %s (p50 %.2f, p99 %.2f)",
+                    label,
+                    metric.last,
+                    unit,
+                    metric.RecentPercentile(0.50),
+                    metric.RecentPercentile(0.99));
+        std::string overlay = "0 - " + std::to_string((int)std::ceil(upper)) + " " + unit;
+        ImGui::PlotHistogram(
+            label, bins, BIN_COUNT, 0, overlay.c_str(), 0.0f, FLT_MAX, ImVec2(0.0f, 50.0f));
+    };
+
+    plot("CPU encode", mTelemetry->GetEncodeMs(), "ms");
+    plot("Submit to GPU done", mTelemetry->GetLatencyMs(), "ms");
+    plot("Frames in flight", mTelemetry->GetFramesInFlightMetric(), "frames");
+
+    lock.unlock();
+
+    if (ImGui::Button("Reset"))
+    {
+        mTelemetry->ResetStatistics();
+    }
+
+    ImGui::Separator();
+    AdaptiveTimestep& timestep = mSimulationVariables.sph
+                                     ? mSPHSimulator->GetAdaptiveTimestep()
+                                     : mMlsMpmSimulator->GetAdaptiveTimestep();
+    bool adaptive = timestep.IsEnabled();
+    if (ImGui::Checkbox("Adaptive substeps", &adaptive))
+    {
+        SetAdaptiveSubsteps(adaptive);
+    }
+    float dt = mSimulationVariables.sph ? mSPHSimulator->GetDt() : mMlsMpmSimulator->GetDt();
+    ImGui::Text("Substeps: %d, dt %.4f", GetSubsteps(), dt);
+    if (mInterpolator)
+    {
+        ImGui::Text("Simulation: %.0f steps/s, %d this frame, %llu dropped",
+                    mSimulationClock.GetStepsPerSecond(),
+                    mSimulationClock.GetFrameSteps(),
+                    static_cast<unsigned long long>(mSimulationClock.GetDroppedSteps()));
+    }
+    if (adaptive)
+    {
+        ImGui::Text("Max particle speed: %.3f", timestep.GetMaxSpeed());
+    }
+    if (mConvergence)
+    {
+        ImGui::Text("Kinetic energy: %.4g per particle%s, %llu frames reused",
+                    mConvergence->GetEnergy(),
+                    IsIdle() ? " (idle)" : "",
+                    static_cast<unsigned long long>(mReusedFrames));
+    }
+
+    ImGui::End();
+}
+
+void Application::UpdateMemoryGUI()
+{
+    static constexpr float MB = 1024.0f * 1024.0f;
+
+    ImGui::Begin("GPU Memory");
+
+    uint64_t total  = GPUMemory::GetTotal();
+    uint64_t budget = GPUMemory::GetBudget();
+    if (budget > 0)
+    {
+        std::string overlay = std::to_string((int)(total / MB)) + " / "
+                              + std::to_string((int)(budget / MB)) + " MB";
+        ImGui::ProgressBar((float)total / budget, ImVec2(-1.0f, 0.0f), overlay.c_str());
+    }
+    else
+    {
+        ImGui::Text("Total %.2f MB (no budget)", total / MB);
+    }
+
+    // Pairs not created yet, warned about before switching to them
+    uint64_t projected = GPUMemory::GetProjectedTotal();
+    if (projected > total)
+    {
+        bool over = budget > 0 && projected > budget;
+        ImVec4 color = over ? ImVec4(1.0f, 0.4f, 0.3f, 1.0f) : ImVec4(0.7f, 0.7f, 0.7f, 1.0f);
+        ImGui::TextColored(color,
+                           "Projected %.2f MB%s",
+                           projected / MB,
+                           over ? " (over budget)" : "");
+        for (const GPUMemory::Estimate& estimate : GPUMemory::GetEstimates())
+        {
+            ImGui::BulletText("%s %.2f MB", estimate.name.c_str(), estimate.bytes / MB);
+        }
+    }
+
+    // Per subsystem totals, expandable to the individual resources
+    const std::vector<GPUMemory::Allocation>& allocations = GPUMemory::GetAllocations();
+    for (const GPUMemory::OwnerTotal& owner : GPUMemory::GetOwnerTotals())
+    {
+        const char* name = owner.owner.c_str();
+        if (!ImGui::TreeNode(name, "%-16s %8.2f MB", name, owner.bytes / MB))
+        {
+            continue;
+        }
+        for (const GPUMemory::Allocation& allocation : allocations)
+        {
+            if (allocation.owner == owner.owner)
+            {
+                ImGui::Text("%-32s %8.2f MB", allocation.label.c_str(), allocation.bytes / MB);
+            }
+        }
+        ImGui::TreePop();
+    }
+
+    ImGui::End();
+}
+
+void Application::UpdateCountersGUI()
+{
+    ImGui::Begin("Algorithm Counters");
+
+    bool enabled = mCountersEnabled;
+    if (ImGui::Checkbox("Enabled", &enabled))
+    {
+        SetCountersEnabled(enabled);
+    }
+
+    AlgorithmCounters counters = GetAlgorithmCounters();
+    if (enabled && counters.valid)
+    {
+        ImGui::Separator();
+        if (counters.sph)
+        {
+            // Candidates are the particles of the 27 neighbor cells, neighbors those within h
+            auto efficiency = [](double neighbors, double candidates)
+            { return candidates > 0.0 ? 100.0 * neighbors / candidates : 0.0; };
+            ImGui::Text("Density: %.1f / %.1f neighbors per particle (%.0f%%)",
+                        counters.densityNeighbors,
+                        counters.densityCandidates,
+                        efficiency(counters.densityNeighbors, counters.densityCandidates));
+            ImGui::Text("Force:   %.1f / %.1f neighbors per particle (%.0f%%)",
+                        counters.forceNeighbors,
+                        counters.forceCandidates,
+                        efficiency(counters.forceNeighbors, counters.forceCandidates));
+        }
+        else
+        {
+            ImGui::Text("Max P2G scatter fan-in: %u particles", counters.maxScatterFanIn);
+        }
+
+        ImGui::Text("Max particles per cell: %u", counters.maxCellOccupancy);
+        ImGui::Text("Empty cells: %.0f", counters.emptyCells);
+
+        std::array<float, GPUCounters::HISTOGRAM_BINS> histogram;
+        for (size_t i = 0; i < histogram.size(); ++i)
+        {
+            histogram[i] = (float)counters.occupancyHistogram[i];
+        }
+        ImGui::PlotHistogram("Cell occupancy",
+                             histogram.data(),
+                             (int)histogram.size(),
+                             0,
+                             "1 .. 16+ particles",
+                             0.0f,
+                             FLT_MAX,
+                             ImVec2(0.0f, 60.0f));
+    }
+
+    ImGui::End();
+}
+
 void Application::Shutdown()
 {
+#ifndef __EMSCRIPTEN__
+    if (mProfiler->IsEnabled())
+    {
+        // Let the last readbacks land before printing
+        WaitForGPU();
+        mProfiler->PrintSummary();
+    }
+#endif
+
+    Trace::Stop();
+    ResourceManager::ReleaseShaderModules();
+
+    if (mOptions.deterministic)
+    {
+        printf("Particle checksum after %d frames: %016llx\n",
+               mFrameCount,
+               static_cast<unsigned long long>(ComputeParticleChecksum()));
+    }
+
+    if (mOptions.headless)
+    {
+        WebGPUUtils::WaitForSubmittedWork(mInstance, mQueue);
+
+        auto now     = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration<double>(now - mRunStartTime);
+        std::cout << "Headless run finished: " << mFrameCount << " frames in " << elapsed.count()
+                  << " s (" << 1000.0 * elapsed.count() / std::max(mFrameCount, 1)
+                  << " ms/frame)" << std::endl;
+        return;
+    }
+
     TerminateGUI();
 
     SDL_DestroyWindow(mWindow);
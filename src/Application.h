@@ -8,10 +8,29 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
-
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "ApplicationOptions.h"
+#include "GPUProfiler.h"
+#include "MetricsServer.h"
+#include "PipelineCache.h"
+#include "StartupProfiler.h"
+#include "FrameTelemetry.h"
 #include "FluidRenderer.h"
 #include "Camera.h"
+#include "CameraPath.h"
+#include "ConvergenceMonitor.h"
+#include "PositionInterpolator.h"
+#include "SimulationClock.h"
+#include "TexturePool.h"
+#include "TripleBuffer.h"
 #include "sph/SPHSimulator.h"
 #include "mpm/MlsMpmSimulator.h"
 
@@ -128,33 +147,185 @@ struct SimulationVariables
     }
 };
 
+// Algorithm counters of the active simulation, from the latest sampled frame
+struct AlgorithmCounters
+{
+    bool valid = false;
+    bool sph   = true;
+
+    // SPH, per particle and substep
+    double densityCandidates = 0.0;
+    double densityNeighbors  = 0.0;
+    double forceCandidates   = 0.0;
+    double forceNeighbors    = 0.0;
+
+    // MLS-MPM
+    uint32_t maxScatterFanIn = 0;
+
+    uint32_t maxCellOccupancy = 0;
+
+    // Cells per occupancy bin and substep, bin i holds cells with i + 1 particles
+    std::array<double, GPUCounters::HISTOGRAM_BINS> occupancyHistogram {};
+    double emptyCells = 0.0;
+};
+
+/**
+ * Input handed from the thread polling SDL events to the render thread. Everything is absolute,
+ * so only the latest snapshot matters
+ */
+struct InputSnapshot
+{
+    // Camera orbit, ignored unless based on the render thread's current camera generation
+    uint64_t cameraGeneration = 0;
+    float xTheta              = 0.0f;
+    float yTheta              = 0.0f;
+    float distance            = 0.0f;
+
+    // Pointer state for the GUI. Presses are counted so a click within one frame still arrives
+    float mouseX        = 0.0f;
+    float mouseY        = 0.0f;
+    uint32_t buttons    = 0;  // bit i is ImGui mouse button i
+    uint32_t presses[3] = {};
+    float wheelX        = 0.0f;
+    float wheelY        = 0.0f;
+
+    // Window size in points and pixels, the GUI's display size and framebuffer scale
+    int windowWidth  = 0;
+    int windowHeight = 0;
+    int pixelWidth   = 0;
+    int pixelHeight  = 0;
+
+    // SDL events polled so far, any new one wakes an idle simulation
+    uint64_t events = 0;
+};
+
+// Camera and GUI state handed back from the render thread to the input thread
+struct ViewSnapshot
+{
+    uint64_t cameraGeneration = 0;  // bumped whenever the render thread moves the camera itself
+    Camera camera;
+    bool guiWantsMouse = false;
+    bool guiWantsText  = false;  // SDL only sends text input events while started
+};
+
 class Application
 {
 public:
-    Application();
+    Application(const ApplicationOptions& options = {});
 
     bool Initialize();
     void RunLoop();
 
     static float Random();
 
+    // Seed Random() with a fixed value, RestartRandom() then restarts the sequence
+    static void SetRandomSeed(uint64_t seed);
+    static void RestartRandom();
+
+    /**
+     * FNV-1a hash of the particle state of the active simulation, blocks until the GPU is done.
+     * Identical between runs in deterministic mode.
+     */
+    uint64_t ComputeParticleChecksum();
+
+    // Driving the application frame by frame, used by the benchmarks
+    void SelectPreset(bool sph, int index);
+    void RunFrame();
+    void WaitForGPU();
+
+    int GetSubsteps() const;
+
+    GPUProfiler& GetProfiler()
+    {
+        return *mProfiler;
+    }
+
+    FrameTelemetry& GetTelemetry()
+    {
+        return *mTelemetry;
+    }
+
+    const StartupProfiler& GetStartupProfiler() const
+    {
+        return mStartup;
+    }
+
+    // Null when the cache is disabled or its directory could not be created
+    PipelineCache* GetPipelineCache() const
+    {
+        return mPipelineCache.get();
+    }
+
+    void SetCountersEnabled(bool enabled);
+    AlgorithmCounters GetAlgorithmCounters() const;
+
+    // CFL-driven substeps for both simulators, see AdaptiveTimestep
+    void SetAdaptiveSubsteps(bool enabled);
+
+    const SimulationVariables& GetSimulationVariables() const
+    {
+        return mSimulationVariables;
+    }
+
+    const std::string& GetAdapterName() const
+    {
+        return mAdapterName;
+    }
+
 private:
     void InitializeBuffers();
+    void InitializeOffscreenTarget(const glm::vec2& size);
+    wgpu::PresentMode SelectPresentMode(wgpu::Adapter adapter) const;
 
     void Loop();
+#ifndef __EMSCRIPTEN__
+    void RunThreadedLoop();
+#endif
+    void RenderFrame();
 
+    // Input thread
     void ProcessInput();
+    void QueueGUIEvent(const SDL_Event& event);
+
+    // Render thread, before and after the frame
+    void ApplyInput();
+    void ApplyGUIEvents();
+    void PublishView();
     void UpdateGame();
+    void UpdateCameraPath();
+    void PublishMetrics();
     void GenerateOutput();
 
     void ResetToSPH();
     void ResetToMlsMpm();
 
-    wgpu::TextureView GetNextSurfaceTextureView();
+    // Create the simulator and renderer pair of `sph` on first use, release the other pair with
+    // --release-inactive. Returns false if a pipeline failed to compile
+    bool ActivateSimulation(bool sph);
+    // Register the footprint of the pairs not created yet with GPUMemory, see ActivateSimulation
+    void UpdateMemoryEstimates(bool sph);
+    void CreateSPH();
+    void CreateMlsMpm();
+    template <typename Simulator>
+    void ConfigureSimulator(Simulator& simulator);
+    void ConfigureRenderer(FluidRenderer& renderer);
+    std::array<wgpu::Buffer, 2> GetRenderPosvelBuffers() const;
+
+    // Record the frame's simulation steps and the draw, see mPosvelIndex
+    void EncodeSimulation(wgpu::CommandEncoder& commandEncoder);
+    void EncodeRender(wgpu::CommandEncoder& commandEncoder,
+                      const wgpu::Texture& targetTexture,
+                      wgpu::TextureView targetView);
+
+    // See mConvergence
+    bool IsIdle() const;
+    void WakeFromIdle(bool restart);
+
+    wgpu::TextureView GetNextSurfaceTextureView(wgpu::Texture& texture);
 
     wgpu::Limits GetRequiredLimits(wgpu::Adapter adapter) const;
 
-    // Mouse events
+    // Mouse events, applied to the input thread's camera
     void OnMouseMove();
     void OnMouseButton(SDL_Event& event);
     void OnScroll(SDL_Event& event);
@@ -163,6 +334,10 @@ private:
     // GUI
     void InitializeGUI();
     void TerminateGUI();
+    void UpdateProfilerGUI();
+    void UpdateTelemetryGUI();
+    void UpdateMemoryGUI();
+    void UpdateCountersGUI();
 
     void Shutdown();
     bool ShouldClose();
@@ -174,21 +349,106 @@ private:
     wgpu::Queue mQueue                 = nullptr;
     wgpu::Surface mSurface             = nullptr;
     wgpu::TextureFormat mSurfaceFormat = wgpu::TextureFormat::Undefined;
+    std::string mAdapterName;
+
+    ApplicationOptions mOptions;
+
+    std::unique_ptr<GPUProfiler> mProfiler;
+    std::unique_ptr<FrameTelemetry> mTelemetry;
+    StartupProfiler mStartup;
+    std::unique_ptr<PipelineCache> mPipelineCache;
 
+    std::unique_ptr<MetricsServer> mMetricsServer;
+    MetricsSnapshot mMetricsSnapshot;
+    std::chrono::steady_clock::time_point mLastFrameTime;
+
+    // Headless
+    wgpu::Texture mOffscreenTexture;
+    wgpu::TextureView mOffscreenTextureView;
+    std::optional<wgpu::Future> mPreviousFrameDone;
+    std::chrono::steady_clock::time_point mRunStartTime;
+    int mFrameCount = 0;
+
+    // Declared before the renderers, which hand their leases back when destroyed
+    std::unique_ptr<TexturePool> mTexturePool;
     std::unique_ptr<FluidRenderer> mSPHRenderer;
     std::unique_ptr<FluidRenderer> mMlsMpmRenderer;
     std::unique_ptr<Camera> mCamera;
+    uint64_t mCameraGeneration = 0;
+    CameraPath mCameraPath;
+
+    /**
+     * The main thread polls SDL and moves its own copy of the camera while a render thread
+     * encodes, submits and presents, unless --single-thread or headless. Each side publishes its
+     * state to the other through a TripleBuffer, so neither ever waits on the other
+     */
+    Camera mInputCamera;
+    InputSnapshot mInput;
+    bool mGUIWantsMouse = false;
+    TripleBuffer<InputSnapshot> mInputHandoff;
+    TripleBuffer<ViewSnapshot> mViewHandoff;
+    InputSnapshot mAppliedInput;
+    bool mTextInputActive = false;
+
+    /**
+     * Keyboard, text and focus events for the GUI. Unlike the snapshot every one of them counts,
+     * so the main thread queues them and ApplyInput() hands them to the SDL backend. The backend's
+     * NewFrame() calls SDL off the main thread, ApplyInput() takes its place
+     */
+    struct GUIEvent
+    {
+        SDL_Event event;
+        std::string text;  // of a text input event, SDL frees the original on the next poll
+    };
+    std::mutex mGUIEventsMutex;
+    std::vector<GUIEvent> mGUIEvents;
+    std::vector<GUIEvent> mAppliedGUIEvents;
+    std::chrono::steady_clock::time_point mGUITime;
 
     wgpu::Buffer mRenderUniformBuffer;
     wgpu::Buffer mParticleBuffer;
-    wgpu::Buffer mPosvelBuffer;
+
+    /**
+     * The steps write mPosvelBuffers[mPosvelIndex] while the renderers read the other buffer,
+     * which holds the previous frame's result. The draw and the steps go into separate command
+     * buffers so the GPU may overlap them, at the cost of one frame of latency. Until the current
+     * simulation has stepped once there is nothing to read, and the frame steps before drawing
+     */
+    std::array<wgpu::Buffer, 2> mPosvelBuffers;
+    uint32_t mPosvelIndex = 0;
+    bool mPosvelReady     = false;
+
+    /**
+     * Null with --no-idle, headless and in deterministic mode. Once the simulation settled it
+     * steps every --idle-interval frames, and a frame that would draw the same image as the last
+     * one copies mLastFrameTexture to the surface instead. mPosvelVersion counts the frames that
+     * stepped, mViewChanged covers the camera, input and parameters
+     */
+    std::unique_ptr<ConvergenceMonitor> mConvergence;
+    wgpu::Texture mLastFrameTexture;  // null when the surface cannot be copied
+    int mIdleFrames              = 0;
+    bool mWasIdle                = false;
+    uint64_t mPosvelVersion      = 0;
+    uint64_t mDrawnPosvelVersion = UINT64_MAX;
+    bool mViewChanged            = true;
+    bool mLastFrameValid         = false;
+    uint64_t mReusedFrames       = 0;
+
+    // Fixed-rate simulation, the interpolator is null when stepping once per displayed frame
+    SimulationClock mSimulationClock;
+    std::unique_ptr<PositionInterpolator> mInterpolator;
 
     RenderUniforms mRenderUniforms;
 
+    // Null until first used, and again after switching away with --release-inactive
     std::unique_ptr<SPHSimulator> mSPHSimulator;
     std::unique_ptr<MlsMpmSimulator> mMlsMpmSimulator;
 
+    // Applied to the simulators as they are created
+    bool mCountersEnabled  = false;
+    bool mAdaptiveSubsteps = false;
+
     SimulationVariables mSimulationVariables;
 
-    bool mIsRunning = true;
+    std::atomic<bool> mIsRunning {true};
 };
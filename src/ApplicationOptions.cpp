@@ -0,0 +1,346 @@
+#include "ApplicationOptions.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace
+{
+    bool ParseInt(const char* text, int& value)
+    {
+        char* end   = nullptr;
+        long parsed = std::strtol(text, &end, 10);
+        if (end == text || *end != '\0')
+        {
+            return false;
+        }
+        value = static_cast<int>(parsed);
+        return true;
+    }
+
+    bool ParseFloat(const char* text, float& value)
+    {
+        char* end     = nullptr;
+        double parsed = std::strtod(text, &end);
+        if (end == text || *end != '\0')
+        {
+            return false;
+        }
+        value = static_cast<float>(parsed);
+        return true;
+    }
+
+    bool ParseSize(const char* text, uint32_t& width, uint32_t& height)
+    {
+        unsigned int w = 0, h = 0;
+        if (std::sscanf(text, "%ux%u", &w, &h) != 2 || w == 0 || h == 0)
+        {
+            return false;
+        }
+        width  = w;
+        height = h;
+        return true;
+    }
+}  // namespace
+
+bool ApplicationOptions::Parse(int argc, char* argv[], ApplicationOptions& options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+
+        // Returns the value of an option which takes an argument
+        auto nextValue = [&]() -> const char*
+        {
+            if (i + 1 >= argc)
+            {
+                std::cerr << "Missing value for " << arg << std::endl;
+                return nullptr;
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--help" || arg == "-h")
+        {
+            PrintUsage(argv[0]);
+            return false;
+        }
+        else if (arg == "--headless")
+        {
+            options.headless = true;
+        }
+        else if (arg == "--fallback-adapter")
+        {
+            options.fallbackAdapter = true;
+        }
+        else if (arg == "--size")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseSize(value, options.width, options.height))
+            {
+                std::cerr << "Invalid --size, expected WIDTHxHEIGHT" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--frames")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseInt(value, options.frames) || options.frames < 0)
+            {
+                std::cerr << "Invalid --frames, expected a non-negative integer" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--profile")
+        {
+            options.profile = true;
+        }
+        else if (arg == "--profile-csv")
+        {
+            const char* value = nextValue();
+            if (!value)
+            {
+                return false;
+            }
+            options.profile    = true;
+            options.profileCSV = value;
+        }
+        else if (arg == "--trace")
+        {
+            const char* value = nextValue();
+            if (!value)
+            {
+                return false;
+            }
+            options.profile   = true;
+            options.tracePath = value;
+        }
+        else if (arg == "--counters")
+        {
+            options.counters = true;
+        }
+        else if (arg == "--counters-interval")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseInt(value, options.countersInterval)
+                || options.countersInterval < 1)
+            {
+                std::cerr << "Invalid --counters-interval, expected a positive integer"
+                          << std::endl;
+                return false;
+            }
+            options.counters = true;
+        }
+        else if (arg == "--deterministic")
+        {
+            options.deterministic = true;
+        }
+        else if (arg == "--seed")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseInt(value, options.seed))
+            {
+                std::cerr << "Invalid --seed, expected an integer" << std::endl;
+                return false;
+            }
+            options.deterministic = true;
+        }
+        else if (arg == "--adaptive-substeps")
+        {
+            options.adaptiveSubsteps = true;
+        }
+        else if (arg == "--max-substeps")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseInt(value, options.maxSubsteps) || options.maxSubsteps < 1)
+            {
+                std::cerr << "Invalid --max-substeps, expected a positive integer" << std::endl;
+                return false;
+            }
+            options.adaptiveSubsteps = true;
+        }
+        else if (arg == "--sim-rate")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseInt(value, options.simulationRate) || options.simulationRate < 0)
+            {
+                std::cerr << "Invalid --sim-rate, expected a non-negative integer" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--present-mode")
+        {
+            const char* value = nextValue();
+            options.presentMode = value ? value : "";
+            if (options.presentMode != "fifo" && options.presentMode != "mailbox"
+                && options.presentMode != "immediate")
+            {
+                std::cerr << "Invalid --present-mode, expected fifo, mailbox or immediate"
+                          << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--no-idle")
+        {
+            options.idle = false;
+        }
+        else if (arg == "--idle-threshold")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseFloat(value, options.idleThreshold) || options.idleThreshold < 0.0f
+                || options.idleThreshold >= 1.0f)
+            {
+                std::cerr << "Invalid --idle-threshold, expected a number in [0, 1)" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--idle-interval")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseInt(value, options.idleInterval) || options.idleInterval < 1)
+            {
+                std::cerr << "Invalid --idle-interval, expected a positive integer" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--single-thread")
+        {
+            options.singleThread = true;
+        }
+        else if (arg == "--release-inactive")
+        {
+            options.releaseInactive = true;
+        }
+        else if (arg == "--record-camera")
+        {
+            const char* value = nextValue();
+            if (!value)
+            {
+                return false;
+            }
+            options.recordCamera = value;
+        }
+        else if (arg == "--replay-camera")
+        {
+            const char* value = nextValue();
+            if (!value)
+            {
+                return false;
+            }
+            options.replayCamera = value;
+        }
+        else if (arg == "--startup-report")
+        {
+            options.startupReport = true;
+        }
+        else if (arg == "--metrics-port")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseInt(value, options.metricsPort) || options.metricsPort < 0
+                || options.metricsPort > 65535)
+            {
+                std::cerr << "Invalid --metrics-port, expected a port number" << std::endl;
+                return false;
+            }
+            if (options.metricsPort > 0)
+            {
+                options.profile = true;
+            }
+        }
+        else if (arg == "--vram-budget-mb")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseInt(value, options.vramBudgetMB) || options.vramBudgetMB < 0)
+            {
+                std::cerr << "Invalid --vram-budget-mb, expected a non-negative integer"
+                          << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--shader-dir")
+        {
+            const char* value = nextValue();
+            if (!value || !*value)
+            {
+                std::cerr << "Invalid --shader-dir, expected a directory" << std::endl;
+                return false;
+            }
+            options.shaderDirectory = value;
+        }
+        else if (arg == "--pipeline-cache")
+        {
+            const char* value = nextValue();
+            if (!value || !*value)
+            {
+                std::cerr << "Invalid --pipeline-cache, expected a directory" << std::endl;
+                return false;
+            }
+            options.pipelineCache = value;
+        }
+        else if (arg == "--pipeline-cache-mb")
+        {
+            const char* value = nextValue();
+            if (!value || !ParseInt(value, options.pipelineCacheMB) || options.pipelineCacheMB <= 0)
+            {
+                std::cerr << "Invalid --pipeline-cache-mb, expected a positive integer"
+                          << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--no-pipeline-cache")
+        {
+            options.pipelineCache.clear();
+        }
+        else
+        {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (options.headless && options.frames == 0)
+    {
+        options.frames = DEFAULT_HEADLESS_FRAMES;
+    }
+
+    return true;
+}
+
+void ApplicationOptions::PrintUsage(const char* program)
+{
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --headless           Render offscreen without window, surface and GUI\n"
+              << "  --fallback-adapter   Use the fallback (CPU) adapter\n"
+              << "  --size WxH           Render target size (default 1024x768)\n"
+              << "  --frames N           Exit after N frames (headless default "
+              << DEFAULT_HEADLESS_FRAMES << ")\n"
+              << "  --profile            Measure the GPU time of every pass\n"
+              << "  --profile-csv FILE   Write per-frame GPU timings to FILE (implies --profile)\n"
+              << "  --trace FILE         Write a Chrome trace of CPU zones and GPU passes to FILE\n"
+              << "  --counters           Sample neighbor work and cell occupancy counters\n"
+              << "  --counters-interval N  Frames between counter samples (default 30)\n"
+              << "  --deterministic      Reproducible simulation, prints a particle checksum\n"
+              << "  --seed N             Seed of the deterministic mode (default 1)\n"
+              << "  --adaptive-substeps  Choose substeps per frame from particle and sound speeds\n"
+              << "  --max-substeps N     Substep budget of --adaptive-substeps (default 4)\n"
+              << "  --sim-rate HZ        Simulation steps per second, 0 = per frame (default 60)\n"
+              << "  --present-mode MODE  fifo, mailbox or immediate (default fifo)\n"
+              << "  --no-idle            Keep simulating and rendering at full rate once settled\n"
+              << "  --idle-threshold F   Settled below F times the peak energy (default 0.002)\n"
+              << "  --idle-interval N    Frames per simulation step once settled (default 15)\n"
+              << "  --single-thread      Poll input on the render thread\n"
+              << "  --release-inactive   Free the inactive simulation when switching\n"
+              << "  --record-camera FILE Write the camera orbit of every frame to FILE\n"
+              << "  --replay-camera FILE Drive the camera from a recorded FILE\n"
+              << "  --startup-report     Print the startup phases and exit after initialization\n"
+              << "  --metrics-port PORT  Serve Prometheus metrics on 127.0.0.1:PORT/metrics\n"
+              << "  --vram-budget-mb MB  Warn when GPU buffers and textures exceed MB\n"
+              << "  --shader-dir DIR     Read the WGSL shaders from DIR instead of the binary\n"
+              << "  --pipeline-cache DIR Compiled pipeline cache (default pipeline_cache)\n"
+              << "  --pipeline-cache-mb MB  Size cap of the pipeline cache (default 256)\n"
+              << "  --no-pipeline-cache  Compile every pipeline from scratch\n"
+              << "  --help               Show this message" << std::endl;
+}
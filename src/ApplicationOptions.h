@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+struct ApplicationOptions
+{
+    // Run without SDL window, surface and ImGui, rendering into an offscreen texture
+    bool headless = false;
+
+    // Request the fallback (CPU) adapter, e.g. SwiftShader on GPU-less machines
+    bool fallbackAdapter = false;
+
+    uint32_t width  = 1024;
+    uint32_t height = 768;
+
+    // Number of frames to run before exiting, 0 means until the window is closed
+    int frames = 0;
+
+    // Measure every compute and render pass with timestamp queries
+    bool profile = false;
+
+    // Write per-frame stage timings to this CSV file, implies profile
+    std::string profileCSV;
+
+    // Write a Chrome trace of CPU zones and GPU passes to this file, implies profile
+    std::string tracePath;
+
+    // Sample the algorithm counters (neighbor work, cell occupancy) every `countersInterval` frames
+    bool counters        = false;
+    int countersInterval = 30;
+
+    // Fixed random seed and a stable particle order inside SPH grid cells, so two runs produce
+    // bitwise identical particle state
+    bool deterministic = false;
+    int seed           = 1;
+
+    // Choose the substeps and dt of every frame from the maximum particle speed (CFL condition),
+    // keeping the simulated time per frame. At most `maxSubsteps` substeps per frame
+    bool adaptiveSubsteps = false;
+    int maxSubsteps       = 4;
+
+    // Simulation steps per second of wall time, rendering interpolates between the last two
+    // steps. 0 runs one step per displayed frame, which is always the case headless and in
+    // deterministic mode
+    int simulationRate = 60;
+
+    // Surface present mode: fifo, mailbox or immediate, unsupported modes fall back to fifo
+    std::string presentMode = "fifo";
+
+    // Once the kinetic energy stays below `idleThreshold` times its peak, step only every
+    // `idleInterval` frames and present the last frame again while nothing on screen changes.
+    // Never headless or in deterministic mode
+    bool idle           = true;
+    float idleThreshold = 0.002f;
+    int idleInterval    = 15;
+
+    // Handle input on the render thread instead of the main thread, always the case headless
+    bool singleThread = false;
+
+    // Destroy the simulator and renderer of a simulation when switching away from it, instead
+    // of keeping both resident
+    bool releaseInactive = false;
+
+    // Write the camera orbit of every frame to this CSV file
+    std::string recordCamera;
+
+    // Drive the camera from a file written with recordCamera, ignoring the mouse and keyboard
+    std::string replayCamera;
+
+    // Exit after Initialize, once the startup phases have been printed
+    bool startupReport = false;
+
+    // Serve Prometheus metrics on 127.0.0.1:metricsPort, 0 disables the endpoint. Implies profile
+    int metricsPort = 0;
+
+    // Warn when the registered buffers and textures exceed this many MB, 0 disables the check
+    int vramBudgetMB = 0;
+
+    // Development mode: read the WGSL shaders from this directory (in place of resources/shader)
+    // instead of the copies embedded at build time
+    std::string shaderDirectory;
+
+    // Keep Dawn's compiled shaders and pipelines in this directory across runs, evicting the
+    // least recently used entries above pipelineCacheMB. An empty path disables the cache
+    std::string pipelineCache = "pipeline_cache";
+    int pipelineCacheMB       = 256;
+
+    static constexpr int DEFAULT_HEADLESS_FRAMES = 600;
+
+    /**
+     * Parse command line arguments, returns false if the application should exit
+     */
+    static bool Parse(int argc, char* argv[], ApplicationOptions& options);
+
+    static void PrintUsage(const char* program);
+};
@@ -0,0 +1,98 @@
+#include "CameraPath.h"
+
+#include <cstdio>
+#include <iostream>
+
+#include "Application.h"
+
+bool CameraPath::OpenRecording(const std::string& path)
+{
+    mFile.open(path);
+    if (!mFile)
+    {
+        std::cerr << "Camera path: failed to open " << path << std::endl;
+        return false;
+    }
+    mFile << "simulation,xTheta,yTheta,distance,targetX,targetY,targetZ\n";
+    return true;
+}
+
+bool CameraPath::Load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cerr << "Camera path: failed to open " << path << std::endl;
+        return false;
+    }
+
+    mKeyframes.clear();
+    mReplayIndex = 0;
+
+    std::string line;
+    std::getline(file, line);  // header
+    while (std::getline(file, line))
+    {
+        char simulation[4] = {};
+        Keyframe keyframe {};
+        int read = std::sscanf(line.c_str(),
+                               "%3[a-z],%f,%f,%f,%f,%f,%f",
+                               simulation,
+                               &keyframe.xTheta,
+                               &keyframe.yTheta,
+                               &keyframe.distance,
+                               &keyframe.target.x,
+                               &keyframe.target.y,
+                               &keyframe.target.z);
+        if (read != 7)
+        {
+            continue;
+        }
+        keyframe.sph = std::string(simulation) == "sph";
+        mKeyframes.push_back(keyframe);
+    }
+
+    if (mKeyframes.empty())
+    {
+        std::cerr << "Camera path: no keyframes in " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void CameraPath::Record(const Camera& camera, bool sph)
+{
+    // 9 significant digits round-trip a float exactly
+    char line[160];
+    std::snprintf(line,
+                  sizeof(line),
+                  "%s,%.9g,%.9g,%.9g,%.9g,%.9g,%.9g\n",
+                  sph ? "sph" : "mpm",
+                  camera.currentXTheta,
+                  camera.currentYTheta,
+                  camera.currentDistance,
+                  camera.target.x,
+                  camera.target.y,
+                  camera.target.z);
+    mFile << line;
+}
+
+void CameraPath::Replay(Camera& camera, RenderUniforms& renderUniforms, bool sph)
+{
+    for (size_t i = 0; i < mKeyframes.size(); ++i)
+    {
+        const Keyframe& keyframe = mKeyframes[mReplayIndex];
+        mReplayIndex             = (mReplayIndex + 1) % mKeyframes.size();
+        if (keyframe.sph != sph)
+        {
+            continue;
+        }
+
+        camera.currentXTheta   = keyframe.xTheta;
+        camera.currentYTheta   = keyframe.yTheta;
+        camera.currentDistance = keyframe.distance;
+        camera.target          = keyframe.target;
+        camera.RecalculateView(renderUniforms);
+        return;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+
+struct RenderUniforms;
+
+/**
+ * Per-frame camera orbit parameters written to / read from a CSV file, so render benchmarks can
+ * follow identical trajectories. Every frame records the simulation it was taken in, frames of
+ * the other simulation are skipped on replay since their scales differ.
+ */
+class CameraPath
+{
+public:
+    struct Keyframe
+    {
+        bool sph;
+        float xTheta;
+        float yTheta;
+        float distance;
+        glm::vec3 target;
+    };
+
+    bool OpenRecording(const std::string& path);
+    bool Load(const std::string& path);
+
+    bool IsRecording() const
+    {
+        return mFile.is_open();
+    }
+
+    bool IsReplaying() const
+    {
+        return !mKeyframes.empty();
+    }
+
+    void Record(const Camera& camera, bool sph);
+
+    /**
+     * Drive the camera from the next keyframe of the simulation, the path loops at its end
+     */
+    void Replay(Camera& camera, RenderUniforms& renderUniforms, bool sph);
+
+    // Replay from the first keyframe, e.g. after a preset change
+    void Restart()
+    {
+        mReplayIndex = 0;
+    }
+
+private:
+    std::ofstream mFile;
+
+    std::vector<Keyframe> mKeyframes;
+    size_t mReplayIndex = 0;
+};
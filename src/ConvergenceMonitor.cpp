@@ -0,0 +1,197 @@
+#include "ConvergenceMonitor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "GPUMemory.h"
+#include "GPUProfiler.h"
+#include "PipelineBatch.h"
+#include "ResourceManager.h"
+#include "WebGPUUtils.h"
+
+ConvergenceMonitor::ConvergenceMonitor(wgpu::Device device,
+                                       const std::array<wgpu::Buffer, 2>& posvelBuffers,
+                                       uint32_t maxParticles,
+                                       const Settings& settings,
+                                       GPUProfiler* profiler) :
+    mDevice(device),
+    mSettings(settings),
+    mProfiler(profiler)
+{
+    uint32_t maxSums = (maxParticles + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+
+    wgpu::BufferDescriptor bufferDesc {
+        .label = WebGPUUtils::GenerateString("kinetic energy buffer"),
+        .usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc,
+        .size  = sizeof(float) * maxSums,
+    };
+
+    mSumsBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "ConvergenceMonitor", this);
+
+    bufferDesc.label = WebGPUUtils::GenerateString("kinetic energy params buffer");
+    bufferDesc.usage = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+    bufferDesc.size  = sizeof(Params);
+
+    mParamsBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "ConvergenceMonitor", this);
+
+    mReadback.Create(mDevice,
+                     sizeof(float) * maxSums,
+                     "kinetic energy readback buffer",
+                     "ConvergenceMonitor",
+                     this);
+
+    wgpu::ShaderModule module =
+        ResourceManager::LoadShaderModule("resources/shader/kineticEnergy.wgsl", mDevice);
+
+    std::vector<wgpu::BindGroupLayoutEntry> bindingLayoutEntries(3);
+    const wgpu::BufferBindingType types[] = {wgpu::BufferBindingType::ReadOnlyStorage,
+                                             wgpu::BufferBindingType::Storage,
+                                             wgpu::BufferBindingType::Uniform};
+    for (uint32_t i = 0; i < bindingLayoutEntries.size(); ++i)
+    {
+        wgpu::BindGroupLayoutEntry& bindingLayout = bindingLayoutEntries[i];
+        WebGPUUtils::SetDefaultBindGroupLayout(bindingLayout);
+        bindingLayout.binding     = i;
+        bindingLayout.visibility  = wgpu::ShaderStage::Compute;
+        bindingLayout.buffer.type = types[i];
+    }
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEntries.data();
+    wgpu::BindGroupLayout bindGroupLayout = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = &bindGroupLayout;
+    wgpu::PipelineLayout layout     = mDevice.CreatePipelineLayout(&layoutDesc);
+
+    wgpu::ComputePipelineDescriptor computePipelineDesc {
+        .label  = WebGPUUtils::GenerateString("kinetic energy pipeline"),
+        .layout = layout,
+        .compute =
+            {
+                .module     = module,
+                .entryPoint = "kineticEnergy",
+            },
+    };
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mPipeline);
+
+    for (uint32_t index = 0; index < 2; ++index)
+    {
+        std::vector<wgpu::BindGroupEntry> bindings(3);
+        const wgpu::Buffer buffers[] = {posvelBuffers[index], mSumsBuffer, mParamsBuffer};
+        for (uint32_t i = 0; i < bindings.size(); ++i)
+        {
+            bindings[i].binding = i;
+            bindings[i].buffer  = buffers[i];
+            bindings[i].offset  = 0;
+            bindings[i].size    = buffers[i].GetSize();
+        }
+
+        wgpu::BindGroupDescriptor bindGroupDesc {
+            .label      = WebGPUUtils::GenerateString("kinetic energy bind group"),
+            .layout     = bindGroupLayout,
+            .entryCount = static_cast<uint32_t>(bindings.size()),
+            .entries    = bindings.data(),
+        };
+        mBindGroups[index] = mDevice.CreateBindGroup(&bindGroupDesc);
+    }
+}
+
+ConvergenceMonitor::~ConvergenceMonitor()
+{
+    GPUMemory::Release(this);
+}
+
+void ConvergenceMonitor::Wake(bool restart)
+{
+    ++mGeneration;
+    mConverged        = false;
+    mSamplesBelow     = 0;
+    mStepsSinceSample = 0;
+    if (restart)
+    {
+        mEnergy = 0.0;
+        mPeak   = 0.0;
+    }
+}
+
+void ConvergenceMonitor::Record(wgpu::CommandEncoder& commandEncoder,
+                                uint32_t posvelIndex,
+                                uint32_t numParticles)
+{
+    if (++mStepsSinceSample < (mConverged ? 1 : mSettings.sampleInterval) || numParticles == 0)
+    {
+        return;
+    }
+
+    Readback::Slot* slot = mReadback.Acquire();
+    if (!slot)
+    {
+        return;
+    }
+    mStepsSinceSample = 0;
+
+    if (numParticles != mNumParticles)
+    {
+        Params params {.n = numParticles};
+        mDevice.GetQueue().WriteBuffer(mParamsBuffer, 0, &params, sizeof(Params));
+        mNumParticles = numParticles;
+    }
+
+    uint32_t sumCount = (numParticles + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+
+    ProfiledComputePass computePass(commandEncoder, mProfiler);
+    wgpu::ComputePassEncoder& pass = computePass.Stage("Kinetic energy");
+    pass.SetBindGroup(0, mBindGroups[posvelIndex], 0, nullptr);
+    pass.SetPipeline(mPipeline);
+    pass.DispatchWorkgroups(sumCount);
+    computePass.End();
+
+    slot->info = {.generation = mGeneration, .sumCount = sumCount, .numParticles = numParticles};
+    mCurrentSlot = slot;
+    commandEncoder.CopyBufferToBuffer(mSumsBuffer, 0, slot->buffer, 0, sizeof(float) * sumCount);
+}
+
+void ConvergenceMonitor::EndFrame()
+{
+    if (!mCurrentSlot)
+    {
+        return;
+    }
+
+    mReadback.Map(*mCurrentSlot,
+                  sizeof(float) * mCurrentSlot->info.sumCount,
+                  [this](const Readback::Slot& slot, const void* data)
+                  {
+                      if (slot.info.generation == mGeneration)
+                      {
+                          Update(slot.info, static_cast<const float*>(data));
+                      }
+                  });
+    mCurrentSlot = nullptr;
+}
+
+void ConvergenceMonitor::Update(const ReadbackInfo& info, const float* sums)
+{
+    double total = 0.0;
+    for (uint32_t i = 0; i < info.sumCount; ++i)
+    {
+        total += sums[i];
+    }
+
+    // A NaN never counts as settled
+    mEnergy = total / info.numParticles;
+    mPeak   = std::max(mPeak, mEnergy);
+    if (mEnergy < mSettings.threshold * mPeak)
+    {
+        ++mSamplesBelow;
+    }
+    else
+    {
+        mSamplesBelow = 0;
+    }
+    mConverged = mSamplesBelow >= mSettings.holdSamples;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <array>
+#include <cstdint>
+
+#include "ReadbackRing.h"
+
+class GPUProfiler;
+
+/**
+ * Detects a settled simulation. Every few steps a reduction sums the kinetic energy of the
+ * particles into one value per workgroup, which is read back asynchronously and summed on the
+ * CPU. The simulation counts as converged once the energy stayed below `threshold` times its peak
+ * since the last restart for `holdSamples` samples in a row.
+ *
+ * The energy is compared with its own peak, so one threshold fits both simulations whatever
+ * their units.
+ */
+class ConvergenceMonitor
+{
+public:
+    struct Settings
+    {
+        float threshold;
+        int holdSamples;
+        int sampleInterval;  // steps between samples
+    };
+
+    ConvergenceMonitor(wgpu::Device device,
+                       const std::array<wgpu::Buffer, 2>& posvelBuffers,
+                       uint32_t maxParticles,
+                       const Settings& settings,
+                       GPUProfiler* profiler);
+    ~ConvergenceMonitor();
+
+    bool IsConverged() const
+    {
+        return mConverged;
+    }
+
+    // Leave the converged state, `restart` also forgets the peak, e.g. after a reset
+    void Wake(bool restart);
+
+    /**
+     * Sum the energy in posvelBuffers[posvelIndex] if a sample is due, record after the steps.
+     * Converged, every call samples so a rising energy is noticed within one step
+     */
+    void Record(wgpu::CommandEncoder& commandEncoder, uint32_t posvelIndex, uint32_t numParticles);
+
+    // Start the readback, call after the frame has been submitted
+    void EndFrame();
+
+    // Latest kinetic energy per particle read back, 0 until the first readback
+    double GetEnergy() const
+    {
+        return mEnergy;
+    }
+
+private:
+    struct ReadbackInfo
+    {
+        uint64_t generation   = 0;
+        uint32_t sumCount     = 0;
+        uint32_t numParticles = 0;
+    };
+
+    using Readback = ReadbackRing<ReadbackInfo, 3>;
+
+    struct Params
+    {
+        uint32_t n;
+    };
+
+    void Update(const ReadbackInfo& info, const float* sums);
+
+private:
+    static constexpr uint32_t WORKGROUP_SIZE = 256;
+
+    wgpu::Device mDevice;
+    Settings mSettings;
+    GPUProfiler* mProfiler;
+
+    wgpu::Buffer mSumsBuffer;
+    wgpu::Buffer mParamsBuffer;
+    wgpu::ComputePipeline mPipeline;
+    wgpu::BindGroup mBindGroups[2];  // one per posvel buffer
+    Readback mReadback;
+
+    Readback::Slot* mCurrentSlot = nullptr;
+    uint32_t mNumParticles       = UINT32_MAX;
+    int mStepsSinceSample        = 0;
+
+    // Samples recorded before a wake are dropped
+    uint64_t mGeneration = 0;
+
+    double mEnergy    = 0.0;
+    double mPeak      = 0.0;
+    int mSamplesBelow = 0;
+    bool mConverged   = false;
+};
@@ -0,0 +1,15 @@
+#include "EmbeddedShaders.h"
+
+#include <algorithm>
+
+const EmbeddedShaders::Shader* EmbeddedShaders::Find(std::string_view path)
+{
+    std::span<const Shader> shaders = GetShaders();
+
+    auto it = std::lower_bound(shaders.begin(),
+                               shaders.end(),
+                               path,
+                               [](const Shader& shader, std::string_view path)
+                               { return shader.path < path; });
+    return it != shaders.end() && it->path == path ? &*it : nullptr;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <span>
+#include <string_view>
+
+/**
+ * WGSL sources compiled into the executable at build time by cmake/EmbedShaders.cmake, so loading
+ * a shader needs no file I/O.
+ */
+namespace EmbeddedShaders
+{
+    struct Shader
+    {
+        std::string_view path;    // relative to the project root, e.g. resources/shader/sph/a.wgsl
+        std::string_view source;  // null-terminated
+    };
+
+    // Sorted by path, defined in the generated source
+    std::span<const Shader> GetShaders();
+
+    // Null if no shader was embedded under `path`
+    const Shader* Find(std::string_view path);
+}  // namespace EmbeddedShaders
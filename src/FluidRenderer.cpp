@@ -1,14 +1,32 @@
 #include "FluidRenderer.h"
 
 #include <imgui.h>
-#include <imgui_impl_sdl3.h>
 #include <imgui_impl_wgpu.h>
 #include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <bit>
 
 #include "Application.h"
 #include "WebGPUUtils.h"
+#include "GPUMemory.h"
+#include "PipelineBatch.h"
 #include "ResourceManager.h"
 #include "sph/SPHSimulator.h"
+#include "GPUProfiler.h"
+#include "TexturePool.h"
+#include "Trace.h"
+
+namespace
+{
+    const char* CUBEMAP_PATHS[] = {"resources/texture/cubemap/posx.png",
+                                   "resources/texture/cubemap/negx.png",
+                                   "resources/texture/cubemap/posy.png",
+                                   "resources/texture/cubemap/negy.png",
+                                   "resources/texture/cubemap/posz.png",
+                                   "resources/texture/cubemap/negz.png"};
+}  // namespace
 
 FluidRenderer::FluidRenderer(wgpu::Device device,
                              const glm::vec2& screenSize,
@@ -16,7 +34,13 @@ FluidRenderer::FluidRenderer(wgpu::Device device,
                              float radius,
                              float fov,
                              wgpu::Buffer renderUniformBuffer,
-                             wgpu::Buffer posvelBuffer) : mDevice(device)
+                             const std::array<wgpu::Buffer, 2>& posvelBuffers,
+                             TexturePool* texturePool) :
+    mDevice(device),
+    mTexturePool(texturePool),
+    mRenderUniformBuffer(renderUniformBuffer),
+    mScreenSize(screenSize),
+    mPresentationFormat(presentationFormat)
 {
     // buffer & uniform
     float bluredDepthScale = 10.0f;
@@ -40,33 +64,144 @@ FluidRenderer::FluidRenderer(wgpu::Device device,
     InitializeFluidPipelines(presentationFormat, vertexModule);
     InitializeSpherePipelines(presentationFormat);
 
-    // textures
-    CreateTextures(screenSize);
+    // textures, the intermediate ones are leased from the pool once the graph is compiled
+    wgpu::SamplerDescriptor samplerDesc;
+    samplerDesc.magFilter = wgpu::FilterMode::Linear;
+    samplerDesc.minFilter = wgpu::FilterMode::Linear;
+    mFluidSampler         = mDevice.CreateSampler(&samplerDesc);
+
+    wgpu::Texture envmapTexture =
+        ResourceManager::LoadCubemapTexture(CUBEMAP_PATHS, mDevice, &mEnvmapTextureView);
+    GPUMemory::RecordTexture(envmapTexture, "envmap cubemap texture", "FluidRenderer", this);
+
+    CreateDrawArgsBuffer();
 
-    // bind group
-    InitializeDepthMapBindGroups(renderUniformBuffer, posvelBuffer);
-    InitializeDepthFilterBindGroups(renderUniformBuffer);
-    InitializeThicknessMapBindGroups(renderUniformBuffer, posvelBuffer);
-    InitializeThicknessFilterBindGroups(renderUniformBuffer);
-    InitializeFluidBindGroups(renderUniformBuffer);
-    InitializeSphereBindGroups(renderUniformBuffer, posvelBuffer);
+    // bind group, the ones sampling intermediate textures are created in CompileGraph
+    InitializeDepthMapBindGroups(renderUniformBuffer, posvelBuffers);
+    InitializeThicknessMapBindGroups(renderUniformBuffer, posvelBuffers);
+    InitializeSphereBindGroups(renderUniformBuffer, posvelBuffers);
+}
+
+FluidRenderer::~FluidRenderer()
+{
+    mTexturePool->Release(this);
+    GPUMemory::Release(this);
+}
+
+uint64_t FluidRenderer::EstimateMemory()
+{
+    // The environment cubemap, read from the image headers. The intermediate textures come from
+    // the pool, which every renderer shares
+    int width = 0, height = 0, channels = 0;
+    if (!stbi_info(CUBEMAP_PATHS[0], &width, &height, &channels))
+    {
+        return 0;
+    }
+
+    wgpu::TextureDescriptor textureDesc {};
+    textureDesc.size   = {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 6};
+    textureDesc.format = wgpu::TextureFormat::RGBA8Unorm;
+    textureDesc.mipLevelCount =
+        std::bit_width(std::max(textureDesc.size.width, textureDesc.size.height));
+    return GPUMemory::GetTextureSize(textureDesc);
 }
 
 void FluidRenderer::Draw(wgpu::CommandEncoder& commandEncoder,
                          wgpu::TextureView targetView,
                          SimulationVariables& simulationVariables)
 {
-    if (simulationVariables.drawSpheres)
+    TRACE_SCOPE("FluidRenderer::Draw");
+
+    if (!mGraphBuilt || simulationVariables.drawSpheres != mGraphDrawSpheres)
+    {
+        BuildGraph(simulationVariables.drawSpheres);
+        CompileGraph();
+    }
+    if (mBundlesDirty)
+    {
+        RecordBundles();
+    }
+    UpdateDrawArgs(simulationVariables.numParticles);
+
+    mGraph.SetView(mTarget, targetView);
+    mSimulationVariables = &simulationVariables;
+    mGraph.Execute(commandEncoder);
+    mSimulationVariables = nullptr;
+}
+
+void FluidRenderer::BuildGraph(bool drawSpheres)
+{
+    uint32_t width  = static_cast<uint32_t>(mScreenSize.x);
+    uint32_t height = static_cast<uint32_t>(mScreenSize.y);
+
+    const wgpu::TextureFormat r32   = wgpu::TextureFormat::R32Float;
+    const wgpu::TextureFormat r16   = wgpu::TextureFormat::R16Float;
+    const wgpu::TextureFormat depth = wgpu::TextureFormat::Depth32Float;
+
+    mGraph.Reset();
+    mTarget          = mGraph.ImportOutput("target");
+    mDepthMap        = mGraph.CreateTexture("depth map", r32, width, height);
+    mTmpDepthMap     = mGraph.CreateTexture("tmp depth map", r32, width, height);
+    mDepthTest       = mGraph.CreateTexture("depth test", depth, width, height);
+    mThicknessMap    = mGraph.CreateTexture("thickness map", r16, width, height);
+    mTmpThicknessMap = mGraph.CreateTexture("tmp thickness map", r16, width, height);
+    mSceneDepth      = mGraph.CreateTexture("scene depth", depth, width, height);
+
+    // The filters ping-pong between the map and its tmp texture, ending on the map
+    mGraph.AddPass("depth map",
+                   {},
+                   {mDepthMap, mDepthTest},
+                   [this](wgpu::CommandEncoder& encoder) { DrawDepthMap(encoder); });
+    mGraph.AddPass("depth filter",
+                   {mDepthMap},
+                   {mTmpDepthMap, mDepthMap},
+                   [this](wgpu::CommandEncoder& encoder) { DrawDepthFilter(encoder); });
+    mGraph.AddPass("thickness map",
+                   {},
+                   {mThicknessMap},
+                   [this](wgpu::CommandEncoder& encoder) { DrawThicknessMap(encoder); });
+    mGraph.AddPass("thickness filter",
+                   {mThicknessMap},
+                   {mTmpThicknessMap, mThicknessMap},
+                   [this](wgpu::CommandEncoder& encoder) { DrawThicknessFilter(encoder); });
+
+    // Nothing reads the fluid maps in sphere mode, which culls their passes
+    if (drawSpheres)
     {
-        DrawSphere(commandEncoder, targetView, simulationVariables);
-        return;
+        mGraph.AddPass("sphere",
+                       {},
+                       {mTarget, mSceneDepth},
+                       [this](wgpu::CommandEncoder& encoder) { DrawSphere(encoder); });
     }
+    else
+    {
+        mGraph.AddPass("fluid",
+                       {mDepthMap, mThicknessMap},
+                       {mTarget, mSceneDepth},
+                       [this](wgpu::CommandEncoder& encoder) { DrawFluid(encoder); });
+    }
+
+    mGraphBuilt       = true;
+    mGraphDrawSpheres = drawSpheres;
+}
+
+void FluidRenderer::CompileGraph()
+{
+    TRACE_SCOPE("FluidRenderer::CompileGraph");
 
-    DrawDepthMap(commandEncoder, simulationVariables.numParticles);
-    DrawDepthFilter(commandEncoder);
-    DrawThicknessMap(commandEncoder, simulationVariables.numParticles);
-    DrawThicknessFilter(commandEncoder);
-    DrawFluid(commandEncoder, targetView, simulationVariables);
+    mGraph.Compile(*mTexturePool, this);
+
+    InitializeDepthFilterBindGroups();
+    InitializeThicknessFilterBindGroups();
+    InitializeFluidBindGroups();
+    mBundlesDirty = true;
+}
+
+void FluidRenderer::ReleaseTransientTextures()
+{
+    mTexturePool->Release(this);
+    mGraph.Reset();
+    mGraphBuilt = false;
 }
 
 void FluidRenderer::InitializeFluidPipelines(wgpu::TextureFormat presentationFormat,
@@ -166,44 +301,36 @@ void FluidRenderer::InitializeFluidPipelines(wgpu::TextureFormat presentationFor
 
     renderPipelineDesc.fragment = &fragmentState;
 
-    mFluidPipeline = mDevice.CreateRenderPipeline(&renderPipelineDesc);
+    PipelineBatch::CreateRenderPipeline(mDevice, renderPipelineDesc, mFluidPipeline);
 }
 
-void FluidRenderer::InitializeFluidBindGroups(wgpu::Buffer renderUniformBuffer)
+void FluidRenderer::InitializeFluidBindGroups()
 {
-    // Create a sampler
-    wgpu::SamplerDescriptor samplerDesc;
-    samplerDesc.magFilter = wgpu::FilterMode::Linear;
-    samplerDesc.minFilter = wgpu::FilterMode::Linear;
-    wgpu::Sampler sampler = mDevice.CreateSampler(&samplerDesc);
-
-    wgpu::TextureView envmapTextureView {};
-    const char* cubemapPaths[] = {"resources/texture/cubemap/posx.png",
-                                  "resources/texture/cubemap/negx.png",
-                                  "resources/texture/cubemap/posy.png",
-                                  "resources/texture/cubemap/negy.png",
-                                  "resources/texture/cubemap/posz.png",
-                                  "resources/texture/cubemap/negz.png"};
-    ResourceManager::LoadCubemapTexture(cubemapPaths, mDevice, &envmapTextureView);
+    // Culled in sphere mode
+    mFluidBindGroup = nullptr;
+    if (!mGraph.GetView(mDepthMap) || !mGraph.GetView(mThicknessMap))
+    {
+        return;
+    }
 
     std::vector<wgpu::BindGroupEntry> bindings(5);
 
     bindings[0].binding = 0;
-    bindings[0].buffer  = renderUniformBuffer;
+    bindings[0].buffer  = mRenderUniformBuffer;
     bindings[0].offset  = 0;
     bindings[0].size    = sizeof(RenderUniforms);
 
     bindings[1].binding     = 1;
-    bindings[1].textureView = mDepthMapTextureView;
+    bindings[1].textureView = mGraph.GetView(mDepthMap);
 
     bindings[2].binding = 2;
-    bindings[2].sampler = sampler;
+    bindings[2].sampler = mFluidSampler;
 
     bindings[3].binding     = 3;
-    bindings[3].textureView = mThicknessMapTextureView;
+    bindings[3].textureView = mGraph.GetView(mThicknessMap);
 
     bindings[4].binding     = 4;
-    bindings[4].textureView = envmapTextureView;
+    bindings[4].textureView = mEnvmapTextureView;
 
     wgpu::BindGroupDescriptor fluidBindGroupDesc {
         .label      = WebGPUUtils::GenerateString("fluid bind group"),
@@ -214,13 +341,13 @@ void FluidRenderer::InitializeFluidBindGroups(wgpu::Buffer renderUniformBuffer)
     mFluidBindGroup = mDevice.CreateBindGroup(&fluidBindGroupDesc);
 }
 
-void FluidRenderer::DrawFluid(wgpu::CommandEncoder& commandEncoder,
-                              wgpu::TextureView targetView,
-                              SimulationVariables& simulationVariables)
+void FluidRenderer::DrawFluid(wgpu::CommandEncoder& commandEncoder)
 {
+    TRACE_SCOPE("FluidRenderer::DrawFluid");
+
     // The attachment part of the render pass descriptor describes the target texture of the pass
     wgpu::RenderPassColorAttachment renderPassColorAttachment {
-        .view          = targetView,
+        .view          = mGraph.GetView(mTarget),
         .depthSlice    = WGPU_DEPTH_SLICE_UNDEFINED,
         .resolveTarget = nullptr,
         .loadOp        = wgpu::LoadOp::Clear,
@@ -229,7 +356,7 @@ void FluidRenderer::DrawFluid(wgpu::CommandEncoder& commandEncoder,
     };
 
     wgpu::RenderPassDepthStencilAttachment depthStencilAttachment {
-        .view            = mDepthTestTextureView,
+        .view            = mGraph.GetView(mSceneDepth),
         .depthLoadOp     = wgpu::LoadOp::Clear,
         .depthStoreOp    = wgpu::StoreOp::Store,
         .depthClearValue = 1.0f,
@@ -242,18 +369,15 @@ void FluidRenderer::DrawFluid(wgpu::CommandEncoder& commandEncoder,
         .colorAttachmentCount   = 1,
         .colorAttachments       = &renderPassColorAttachment,
         .depthStencilAttachment = &depthStencilAttachment,
-        .timestampWrites        = nullptr,
+        .timestampWrites        = TimestampWrites("fluid"),
     };
 
     // Create the render pass and end it immediately (we only clear the screen but do not draw anything)
     wgpu::RenderPassEncoder renderPass = commandEncoder.BeginRenderPass(&renderPassDesc);
 
-    // Select which render pipeline to use
-    renderPass.SetPipeline(mFluidPipeline);
-    renderPass.SetBindGroup(0, mFluidBindGroup, 0, nullptr);
-    renderPass.Draw(6, 1, 0, 0);
+    renderPass.ExecuteBundles(1, &mFluidBundle);
 
-    UpdateGUI(renderPass, simulationVariables);
+    UpdateGUI(renderPass, *mSimulationVariables);
 
     renderPass.End();
 }
@@ -269,14 +393,14 @@ void FluidRenderer::CreateDepthFilterUniform(float depthThreshold,
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
     bufferDesc.mappedAtCreation = false;
 
-    mFilterXUniformBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mFilterXUniformBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "FluidRenderer", this);
 
     bufferDesc.label            = WebGPUUtils::GenerateString("filter Y unioform buffer");
     bufferDesc.size             = sizeof(FilterUniform);
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
     bufferDesc.mappedAtCreation = false;
 
-    mFilterYUniformBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mFilterYUniformBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "FluidRenderer", this);
 
     // setupt uniform
     mFilterXUniform.blurDir                   = glm::vec2(1.0f, 0.0f);
@@ -367,16 +491,24 @@ void FluidRenderer::InitializeDepthFilterPipeline(wgpu::ShaderModule vertexModul
 
     renderPipelineDesc.fragment = &fragmentState;
 
-    mDepthFilterPipeline = mDevice.CreateRenderPipeline(&renderPipelineDesc);
+    PipelineBatch::CreateRenderPipeline(mDevice, renderPipelineDesc, mDepthFilterPipeline);
 }
 
-void FluidRenderer::InitializeDepthFilterBindGroups(wgpu::Buffer renderUniformBuffer)
+void FluidRenderer::InitializeDepthFilterBindGroups()
 {
+    // Culled in sphere mode
+    mDepthFilterBindGroups[0] = nullptr;
+    mDepthFilterBindGroups[1] = nullptr;
+    if (!mGraph.GetView(mDepthMap))
+    {
+        return;
+    }
+
     std::vector<wgpu::BindGroupEntry> bindings(3);
 
     // filter X
     bindings[0].binding = 0;
-    bindings[0].buffer  = renderUniformBuffer;
+    bindings[0].buffer  = mRenderUniformBuffer;
     bindings[0].offset  = 0;
     bindings[0].size    = sizeof(RenderUniforms);
 
@@ -386,7 +518,7 @@ void FluidRenderer::InitializeDepthFilterBindGroups(wgpu::Buffer renderUniformBu
     bindings[1].size    = sizeof(FilterUniform);
 
     bindings[2].binding     = 2;
-    bindings[2].textureView = mDepthMapTextureView;
+    bindings[2].textureView = mGraph.GetView(mDepthMap);
 
     wgpu::BindGroupDescriptor bindGroupDesc {};
     bindGroupDesc.label       = WebGPUUtils::GenerateString("depth filterX bind group");
@@ -400,7 +532,7 @@ void FluidRenderer::InitializeDepthFilterBindGroups(wgpu::Buffer renderUniformBu
 
     // filter Y
     bindings[0].binding = 0;
-    bindings[0].buffer  = renderUniformBuffer;
+    bindings[0].buffer  = mRenderUniformBuffer;
     bindings[0].offset  = 0;
     bindings[0].size    = sizeof(RenderUniforms);
 
@@ -410,7 +542,7 @@ void FluidRenderer::InitializeDepthFilterBindGroups(wgpu::Buffer renderUniformBu
     bindings[1].size    = sizeof(FilterUniform);
 
     bindings[2].binding     = 2;
-    bindings[2].textureView = mTmpDepthMapTextureView;
+    bindings[2].textureView = mGraph.GetView(mTmpDepthMap);
 
     bindGroupDesc.label       = WebGPUUtils::GenerateString("depth filterY bind group");
     bindGroupDesc.layout      = mDepthFilterBindGroupLayout;
@@ -421,10 +553,12 @@ void FluidRenderer::InitializeDepthFilterBindGroups(wgpu::Buffer renderUniformBu
 
 void FluidRenderer::DrawDepthFilter(wgpu::CommandEncoder& commandEncoder)
 {
+    TRACE_SCOPE("FluidRenderer::DrawDepthFilter");
+
     // filter X
     wgpu::RenderPassColorAttachment renderPassColorAttachmentX {
         .nextInChain   = nullptr,
-        .view          = mTmpDepthMapTextureView,
+        .view          = mGraph.GetView(mTmpDepthMap),
         .depthSlice    = WGPU_DEPTH_SLICE_UNDEFINED,
         .resolveTarget = nullptr,
         .loadOp        = wgpu::LoadOp::Clear,
@@ -444,7 +578,7 @@ void FluidRenderer::DrawDepthFilter(wgpu::CommandEncoder& commandEncoder)
     // filter Y
     wgpu::RenderPassColorAttachment renderPassColorAttachmentY {
         .nextInChain   = nullptr,
-        .view          = mDepthMapTextureView,
+        .view          = mGraph.GetView(mDepthMap),
         .depthSlice    = WGPU_DEPTH_SLICE_UNDEFINED,
         .resolveTarget = nullptr,
         .loadOp        = wgpu::LoadOp::Clear,
@@ -463,16 +597,14 @@ void FluidRenderer::DrawDepthFilter(wgpu::CommandEncoder& commandEncoder)
 
     for (int i = 0; i < 4; ++i)
     {
+        renderPassDescriptorX.timestampWrites = TimestampWrites("depth filter");
         auto depthFilterPassEncoderX = commandEncoder.BeginRenderPass(&renderPassDescriptorX);
-        depthFilterPassEncoderX.SetBindGroup(0, mDepthFilterBindGroups[0], 0, nullptr);
-        depthFilterPassEncoderX.SetPipeline(mDepthFilterPipeline);
-        depthFilterPassEncoderX.Draw(6, 1, 0, 0);
+        depthFilterPassEncoderX.ExecuteBundles(1, &mDepthFilterBundles[0]);
         depthFilterPassEncoderX.End();
 
+        renderPassDescriptorY.timestampWrites = TimestampWrites("depth filter");
         auto depthFilterPassEncoderY = commandEncoder.BeginRenderPass(&renderPassDescriptorY);
-        depthFilterPassEncoderY.SetBindGroup(0, mDepthFilterBindGroups[1], 0, nullptr);
-        depthFilterPassEncoderY.SetPipeline(mDepthFilterPipeline);
-        depthFilterPassEncoderY.Draw(6, 1, 0, 0);
+        depthFilterPassEncoderY.ExecuteBundles(1, &mDepthFilterBundles[1]);
         depthFilterPassEncoderY.End();
     }
 }
@@ -559,37 +691,42 @@ void FluidRenderer::InitializeThicknessMapPipeline()
 
     renderPipelineDesc.fragment = &fragmentState;
 
-    mThicknessMapPipeline = mDevice.CreateRenderPipeline(&renderPipelineDesc);
+    PipelineBatch::CreateRenderPipeline(mDevice, renderPipelineDesc, mThicknessMapPipeline);
 }
 
-void FluidRenderer::InitializeThicknessMapBindGroups(wgpu::Buffer renderUniformBuffer,
-                                                     wgpu::Buffer posvelBuffer)
+void FluidRenderer::InitializeThicknessMapBindGroups(
+    wgpu::Buffer renderUniformBuffer, const std::array<wgpu::Buffer, 2>& posvelBuffers)
 {
-    std::vector<wgpu::BindGroupEntry> bindings(2);
-
-    bindings[0].binding = 0;
-    bindings[0].buffer  = renderUniformBuffer;
-    bindings[0].offset  = 0;
-    bindings[0].size    = sizeof(RenderUniforms);
-
-    bindings[1].binding = 1;
-    bindings[1].buffer  = posvelBuffer;
-    bindings[1].offset  = 0;
-    bindings[1].size    = posvelBuffer.GetSize();
-
-    wgpu::BindGroupDescriptor bindGroupDesc {
-        .label      = WebGPUUtils::GenerateString("fluid bind group"),
-        .layout     = mThicknessMapBindGroupLayout,
-        .entryCount = static_cast<uint32_t>(bindings.size()),
-        .entries    = bindings.data(),
-    };
-    mThicknessMapBindGroup = mDevice.CreateBindGroup(&bindGroupDesc);
+    for (uint32_t index = 0; index < 2; ++index)
+    {
+        std::vector<wgpu::BindGroupEntry> bindings(2);
+
+        bindings[0].binding = 0;
+        bindings[0].buffer  = renderUniformBuffer;
+        bindings[0].offset  = 0;
+        bindings[0].size    = sizeof(RenderUniforms);
+
+        bindings[1].binding = 1;
+        bindings[1].buffer  = posvelBuffers[index];
+        bindings[1].offset  = 0;
+        bindings[1].size    = posvelBuffers[index].GetSize();
+
+        wgpu::BindGroupDescriptor bindGroupDesc {
+            .label      = WebGPUUtils::GenerateString("fluid bind group"),
+            .layout     = mThicknessMapBindGroupLayout,
+            .entryCount = static_cast<uint32_t>(bindings.size()),
+            .entries    = bindings.data(),
+        };
+        mThicknessMapBindGroups[index] = mDevice.CreateBindGroup(&bindGroupDesc);
+    }
 }
 
-void FluidRenderer::DrawThicknessMap(wgpu::CommandEncoder& commandEncoder, uint32_t numParticles)
+void FluidRenderer::DrawThicknessMap(wgpu::CommandEncoder& commandEncoder)
 {
+    TRACE_SCOPE("FluidRenderer::DrawThicknessMap");
+
     wgpu::RenderPassColorAttachment renderPassColorAttachment {
-        .view          = mThicknessMapTextureView,
+        .view          = mGraph.GetView(mThicknessMap),
         .depthSlice    = WGPU_DEPTH_SLICE_UNDEFINED,
         .resolveTarget = nullptr,
         .loadOp        = wgpu::LoadOp::Clear,
@@ -604,16 +741,13 @@ void FluidRenderer::DrawThicknessMap(wgpu::CommandEncoder& commandEncoder, uint3
         .colorAttachmentCount   = 1,
         .colorAttachments       = &renderPassColorAttachment,
         .depthStencilAttachment = nullptr,
-        .timestampWrites        = nullptr,
+        .timestampWrites        = TimestampWrites("thickness map"),
     };
 
     // Create the render pass and end it immediately (we only clear the screen but do not draw anything)
     wgpu::RenderPassEncoder renderPass = commandEncoder.BeginRenderPass(&renderPassDesc);
 
-    // Select which render pipeline to use
-    renderPass.SetPipeline(mThicknessMapPipeline);
-    renderPass.SetBindGroup(0, mThicknessMapBindGroup, 0, nullptr);
-    renderPass.Draw(6, numParticles, 0, 0);
+    renderPass.ExecuteBundles(1, &mThicknessMapBundles[mPosvelIndex]);
 
     renderPass.End();
 }
@@ -690,16 +824,24 @@ void FluidRenderer::InitializeThicknessFilterPipeline(wgpu::ShaderModule vertexM
 
     renderPipelineDesc.fragment = &fragmentState;
 
-    mThicknessFilterPipeline = mDevice.CreateRenderPipeline(&renderPipelineDesc);
+    PipelineBatch::CreateRenderPipeline(mDevice, renderPipelineDesc, mThicknessFilterPipeline);
 }
 
-void FluidRenderer::InitializeThicknessFilterBindGroups(wgpu::Buffer renderUniformBuffer)
+void FluidRenderer::InitializeThicknessFilterBindGroups()
 {
+    // Culled in sphere mode
+    mThicknessFilterBindGroups[0] = nullptr;
+    mThicknessFilterBindGroups[1] = nullptr;
+    if (!mGraph.GetView(mThicknessMap))
+    {
+        return;
+    }
+
     std::vector<wgpu::BindGroupEntry> bindings(3);
 
     // filter X
     bindings[0].binding = 0;
-    bindings[0].buffer  = renderUniformBuffer;
+    bindings[0].buffer  = mRenderUniformBuffer;
     bindings[0].offset  = 0;
     bindings[0].size    = sizeof(RenderUniforms);
 
@@ -709,7 +851,7 @@ void FluidRenderer::InitializeThicknessFilterBindGroups(wgpu::Buffer renderUnifo
     bindings[1].size    = sizeof(FilterUniform);
 
     bindings[2].binding     = 2;
-    bindings[2].textureView = mThicknessMapTextureView;
+    bindings[2].textureView = mGraph.GetView(mThicknessMap);
 
     wgpu::BindGroupDescriptor bindGroupDesc {};
     bindGroupDesc.label           = WebGPUUtils::GenerateString("depth filterX bind group");
@@ -723,7 +865,7 @@ void FluidRenderer::InitializeThicknessFilterBindGroups(wgpu::Buffer renderUnifo
 
     // filter Y
     bindings[0].binding = 0;
-    bindings[0].buffer  = renderUniformBuffer;
+    bindings[0].buffer  = mRenderUniformBuffer;
     bindings[0].offset  = 0;
     bindings[0].size    = sizeof(RenderUniforms);
 
@@ -733,7 +875,7 @@ void FluidRenderer::InitializeThicknessFilterBindGroups(wgpu::Buffer renderUnifo
     bindings[1].size    = sizeof(FilterUniform);
 
     bindings[2].binding     = 2;
-    bindings[2].textureView = mTmpThicknessMapTextureView;
+    bindings[2].textureView = mGraph.GetView(mTmpThicknessMap);
 
     bindGroupDesc.label           = WebGPUUtils::GenerateString("depth filterY bind group");
     bindGroupDesc.layout          = mThicknessFilterBindGroupLayout;
@@ -744,9 +886,11 @@ void FluidRenderer::InitializeThicknessFilterBindGroups(wgpu::Buffer renderUnifo
 
 void FluidRenderer::DrawThicknessFilter(wgpu::CommandEncoder& commandEncoder)
 {
+    TRACE_SCOPE("FluidRenderer::DrawThicknessFilter");
+
     // filter X
     wgpu::RenderPassColorAttachment renderPassColorAttachmentX {
-        .view          = mTmpThicknessMapTextureView,
+        .view          = mGraph.GetView(mTmpThicknessMap),
         .depthSlice    = WGPU_DEPTH_SLICE_UNDEFINED,
         .resolveTarget = nullptr,
         .loadOp        = wgpu::LoadOp::Clear,
@@ -765,7 +909,7 @@ void FluidRenderer::DrawThicknessFilter(wgpu::CommandEncoder& commandEncoder)
 
     // filter Y
     wgpu::RenderPassColorAttachment renderPassColorAttachmentY {
-        .view          = mThicknessMapTextureView,
+        .view          = mGraph.GetView(mThicknessMap),
         .depthSlice    = WGPU_DEPTH_SLICE_UNDEFINED,
         .resolveTarget = nullptr,
         .loadOp        = wgpu::LoadOp::Clear,
@@ -784,16 +928,14 @@ void FluidRenderer::DrawThicknessFilter(wgpu::CommandEncoder& commandEncoder)
 
     for (int i = 0; i < 1; ++i)
     {
+        renderPassDescriptorX.timestampWrites = TimestampWrites("thickness filter");
         auto thicknessFilterPassEncoderX = commandEncoder.BeginRenderPass(&renderPassDescriptorX);
-        thicknessFilterPassEncoderX.SetBindGroup(0, mThicknessFilterBindGroups[0], 0, nullptr);
-        thicknessFilterPassEncoderX.SetPipeline(mThicknessFilterPipeline);
-        thicknessFilterPassEncoderX.Draw(6, 1, 0, 0);
+        thicknessFilterPassEncoderX.ExecuteBundles(1, &mThicknessFilterBundles[0]);
         thicknessFilterPassEncoderX.End();
 
+        renderPassDescriptorY.timestampWrites = TimestampWrites("thickness filter");
         auto thicknessFilterPassEncoderY = commandEncoder.BeginRenderPass(&renderPassDescriptorY);
-        thicknessFilterPassEncoderY.SetBindGroup(0, mThicknessFilterBindGroups[1], 0, nullptr);
-        thicknessFilterPassEncoderY.SetPipeline(mThicknessFilterPipeline);
-        thicknessFilterPassEncoderY.Draw(6, 1, 0, 0);
+        thicknessFilterPassEncoderY.ExecuteBundles(1, &mThicknessFilterBundles[1]);
         thicknessFilterPassEncoderY.End();
     }
 }
@@ -870,40 +1012,43 @@ void FluidRenderer::InitializeSpherePipelines(wgpu::TextureFormat presentationFo
 
     renderPipelineDesc.fragment = &fragmentState;
 
-    mSpherePipeline = mDevice.CreateRenderPipeline(&renderPipelineDesc);
+    PipelineBatch::CreateRenderPipeline(mDevice, renderPipelineDesc, mSpherePipeline);
 }
 
 void FluidRenderer::InitializeSphereBindGroups(wgpu::Buffer renderUniformBuffer,
-                                               wgpu::Buffer posvelBuffer)
+                                               const std::array<wgpu::Buffer, 2>& posvelBuffers)
 {
-    std::vector<wgpu::BindGroupEntry> bindings(2);
-
-    bindings[0].binding = 0;
-    bindings[0].buffer  = renderUniformBuffer;
-    bindings[0].offset  = 0;
-    bindings[0].size    = sizeof(RenderUniforms);
-
-    bindings[1].binding = 1;
-    bindings[1].buffer  = posvelBuffer;
-    bindings[1].offset  = 0;
-    bindings[1].size    = posvelBuffer.GetSize();
-
-    wgpu::BindGroupDescriptor bindGroupDesc {
-        .label      = WebGPUUtils::GenerateString("sphere bind group"),
-        .layout     = mSphereBindGroupLayout,
-        .entryCount = static_cast<uint32_t>(bindings.size()),
-        .entries    = bindings.data(),
-    };
-    mSphereBindGroup = mDevice.CreateBindGroup(&bindGroupDesc);
+    for (uint32_t index = 0; index < 2; ++index)
+    {
+        std::vector<wgpu::BindGroupEntry> bindings(2);
+
+        bindings[0].binding = 0;
+        bindings[0].buffer  = renderUniformBuffer;
+        bindings[0].offset  = 0;
+        bindings[0].size    = sizeof(RenderUniforms);
+
+        bindings[1].binding = 1;
+        bindings[1].buffer  = posvelBuffers[index];
+        bindings[1].offset  = 0;
+        bindings[1].size    = posvelBuffers[index].GetSize();
+
+        wgpu::BindGroupDescriptor bindGroupDesc {
+            .label      = WebGPUUtils::GenerateString("sphere bind group"),
+            .layout     = mSphereBindGroupLayout,
+            .entryCount = static_cast<uint32_t>(bindings.size()),
+            .entries    = bindings.data(),
+        };
+        mSphereBindGroups[index] = mDevice.CreateBindGroup(&bindGroupDesc);
+    }
 }
 
-void FluidRenderer::DrawSphere(wgpu::CommandEncoder& commandEncoder,
-                               wgpu::TextureView targetView,
-                               SimulationVariables& simulationVariables)
+void FluidRenderer::DrawSphere(wgpu::CommandEncoder& commandEncoder)
 {
+    TRACE_SCOPE("FluidRenderer::DrawSphere");
+
     // The attachment part of the render pass descriptor describes the target texture of the pass
     wgpu::RenderPassColorAttachment renderPassColorAttachment {
-        .view          = targetView,
+        .view          = mGraph.GetView(mTarget),
         .depthSlice    = WGPU_DEPTH_SLICE_UNDEFINED,
         .resolveTarget = nullptr,
         .loadOp        = wgpu::LoadOp::Clear,
@@ -912,7 +1057,7 @@ void FluidRenderer::DrawSphere(wgpu::CommandEncoder& commandEncoder,
     };
 
     wgpu::RenderPassDepthStencilAttachment depthStencilAttachment {
-        .view            = mDepthTestTextureView,
+        .view            = mGraph.GetView(mSceneDepth),
         .depthLoadOp     = wgpu::LoadOp::Clear,
         .depthStoreOp    = wgpu::StoreOp::Store,
         .depthClearValue = 1.0f,
@@ -925,79 +1070,164 @@ void FluidRenderer::DrawSphere(wgpu::CommandEncoder& commandEncoder,
         .colorAttachmentCount   = 1,
         .colorAttachments       = &renderPassColorAttachment,
         .depthStencilAttachment = &depthStencilAttachment,
-        .timestampWrites        = nullptr,
+        .timestampWrites        = TimestampWrites("sphere"),
     };
 
     // Create the render pass and end it immediately (we only clear the screen but do not draw anything)
     wgpu::RenderPassEncoder renderPass = commandEncoder.BeginRenderPass(&renderPassDesc);
 
-    // Select which render pipeline to use
-    renderPass.SetPipeline(mSpherePipeline);
-    renderPass.SetBindGroup(0, mSphereBindGroup, 0, nullptr);
-    renderPass.Draw(6, simulationVariables.numParticles, 0, 0);
+    renderPass.ExecuteBundles(1, &mSphereBundles[mPosvelIndex]);
 
-    UpdateGUI(renderPass, simulationVariables);
+    UpdateGUI(renderPass, *mSimulationVariables);
 
     renderPass.End();
 }
 
-void FluidRenderer::CreateTextures(const glm::vec2& textureSize)
+void FluidRenderer::CreateDrawArgsBuffer()
 {
-    wgpu::Extent3D size = {(unsigned int)textureSize.x, (unsigned int)textureSize.y, 1};
-    wgpu::TextureDescriptor textureDesc {};
+    wgpu::BufferDescriptor bufferDesc {
+        .label = WebGPUUtils::GenerateString("particle draw args buffer"),
+        .usage = wgpu::BufferUsage::Indirect | wgpu::BufferUsage::CopyDst,
+        .size  = sizeof(DrawArgs),
+    };
+
+    mDrawArgsBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "FluidRenderer", this);
+}
+
+void FluidRenderer::UpdateDrawArgs(uint32_t numParticles)
+{
+    if (numParticles == mDrawInstanceCount)
+    {
+        return;
+    }
 
-    // depth map texture
-    textureDesc.label  = WebGPUUtils::GenerateString("depth map texture");
-    textureDesc.size   = size;
-    textureDesc.usage  = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
-    textureDesc.format = wgpu::TextureFormat::R32Float;
-
-    wgpu::Texture depthMapTexture = mDevice.CreateTexture(&textureDesc);
-    mDepthMapTextureView          = depthMapTexture.CreateView();
-
-    // temporary depth map texture
-    textureDesc.label  = WebGPUUtils::GenerateString("temporary depth map texture");
-    textureDesc.size   = size;
-    textureDesc.usage  = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
-    textureDesc.format = wgpu::TextureFormat::R32Float;
-
-    wgpu::Texture tmpDepthMapTexture = mDevice.CreateTexture(&textureDesc);
-    mTmpDepthMapTextureView          = tmpDepthMapTexture.CreateView();
-
-    // depth test texture
-    textureDesc.label  = WebGPUUtils::GenerateString("depth test texture");
-    textureDesc.size   = size;
-    textureDesc.usage  = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
-    textureDesc.format = wgpu::TextureFormat::Depth32Float;
-
-    wgpu::Texture depthTestTexture = mDevice.CreateTexture(&textureDesc);
-    mDepthTestTextureView          = depthTestTexture.CreateView();
-
-    // thickness map texture
-    textureDesc.label  = WebGPUUtils::GenerateString("thickness map texture");
-    textureDesc.size   = size;
-    textureDesc.usage  = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
-    textureDesc.format = wgpu::TextureFormat::R16Float;
-
-    wgpu::Texture thicknessMapTexture = mDevice.CreateTexture(&textureDesc);
-    mThicknessMapTextureView          = thicknessMapTexture.CreateView();
-
-    // temporary thickness map texture
-    textureDesc.label  = WebGPUUtils::GenerateString("temporary thickness map texture");
-    textureDesc.size   = size;
-    textureDesc.usage  = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
-    textureDesc.format = wgpu::TextureFormat::R16Float;
-
-    wgpu::Texture temporaryThicknessMapTexture = mDevice.CreateTexture(&textureDesc);
-    mTmpThicknessMapTextureView                = temporaryThicknessMapTexture.CreateView();
+    // One quad per particle
+    DrawArgs args {.vertexCount = 6, .instanceCount = numParticles};
+    mDevice.GetQueue().WriteBuffer(mDrawArgsBuffer, 0, &args, sizeof(DrawArgs));
+    mDrawInstanceCount = numParticles;
+}
+
+void FluidRenderer::RecordBundles()
+{
+    TRACE_SCOPE("FluidRenderer::RecordBundles");
+
+    const wgpu::TextureFormat depth = wgpu::TextureFormat::Depth32Float;
+    const wgpu::TextureFormat none  = wgpu::TextureFormat::Undefined;
+
+    // Passes the graph culled have no texture bind groups and get no bundle
+    for (int i = 0; i < 2; ++i)
+    {
+        mDepthMapBundles[i] = RecordBundle("depth map bundle",
+                                           wgpu::TextureFormat::R32Float,
+                                           depth,
+                                           mDepthMapPipeline,
+                                           mDepthMapBindGroups[i],
+                                           true);
+        mThicknessMapBundles[i] = RecordBundle("thickness map bundle",
+                                               wgpu::TextureFormat::R16Float,
+                                               none,
+                                               mThicknessMapPipeline,
+                                               mThicknessMapBindGroups[i],
+                                               true);
+        mSphereBundles[i] = RecordBundle("sphere bundle",
+                                         mPresentationFormat,
+                                         depth,
+                                         mSpherePipeline,
+                                         mSphereBindGroups[i],
+                                         true);
+
+        mDepthFilterBundles[i] = !mDepthFilterBindGroups[i]
+                                     ? nullptr
+                                     : RecordBundle("depth filter bundle",
+                                                    wgpu::TextureFormat::R32Float,
+                                                    none,
+                                                    mDepthFilterPipeline,
+                                                    mDepthFilterBindGroups[i],
+                                                    false);
+        mThicknessFilterBundles[i] = !mThicknessFilterBindGroups[i]
+                                         ? nullptr
+                                         : RecordBundle("thickness filter bundle",
+                                                        wgpu::TextureFormat::R16Float,
+                                                        none,
+                                                        mThicknessFilterPipeline,
+                                                        mThicknessFilterBindGroups[i],
+                                                        false);
+    }
+
+    mFluidBundle = !mFluidBindGroup ? nullptr
+                                    : RecordBundle("fluid bundle",
+                                                   mPresentationFormat,
+                                                   depth,
+                                                   mFluidPipeline,
+                                                   mFluidBindGroup,
+                                                   false);
+
+    mBundlesDirty = false;
+}
+
+wgpu::RenderBundle FluidRenderer::RecordBundle(const char* label,
+                                               wgpu::TextureFormat colorFormat,
+                                               wgpu::TextureFormat depthStencilFormat,
+                                               wgpu::RenderPipeline pipeline,
+                                               wgpu::BindGroup bindGroup,
+                                               bool instanced)
+{
+    wgpu::RenderBundleEncoderDescriptor encoderDesc {
+        .label              = WebGPUUtils::GenerateString(label),
+        .colorFormatCount   = 1,
+        .colorFormats       = &colorFormat,
+        .depthStencilFormat = depthStencilFormat,
+        .sampleCount        = 1,
+    };
+    wgpu::RenderBundleEncoder encoder = mDevice.CreateRenderBundleEncoder(&encoderDesc);
+
+    encoder.SetPipeline(pipeline);
+    encoder.SetBindGroup(0, bindGroup, 0, nullptr);
+    if (instanced)
+    {
+        encoder.DrawIndirect(mDrawArgsBuffer, 0);
+    }
+    else
+    {
+        // Full screen triangle pair
+        encoder.Draw(6, 1, 0, 0);
+    }
+
+    wgpu::RenderBundleDescriptor bundleDesc {
+        .label = WebGPUUtils::GenerateString(label),
+    };
+    return encoder.Finish(&bundleDesc);
+}
+
+void FluidRenderer::SetProfiler(GPUProfiler* profiler)
+{
+    mProfiler = profiler;
+}
+
+void FluidRenderer::SetGUICallback(std::function<void()> callback)
+{
+    mGUICallback = std::move(callback);
+}
+
+const wgpu::PassTimestampWrites* FluidRenderer::TimestampWrites(const char* stage)
+{
+    return mProfiler ? mProfiler->Allocate(stage) : nullptr;
 }
 
 void FluidRenderer::UpdateGUI(wgpu::RenderPassEncoder& renderPass,
                               SimulationVariables& simulationVariables)
 {
-    // Start the Dear ImGui frame
+    TRACE_SCOPE("FluidRenderer::UpdateGUI");
+
+    // No GUI context in headless mode
+    if (ImGui::GetCurrentContext() == nullptr)
+    {
+        return;
+    }
+
+    // Start the Dear ImGui frame. Display size, time and input come from Application::ApplyInput()
+    // instead of the SDL backend, which has to stay on the main thread
     ImGui_ImplWGPU_NewFrame();
-    ImGui_ImplSDL3_NewFrame();
     ImGui::NewFrame();
 
     // Build UI
@@ -1045,6 +1275,11 @@ void FluidRenderer::UpdateGUI(wgpu::RenderPassEncoder& renderPass,
         ImGui::End();
     }
 
+    if (mGUICallback)
+    {
+        mGUICallback();
+    }
+
     // Draw UI
     ImGui::EndFrame();
     ImGui::Render();
@@ -1127,38 +1362,43 @@ void FluidRenderer::InitializeDepthMapPipeline()
 
     renderPipelineDesc.fragment = &fragmentState;
 
-    mDepthMapPipeline = mDevice.CreateRenderPipeline(&renderPipelineDesc);
+    PipelineBatch::CreateRenderPipeline(mDevice, renderPipelineDesc, mDepthMapPipeline);
 }
 
 void FluidRenderer::InitializeDepthMapBindGroups(wgpu::Buffer renderUniformBuffer,
-                                                 wgpu::Buffer posvelBuffer)
+                                                 const std::array<wgpu::Buffer, 2>& posvelBuffers)
 {
-    std::vector<wgpu::BindGroupEntry> bindings(2);
-
-    bindings[0].binding = 0;
-    bindings[0].buffer  = renderUniformBuffer;
-    bindings[0].offset  = 0;
-    bindings[0].size    = sizeof(RenderUniforms);
-
-    bindings[1].binding = 1;
-    bindings[1].buffer  = posvelBuffer;
-    bindings[1].offset  = 0;
-    bindings[1].size    = posvelBuffer.GetSize();
-
-    wgpu::BindGroupDescriptor bindGroupDesc {
-        .label      = WebGPUUtils::GenerateString("depth map bind group"),
-        .layout     = mDepthMapBindGroupLayout,
-        .entryCount = static_cast<uint32_t>(bindings.size()),
-        .entries    = bindings.data(),
-    };
-    mDepthMapBindGroup = mDevice.CreateBindGroup(&bindGroupDesc);
+    for (uint32_t index = 0; index < 2; ++index)
+    {
+        std::vector<wgpu::BindGroupEntry> bindings(2);
+
+        bindings[0].binding = 0;
+        bindings[0].buffer  = renderUniformBuffer;
+        bindings[0].offset  = 0;
+        bindings[0].size    = sizeof(RenderUniforms);
+
+        bindings[1].binding = 1;
+        bindings[1].buffer  = posvelBuffers[index];
+        bindings[1].offset  = 0;
+        bindings[1].size    = posvelBuffers[index].GetSize();
+
+        wgpu::BindGroupDescriptor bindGroupDesc {
+            .label      = WebGPUUtils::GenerateString("depth map bind group"),
+            .layout     = mDepthMapBindGroupLayout,
+            .entryCount = static_cast<uint32_t>(bindings.size()),
+            .entries    = bindings.data(),
+        };
+        mDepthMapBindGroups[index] = mDevice.CreateBindGroup(&bindGroupDesc);
+    }
 }
 
-void FluidRenderer::DrawDepthMap(wgpu::CommandEncoder& commandEncoder, uint32_t numParticles)
+void FluidRenderer::DrawDepthMap(wgpu::CommandEncoder& commandEncoder)
 {
+    TRACE_SCOPE("FluidRenderer::DrawDepthMap");
+
     // The attachment part of the render pass descriptor describes the target texture of the pass
     wgpu::RenderPassColorAttachment renderPassColorAttachment {
-        .view          = mDepthMapTextureView,
+        .view          = mGraph.GetView(mDepthMap),
         .resolveTarget = nullptr,
         .loadOp        = wgpu::LoadOp::Clear,
         .storeOp       = wgpu::StoreOp::Store,
@@ -1166,7 +1406,7 @@ void FluidRenderer::DrawDepthMap(wgpu::CommandEncoder& commandEncoder, uint32_t
     };
 
     wgpu::RenderPassDepthStencilAttachment depthStencilAttachment {
-        .view            = mDepthTestTextureView,
+        .view            = mGraph.GetView(mDepthTest),
         .depthLoadOp     = wgpu::LoadOp::Clear,
         .depthStoreOp    = wgpu::StoreOp::Store,
         .depthClearValue = 1.0f,
@@ -1179,16 +1419,13 @@ void FluidRenderer::DrawDepthMap(wgpu::CommandEncoder& commandEncoder, uint32_t
         .colorAttachmentCount   = 1,
         .colorAttachments       = &renderPassColorAttachment,
         .depthStencilAttachment = &depthStencilAttachment,
-        .timestampWrites        = nullptr,
+        .timestampWrites        = TimestampWrites("depth map"),
     };
 
     // Create the render pass and end it immediately (we only clear the screen but do not draw anything)
     wgpu::RenderPassEncoder renderPass = commandEncoder.BeginRenderPass(&renderPassDesc);
 
-    // Select which render pipeline to use
-    renderPass.SetPipeline(mDepthMapPipeline);
-    renderPass.SetBindGroup(0, mDepthMapBindGroup, 0, nullptr);
-    renderPass.Draw(6, numParticles, 0, 0);
+    renderPass.ExecuteBundles(1, &mDepthMapBundles[mPosvelIndex]);
 
     renderPass.End();
 }
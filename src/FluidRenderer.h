@@ -6,7 +6,14 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 
+#include <array>
+#include <cstdint>
+#include <functional>
+
+#include "RenderGraph.h"
+
 struct SimulationVariables;
+class GPUProfiler;
 
 struct FilterUniform
 {
@@ -18,6 +25,20 @@ struct FilterUniform
     float _padding[3];
 };
 
+// Arguments of DrawIndirect
+struct DrawArgs
+{
+    uint32_t vertexCount;
+    uint32_t instanceCount = 0;
+    uint32_t firstVertex   = 0;
+    uint32_t firstInstance = 0;
+};
+
+/**
+ * Screen space fluid rendering. The passes are declared in a RenderGraph, rebuilt when the
+ * sphere mode is toggled, so sphere mode culls the fluid passes and leases none of their
+ * textures. The intermediate textures come from a TexturePool shared by every renderer
+ */
 class FluidRenderer
 {
 public:
@@ -27,57 +48,90 @@ public:
                   float radius,
                   float fov,
                   wgpu::Buffer renderUniformBuffer,
-                  wgpu::Buffer posvelBuffer);
+                  const std::array<wgpu::Buffer, 2>& posvelBuffers,
+                  TexturePool* texturePool);
+    ~FluidRenderer();
+
+    // Bytes a renderer allocates itself, known before creation
+    static uint64_t EstimateMemory();
 
     void Draw(wgpu::CommandEncoder& commandEncoder,
               wgpu::TextureView targetView,
               SimulationVariables& simulationVariables);
 
+    void SetProfiler(GPUProfiler* profiler);
+
+    // Select the posvel buffer the particle passes read, see Application::mPosvelIndex
+    void SetPosvelIndex(uint32_t index)
+    {
+        mPosvelIndex = index;
+    }
+
+    // Additional GUI windows, built every frame after the simulation panel
+    void SetGUICallback(std::function<void()> callback);
+
+    // Hand the pool textures back while the renderer is not drawing, the next Draw leases again
+    void ReleaseTransientTextures();
+
 private:
     // Fluid
     void InitializeFluidPipelines(wgpu::TextureFormat presentationFormat,
                                   wgpu::ShaderModule vertexModule);
-    void InitializeFluidBindGroups(wgpu::Buffer renderUniformBuffer);
-    void DrawFluid(wgpu::CommandEncoder& commandEncoder,
-                   wgpu::TextureView targetView,
-                   SimulationVariables& simulationVariables);
+    void InitializeFluidBindGroups();
+    void DrawFluid(wgpu::CommandEncoder& commandEncoder);
 
     // Depth map
     void InitializeDepthMapPipeline();
-    void InitializeDepthMapBindGroups(wgpu::Buffer renderUniformBuffer, wgpu::Buffer posvelBuffer);
-    void DrawDepthMap(wgpu::CommandEncoder& commandEncoder, uint32_t numParticles);
+    void InitializeDepthMapBindGroups(wgpu::Buffer renderUniformBuffer,
+                                      const std::array<wgpu::Buffer, 2>& posvelBuffers);
+    void DrawDepthMap(wgpu::CommandEncoder& commandEncoder);
 
     // Depth filter
     void CreateDepthFilterUniform(float depthThreshold,
                                   float projectedParticleConstant,
                                   float maxFilterSize);
     void InitializeDepthFilterPipeline(wgpu::ShaderModule vertexModule);
-    void InitializeDepthFilterBindGroups(wgpu::Buffer renderUniformBuffer);
+    void InitializeDepthFilterBindGroups();
     void DrawDepthFilter(wgpu::CommandEncoder& commandEncoder);
 
     // Thickness map
     void InitializeThicknessMapPipeline();
     void InitializeThicknessMapBindGroups(wgpu::Buffer renderUniformBuffer,
-                                          wgpu::Buffer posvelBuffer);
-    void DrawThicknessMap(wgpu::CommandEncoder& commandEncoder, uint32_t numParticles);
+                                          const std::array<wgpu::Buffer, 2>& posvelBuffers);
+    void DrawThicknessMap(wgpu::CommandEncoder& commandEncoder);
 
     // Thickness filter
     void InitializeThicknessFilterPipeline(wgpu::ShaderModule vertexModule);
-    void InitializeThicknessFilterBindGroups(wgpu::Buffer renderUniformBuffer);
+    void InitializeThicknessFilterBindGroups();
     void DrawThicknessFilter(wgpu::CommandEncoder& commandEncoder);
 
     // Sphere
     void InitializeSpherePipelines(wgpu::TextureFormat presentationFormat);
-    void InitializeSphereBindGroups(wgpu::Buffer renderUniformBuffer, wgpu::Buffer posvelBuffer);
-    void DrawSphere(wgpu::CommandEncoder& commandEncoder,
-                    wgpu::TextureView targetView,
-                    SimulationVariables& simulationVariables);
-
-    void CreateTextures(const glm::vec2& textureSize);
+    void InitializeSphereBindGroups(wgpu::Buffer renderUniformBuffer,
+                                    const std::array<wgpu::Buffer, 2>& posvelBuffers);
+    void DrawSphere(wgpu::CommandEncoder& commandEncoder);
+
+    // Render graph
+    void BuildGraph(bool drawSpheres);
+    void CompileGraph();
+
+    // Render bundles
+    void CreateDrawArgsBuffer();
+    void UpdateDrawArgs(uint32_t numParticles);
+    void RecordBundles();
+    wgpu::RenderBundle RecordBundle(const char* label,
+                                    wgpu::TextureFormat colorFormat,
+                                    wgpu::TextureFormat depthStencilFormat,
+                                    wgpu::RenderPipeline pipeline,
+                                    wgpu::BindGroup bindGroup,
+                                    bool instanced);
 
     // GUI
     void UpdateGUI(wgpu::RenderPassEncoder& renderPass, SimulationVariables& simulationVariables);
 
+    // Returns nullptr when the pass is not profiled
+    const wgpu::PassTimestampWrites* TimestampWrites(const char* stage);
+
 private:
     wgpu::Device mDevice;
 
@@ -86,11 +140,13 @@ private:
     wgpu::BindGroupLayout mFluidBindGroupLayout;
     wgpu::BindGroup mFluidBindGroup;
     wgpu::RenderPipeline mFluidPipeline;
+    wgpu::Sampler mFluidSampler;
+    wgpu::TextureView mEnvmapTextureView;
 
     // Depth map
     wgpu::PipelineLayout mDepthMapLayout;
     wgpu::BindGroupLayout mDepthMapBindGroupLayout;
-    wgpu::BindGroup mDepthMapBindGroup;
+    wgpu::BindGroup mDepthMapBindGroups[2];  // one per posvel buffer
     wgpu::RenderPipeline mDepthMapPipeline;
 
     // Depth filter
@@ -106,7 +162,7 @@ private:
     // Thickness map
     wgpu::PipelineLayout mThicknessMapLayout;
     wgpu::BindGroupLayout mThicknessMapBindGroupLayout;
-    wgpu::BindGroup mThicknessMapBindGroup;
+    wgpu::BindGroup mThicknessMapBindGroups[2];  // one per posvel buffer
     wgpu::RenderPipeline mThicknessMapPipeline;
 
     // Thickness filter
@@ -118,13 +174,48 @@ private:
     // Sphere
     wgpu::PipelineLayout mSphereLayout;
     wgpu::BindGroupLayout mSphereBindGroupLayout;
-    wgpu::BindGroup mSphereBindGroup;
+    wgpu::BindGroup mSphereBindGroups[2];  // one per posvel buffer
     wgpu::RenderPipeline mSpherePipeline;
 
-    // Texture Views
-    wgpu::TextureView mDepthMapTextureView;
-    wgpu::TextureView mTmpDepthMapTextureView;
-    wgpu::TextureView mDepthTestTextureView;
-    wgpu::TextureView mThicknessMapTextureView;
-    wgpu::TextureView mTmpThicknessMapTextureView;
+    /**
+     * Built on the first Draw and whenever drawSpheres changes. The texture bind groups are
+     * created again after every compile, since the pool may hand out other textures
+     */
+    RenderGraph mGraph;
+    TexturePool* mTexturePool;
+    wgpu::Buffer mRenderUniformBuffer;
+    glm::vec2 mScreenSize;
+    bool mGraphBuilt       = false;
+    bool mGraphDrawSpheres = false;
+    RenderGraph::Texture mTarget;
+    RenderGraph::Texture mDepthMap;
+    RenderGraph::Texture mTmpDepthMap;
+    RenderGraph::Texture mDepthTest;
+    RenderGraph::Texture mThicknessMap;
+    RenderGraph::Texture mTmpThicknessMap;
+    RenderGraph::Texture mSceneDepth;
+
+    // Set for the duration of Draw, for the passes that build the GUI
+    SimulationVariables* mSimulationVariables = nullptr;
+
+    /**
+     * Every pass replays a render bundle. The bundles are recorded on the first Draw, once the
+     * pipelines are compiled, and again only after the pipelines or bind groups change. The
+     * particle passes draw indirectly, so a new particle count only rewrites the args buffer.
+     * The particle passes have one bundle per posvel buffer
+     */
+    wgpu::TextureFormat mPresentationFormat;
+    wgpu::Buffer mDrawArgsBuffer;
+    uint32_t mDrawInstanceCount = 0;
+    bool mBundlesDirty          = true;
+    uint32_t mPosvelIndex       = 0;
+    wgpu::RenderBundle mDepthMapBundles[2];
+    wgpu::RenderBundle mDepthFilterBundles[2];
+    wgpu::RenderBundle mThicknessMapBundles[2];
+    wgpu::RenderBundle mThicknessFilterBundles[2];
+    wgpu::RenderBundle mFluidBundle;
+    wgpu::RenderBundle mSphereBundles[2];
+
+    GPUProfiler* mProfiler = nullptr;
+    std::function<void()> mGUICallback;
 };
@@ -0,0 +1,213 @@
+#include "FrameTelemetry.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "WebGPUUtils.h"
+
+namespace
+{
+    int LifetimeBin(double value)
+    {
+        using Metric = FrameTelemetry::Metric;
+        if (value <= Metric::LIFETIME_MIN)
+        {
+            return 0;
+        }
+        int bin = static_cast<int>(std::log2(value / Metric::LIFETIME_MIN)
+                                   * Metric::LIFETIME_BINS_PER_OCTAVE);
+        return std::clamp(bin, 0, Metric::LIFETIME_BINS - 1);
+    }
+
+    // Geometric center of a bin
+    double LifetimeBinValue(int bin)
+    {
+        using Metric = FrameTelemetry::Metric;
+        return Metric::LIFETIME_MIN * std::exp2((bin + 0.5) / Metric::LIFETIME_BINS_PER_OCTAVE);
+    }
+}  // namespace
+
+void FrameTelemetry::Metric::Add(double value)
+{
+    lifetimeMin = lifetimeCount == 0 ? value : std::min(lifetimeMin, value);
+    lifetimeMax = lifetimeCount == 0 ? value : std::max(lifetimeMax, value);
+    last        = value;
+
+    lifetimeSum += value;
+    ++lifetimeCount;
+    ++lifetimeBins[LifetimeBin(value)];
+
+    history[historyIndex] = static_cast<float>(value);
+    historyIndex          = (historyIndex + 1) % HISTORY_SIZE;
+    historyCount          = std::min(historyCount + 1, HISTORY_SIZE);
+}
+
+void FrameTelemetry::Metric::Reset()
+{
+    lifetimeBins.fill(0);
+    lifetimeCount = 0;
+    lifetimeSum   = 0.0;
+    lifetimeMin   = 0.0;
+    lifetimeMax   = 0.0;
+    historyCount  = 0;
+    historyIndex  = 0;
+    last          = 0.0;
+}
+
+double FrameTelemetry::Metric::Mean() const
+{
+    return lifetimeCount == 0 ? 0.0 : lifetimeSum / lifetimeCount;
+}
+
+double FrameTelemetry::Metric::Percentile(double p) const
+{
+    if (lifetimeCount == 0)
+    {
+        return 0.0;
+    }
+
+    // Same rank as the nearest-rank percentile of the sorted samples
+    uint64_t rank =
+        std::min(static_cast<uint64_t>(p * (lifetimeCount - 1) + 0.5), lifetimeCount - 1);
+    uint64_t cumulative = 0;
+    for (int bin = 0; bin < LIFETIME_BINS; ++bin)
+    {
+        cumulative += lifetimeBins[bin];
+        if (cumulative > rank)
+        {
+            return std::clamp(LifetimeBinValue(bin), lifetimeMin, lifetimeMax);
+        }
+    }
+    return lifetimeMax;
+}
+
+double FrameTelemetry::Metric::RecentPercentile(double p) const
+{
+    if (historyCount == 0)
+    {
+        return 0.0;
+    }
+
+    std::array<float, HISTORY_SIZE> sorted = history;
+    size_t index = std::min(static_cast<size_t>(p * (historyCount - 1) + 0.5), historyCount - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.begin() + historyCount);
+    return sorted[index];
+}
+
+double FrameTelemetry::Metric::Max() const
+{
+    return lifetimeMax;
+}
+
+void FrameTelemetry::Metric::Histogram(float* bins, int binCount, float upper) const
+{
+    std::fill(bins, bins + binCount, 0.0f);
+    if (upper <= 0.0f)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < historyCount; ++i)
+    {
+        // The last bin also collects everything above `upper`
+        int bin = static_cast<int>(history[i] / upper * binCount);
+        bins[std::clamp(bin, 0, binCount - 1)] += 1.0f;
+    }
+}
+
+void FrameTelemetry::Metric::LifetimeHistogram(int* bins, int binCount, double binWidth) const
+{
+    std::fill(bins, bins + binCount, 0);
+    if (binWidth <= 0.0)
+    {
+        return;
+    }
+
+    for (int bin = 0; bin < LIFETIME_BINS; ++bin)
+    {
+        if (lifetimeBins[bin] == 0)
+        {
+            continue;
+        }
+        double value = std::clamp(LifetimeBinValue(bin), lifetimeMin, lifetimeMax);
+        int target   = static_cast<int>(value / binWidth);
+        bins[std::clamp(target, 0, binCount - 1)] += static_cast<int>(lifetimeBins[bin]);
+    }
+}
+
+FrameTelemetry::FrameTelemetry(wgpu::Instance instance, wgpu::Queue queue) :
+    mInstance(instance),
+    mQueue(queue)
+{
+}
+
+FrameTelemetry::~FrameTelemetry()
+{
+#ifndef __EMSCRIPTEN__
+    // The work done callbacks reference `this`, let the outstanding ones fire first
+    if (GetFramesInFlight() > 0)
+    {
+        WebGPUUtils::WaitForSubmittedWork(mInstance, mQueue);
+    }
+#endif
+}
+
+void FrameTelemetry::BeginFrame()
+{
+    mFrameStart = Clock::now();
+}
+
+void FrameTelemetry::EndEncode()
+{
+    auto elapsed     = Clock::now() - mFrameStart;
+    mPendingEncodeMs = std::chrono::duration<double, std::milli>(elapsed).count();
+}
+
+void FrameTelemetry::Submitted()
+{
+    Clock::time_point submitTime = Clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mPending;
+        mEncodeMs.Add(mPendingEncodeMs);
+        mFramesInFlight.Add(mPending);
+    }
+
+    mQueue.OnSubmittedWorkDone(wgpu::CallbackMode::AllowSpontaneous,
+                               [this, submitTime](wgpu::QueueWorkDoneStatus status, auto&&...)
+                               {
+                                   if (status == wgpu::QueueWorkDoneStatus::Success)
+                                   {
+                                       OnWorkDone(submitTime);
+                                   }
+                                   else
+                                   {
+                                       std::lock_guard<std::mutex> lock(mMutex);
+                                       --mPending;
+                                   }
+                               });
+}
+
+void FrameTelemetry::OnWorkDone(Clock::time_point submitTime)
+{
+    double latencyMs = std::chrono::duration<double, std::milli>(Clock::now() - submitTime).count();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    --mPending;
+    mLatencyMs.Add(latencyMs);
+}
+
+void FrameTelemetry::ResetStatistics()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEncodeMs.Reset();
+    mLatencyMs.Reset();
+    mFramesInFlight.Reset();
+}
+
+int FrameTelemetry::GetFramesInFlight() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mPending;
+}
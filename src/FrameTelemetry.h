@@ -0,0 +1,120 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/**
+ * Per-frame CPU/GPU pacing statistics: CPU encode time, latency from submission until the GPU
+ * finished the frame (Queue::OnSubmittedWorkDone) and the number of frames in flight at submission.
+ * Natively the completion callbacks fire from Device::Tick, so the latency is quantized to the
+ * tick cadence.
+ */
+class FrameTelemetry
+{
+public:
+    struct Metric
+    {
+        static constexpr size_t HISTORY_SIZE = 240;
+
+        /**
+         * Samples since the last ResetStatistics() are kept as counts in logarithmic bins from
+         * LIFETIME_MIN, LIFETIME_BINS_PER_OCTAVE per doubling, so the storage stays fixed on
+         * long runs and the percentiles are within about 2%
+         */
+        static constexpr double LIFETIME_MIN          = 1.0 / 1024.0;
+        static constexpr int LIFETIME_BINS_PER_OCTAVE = 32;
+        static constexpr int LIFETIME_BINS            = 24 * LIFETIME_BINS_PER_OCTAVE;
+
+        std::array<float, HISTORY_SIZE> history {};  // ring of the most recent samples
+        size_t historyCount = 0;
+        size_t historyIndex = 0;
+
+        std::array<uint64_t, LIFETIME_BINS> lifetimeBins {};
+        uint64_t lifetimeCount = 0;
+        double lifetimeSum     = 0.0;
+        double lifetimeMin     = 0.0;
+        double lifetimeMax     = 0.0;
+        double last            = 0.0;
+
+        void Add(double value);
+        void Reset();
+
+        double Mean() const;
+        double Percentile(double p) const;
+        double Max() const;
+
+        // Percentile over the recent history only
+        double RecentPercentile(double p) const;
+
+        /**
+         * Bin the recent samples into `bins` buckets between 0 and `upper`, for ImGui histograms
+         */
+        void Histogram(float* bins, int binCount, float upper) const;
+
+        // Rebin the lifetime samples into `binCount` buckets of `binWidth`, the last one also
+        // collects everything above
+        void LifetimeHistogram(int* bins, int binCount, double binWidth) const;
+    };
+
+    FrameTelemetry(wgpu::Instance instance, wgpu::Queue queue);
+    ~FrameTelemetry();
+
+    // Start of the CPU work of a frame
+    void BeginFrame();
+
+    // Command buffer finished, closes the CPU encode time of the frame
+    void EndEncode();
+
+    // Call right after submitting the frame's command buffer
+    void Submitted();
+
+    void ResetStatistics();
+
+    int GetFramesInFlight() const;
+
+    /**
+     * The metrics are written from queue callbacks, hold the returned lock while reading them
+     */
+    std::unique_lock<std::mutex> Lock() const
+    {
+        return std::unique_lock<std::mutex>(mMutex);
+    }
+
+    const Metric& GetEncodeMs() const
+    {
+        return mEncodeMs;
+    }
+
+    const Metric& GetLatencyMs() const
+    {
+        return mLatencyMs;
+    }
+
+    const Metric& GetFramesInFlightMetric() const
+    {
+        return mFramesInFlight;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void OnWorkDone(Clock::time_point submitTime);
+
+private:
+    wgpu::Instance mInstance;
+    wgpu::Queue mQueue;
+
+    Clock::time_point mFrameStart;
+    double mPendingEncodeMs = 0.0;
+
+    mutable std::mutex mMutex;
+    int mPending = 0;
+
+    Metric mEncodeMs;
+    Metric mLatencyMs;
+    Metric mFramesInFlight;
+};
@@ -0,0 +1,168 @@
+#include "GPUCounters.h"
+
+#include <cstring>
+
+#include "GPUMemory.h"
+#include "PipelineBatch.h"
+#include "ResourceManager.h"
+#include "WebGPUUtils.h"
+
+GPUCounters::GPUCounters(wgpu::Device device,
+                         uint32_t count,
+                         uint64_t scratchSize,
+                         const char* owner) :
+    mDevice(device),
+    mCount(count)
+{
+    uint64_t size = count * sizeof(uint32_t);
+
+    wgpu::BufferDescriptor bufferDesc {
+        .label = WebGPUUtils::GenerateString("counters buffer"),
+        .usage =
+            wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst,
+        .size = size,
+    };
+
+    mBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, owner, this);
+
+    mReadback.Create(mDevice, size, "counters readback buffer", owner, this);
+
+    std::vector<wgpu::BindGroupLayoutEntry> bindingLayoutEntries(scratchSize > 0 ? 2 : 1);
+    for (uint32_t i = 0; i < bindingLayoutEntries.size(); ++i)
+    {
+        wgpu::BindGroupLayoutEntry& bindingLayout = bindingLayoutEntries[i];
+        WebGPUUtils::SetDefaultBindGroupLayout(bindingLayout);
+        bindingLayout.binding     = i;
+        bindingLayout.visibility  = wgpu::ShaderStage::Compute;
+        bindingLayout.buffer.type = wgpu::BufferBindingType::Storage;
+    }
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEntries.data();
+    mBindGroupLayout               = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    std::vector<wgpu::BindGroupEntry> bindings(1);
+    bindings[0].binding = 0;
+    bindings[0].buffer  = mBuffer;
+    bindings[0].offset  = 0;
+    bindings[0].size    = size;
+
+    if (scratchSize > 0)
+    {
+        bufferDesc.label = WebGPUUtils::GenerateString("counters scratch buffer");
+        bufferDesc.size  = scratchSize;
+        bufferDesc.usage = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+
+        mScratchBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, owner, this);
+
+        wgpu::BindGroupEntry& scratch = bindings.emplace_back();
+        scratch.binding               = 1;
+        scratch.buffer                = mScratchBuffer;
+        scratch.offset                = 0;
+        scratch.size                  = scratchSize;
+    }
+
+    wgpu::BindGroupDescriptor bindGroupDesc {
+        .label      = WebGPUUtils::GenerateString("counters bind group"),
+        .layout     = mBindGroupLayout,
+        .entryCount = static_cast<uint32_t>(bindings.size()),
+        .entries    = bindings.data(),
+    };
+    mBindGroup = mDevice.CreateBindGroup(&bindGroupDesc);
+}
+
+GPUCounters::~GPUCounters()
+{
+    GPUMemory::Release(this);
+}
+
+void GPUCounters::SetEnabled(bool enabled)
+{
+    mEnabled = enabled;
+    if (!enabled)
+    {
+        mValues.clear();
+        return;
+    }
+
+    if (!mPipelinesCreated)
+    {
+        for (const CountingPipeline& countingPipeline : mCountingPipelines)
+        {
+            CreateCountingPipeline(countingPipeline);
+        }
+        mPipelinesCreated = true;
+    }
+}
+
+void GPUCounters::BeginFrame(wgpu::CommandEncoder& commandEncoder, uint32_t substeps)
+{
+    mSampling    = false;
+    mCurrentSlot = nullptr;
+
+    if (mEnabled && mFrameIndex % mInterval == 0)
+    {
+        mCurrentSlot = mReadback.Acquire();
+        if (mCurrentSlot)
+        {
+            mCurrentSlot->info = {.frame = mFrameIndex, .substeps = substeps};
+            mSampling          = true;
+            commandEncoder.ClearBuffer(mBuffer, 0, mCount * sizeof(uint32_t));
+        }
+    }
+
+    ++mFrameIndex;
+}
+
+void GPUCounters::Resolve(wgpu::CommandEncoder& commandEncoder)
+{
+    if (!mCurrentSlot)
+    {
+        return;
+    }
+
+    commandEncoder.CopyBufferToBuffer(mBuffer, 0, mCurrentSlot->buffer, 0, mBuffer.GetSize());
+    mSampling = false;
+}
+
+void GPUCounters::EndFrame()
+{
+    if (!mCurrentSlot)
+    {
+        return;
+    }
+
+    mReadback.Map(*mCurrentSlot,
+                  mCount * sizeof(uint32_t),
+                  [this](const Readback::Slot& slot, const void* data)
+                  {
+                      if (mEnabled && slot.info.frame >= mValuesFrame)
+                      {
+                          mValues.resize(mCount);
+                          std::memcpy(mValues.data(), data, mCount * sizeof(uint32_t));
+                          mValuesFrame    = slot.info.frame;
+                          mValuesSubsteps = slot.info.substeps;
+                      }
+                  });
+    mCurrentSlot = nullptr;
+}
+
+void GPUCounters::AddCountingPipeline(const wgpu::ComputePipelineDescriptor& descriptor,
+                                      const std::filesystem::path& shaderPath,
+                                      wgpu::ComputePipeline& pipeline)
+{
+    mCountingPipelines.push_back({descriptor, shaderPath, &pipeline});
+    if (mPipelinesCreated)
+    {
+        CreateCountingPipeline(mCountingPipelines.back());
+    }
+}
+
+void GPUCounters::CreateCountingPipeline(const CountingPipeline& countingPipeline) const
+{
+    wgpu::ComputePipelineDescriptor descriptor = countingPipeline.descriptor;
+    descriptor.compute.module =
+        ResourceManager::LoadShaderModule(countingPipeline.shaderPath, mDevice, {{"COUNTERS", ""}});
+    PipelineBatch::CreateComputePipeline(mDevice, descriptor, *countingPipeline.pipeline);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "ReadbackRing.h"
+
+/**
+ * Opt-in algorithm counters written by the compute shaders. Counting kernels are separate
+ * pipelines built from the `COUNTERS` shader permutation when the counters are first enabled,
+ * and only run on sampled frames, every `interval` frames. The counters are cleared before a
+ * sampled frame and read back asynchronously.
+ *
+ * The shaders bind the counters at @group(1) @binding(0) as array<atomic<u32>>, and an optional
+ * scratch buffer (e.g. per-cell counts) at @binding(1).
+ */
+class GPUCounters
+{
+public:
+    // Bins of the cell occupancy histograms, bin i holds cells with i + 1 particles and the last
+    // bin everything above. Must match HISTOGRAM_BINS in include/counters.wgsl.
+    static constexpr uint32_t HISTOGRAM_BINS = 16;
+
+    GPUCounters(wgpu::Device device, uint32_t count, uint64_t scratchSize, const char* owner);
+    ~GPUCounters();
+
+    bool IsEnabled() const
+    {
+        return mEnabled;
+    }
+
+    void SetEnabled(bool enabled);
+
+    void SetInterval(int frames)
+    {
+        mInterval = frames > 0 ? frames : 1;
+    }
+
+    // True while recording a sampled frame, select the counting pipelines then
+    bool IsSampling() const
+    {
+        return mSampling;
+    }
+
+    // Clear the counters if this frame is sampled, `substeps` is the number the frame runs
+    void BeginFrame(wgpu::CommandEncoder& commandEncoder, uint32_t substeps);
+
+    // Copy the counters for readback, call after the frame's dispatches
+    void Resolve(wgpu::CommandEncoder& commandEncoder);
+
+    // Start the readback, call after the frame has been submitted
+    void EndFrame();
+
+    const wgpu::BindGroupLayout& GetBindGroupLayout() const
+    {
+        return mBindGroupLayout;
+    }
+
+    const wgpu::BindGroup& GetBindGroup() const
+    {
+        return mBindGroup;
+    }
+
+    /**
+     * Pipeline from the descriptor of the regular pipeline, with the module replaced by the
+     * `COUNTERS` permutation of `shaderPath`. Nothing is compiled until the counters are first
+     * enabled, then through PipelineBatch, so `pipeline` may be assigned later. The label and
+     * entry point must outlive the counters, e.g. string literals.
+     */
+    void AddCountingPipeline(const wgpu::ComputePipelineDescriptor& descriptor,
+                             const std::filesystem::path& shaderPath,
+                             wgpu::ComputePipeline& pipeline);
+
+    // Values of the latest completed readback, empty until the first one
+    const std::vector<uint32_t>& GetValues() const
+    {
+        return mValues;
+    }
+
+    uint64_t GetValuesFrame() const
+    {
+        return mValuesFrame;
+    }
+
+    // Substeps the counters of GetValues() accumulated over
+    uint32_t GetValuesSubsteps() const
+    {
+        return mValuesSubsteps;
+    }
+
+private:
+    struct ReadbackInfo
+    {
+        uint64_t frame    = 0;
+        uint32_t substeps = 0;
+    };
+
+    using Readback = ReadbackRing<ReadbackInfo, 2>;
+
+    struct CountingPipeline
+    {
+        wgpu::ComputePipelineDescriptor descriptor;
+        std::filesystem::path shaderPath;
+        wgpu::ComputePipeline* pipeline;
+    };
+
+    void CreateCountingPipeline(const CountingPipeline& countingPipeline) const;
+
+private:
+
+    wgpu::Device mDevice;
+    uint32_t mCount;
+
+    wgpu::Buffer mBuffer;
+    wgpu::Buffer mScratchBuffer;
+    wgpu::BindGroupLayout mBindGroupLayout;
+    wgpu::BindGroup mBindGroup;
+    Readback mReadback;
+
+    std::vector<CountingPipeline> mCountingPipelines;
+    bool mPipelinesCreated = false;
+
+    bool mEnabled  = false;
+    bool mSampling = false;
+    int mInterval  = 30;
+
+    Readback::Slot* mCurrentSlot = nullptr;
+    uint64_t mFrameIndex         = 0;
+
+    std::vector<uint32_t> mValues;
+    uint64_t mValuesFrame    = 0;
+    uint32_t mValuesSubsteps = 0;
+};
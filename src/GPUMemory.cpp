@@ -0,0 +1,299 @@
+#include "GPUMemory.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <string_view>
+
+namespace GPUMemory
+{
+    namespace
+    {
+        std::vector<Allocation> gAllocations;
+        std::vector<Estimate> gEstimates;
+        uint64_t gTotal             = 0;
+        uint64_t gBudget            = 0;
+        bool gBudgetWarningShown    = false;
+        bool gProjectedWarningShown = false;
+
+        constexpr double MB = 1024.0 * 1024.0;
+
+        uint32_t GetBytesPerTexel(wgpu::TextureFormat format)
+        {
+            switch (format)
+            {
+                case wgpu::TextureFormat::R8Unorm:
+                case wgpu::TextureFormat::Stencil8:
+                    return 1;
+                case wgpu::TextureFormat::R16Float:
+                case wgpu::TextureFormat::RG8Unorm:
+                case wgpu::TextureFormat::Depth16Unorm:
+                    return 2;
+                case wgpu::TextureFormat::RGBA16Float:
+                case wgpu::TextureFormat::RG32Float:
+                    return 8;
+                case wgpu::TextureFormat::RGBA32Float:
+                    return 16;
+                case wgpu::TextureFormat::Depth32FloatStencil8:
+                    return 5;
+                default:
+                    // RGBA8 / BGRA8 variants, R32Float, Depth24Plus, Depth32Float, ...
+                    return 4;
+            }
+        }
+
+        void Record(Allocation allocation)
+        {
+            // The handle of a released resource may be reused by a new one
+            auto it = std::find_if(gAllocations.begin(),
+                                   gAllocations.end(),
+                                   [&](const Allocation& other)
+                                   { return other.handle == allocation.handle; });
+            if (it != gAllocations.end())
+            {
+                gTotal -= it->bytes;
+                *it = std::move(allocation);
+                gTotal += it->bytes;
+            }
+            else
+            {
+                gTotal += allocation.bytes;
+                gAllocations.push_back(std::move(allocation));
+            }
+
+            if (gBudget > 0 && gTotal > gBudget && !gBudgetWarningShown)
+            {
+                printf("Warning: GPU memory %.1f MB exceeds the budget of %.1f MB\n",
+                       gTotal / MB,
+                       gBudget / MB);
+                gBudgetWarningShown = true;
+            }
+        }
+
+        // Warn before anything is created, once per crossing of the budget
+        void CheckProjection()
+        {
+            uint64_t projected = GetProjectedTotal();
+            if (gBudget == 0 || projected <= gBudget)
+            {
+                gProjectedWarningShown = false;
+                return;
+            }
+            if (!gProjectedWarningShown)
+            {
+                printf("Warning: GPU memory would reach %.1f MB with", projected / MB);
+                for (const Estimate& estimate : gEstimates)
+                {
+                    printf(" %s (%.1f MB)", estimate.name.c_str(), estimate.bytes / MB);
+                }
+                printf(", over the budget of %.1f MB\n", gBudget / MB);
+                gProjectedWarningShown = true;
+            }
+        }
+
+        void ReleaseHandle(const void* handle)
+        {
+            auto it = std::find_if(gAllocations.begin(),
+                                   gAllocations.end(),
+                                   [handle](const Allocation& allocation)
+                                   { return allocation.handle == handle; });
+            if (it != gAllocations.end())
+            {
+                gTotal -= it->bytes;
+                gAllocations.erase(it);
+                gBudgetWarningShown = gBudgetWarningShown && gTotal > gBudget;
+            }
+        }
+
+        std::string ToString(wgpu::StringView label)
+        {
+            return label.data ? std::string(std::string_view(label)) : std::string();
+        }
+    }  // namespace
+
+    wgpu::Buffer CreateBuffer(wgpu::Device device,
+                              const wgpu::BufferDescriptor& descriptor,
+                              const char* owner,
+                              const void* instance)
+    {
+        wgpu::Buffer buffer = device.CreateBuffer(&descriptor);
+        Record({buffer.Get(), owner, instance, ToString(descriptor.label), descriptor.size, false});
+        return buffer;
+    }
+
+    wgpu::Texture CreateTexture(wgpu::Device device,
+                                const wgpu::TextureDescriptor& descriptor,
+                                const char* owner,
+                                const void* instance)
+    {
+        wgpu::Texture texture = device.CreateTexture(&descriptor);
+        Record({texture.Get(),
+                owner,
+                instance,
+                ToString(descriptor.label),
+                GetTextureSize(descriptor),
+                true});
+        return texture;
+    }
+
+    void RecordTexture(const wgpu::Texture& texture,
+                       const char* label,
+                       const char* owner,
+                       const void* instance)
+    {
+        if (!texture)
+        {
+            return;
+        }
+
+        wgpu::TextureDescriptor descriptor {};
+        descriptor.size          = {texture.GetWidth(),
+                                    texture.GetHeight(),
+                                    texture.GetDepthOrArrayLayers()};
+        descriptor.format        = texture.GetFormat();
+        descriptor.mipLevelCount = texture.GetMipLevelCount();
+        descriptor.sampleCount   = texture.GetSampleCount();
+        Record({texture.Get(), owner, instance, label, GetTextureSize(descriptor), true});
+    }
+
+    void Release(const void* instance)
+    {
+        auto removed = std::stable_partition(gAllocations.begin(),
+                                             gAllocations.end(),
+                                             [instance](const Allocation& allocation)
+                                             { return allocation.instance != instance; });
+        for (auto it = removed; it != gAllocations.end(); ++it)
+        {
+            gTotal -= it->bytes;
+        }
+        gAllocations.erase(removed, gAllocations.end());
+        gBudgetWarningShown = gBudgetWarningShown && gTotal > gBudget;
+    }
+
+    void Release(const wgpu::Buffer& buffer)
+    {
+        ReleaseHandle(buffer.Get());
+    }
+
+    void Release(const wgpu::Texture& texture)
+    {
+        ReleaseHandle(texture.Get());
+    }
+
+    uint64_t GetTextureSize(const wgpu::TextureDescriptor& descriptor)
+    {
+        uint64_t texels = 0;
+        for (uint32_t level = 0; level < std::max(descriptor.mipLevelCount, 1u); ++level)
+        {
+            uint64_t width  = std::max(descriptor.size.width >> level, 1u);
+            uint64_t height = std::max(descriptor.size.height >> level, 1u);
+            texels += width * height * std::max(descriptor.size.depthOrArrayLayers, 1u);
+        }
+        return texels * GetBytesPerTexel(descriptor.format) * std::max(descriptor.sampleCount, 1u);
+    }
+
+    void SetBudget(uint64_t bytes)
+    {
+        gBudget                = bytes;
+        gBudgetWarningShown    = false;
+        gProjectedWarningShown = false;
+        CheckProjection();
+    }
+
+    uint64_t GetBudget()
+    {
+        return gBudget;
+    }
+
+    void SetEstimate(const char* name, uint64_t bytes)
+    {
+        std::erase_if(gEstimates,
+                      [name](const Estimate& estimate) { return estimate.name == name; });
+        if (bytes > 0)
+        {
+            gEstimates.push_back({name, bytes});
+        }
+        CheckProjection();
+    }
+
+    const std::vector<Estimate>& GetEstimates()
+    {
+        return gEstimates;
+    }
+
+    uint64_t GetTotal()
+    {
+        return gTotal;
+    }
+
+    uint64_t GetProjectedTotal()
+    {
+        uint64_t projected = gTotal;
+        for (const Estimate& estimate : gEstimates)
+        {
+            projected += estimate.bytes;
+        }
+        return projected;
+    }
+
+    const std::vector<Allocation>& GetAllocations()
+    {
+        return gAllocations;
+    }
+
+    std::vector<OwnerTotal> GetOwnerTotals()
+    {
+        std::vector<OwnerTotal> totals;
+        for (const Allocation& allocation : gAllocations)
+        {
+            auto it = std::find_if(totals.begin(),
+                                   totals.end(),
+                                   [&](const OwnerTotal& total)
+                                   { return total.owner == allocation.owner; });
+            if (it == totals.end())
+            {
+                totals.push_back({allocation.owner, 0, 0});
+                it = totals.end() - 1;
+            }
+            it->bytes += allocation.bytes;
+            ++it->count;
+        }
+
+        std::sort(totals.begin(),
+                  totals.end(),
+                  [](const OwnerTotal& a, const OwnerTotal& b) { return a.bytes > b.bytes; });
+        return totals;
+    }
+
+    void PrintReport()
+    {
+        printf("GPU memory by subsystem:\n");
+        for (const OwnerTotal& total : GetOwnerTotals())
+        {
+            printf(" - %-20s %9.2f MB (%d resources)\n",
+                   total.owner.c_str(),
+                   total.bytes / MB,
+                   total.count);
+        }
+        printf(" - %-20s %9.2f MB", "total", gTotal / MB);
+        if (gBudget > 0)
+        {
+            printf(" of %.2f MB budget%s", gBudget / MB, gTotal > gBudget ? " (exceeded)" : "");
+        }
+        printf("\n");
+
+        if (!gEstimates.empty())
+        {
+            uint64_t projected = GetProjectedTotal();
+            for (const Estimate& estimate : gEstimates)
+            {
+                printf(" + %-20s %9.2f MB (estimate)\n",
+                       estimate.name.c_str(),
+                       estimate.bytes / MB);
+            }
+            printf(" = %-20s %9.2f MB%s\n",
+                   "projected",
+                   projected / MB,
+                   gBudget > 0 && projected > gBudget ? " (over budget)" : "");
+        }
+    }
+}  // namespace GPUMemory
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Registry of the buffers and textures created by the application. Allocations are keyed by the
+ * resource handle and tagged with the subsystem (`owner`) and the object that created them
+ * (`instance`), so several instances of the same subsystem, e.g. the two fluid renderers, are
+ * accounted separately and resources may share a label.
+ */
+namespace GPUMemory
+{
+    struct Allocation
+    {
+        const void* handle;
+        std::string owner;
+        const void* instance;
+        std::string label;
+        uint64_t bytes;
+        bool texture;
+    };
+
+    // Expected footprint of something not created yet, e.g. a simulation built on first use
+    struct Estimate
+    {
+        std::string name;
+        uint64_t bytes;
+    };
+
+    struct OwnerTotal
+    {
+        std::string owner;
+        uint64_t bytes;
+        int count;
+    };
+
+    wgpu::Buffer CreateBuffer(wgpu::Device device,
+                              const wgpu::BufferDescriptor& descriptor,
+                              const char* owner,
+                              const void* instance);
+
+    wgpu::Texture CreateTexture(wgpu::Device device,
+                                const wgpu::TextureDescriptor& descriptor,
+                                const char* owner,
+                                const void* instance);
+
+    // Record a texture created elsewhere, e.g. loaded by ResourceManager
+    void RecordTexture(const wgpu::Texture& texture,
+                       const char* label,
+                       const char* owner,
+                       const void* instance);
+
+    // Forget every allocation made by `instance`, call when it is destroyed
+    void Release(const void* instance);
+
+    // Forget a single resource, e.g. one destroyed before its creator
+    void Release(const wgpu::Buffer& buffer);
+    void Release(const wgpu::Texture& texture);
+
+    // Size of a texture including mip levels and samples, compressed formats are not handled
+    uint64_t GetTextureSize(const wgpu::TextureDescriptor& descriptor);
+
+    /**
+     * Warn when the projected total, the registered one plus the estimates, would exceed `bytes`,
+     * and again when the registered total does. 0 disables the budget
+     */
+    void SetBudget(uint64_t bytes);
+    uint64_t GetBudget();
+
+    // Replace the estimate called `name`, 0 bytes removes it
+    void SetEstimate(const char* name, uint64_t bytes);
+    const std::vector<Estimate>& GetEstimates();
+
+    uint64_t GetTotal();
+    uint64_t GetProjectedTotal();
+    const std::vector<Allocation>& GetAllocations();
+
+    // Totals per owner, largest first
+    std::vector<OwnerTotal> GetOwnerTotals();
+
+    void PrintReport();
+}  // namespace GPUMemory
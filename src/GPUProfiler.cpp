@@ -0,0 +1,275 @@
+#include "GPUProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+#include "Trace.h"
+#include "WebGPUUtils.h"
+#include "GPUMemory.h"
+
+GPUProfiler::GPUProfiler(wgpu::Device device, bool supported) :
+    mDevice(device),
+    mSupported(supported)
+{
+    if (!mSupported)
+    {
+        return;
+    }
+
+    wgpu::QuerySetDescriptor querySetDesc {
+        .nextInChain = nullptr,
+        .label       = WebGPUUtils::GenerateString("profiler query set"),
+        .type        = wgpu::QueryType::Timestamp,
+        .count       = MAX_QUERIES,
+    };
+    mQuerySet = mDevice.CreateQuerySet(&querySetDesc);
+
+    wgpu::BufferDescriptor bufferDesc {};
+    bufferDesc.label            = WebGPUUtils::GenerateString("profiler resolve buffer");
+    bufferDesc.size             = MAX_QUERIES * sizeof(uint64_t);
+    bufferDesc.usage            = wgpu::BufferUsage::QueryResolve | wgpu::BufferUsage::CopySrc;
+    bufferDesc.mappedAtCreation = false;
+
+    mResolveBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "GPUProfiler", this);
+
+    mReadback.Create(mDevice, bufferDesc.size, "profiler readback buffer", "GPUProfiler", this);
+
+    for (uint32_t i = 0; i < mTimestampWrites.size(); ++i)
+    {
+        mTimestampWrites[i].querySet                  = mQuerySet;
+        mTimestampWrites[i].beginningOfPassWriteIndex = 2 * i;
+        mTimestampWrites[i].endOfPassWriteIndex       = 2 * i + 1;
+    }
+}
+
+GPUProfiler::~GPUProfiler()
+{
+    GPUMemory::Release(this);
+}
+
+void GPUProfiler::SetEnabled(bool enabled)
+{
+    if (enabled && !mSupported)
+    {
+        std::cout << "GPU profiler: timestamp queries are not supported by this adapter"
+                  << std::endl;
+    }
+    mEnabled = enabled;
+}
+
+bool GPUProfiler::OpenCSV(const std::string& path)
+{
+    mCSV.open(path);
+    if (!mCSV)
+    {
+        std::cerr << "GPU profiler: failed to open " << path << std::endl;
+        return false;
+    }
+    mCSV << "frame,stage,ms\n";
+    return true;
+}
+
+void GPUProfiler::BeginFrame()
+{
+    mCurrentSlot = nullptr;
+    mQueryCount  = 0;
+
+    if (IsEnabled())
+    {
+        mCurrentSlot = mReadback.Acquire();
+        if (mCurrentSlot)
+        {
+            ReadbackInfo& info = mCurrentSlot->info;
+            info.frame         = mFrameIndex;
+            info.stages.clear();
+            info.stages.reserve(MAX_QUERIES / 2);
+        }
+    }
+
+    ++mFrameIndex;
+}
+
+const wgpu::PassTimestampWrites* GPUProfiler::Allocate(const char* stage)
+{
+    if (!mCurrentSlot || mQueryCount + 2 > MAX_QUERIES)
+    {
+        return nullptr;
+    }
+
+    const wgpu::PassTimestampWrites* timestampWrites = &mTimestampWrites[mQueryCount / 2];
+    mCurrentSlot->info.stages.push_back(stage);
+    mQueryCount += 2;
+    return timestampWrites;
+}
+
+void GPUProfiler::Resolve(wgpu::CommandEncoder& commandEncoder)
+{
+    if (!mCurrentSlot || mQueryCount == 0)
+    {
+        return;
+    }
+
+    mCurrentSlot->info.cpuSubmitUs = Trace::Now();
+
+    uint64_t size = mQueryCount * sizeof(uint64_t);
+    commandEncoder.ResolveQuerySet(mQuerySet, 0, mQueryCount, mResolveBuffer, 0);
+    commandEncoder.CopyBufferToBuffer(mResolveBuffer, 0, mCurrentSlot->buffer, 0, size);
+}
+
+void GPUProfiler::EndFrame()
+{
+    if (!mCurrentSlot)
+    {
+        return;
+    }
+
+    Readback::Slot& slot = *mCurrentSlot;
+    mCurrentSlot         = nullptr;
+
+    if (mQueryCount == 0)
+    {
+        mReadback.Cancel(slot);
+        return;
+    }
+
+    mReadback.Map(slot,
+                  mQueryCount * sizeof(uint64_t),
+                  [this](const Readback::Slot& mapped, const void* data)
+                  { OnReadback(mapped.info, static_cast<const uint64_t*>(data)); });
+}
+
+void GPUProfiler::OnReadback(const ReadbackInfo& info, const uint64_t* timestamps)
+{
+
+    // A stage may span several passes (e.g. the filter iterations), sum them per frame. Stages
+    // which were not recorded this frame keep a negative value and are left untouched.
+    mFrameStageMs.assign(mStageTimings.size(), -1.0);
+    for (size_t i = 0; i < info.stages.size(); ++i)
+    {
+        uint64_t begin = timestamps[2 * i];
+        uint64_t end   = timestamps[2 * i + 1];
+        if (end < begin)
+        {
+            continue;
+        }
+
+        if (Trace::IsEnabled())
+        {
+            Trace::AddGPUZone(info.stages[i], begin, end, info.cpuSubmitUs);
+        }
+
+        StageTiming& stage = FindStage(info.stages[i]);
+        size_t index       = &stage - mStageTimings.data();
+        mFrameStageMs.resize(mStageTimings.size(), -1.0);
+        mFrameStageMs[index] = std::max(mFrameStageMs[index], 0.0) + (end - begin) * 1e-6;
+    }
+
+    for (size_t i = 0; i < mFrameStageMs.size(); ++i)
+    {
+        double ms = mFrameStageMs[i];
+        if (ms < 0.0)
+        {
+            continue;
+        }
+
+        StageTiming& stage = mStageTimings[i];
+
+        stage.lastMs = ms;
+        stage.averageMs =
+            stage.sampleCount == 0 ? ms : stage.averageMs + SMOOTHING * (ms - stage.averageMs);
+        stage.totalMs += ms;
+        ++stage.sampleCount;
+
+        if (mCSV)
+        {
+            mCSV << info.frame << "," << stage.name << "," << ms << "\n";
+        }
+    }
+}
+
+GPUProfiler::StageTiming& GPUProfiler::FindStage(const char* name)
+{
+    for (StageTiming& stage : mStageTimings)
+    {
+        if (stage.name == name)
+        {
+            return stage;
+        }
+    }
+
+    StageTiming& stage = mStageTimings.emplace_back();
+    stage.name         = name;
+    return stage;
+}
+
+void GPUProfiler::ResetStatistics()
+{
+    mStageTimings.clear();
+}
+
+double GPUProfiler::GetFrameAverageMs() const
+{
+    double ms = 0.0;
+    for (const StageTiming& stage : mStageTimings)
+    {
+        ms += stage.averageMs;
+    }
+    return ms;
+}
+
+void GPUProfiler::PrintSummary() const
+{
+    if (mStageTimings.empty())
+    {
+        return;
+    }
+
+    printf("GPU stage timings (mean over profiled frames):\n");
+    for (const StageTiming& stage : mStageTimings)
+    {
+        printf(" - %-20s %8.3f ms\n", stage.name.c_str(), stage.totalMs / stage.sampleCount);
+    }
+}
+
+ProfiledComputePass::ProfiledComputePass(wgpu::CommandEncoder& commandEncoder,
+                                         GPUProfiler* profiler) :
+    mCommandEncoder(commandEncoder),
+    mProfiler(profiler),
+    mProfiling(profiler && profiler->IsEnabled())
+{
+    if (!mProfiling)
+    {
+        wgpu::ComputePassDescriptor computePassDesc {
+            .timestampWrites = nullptr,
+        };
+        mPass = mCommandEncoder.BeginComputePass(&computePassDesc);
+    }
+}
+
+wgpu::ComputePassEncoder& ProfiledComputePass::Stage(const char* stage)
+{
+    if (mProfiling)
+    {
+        if (mPass)
+        {
+            mPass.End();
+        }
+
+        wgpu::ComputePassDescriptor computePassDesc {
+            .label           = WebGPUUtils::GenerateString(stage),
+            .timestampWrites = mProfiler->Allocate(stage),
+        };
+        mPass = mCommandEncoder.BeginComputePass(&computePassDesc);
+    }
+    return mPass;
+}
+
+void ProfiledComputePass::End()
+{
+    if (mPass)
+    {
+        mPass.End();
+        mPass = nullptr;
+    }
+}
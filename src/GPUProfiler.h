@@ -0,0 +1,127 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <array>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ReadbackRing.h"
+
+/**
+ * Timestamp query profiler. Every measured pass gets a pair of timestamps, the queries are
+ * resolved at the end of the frame and read back through a ring of buffers so the CPU never
+ * waits for the GPU. A frame is simply not profiled when no readback buffer is free.
+ */
+class GPUProfiler
+{
+public:
+    struct StageTiming
+    {
+        std::string name;
+        double lastMs    = 0.0;
+        double averageMs = 0.0;  // exponential moving average
+        double totalMs   = 0.0;  // since the last ResetStatistics()
+        int sampleCount  = 0;
+    };
+
+    GPUProfiler(wgpu::Device device, bool supported);
+    ~GPUProfiler();
+
+    bool IsSupported() const
+    {
+        return mSupported;
+    }
+
+    bool IsEnabled() const
+    {
+        return mSupported && mEnabled;
+    }
+
+    void SetEnabled(bool enabled);
+
+    bool OpenCSV(const std::string& path);
+
+    void BeginFrame();
+
+    /**
+     * Returns the timestamp writes for a pass measuring `stage`, or nullptr when the profiler is
+     * disabled or ran out of queries. `stage` must be a string literal.
+     */
+    const wgpu::PassTimestampWrites* Allocate(const char* stage);
+
+    // Record query resolution, call before finishing the frame's command encoder
+    void Resolve(wgpu::CommandEncoder& commandEncoder);
+
+    // Start the readback, call after the frame has been submitted
+    void EndFrame();
+
+    void ResetStatistics();
+
+    const std::vector<StageTiming>& GetStageTimings() const
+    {
+        return mStageTimings;
+    }
+
+    // Sum of the moving averages of all stages
+    double GetFrameAverageMs() const;
+
+    void PrintSummary() const;
+
+private:
+    struct ReadbackInfo
+    {
+        std::vector<const char*> stages;
+        uint64_t frame       = 0;
+        uint64_t cpuSubmitUs = 0;  // trace clock, taken before submission
+    };
+
+    using Readback = ReadbackRing<ReadbackInfo, 4>;
+
+    void OnReadback(const ReadbackInfo& info, const uint64_t* timestamps);
+    StageTiming& FindStage(const char* name);
+
+private:
+    static constexpr uint32_t MAX_QUERIES = 256;
+    static constexpr double SMOOTHING     = 0.05;
+
+    wgpu::Device mDevice;
+    wgpu::QuerySet mQuerySet;
+    wgpu::Buffer mResolveBuffer;
+    Readback mReadback;
+    std::array<wgpu::PassTimestampWrites, MAX_QUERIES / 2> mTimestampWrites;
+
+    bool mSupported = false;
+    bool mEnabled   = false;
+
+    Readback::Slot* mCurrentSlot = nullptr;
+    uint32_t mQueryCount         = 0;
+    uint64_t mFrameIndex         = 0;
+
+    std::vector<StageTiming> mStageTimings;
+    std::vector<double> mFrameStageMs;
+
+    std::ofstream mCSV;
+};
+
+/**
+ * Records a sequence of compute stages. Without profiling all stages share a single compute pass,
+ * while profiling each stage is recorded into its own timed pass.
+ */
+class ProfiledComputePass
+{
+public:
+    ProfiledComputePass(wgpu::CommandEncoder& commandEncoder, GPUProfiler* profiler);
+
+    // Returns the pass to record `stage` into
+    wgpu::ComputePassEncoder& Stage(const char* stage);
+
+    void End();
+
+private:
+    wgpu::CommandEncoder& mCommandEncoder;
+    GPUProfiler* mProfiler;
+    wgpu::ComputePassEncoder mPass;
+    bool mProfiling = false;
+};
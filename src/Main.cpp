@@ -2,12 +2,24 @@
 
 int main(int argc, char* argv[])
 {
-    Application app;
+    ApplicationOptions options;
+    if (!ApplicationOptions::Parse(argc, argv, options))
+    {
+        return 1;
+    }
+
+    Application app(options);
     if (!app.Initialize())
     {
         return 1;
     }
 
+    if (options.startupReport)
+    {
+        app.Shutdown();
+        return 0;
+    }
+
     app.RunLoop();
 
     return 0;
@@ -0,0 +1,213 @@
+#include "MetricsServer.h"
+
+#include <cstdio>
+#include <iostream>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+    #define METRICS_SERVER_SUPPORTED
+#endif
+
+MetricsServer::~MetricsServer()
+{
+    Stop();
+}
+
+bool MetricsServer::Start(int port)
+{
+#ifdef METRICS_SERVER_SUPPORTED
+    mSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (mSocket < 0)
+    {
+        std::cerr << "Metrics server: failed to create a socket" << std::endl;
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    #ifdef SO_NOSIGPIPE
+    setsockopt(mSocket, SOL_SOCKET, SO_NOSIGPIPE, &reuse, sizeof(reuse));
+    #endif
+
+    sockaddr_in address {};
+    address.sin_family      = AF_INET;
+    address.sin_port        = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(mSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+        || listen(mSocket, 4) < 0)
+    {
+        std::cerr << "Metrics server: failed to listen on port " << port << std::endl;
+        close(mSocket);
+        mSocket = -1;
+        return false;
+    }
+
+    mRunning = true;
+    mThread  = std::thread(&MetricsServer::Serve, this);
+
+    std::cout << "Serving metrics on http://127.0.0.1:" << port << "/metrics" << std::endl;
+    return true;
+#else
+    (void)port;
+    std::cerr << "Metrics server: not supported on this platform" << std::endl;
+    return false;
+#endif
+}
+
+void MetricsServer::Stop()
+{
+#ifdef METRICS_SERVER_SUPPORTED
+    mRunning = false;
+    if (mThread.joinable())
+    {
+        mThread.join();
+    }
+    if (mSocket >= 0)
+    {
+        close(mSocket);
+        mSocket = -1;
+    }
+#endif
+}
+
+void MetricsServer::Publish(const MetricsSnapshot& snapshot)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSnapshot = snapshot;
+}
+
+void MetricsServer::Serve()
+{
+#ifdef METRICS_SERVER_SUPPORTED
+    while (mRunning)
+    {
+        // Wake up regularly to notice Stop()
+        pollfd listener {mSocket, POLLIN, 0};
+        if (poll(&listener, 1, 200) <= 0)
+        {
+            continue;
+        }
+
+        int client = accept(mSocket, nullptr, nullptr);
+        if (client < 0)
+        {
+            continue;
+        }
+
+        // The request itself does not matter, every path serves the metrics
+        char request[1024];
+        pollfd readable {client, POLLIN, 0};
+        if (poll(&readable, 1, 1000) > 0)
+        {
+            recv(client, request, sizeof(request), 0);
+        }
+
+        std::string body = Format();
+        std::string response =
+            "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: "
+            + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+
+        int flags = 0;
+    #ifdef MSG_NOSIGNAL
+        flags = MSG_NOSIGNAL;
+    #endif
+        size_t sent = 0;
+        while (sent < response.size())
+        {
+            ssize_t n = send(client, response.data() + sent, response.size() - sent, flags);
+            if (n <= 0)
+            {
+                break;
+            }
+            sent += n;
+        }
+        close(client);
+    }
+#endif
+}
+
+std::string MetricsServer::Format()
+{
+    MetricsSnapshot snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        snapshot = mSnapshot;
+    }
+
+    std::string out;
+    char line[256];
+
+    auto metric = [&](const char* name, const char* type, const char* help, double value)
+    {
+        std::snprintf(line,
+                      sizeof(line),
+                      "# HELP %s %s\n# TYPE %s %s\n%s %.9g\n",
+                      name,
+                      help,
+                      name,
+                      type,
+                      name,
+                      value);
+        out += line;
+    };
+
+    metric("ocean_frames_total", "counter", "Frames rendered.", snapshot.frames);
+    metric("ocean_frame_time_seconds", "gauge", "CPU time between frames.", snapshot.frameMs / 1e3);
+    metric("ocean_encode_time_seconds",
+           "gauge",
+           "CPU time to encode a frame.",
+           snapshot.encodeMs / 1e3);
+    metric("ocean_submit_to_gpu_done_seconds",
+           "gauge",
+           "Latency from submit to GPU completion.",
+           snapshot.latencyMs / 1e3);
+    metric("ocean_frames_in_flight",
+           "gauge",
+           "Submitted frames not done.",
+           snapshot.framesInFlight);
+    metric("ocean_particles", "gauge", "Simulated particles.", snapshot.particles);
+    metric("ocean_substeps", "gauge", "Simulation substeps per frame.", snapshot.substeps);
+    metric("ocean_gpu_memory_bytes",
+           "gauge",
+           "Registered GPU buffers and textures.",
+           snapshot.gpuMemory);
+    metric("ocean_gpu_memory_budget_bytes",
+           "gauge",
+           "GPU memory budget, 0 without budget.",
+           snapshot.gpuBudget);
+    metric("ocean_device_lost_total", "counter", "Device lost events.", snapshot.deviceLost);
+    metric("ocean_device_errors_total",
+           "counter",
+           "Uncaptured device errors.",
+           snapshot.deviceErrors);
+
+    out += "# HELP ocean_simulation_info Active simulation.\n# TYPE ocean_simulation_info gauge\n";
+    std::snprintf(line,
+                  sizeof(line),
+                  "ocean_simulation_info{simulation=\"%s\"} 1\n",
+                  snapshot.simulation);
+    out += line;
+
+    if (snapshot.stageCount > 0)
+    {
+        out += "# HELP ocean_gpu_stage_seconds GPU time per stage, moving average.\n"
+               "# TYPE ocean_gpu_stage_seconds gauge\n";
+        for (size_t i = 0; i < snapshot.stageCount; ++i)
+        {
+            std::snprintf(line,
+                          sizeof(line),
+                          "ocean_gpu_stage_seconds{stage=\"%s\"} %.9g\n",
+                          snapshot.stages[i].name,
+                          snapshot.stages[i].ms / 1e3);
+            out += line;
+        }
+    }
+
+    return out;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Values exported by the metrics server. Plain data with fixed capacity so publishing a frame
+ * never allocates.
+ */
+struct MetricsSnapshot
+{
+    static constexpr size_t MAX_STAGES      = 32;
+    static constexpr size_t STAGE_NAME_SIZE = 48;
+
+    struct Stage
+    {
+        char name[STAGE_NAME_SIZE];
+        double ms;
+    };
+
+    uint64_t frames        = 0;
+    double frameMs         = 0.0;
+    double encodeMs        = 0.0;
+    double latencyMs       = 0.0;
+    int framesInFlight     = 0;
+    const char* simulation = "";
+    uint32_t particles     = 0;
+    int substeps           = 0;
+    uint64_t gpuMemory     = 0;
+    uint64_t gpuBudget     = 0;
+    uint32_t deviceLost    = 0;
+    uint32_t deviceErrors  = 0;
+
+    std::array<Stage, MAX_STAGES> stages;
+    size_t stageCount = 0;
+};
+
+/**
+ * Localhost HTTP endpoint serving the latest snapshot in the Prometheus text exposition format.
+ * Requests are answered on a thread of their own, the render thread only copies the snapshot
+ * under a mutex. POSIX only, Start() fails elsewhere.
+ */
+class MetricsServer
+{
+public:
+    MetricsServer() = default;
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&)            = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // Listen on 127.0.0.1:port
+    bool Start(int port);
+    void Stop();
+
+    void Publish(const MetricsSnapshot& snapshot);
+
+private:
+    void Serve();
+    std::string Format();
+
+private:
+    std::mutex mMutex;
+    MetricsSnapshot mSnapshot;
+
+    int mSocket = -1;
+    std::atomic<bool> mRunning {false};
+    std::thread mThread;
+};
@@ -0,0 +1,106 @@
+#include "PipelineBatch.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <string_view>
+#include <vector>
+
+#include "Trace.h"
+
+namespace PipelineBatch
+{
+    namespace
+    {
+        bool gActive = false;
+        bool gFailed = false;
+        std::vector<wgpu::Future> gFutures;
+
+        void ReportFailure(wgpu::CreatePipelineAsyncStatus status, wgpu::StringView message)
+        {
+            if (status != wgpu::CreatePipelineAsyncStatus::Success)
+            {
+                printf("Pipeline creation failed: %.*s\n",
+                       static_cast<int>(std::string_view(message).size()),
+                       std::string_view(message).data());
+                gFailed = true;
+            }
+        }
+    }  // namespace
+
+    void Begin()
+    {
+        gActive = true;
+        gFailed = false;
+        gFutures.clear();
+    }
+
+    bool IsActive()
+    {
+        return gActive;
+    }
+
+    void CreateComputePipeline(wgpu::Device device,
+                               const wgpu::ComputePipelineDescriptor& descriptor,
+                               wgpu::ComputePipeline& pipeline)
+    {
+        if (!gActive)
+        {
+            pipeline = device.CreateComputePipeline(&descriptor);
+            return;
+        }
+
+        gFutures.push_back(device.CreateComputePipelineAsync(
+            &descriptor,
+            wgpu::CallbackMode::WaitAnyOnly,
+            [&pipeline](wgpu::CreatePipelineAsyncStatus status,
+                        wgpu::ComputePipeline result,
+                        wgpu::StringView message)
+            {
+                ReportFailure(status, message);
+                pipeline = std::move(result);
+            }));
+    }
+
+    void CreateRenderPipeline(wgpu::Device device,
+                              const wgpu::RenderPipelineDescriptor& descriptor,
+                              wgpu::RenderPipeline& pipeline)
+    {
+        if (!gActive)
+        {
+            pipeline = device.CreateRenderPipeline(&descriptor);
+            return;
+        }
+
+        gFutures.push_back(device.CreateRenderPipelineAsync(
+            &descriptor,
+            wgpu::CallbackMode::WaitAnyOnly,
+            [&pipeline](wgpu::CreatePipelineAsyncStatus status,
+                        wgpu::RenderPipeline result,
+                        wgpu::StringView message)
+            {
+                ReportFailure(status, message);
+                pipeline = std::move(result);
+            }));
+    }
+
+    bool End(wgpu::Instance instance)
+    {
+        TRACE_SCOPE("PipelineBatch::End");
+
+        // All pipelines compile concurrently, the total wait is roughly the slowest one
+        for (wgpu::Future& future : gFutures)
+        {
+            // Without a successful wait the callback never ran and the target is still null
+            wgpu::WaitStatus status = instance.WaitAny(future, UINT64_MAX);
+            if (status != wgpu::WaitStatus::Success)
+            {
+                printf("Waiting for a pipeline failed: %d\n", static_cast<int>(status));
+                gFailed = true;
+            }
+        }
+
+        gFutures.clear();
+        gActive = false;
+        return !gFailed;
+    }
+}  // namespace PipelineBatch
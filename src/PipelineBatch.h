@@ -0,0 +1,30 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+/**
+ * Parallel pipeline creation. Between Begin() and End() pipelines are created with the async
+ * entry points so the backend can compile them concurrently on worker threads, and End() waits
+ * for all of them at once. Outside a batch the pipelines are created synchronously.
+ *
+ * The target handles are assigned when the pipeline is ready and must stay alive until End().
+ */
+namespace PipelineBatch
+{
+    void Begin();
+
+    bool IsActive();
+
+    void CreateComputePipeline(wgpu::Device device,
+                               const wgpu::ComputePipelineDescriptor& descriptor,
+                               wgpu::ComputePipeline& pipeline);
+
+    void CreateRenderPipeline(wgpu::Device device,
+                              const wgpu::RenderPipelineDescriptor& descriptor,
+                              wgpu::RenderPipeline& pipeline);
+
+    /**
+     * Wait for every pipeline of the batch, returns false if any of them failed to compile
+     */
+    bool End(wgpu::Instance instance);
+}  // namespace PipelineBatch
@@ -0,0 +1,264 @@
+#include "PipelineCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <system_error>
+
+namespace
+{
+    constexpr double MB = 1024.0 * 1024.0;
+
+    uint64_t Hash(const void* data, size_t size)
+    {
+        // FNV-1a, collisions are caught by the key stored in the file
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        uint64_t hash     = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string ToString(wgpu::StringView view)
+    {
+        return view.data ? std::string(std::string_view(view)) : std::string();
+    }
+}  // namespace
+
+PipelineCache::PipelineCache(const std::filesystem::path& directory, uint64_t maxBytes) :
+    mDirectory(directory),
+    mMaxBytes(maxBytes)
+{
+}
+
+bool PipelineCache::Open()
+{
+    std::error_code error;
+    std::filesystem::create_directories(mDirectory, error);
+    if (error)
+    {
+        printf("Could not create the pipeline cache %s: %s\n",
+               mDirectory.string().c_str(),
+               error.message().c_str());
+        return false;
+    }
+
+    struct File
+    {
+        std::string name;
+        uint64_t bytes;
+        std::filesystem::file_time_type time;
+    };
+
+    std::vector<File> files;
+    for (const auto& entry : std::filesystem::directory_iterator(mDirectory, error))
+    {
+        if (entry.is_regular_file() && entry.path().extension() == ".bin")
+        {
+            files.push_back({entry.path().filename().string(),
+                             static_cast<uint64_t>(entry.file_size()),
+                             entry.last_write_time()});
+        }
+    }
+
+    // The modification times carry the use order over from the previous runs
+    std::sort(files.begin(),
+              files.end(),
+              [](const File& a, const File& b) { return a.time < b.time; });
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.clear();
+    mTotalBytes = 0;
+    for (const File& file : files)
+    {
+        mEntries.push_back({file.name, file.bytes, ++mUseCounter});
+        mTotalBytes += file.bytes;
+    }
+    Evict();
+
+    return true;
+}
+
+void PipelineCache::Attach(wgpu::DeviceDescriptor& descriptor, const wgpu::AdapterInfo& adapterInfo)
+{
+#ifndef __EMSCRIPTEN__
+    mIsolationKey = ToString(adapterInfo.vendor) + "|" + ToString(adapterInfo.architecture) + "|"
+                    + ToString(adapterInfo.device) + "|" + ToString(adapterInfo.description) + "|"
+                    + std::to_string(adapterInfo.vendorID) + ":"
+                    + std::to_string(adapterInfo.deviceID) + "|"
+                    + std::to_string(static_cast<uint32_t>(adapterInfo.backendType));
+
+    mCacheDescriptor.nextInChain      = descriptor.nextInChain;
+    mCacheDescriptor.isolationKey     = {mIsolationKey.data(), mIsolationKey.size()};
+    mCacheDescriptor.functionUserdata = this;
+    mCacheDescriptor.loadDataFunction =
+        [](const void* key, size_t keySize, void* value, size_t valueSize, void* userdata)
+    { return static_cast<PipelineCache*>(userdata)->Load(key, keySize, value, valueSize); };
+    mCacheDescriptor.storeDataFunction =
+        [](const void* key, size_t keySize, const void* value, size_t valueSize, void* userdata)
+    { static_cast<PipelineCache*>(userdata)->Store(key, keySize, value, valueSize); };
+
+    descriptor.nextInChain = &mCacheDescriptor;
+#else
+    (void)descriptor;
+    (void)adapterInfo;
+#endif
+}
+
+size_t PipelineCache::Load(const void* key, size_t keySize, void* value, size_t valueSize)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::filesystem::path path = GetPath(key, keySize);
+    Entry* entry               = FindEntry(path.filename().string());
+
+    // Dawn first asks for the size with a null value, which is where hits and misses are counted
+    bool query = value == nullptr || valueSize == 0;
+
+    std::ifstream file(path, std::ios::binary);
+    uint64_t storedKeySize = 0;
+    if (!entry || !file || !file.read(reinterpret_cast<char*>(&storedKeySize), sizeof(uint64_t))
+        || storedKeySize != keySize)
+    {
+        mStatistics.misses += query ? 1 : 0;
+        return 0;
+    }
+
+    std::vector<char> storedKey(keySize);
+    if (!file.read(storedKey.data(), keySize) || std::memcmp(storedKey.data(), key, keySize) != 0)
+    {
+        mStatistics.misses += query ? 1 : 0;
+        return 0;
+    }
+
+    size_t size = entry->bytes - sizeof(uint64_t) - keySize;
+    if (query)
+    {
+        ++mStatistics.hits;
+        return size;
+    }
+
+    if (valueSize < size || !file.read(static_cast<char*>(value), size))
+    {
+        return 0;
+    }
+
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+    entry->lastUse = ++mUseCounter;
+    return size;
+}
+
+void PipelineCache::Store(const void* key, size_t keySize, const void* value, size_t valueSize)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::filesystem::path path = GetPath(key, keySize);
+    uint64_t bytes             = sizeof(uint64_t) + keySize + valueSize;
+    if (bytes > mMaxBytes)
+    {
+        return;
+    }
+
+    // Written to a temporary file first so a crash never leaves a truncated entry behind
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        uint64_t size = keySize;
+        file.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
+        file.write(static_cast<const char*>(key), keySize);
+        file.write(static_cast<const char*>(value), valueSize);
+        if (!file)
+        {
+            return;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        std::filesystem::remove(temporary, error);
+        return;
+    }
+
+    std::string name = path.filename().string();
+    if (Entry* entry = FindEntry(name))
+    {
+        mTotalBytes -= entry->bytes;
+        entry->bytes   = bytes;
+        entry->lastUse = ++mUseCounter;
+    }
+    else
+    {
+        mEntries.push_back({name, bytes, ++mUseCounter});
+    }
+    mTotalBytes += bytes;
+    ++mStatistics.stores;
+
+    Evict();
+}
+
+std::filesystem::path PipelineCache::GetPath(const void* key, size_t keySize) const
+{
+    char name[32];
+    snprintf(name,
+             sizeof(name),
+             "%016llx.bin",
+             static_cast<unsigned long long>(Hash(key, keySize)));
+    return mDirectory / name;
+}
+
+PipelineCache::Entry* PipelineCache::FindEntry(const std::string& name)
+{
+    auto it = std::find_if(
+        mEntries.begin(), mEntries.end(), [&](const Entry& entry) { return entry.name == name; });
+    return it != mEntries.end() ? &*it : nullptr;
+}
+
+void PipelineCache::Evict()
+{
+    while (mTotalBytes > mMaxBytes && !mEntries.empty())
+    {
+        auto oldest = std::min_element(mEntries.begin(),
+                                       mEntries.end(),
+                                       [](const Entry& a, const Entry& b)
+                                       { return a.lastUse < b.lastUse; });
+
+        std::error_code error;
+        std::filesystem::remove(mDirectory / oldest->name, error);
+        mTotalBytes -= oldest->bytes;
+        mEntries.erase(oldest);
+        ++mStatistics.evictions;
+    }
+}
+
+PipelineCache::Statistics PipelineCache::GetStatistics()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStatistics;
+}
+
+uint64_t PipelineCache::GetTotalBytes()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mTotalBytes;
+}
+
+void PipelineCache::PrintReport()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    printf("Pipeline cache: %llu hits, %llu misses, %llu stores, %llu evictions, %.2f of %.2f MB\n",
+           static_cast<unsigned long long>(mStatistics.hits),
+           static_cast<unsigned long long>(mStatistics.misses),
+           static_cast<unsigned long long>(mStatistics.stores),
+           static_cast<unsigned long long>(mStatistics.evictions),
+           mTotalBytes / MB,
+           mMaxBytes / MB);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Disk-backed blob cache for Dawn's compiled shaders and pipelines. Dawn keys the blobs by the
+ * shader source and pipeline state, the isolation key adds the adapter and driver so a driver
+ * update starts a fresh cache. One file per blob, least recently used files are evicted once
+ * the directory exceeds its size cap.
+ *
+ * Dawn may call the cache from its compilation threads, every access is serialized. Native only,
+ * Attach() does nothing on the web.
+ */
+class PipelineCache
+{
+public:
+    struct Statistics
+    {
+        uint64_t hits      = 0;
+        uint64_t misses    = 0;
+        uint64_t stores    = 0;
+        uint64_t evictions = 0;
+    };
+
+    PipelineCache(const std::filesystem::path& directory, uint64_t maxBytes);
+
+    PipelineCache(const PipelineCache&)            = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    // Create the directory and index the existing entries
+    bool Open();
+
+    /**
+     * Chain the cache into `descriptor`, keeping both this object and the descriptor chain alive
+     * until the device is created
+     */
+    void Attach(wgpu::DeviceDescriptor& descriptor, const wgpu::AdapterInfo& adapterInfo);
+
+    Statistics GetStatistics();
+    uint64_t GetTotalBytes();
+
+    void PrintReport();
+
+private:
+    struct Entry
+    {
+        std::string name;
+        uint64_t bytes;
+        uint64_t lastUse;  // ordering only, files are touched on every hit
+    };
+
+    size_t Load(const void* key, size_t keySize, void* value, size_t valueSize);
+    void Store(const void* key, size_t keySize, const void* value, size_t valueSize);
+
+    std::filesystem::path GetPath(const void* key, size_t keySize) const;
+    Entry* FindEntry(const std::string& name);
+    void Evict();
+
+private:
+    std::filesystem::path mDirectory;
+    uint64_t mMaxBytes;
+
+    std::mutex mMutex;
+    std::vector<Entry> mEntries;
+    uint64_t mTotalBytes = 0;
+    uint64_t mUseCounter = 0;
+    Statistics mStatistics;
+
+    std::string mIsolationKey;
+#ifndef __EMSCRIPTEN__
+    wgpu::DawnCacheDeviceDescriptor mCacheDescriptor;
+#endif
+};
@@ -0,0 +1,138 @@
+#include "PositionInterpolator.h"
+
+#include <cmath>
+#include <vector>
+
+#include "Application.h"
+#include "GPUMemory.h"
+#include "GPUProfiler.h"
+#include "PipelineBatch.h"
+#include "ResourceManager.h"
+#include "WebGPUUtils.h"
+
+PositionInterpolator::PositionInterpolator(wgpu::Device device,
+                                           const std::array<wgpu::Buffer, 2>& posvelBuffers,
+                                           uint32_t maxParticles,
+                                           GPUProfiler* profiler) :
+    mDevice(device),
+    mProfiler(profiler),
+    mPosvelBuffers(posvelBuffers)
+{
+    wgpu::BufferDescriptor bufferDesc {
+        .label = WebGPUUtils::GenerateString("previous position storage buffer"),
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage,
+        .size  = sizeof(PosVel) * maxParticles,
+    };
+
+    mPreviousBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "PositionInterpolator", this);
+
+    bufferDesc.label = WebGPUUtils::GenerateString("interpolated position storage buffer");
+    bufferDesc.usage = wgpu::BufferUsage::Storage;
+
+    mOutputBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "PositionInterpolator", this);
+
+    bufferDesc.label = WebGPUUtils::GenerateString("interpolation params buffer");
+    bufferDesc.usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
+    bufferDesc.size  = sizeof(Params);
+
+    mParamsBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "PositionInterpolator", this);
+
+    wgpu::ShaderModule module =
+        ResourceManager::LoadShaderModule("resources/shader/interpolatePosvel.wgsl", mDevice);
+
+    std::vector<wgpu::BindGroupLayoutEntry> bindingLayoutEntries(4);
+    const wgpu::BufferBindingType types[] = {wgpu::BufferBindingType::ReadOnlyStorage,
+                                             wgpu::BufferBindingType::ReadOnlyStorage,
+                                             wgpu::BufferBindingType::Storage,
+                                             wgpu::BufferBindingType::Uniform};
+    for (uint32_t i = 0; i < bindingLayoutEntries.size(); ++i)
+    {
+        wgpu::BindGroupLayoutEntry& bindingLayout = bindingLayoutEntries[i];
+        WebGPUUtils::SetDefaultBindGroupLayout(bindingLayout);
+        bindingLayout.binding     = i;
+        bindingLayout.visibility  = wgpu::ShaderStage::Compute;
+        bindingLayout.buffer.type = types[i];
+    }
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEntries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEntries.data();
+    wgpu::BindGroupLayout bindGroupLayout = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = &bindGroupLayout;
+    wgpu::PipelineLayout layout     = mDevice.CreatePipelineLayout(&layoutDesc);
+
+    wgpu::ComputePipelineDescriptor computePipelineDesc {
+        .label  = WebGPUUtils::GenerateString("interpolate position pipeline"),
+        .layout = layout,
+        .compute =
+            {
+                .module     = module,
+                .entryPoint = "interpolatePosvel",
+            },
+    };
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mPipeline);
+
+    for (uint32_t index = 0; index < 2; ++index)
+    {
+        std::vector<wgpu::BindGroupEntry> bindings(4);
+        const wgpu::Buffer buffers[] = {
+            mPreviousBuffer, mPosvelBuffers[index], mOutputBuffer, mParamsBuffer};
+        for (uint32_t i = 0; i < bindings.size(); ++i)
+        {
+            bindings[i].binding = i;
+            bindings[i].buffer  = buffers[i];
+            bindings[i].offset  = 0;
+            bindings[i].size    = buffers[i].GetSize();
+        }
+
+        wgpu::BindGroupDescriptor bindGroupDesc {
+            .label      = WebGPUUtils::GenerateString("interpolate position bind group"),
+            .layout     = bindGroupLayout,
+            .entryCount = static_cast<uint32_t>(bindings.size()),
+            .entries    = bindings.data(),
+        };
+        mBindGroups[index] = mDevice.CreateBindGroup(&bindGroupDesc);
+    }
+}
+
+PositionInterpolator::~PositionInterpolator()
+{
+    GPUMemory::Release(this);
+}
+
+void PositionInterpolator::BeginSteps(wgpu::CommandEncoder& commandEncoder,
+                                      uint32_t numParticles,
+                                      int steps)
+{
+    if (steps <= 0)
+    {
+        return;
+    }
+
+    // Until the simulation has run once after a reset the positions are stale
+    commandEncoder.CopyBufferToBuffer(
+        mPosvelBuffers[mPosvelIndex], 0, mPreviousBuffer, 0, sizeof(PosVel) * numParticles);
+    mSpan  = mValid ? steps : 0;
+    mValid = true;
+}
+
+void PositionInterpolator::Interpolate(wgpu::CommandEncoder& commandEncoder,
+                                       uint32_t numParticles,
+                                       double alpha)
+{
+    // The displayed time lags the current state by 1 - alpha steps
+    float weight = mSpan > 0 ? static_cast<float>(1.0 - (1.0 - alpha) / mSpan) : 1.0f;
+
+    Params params {.n = numParticles, .weight = weight};
+    mDevice.GetQueue().WriteBuffer(mParamsBuffer, 0, &params, sizeof(Params));
+
+    ProfiledComputePass computePass(commandEncoder, mProfiler);
+    wgpu::ComputePassEncoder& pass = computePass.Stage("Interpolate positions");
+    pass.SetBindGroup(0, mBindGroups[mPosvelIndex], 0, nullptr);
+    pass.SetPipeline(mPipeline);
+    pass.DispatchWorkgroups(std::ceil(numParticles / 64.0f));
+    computePass.End();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <array>
+#include <cstdint>
+
+class GPUProfiler;
+
+/**
+ * Renders the particles between the last two simulation states when the simulation runs on its
+ * own clock. The state before a frame's steps is kept, and the renderers read a blend of it and
+ * the current positions from GetOutputBuffer().
+ *
+ * When a frame ran several steps the blend spans all of them, which is exact at both ends and
+ * linear in between.
+ */
+class PositionInterpolator
+{
+public:
+    PositionInterpolator(wgpu::Device device,
+                         const std::array<wgpu::Buffer, 2>& posvelBuffers,
+                         uint32_t maxParticles,
+                         GPUProfiler* profiler);
+    ~PositionInterpolator();
+
+    const wgpu::Buffer& GetOutputBuffer() const
+    {
+        return mOutputBuffer;
+    }
+
+    // Forget the previous state, e.g. after a reset, the next frames show the current one
+    void Invalidate()
+    {
+        mValid = false;
+        mSpan  = 0;
+    }
+
+    // Select the posvel buffer holding the current state, see Application::mPosvelIndex
+    void SetPosvelIndex(uint32_t index)
+    {
+        mPosvelIndex = index;
+    }
+
+    // Keep the current state as the previous one, record before the simulation steps
+    void BeginSteps(wgpu::CommandEncoder& commandEncoder, uint32_t numParticles, int steps);
+
+    // Blend at `alpha` steps past the current state's predecessor, record after the steps
+    void Interpolate(wgpu::CommandEncoder& commandEncoder, uint32_t numParticles, double alpha);
+
+private:
+    struct Params
+    {
+        uint32_t n;
+        float weight;
+    };
+
+private:
+    wgpu::Device mDevice;
+    GPUProfiler* mProfiler;
+
+    std::array<wgpu::Buffer, 2> mPosvelBuffers;
+    wgpu::Buffer mPreviousBuffer;
+    wgpu::Buffer mOutputBuffer;
+    wgpu::Buffer mParamsBuffer;
+    wgpu::ComputePipeline mPipeline;
+    wgpu::BindGroup mBindGroups[2];  // one per posvel buffer
+    uint32_t mPosvelIndex = 0;
+
+    bool mValid = false;
+    int mSpan   = 0;  // steps between the previous and the current state, 0 without a previous
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+#include "GPUMemory.h"
+#include "WebGPUUtils.h"
+
+/**
+ * Ring of MapRead buffers carrying GPU results back to the CPU without stalling. A slot is taken
+ * when a frame starts recording and returns to the ring once its mapping completed, a frame
+ * simply goes without a readback when no slot is free. `Info` holds whatever the owner needs to
+ * interpret the data later, e.g. the frame it was recorded in.
+ *
+ * Map callbacks only run in Instance::ProcessEvents, which the render thread pumps every frame, so
+ * the owner's results are written on the thread that records and reads them.
+ */
+template <typename Info, size_t Size>
+class ReadbackRing
+{
+    enum class State
+    {
+        Free,
+        Recording,
+        Mapping,
+    };
+
+public:
+    class Slot
+    {
+    public:
+        wgpu::Buffer buffer;
+        Info info {};
+
+    private:
+        friend class ReadbackRing;
+        State state = State::Free;
+    };
+
+    ReadbackRing() = default;
+
+    ReadbackRing(const ReadbackRing&)            = delete;
+    ReadbackRing& operator=(const ReadbackRing&) = delete;
+
+    ~ReadbackRing()
+    {
+        // Pending map callbacks are aborted, they still run in a later ProcessEvents
+        *mAlive = false;
+        for (Slot& slot : mSlots)
+        {
+            if (slot.buffer)
+            {
+                slot.buffer.Destroy();
+            }
+        }
+    }
+
+    // Allocate `size` bytes per slot, recorded in GPUMemory for `owner` and `instance`
+    void Create(wgpu::Device device,
+                uint64_t size,
+                const char* label,
+                const char* owner,
+                const void* instance)
+    {
+        wgpu::BufferDescriptor bufferDesc {
+            .label = WebGPUUtils::GenerateString(label),
+            .usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst,
+            .size  = size,
+        };
+        for (Slot& slot : mSlots)
+        {
+            slot.buffer = GPUMemory::CreateBuffer(device, bufferDesc, owner, instance);
+        }
+    }
+
+    // The next free slot in ring order, nullptr when all are in use or the ring was not created
+    Slot* Acquire()
+    {
+        for (size_t i = 0; i < Size; ++i)
+        {
+            Slot& slot = mSlots[(mNext + i) % Size];
+            if (slot.buffer && slot.state == State::Free)
+            {
+                slot.state = State::Recording;
+                mNext      = (mNext + i + 1) % Size;
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    // Return an acquired slot nothing was copied into
+    void Cancel(Slot& slot)
+    {
+        slot.state = State::Free;
+    }
+
+    /**
+     * Map the first `size` bytes of an acquired slot once the copy into it was submitted.
+     * `onMapped(const Slot&, const void* data)` runs when the data is readable, the slot is free
+     * again after it returned. A failed mapping only frees the slot.
+     */
+    template <typename F>
+    void Map(Slot& slot, uint64_t size, F onMapped)
+    {
+        slot.state = State::Mapping;
+        slot.buffer.MapAsync(wgpu::MapMode::Read,
+                             0,
+                             size,
+                             wgpu::CallbackMode::AllowProcessEvents,
+                             [alive = mAlive, &slot, size, onMapped](wgpu::MapAsyncStatus status,
+                                                                     wgpu::StringView)
+                             {
+                                 if (!*alive)
+                                 {
+                                     return;
+                                 }
+                                 if (status == wgpu::MapAsyncStatus::Success)
+                                 {
+                                     const void* data = slot.buffer.GetConstMappedRange(0, size);
+                                     if (data)
+                                     {
+                                         onMapped(static_cast<const Slot&>(slot), data);
+                                     }
+                                     slot.buffer.Unmap();
+                                 }
+                                 slot.state = State::Free;
+                             });
+    }
+
+private:
+    std::array<Slot, Size> mSlots;
+    size_t mNext = 0;
+
+    // Cleared on destruction, the callbacks of aborted mappings outlive the ring
+    std::shared_ptr<bool> mAlive = std::make_shared<bool>(true);
+};
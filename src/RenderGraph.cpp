@@ -0,0 +1,162 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "Trace.h"
+
+void RenderGraph::Reset()
+{
+    mTextures.clear();
+    mPasses.clear();
+}
+
+RenderGraph::Texture RenderGraph::CreateTexture(const char* name,
+                                                wgpu::TextureFormat format,
+                                                uint32_t width,
+                                                uint32_t height)
+{
+    mTextures.push_back({name, {format, width, height}, false, nullptr});
+    return static_cast<Texture>(mTextures.size() - 1);
+}
+
+RenderGraph::Texture RenderGraph::ImportOutput(const char* name)
+{
+    mTextures.push_back({name, {}, true, nullptr});
+    return static_cast<Texture>(mTextures.size() - 1);
+}
+
+void RenderGraph::AddPass(const char* name,
+                          std::initializer_list<Texture> reads,
+                          std::initializer_list<Texture> writes,
+                          ExecuteFunction execute)
+{
+    mPasses.push_back({name, reads, writes, std::move(execute)});
+}
+
+void RenderGraph::Compile(TexturePool& pool, const void* lessee)
+{
+    TRACE_SCOPE("RenderGraph::Compile");
+
+    // Walk back from the outputs, a pass is needed if a later needed pass reads what it writes
+    std::vector<bool> needed(mTextures.size());
+    for (size_t i = 0; i < mTextures.size(); ++i)
+    {
+        needed[i] = mTextures[i].imported;
+    }
+    for (auto it = mPasses.rbegin(); it != mPasses.rend(); ++it)
+    {
+        PassNode& pass = *it;
+        pass.culled = std::none_of(
+            pass.writes.begin(), pass.writes.end(), [&](Texture t) { return needed[t]; });
+        if (!pass.culled)
+        {
+            for (Texture texture : pass.reads)
+            {
+                needed[texture] = true;
+            }
+        }
+    }
+
+    // Lifetimes in pass indices, -1 when no remaining pass uses the texture
+    std::vector<int> first(mTextures.size(), -1);
+    std::vector<int> last(mTextures.size(), -1);
+    for (int i = 0; i < static_cast<int>(mPasses.size()); ++i)
+    {
+        const PassNode& pass = mPasses[i];
+        if (pass.culled)
+        {
+            continue;
+        }
+        for (const std::vector<Texture>* textures : {&pass.reads, &pass.writes})
+        {
+            for (Texture texture : *textures)
+            {
+                first[texture] = first[texture] < 0 ? i : first[texture];
+                last[texture]  = i;
+            }
+        }
+    }
+
+    std::vector<Texture> order(mTextures.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(
+        order.begin(), order.end(), [&](Texture a, Texture b) { return first[a] < first[b]; });
+
+    // Each texture takes the first pool texture of its key that is free again, or a new one
+    struct Physical
+    {
+        TexturePool::Key key;
+        uint32_t index;
+        int last;
+    };
+    std::vector<Physical> physicals;
+    std::vector<uint32_t> assigned(mTextures.size());
+    std::vector<TexturePool::Request> requests;
+    for (Texture texture : order)
+    {
+        const TextureNode& node = mTextures[texture];
+        if (node.imported || first[texture] < 0)
+        {
+            continue;
+        }
+
+        auto it = std::find_if(physicals.begin(),
+                               physicals.end(),
+                               [&](const Physical& physical)
+                               {
+                                   return physical.key == node.key
+                                          && physical.last < first[texture];
+                               });
+        if (it != physicals.end())
+        {
+            it->last          = last[texture];
+            assigned[texture] = it->index;
+            continue;
+        }
+
+        auto request = std::find_if(requests.begin(),
+                                    requests.end(),
+                                    [&](const TexturePool::Request& r)
+                                    { return r.key == node.key; });
+        if (request == requests.end())
+        {
+            requests.push_back({node.key, 0});
+            request = requests.end() - 1;
+        }
+        assigned[texture] = request->count++;
+        physicals.push_back({node.key, assigned[texture], last[texture]});
+    }
+
+    pool.SetLeases(lessee, requests);
+
+    for (Texture texture = 0; texture < mTextures.size(); ++texture)
+    {
+        TextureNode& node = mTextures[texture];
+        if (!node.imported)
+        {
+            node.view = first[texture] < 0 ? nullptr : pool.GetView(node.key, assigned[texture]);
+        }
+    }
+}
+
+void RenderGraph::SetView(Texture texture, wgpu::TextureView view)
+{
+    mTextures[texture].view = view;
+}
+
+wgpu::TextureView RenderGraph::GetView(Texture texture) const
+{
+    return mTextures[texture].view;
+}
+
+void RenderGraph::Execute(wgpu::CommandEncoder& commandEncoder) const
+{
+    for (const PassNode& pass : mPasses)
+    {
+        if (!pass.culled)
+        {
+            pass.execute(commandEncoder);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "TexturePool.h"
+
+/**
+ * Declares the passes of a frame with the textures they read and write, then runs them in
+ * declaration order. Compile() culls every pass that does not contribute to an imported output,
+ * and allocates the transient textures of the remaining passes from a TexturePool: textures of
+ * the same format and size whose lifetimes, from the first to the last pass using them, do not
+ * overlap share one pool texture.
+ *
+ * A pass may encode several render passes, e.g. the iterations of a separable filter. Writing a
+ * texture does not end the need for earlier writes to it, which keeps ping-pong passes alive.
+ */
+class RenderGraph
+{
+public:
+    using Texture         = uint32_t;
+    using ExecuteFunction = std::function<void(wgpu::CommandEncoder&)>;
+
+    // Forget every pass and texture, the views stay leased until the next Compile()
+    void Reset();
+
+    Texture CreateTexture(const char* name,
+                          wgpu::TextureFormat format,
+                          uint32_t width,
+                          uint32_t height);
+
+    // A texture owned elsewhere, e.g. the surface, its view is set every frame with SetView()
+    Texture ImportOutput(const char* name);
+
+    void AddPass(const char* name,
+                 std::initializer_list<Texture> reads,
+                 std::initializer_list<Texture> writes,
+                 ExecuteFunction execute);
+
+    // Cull, alias and lease the transient textures as `lessee`
+    void Compile(TexturePool& pool, const void* lessee);
+
+    void SetView(Texture texture, wgpu::TextureView view);
+
+    // nullptr for a transient texture only the culled passes use
+    wgpu::TextureView GetView(Texture texture) const;
+
+    void Execute(wgpu::CommandEncoder& commandEncoder) const;
+
+private:
+    struct TextureNode
+    {
+        std::string name;
+        TexturePool::Key key;
+        bool imported;
+        wgpu::TextureView view;
+    };
+
+    struct PassNode
+    {
+        std::string name;
+        std::vector<Texture> reads;
+        std::vector<Texture> writes;
+        ExecuteFunction execute;
+        bool culled = false;
+    };
+
+private:
+    std::vector<TextureNode> mTextures;
+    std::vector<PassNode> mPasses;
+};
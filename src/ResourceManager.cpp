@@ -3,42 +3,275 @@
 #include <algorithm>
 #include <array>
 #include <bit>
+#include <cctype>
+#include <cstdio>
 #include <fstream>
+#include <map>
+#include <set>
 #include <sstream>
 #include <string>
+#include <utility>
 
 #include <stb_image.h>
 
+#include "EmbeddedShaders.h"
 #include "WebGPUUtils.h"
 
+namespace
+{
+    const std::filesystem::path SHADER_ROOT = "resources/shader";
+
+    std::filesystem::path gShaderOverrideDirectory;
+
+    // Modules by device, path and defines, only used for the embedded shaders
+    std::map<std::pair<WGPUDevice, std::string>, wgpu::ShaderModule> gShaderModules;
+
+    bool ReadShaderSource(const std::filesystem::path& path, std::string& source)
+    {
+        if (gShaderOverrideDirectory.empty())
+        {
+            const EmbeddedShaders::Shader* shader = EmbeddedShaders::Find(path.generic_string());
+            if (!shader)
+            {
+                printf("Shader %s is not embedded\n", path.generic_string().c_str());
+                return false;
+            }
+            source = shader->source;
+            return true;
+        }
+
+        std::filesystem::path filePath =
+            gShaderOverrideDirectory / path.lexically_relative(SHADER_ROOT);
+        std::ifstream file(filePath);
+        if (!file.is_open())
+        {
+            printf("Could not open shader %s\n", filePath.string().c_str());
+            return false;
+        }
+        file.seekg(0, std::ios::end);
+        size_t size = file.tellg();
+        source      = std::string(size, ' ');
+        file.seekg(0);
+        file.read(source.data(), size);
+        return true;
+    }
+
+    bool IsIdentifierChar(char c)
+    {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    // Replace the defines that have a value on identifier boundaries
+    void SubstituteDefines(std::string_view line,
+                           const ResourceManager::ShaderDefines& defines,
+                           std::string& output)
+    {
+        size_t i = 0;
+        while (i < line.size())
+        {
+            if (!IsIdentifierChar(line[i]) || std::isdigit(static_cast<unsigned char>(line[i])))
+            {
+                output += line[i++];
+                continue;
+            }
+
+            size_t end = i;
+            while (end < line.size() && IsIdentifierChar(line[end]))
+            {
+                ++end;
+            }
+            std::string identifier(line.substr(i, end - i));
+            auto it = defines.find(identifier);
+            output += it != defines.end() && !it->second.empty() ? it->second : identifier;
+            i = end;
+        }
+    }
+
+    /**
+     * Minimal preprocessor: #include "path" (relative to resources/shader, every file at most
+     * once), #define NAME [VALUE], #undef, #ifdef, #ifndef, #else and #endif
+     */
+    bool ComposeShaderSource(const std::filesystem::path& path,
+                             ResourceManager::ShaderDefines& defines,
+                             std::set<std::string>& included,
+                             std::string& output)
+    {
+        std::string source;
+        if (!included.insert(path.generic_string()).second)
+        {
+            return true;
+        }
+        if (!ReadShaderSource(path, source))
+        {
+            return false;
+        }
+
+        struct Condition
+        {
+            bool active;  // lines up to the next #else or #endif are kept
+            bool parentActive;
+        };
+        std::vector<Condition> conditions;
+
+        auto fail = [&](int lineNumber, const char* message)
+        {
+            printf("%s:%d: %s\n", path.generic_string().c_str(), lineNumber, message);
+            return false;
+        };
+
+        std::istringstream stream(source);
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(stream, line))
+        {
+            ++lineNumber;
+            bool active = conditions.empty() || conditions.back().active;
+
+            size_t first = line.find_first_not_of(" \t");
+            if (first == std::string::npos || line[first] != '#')
+            {
+                if (active)
+                {
+                    SubstituteDefines(line, defines, output);
+                    output += '\n';
+                }
+                continue;
+            }
+
+            std::istringstream directiveStream(line.substr(first + 1));
+            std::string directive, name;
+            directiveStream >> directive >> name;
+
+            if (directive == "ifdef" || directive == "ifndef")
+            {
+                bool defined = defines.count(name) > 0;
+                conditions.push_back({active && defined == (directive == "ifdef"), active});
+            }
+            else if (directive == "else")
+            {
+                if (conditions.empty())
+                {
+                    return fail(lineNumber, "#else without #ifdef");
+                }
+                Condition& condition = conditions.back();
+                condition.active     = condition.parentActive && !condition.active;
+            }
+            else if (directive == "endif")
+            {
+                if (conditions.empty())
+                {
+                    return fail(lineNumber, "#endif without #ifdef");
+                }
+                conditions.pop_back();
+            }
+            else if (!active)
+            {
+                continue;
+            }
+            else if (directive == "include")
+            {
+                size_t open  = line.find('"');
+                size_t close = line.rfind('"');
+                if (open == std::string::npos || close <= open)
+                {
+                    return fail(lineNumber, "expected #include \"path\"");
+                }
+                std::string includePath = line.substr(open + 1, close - open - 1);
+                if (!ComposeShaderSource(SHADER_ROOT / includePath, defines, included, output))
+                {
+                    return fail(lineNumber, "included from here");
+                }
+            }
+            else if (directive == "define")
+            {
+                std::string value;
+                std::getline(directiveStream >> std::ws, value);
+                defines[name] = value;
+            }
+            else if (directive == "undef")
+            {
+                defines.erase(name);
+            }
+            else
+            {
+                return fail(lineNumber, "unknown directive");
+            }
+        }
+
+        if (!conditions.empty())
+        {
+            return fail(lineNumber, "missing #endif");
+        }
+        return true;
+    }
+}  // namespace
+
 wgpu::ShaderModule ResourceManager::LoadShaderModule(const std::filesystem::path& path,
-                                                     wgpu::Device device)
+                                                     wgpu::Device device,
+                                                     const ShaderDefines& defines)
 {
-    std::ifstream file(path);
-    if (!file.is_open())
+    // Path and permutation, also the label of the module
+    std::string key = path.generic_string();
+    for (const auto& [name, value] : defines)
+    {
+        key += " " + name + (value.empty() ? "" : "=" + value);
+    }
+
+    // Shaders loaded from disk are compiled every time so edits show up on the next load
+    bool cached                = gShaderOverrideDirectory.empty();
+    auto cacheKey              = std::make_pair(device.Get(), key);
+    wgpu::ShaderModule* module = nullptr;
+    if (cached)
     {
+        module = &gShaderModules[cacheKey];
+        if (*module)
+        {
+            return *module;
+        }
+    }
+
+    std::string composed;
+    ShaderDefines composeDefines = defines;
+    std::set<std::string> included;
+    if (!ComposeShaderSource(path, composeDefines, included, composed))
+    {
+        if (cached)
+        {
+            gShaderModules.erase(cacheKey);
+        }
         return nullptr;
     }
-    file.seekg(0, std::ios::end);
-    size_t size = file.tellg();
-    std::string shaderSource(size, ' ');
-    file.seekg(0);
-    file.read(shaderSource.data(), size);
 
     wgpu::ShaderSourceWGSL shaderCodeDesc {};
     shaderCodeDesc.nextInChain = nullptr;
     shaderCodeDesc.sType       = wgpu::SType::ShaderSourceWGSL;
-    shaderCodeDesc.code        = WebGPUUtils::GenerateString(shaderSource.c_str());
+    shaderCodeDesc.code        = {composed.data(), composed.size()};
 
     wgpu::ShaderModuleDescriptor shaderDesc {
         .nextInChain = &shaderCodeDesc,
+        .label       = {key.data(), key.size()},
     };
 
     wgpu::ShaderModule shaderMdoule = device.CreateShaderModule(&shaderDesc);
+    if (cached)
+    {
+        *module = shaderMdoule;
+    }
 
     return shaderMdoule;
 }
 
+void ResourceManager::ReleaseShaderModules()
+{
+    gShaderModules.clear();
+}
+
+void ResourceManager::SetShaderOverrideDirectory(const std::filesystem::path& directory)
+{
+    gShaderOverrideDirectory = directory;
+    gShaderModules.clear();
+}
+
 wgpu::Texture ResourceManager::LoadTexture(const std::filesystem::path& path,
                                            wgpu::Device device,
                                            wgpu::TextureView* pTextureView)
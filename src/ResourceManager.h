@@ -1,14 +1,38 @@
 #pragma once
 
 #include <webgpu/webgpu_cpp.h>
+#include <cstdint>
 #include <filesystem>
+#include <map>
+#include <string>
 #include <vector>
 
 class ResourceManager
 {
 public:
+    // Permutation keys, a define without value only selects #ifdef blocks
+    using ShaderDefines = std::map<std::string, std::string>;
+
+    /**
+     * Create a shader module from the copy of `path` embedded at build time, e.g.
+     * "resources/shader/sph/force.wgsl". Read from disk instead with a shader override directory.
+     *
+     * The source is run through a small preprocessor first: #include "include/sph.wgsl" pulls in
+     * shared declarations, #ifdef / #ifndef / #else / #endif select code by `defines`. Every
+     * permutation is compiled once per device and the module cached by path and defines
+     */
     static wgpu::ShaderModule LoadShaderModule(const std::filesystem::path& path,
-                                               wgpu::Device device);
+                                               wgpu::Device device,
+                                               const ShaderDefines& defines = {});
+
+    // Drop the cached modules, which keep their devices alive, call before the device goes away
+    static void ReleaseShaderModules();
+
+    /**
+     * Development mode: load shaders from `directory`, which takes the place of resources/shader,
+     * so shaders can be edited without rebuilding. An empty path restores the embedded shaders
+     */
+    static void SetShaderOverrideDirectory(const std::filesystem::path& directory);
 
     static wgpu::Texture LoadTexture(const std::filesystem::path& path,
                                      wgpu::Device device,
@@ -0,0 +1,37 @@
+#include "SimulationClock.h"
+
+#include <cmath>
+
+void SimulationClock::Reset()
+{
+    mStarted     = false;
+    mAccumulator = 0.0;
+}
+
+int SimulationClock::Advance()
+{
+    Clock::time_point now = Clock::now();
+    if (!mStarted)
+    {
+        mStarted     = true;
+        mLastTime    = now;
+        mAccumulator = 0.0;
+        mFrameSteps  = 1;
+        return mFrameSteps;
+    }
+
+    mAccumulator += std::chrono::duration<double>(now - mLastTime).count();
+    mLastTime = now;
+
+    double steps = std::floor(mAccumulator / mStepSeconds);
+    mAccumulator -= steps * mStepSeconds;
+
+    if (steps > mMaxStepsPerFrame)
+    {
+        mDroppedSteps += static_cast<uint64_t>(steps) - mMaxStepsPerFrame;
+        steps = mMaxStepsPerFrame;
+    }
+
+    mFrameSteps = static_cast<int>(steps);
+    return mFrameSteps;
+}
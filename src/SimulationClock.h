@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Fixed-rate simulation clock. Wall time is accumulated every displayed frame and spent in whole
+ * simulation steps, so the simulation speed no longer depends on the refresh rate. A step is one
+ * simulator Compute with all its substeps.
+ *
+ * Time beyond `maxStepsPerFrame` steps is dropped instead of carried over, so a hitch slows the
+ * simulation down once rather than making every following frame catch up.
+ */
+class SimulationClock
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void SetStepsPerSecond(double stepsPerSecond)
+    {
+        mStepSeconds = 1.0 / stepsPerSecond;
+    }
+
+    double GetStepsPerSecond() const
+    {
+        return 1.0 / mStepSeconds;
+    }
+
+    void SetMaxStepsPerFrame(int steps)
+    {
+        mMaxStepsPerFrame = steps > 0 ? steps : 1;
+    }
+
+    // Start over, the next Advance runs a single step
+    void Reset();
+
+    // Accumulate the wall time since the previous call, returns the steps to run this frame
+    int Advance();
+
+    // Fraction of a step accumulated after the steps of this frame, in [0, 1)
+    double GetAlpha() const
+    {
+        return mAccumulator / mStepSeconds;
+    }
+
+    int GetFrameSteps() const
+    {
+        return mFrameSteps;
+    }
+
+    uint64_t GetDroppedSteps() const
+    {
+        return mDroppedSteps;
+    }
+
+private:
+    double mStepSeconds   = 1.0 / 60.0;
+    int mMaxStepsPerFrame = 4;
+
+    bool mStarted = false;
+    Clock::time_point mLastTime;
+    double mAccumulator = 0.0;
+
+    int mFrameSteps        = 0;
+    uint64_t mDroppedSteps = 0;
+};
@@ -0,0 +1,57 @@
+#include "StartupProfiler.h"
+
+#include <cstdio>
+
+#include "Trace.h"
+
+void StartupProfiler::Start()
+{
+    mStartUs = Trace::Now();
+    mCurrent = nullptr;
+    mPhases.clear();
+    mTotalMs = 0.0;
+}
+
+void StartupProfiler::Begin(const char* name)
+{
+    End();
+    mCurrent = name;
+    mBeginUs = Trace::Now();
+}
+
+void StartupProfiler::End()
+{
+    uint64_t now = Trace::Now();
+    if (mCurrent)
+    {
+        mPhases.push_back({mCurrent, (now - mBeginUs) / 1000.0});
+        if (Trace::IsEnabled())
+        {
+            Trace::AddCPUZone(mCurrent, mBeginUs, now);
+        }
+        mCurrent = nullptr;
+    }
+    mTotalMs = (now - mStartUs) / 1000.0;
+}
+
+void StartupProfiler::PrintReport() const
+{
+    printf("Startup phases:\n");
+
+    double phasesMs = 0.0;
+    for (const Phase& phase : mPhases)
+    {
+        printf(" - %-24s %9.2f ms (%4.1f%%)\n",
+               phase.name.c_str(),
+               phase.ms,
+               mTotalMs > 0.0 ? 100.0 * phase.ms / mTotalMs : 0.0);
+        phasesMs += phase.ms;
+    }
+
+    // Time between the phases, e.g. the GPU memory report
+    if (mTotalMs > phasesMs)
+    {
+        printf(" - %-24s %9.2f ms\n", "other", mTotalMs - phasesMs);
+    }
+    printf(" - %-24s %9.2f ms\n", "total", mTotalMs);
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Wall time of the phases of Application::Initialize. Phases are consecutive, beginning a phase
+ * ends the previous one, and are also recorded as trace zones when tracing.
+ */
+class StartupProfiler
+{
+public:
+    struct Phase
+    {
+        std::string name;
+        double ms;
+    };
+
+    // Start of the startup, the total is measured from here
+    void Start();
+
+    // `name` must be a string literal
+    void Begin(const char* name);
+    void End();
+
+    const std::vector<Phase>& GetPhases() const
+    {
+        return mPhases;
+    }
+
+    double GetTotalMs() const
+    {
+        return mTotalMs;
+    }
+
+    void PrintReport() const;
+
+private:
+    uint64_t mStartUs = 0;
+    uint64_t mBeginUs = 0;
+
+    const char* mCurrent = nullptr;
+
+    std::vector<Phase> mPhases;
+    double mTotalMs = 0.0;
+};
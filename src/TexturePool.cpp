@@ -0,0 +1,95 @@
+#include "TexturePool.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "GPUMemory.h"
+#include "WebGPUUtils.h"
+
+TexturePool::TexturePool(wgpu::Device device) : mDevice(device) {}
+
+TexturePool::~TexturePool()
+{
+    GPUMemory::Release(this);
+}
+
+void TexturePool::SetLeases(const void* lessee, const std::vector<Request>& requests)
+{
+    std::erase_if(mLeases, [lessee](const Lease& lease) { return lease.lessee == lessee; });
+
+    for (const Request& request : requests)
+    {
+        mLeases.push_back({lessee, request});
+
+        for (uint32_t index = 0; index < request.count; ++index)
+        {
+            auto it = std::find_if(mEntries.begin(),
+                                   mEntries.end(),
+                                   [&](const Entry& entry)
+                                   { return entry.key == request.key && entry.index == index; });
+            if (it != mEntries.end())
+            {
+                continue;
+            }
+
+            char label[96];
+            snprintf(label,
+                     sizeof(label),
+                     "transient texture %ux%u format 0x%x #%u",
+                     request.key.width,
+                     request.key.height,
+                     static_cast<uint32_t>(request.key.format),
+                     index);
+
+            wgpu::TextureDescriptor textureDesc {
+                .label  = WebGPUUtils::GenerateString(label),
+                .usage  = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding,
+                .size   = {request.key.width, request.key.height, 1},
+                .format = request.key.format,
+            };
+
+            Entry entry {.key = request.key, .index = index};
+            entry.texture = GPUMemory::CreateTexture(mDevice, textureDesc, "TexturePool", this);
+            entry.view    = entry.texture.CreateView();
+            mEntries.push_back(entry);
+        }
+    }
+
+    Trim();
+}
+
+wgpu::TextureView TexturePool::GetView(const Key& key, uint32_t index) const
+{
+    for (const Entry& entry : mEntries)
+    {
+        if (entry.key == key && entry.index == index)
+        {
+            return entry.view;
+        }
+    }
+    return nullptr;
+}
+
+void TexturePool::Trim()
+{
+    std::erase_if(mEntries,
+                  [this](Entry& entry)
+                  {
+                      bool leased = std::any_of(mLeases.begin(),
+                                                mLeases.end(),
+                                                [&](const Lease& lease)
+                                                {
+                                                    return lease.request.key == entry.key
+                                                           && entry.index < lease.request.count;
+                                                });
+                      if (leased)
+                      {
+                          return false;
+                      }
+
+                      // Work already submitted keeps its use of the texture
+                      GPUMemory::Release(entry.texture);
+                      entry.texture.Destroy();
+                      return true;
+                  });
+}
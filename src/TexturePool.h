@@ -0,0 +1,70 @@
+#pragma once
+
+#include <webgpu/webgpu_cpp.h>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Render attachments shared by every RenderGraph. A graph leases a number of textures per
+ * format and size, the leases of all graphs overlap, so two graphs asking for two R32Float
+ * textures of the same size get the same two. That is only valid for transient contents, which
+ * every graph writes before reading within its own execution.
+ *
+ * A texture no lease covers anymore is destroyed right away.
+ */
+class TexturePool
+{
+public:
+    struct Key
+    {
+        wgpu::TextureFormat format;
+        uint32_t width;
+        uint32_t height;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct Request
+    {
+        Key key;
+        uint32_t count;
+    };
+
+    explicit TexturePool(wgpu::Device device);
+    ~TexturePool();
+
+    // Replace every lease of `lessee`, creating the textures that are missing
+    void SetLeases(const void* lessee, const std::vector<Request>& requests);
+
+    void Release(const void* lessee)
+    {
+        SetLeases(lessee, {});
+    }
+
+    // Texture `index` of `key`, leased through SetLeases()
+    wgpu::TextureView GetView(const Key& key, uint32_t index) const;
+
+private:
+    struct Entry
+    {
+        Key key;
+        uint32_t index;
+        wgpu::Texture texture;
+        wgpu::TextureView view;
+    };
+
+    struct Lease
+    {
+        const void* lessee;
+        Request request;
+    };
+
+    void Trim();
+
+private:
+    wgpu::Device mDevice;
+
+    std::vector<Entry> mEntries;
+    std::vector<Lease> mLeases;
+};
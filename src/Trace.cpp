@@ -0,0 +1,149 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace Trace
+{
+    std::atomic<bool> gEnabled {false};
+
+    namespace
+    {
+        constexpr uint32_t GPU_THREAD = 0;
+
+        struct Event
+        {
+            const char* name;
+            uint64_t begin;  // us for CPU zones, ns for GPU zones
+            uint64_t end;
+            uint32_t thread;
+            uint64_t cpuSubmitUs;
+        };
+
+        std::mutex gMutex;
+        std::vector<Event> gEvents;
+        std::string gPath;
+
+        std::atomic<uint32_t> gNextThread {1};
+        const auto gClockBase = std::chrono::steady_clock::now();
+
+        uint32_t GetThreadIndex()
+        {
+            thread_local uint32_t index = gNextThread++;
+            return index;
+        }
+    }  // namespace
+
+    void Start(const std::string& path)
+    {
+        std::lock_guard<std::mutex> lock(gMutex);
+        gPath = path;
+        gEvents.clear();
+        gEvents.reserve(1 << 16);
+        gEnabled = true;
+    }
+
+    bool Stop()
+    {
+        if (!gEnabled.exchange(false))
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(gMutex);
+
+        // The GPU can not start a pass before it was submitted, so the smallest offset that
+        // keeps every GPU zone after its submission is the best estimate of the clock offset
+        int64_t gpuOffsetNs = std::numeric_limits<int64_t>::min();
+        std::set<uint32_t> threads;
+        for (const Event& event : gEvents)
+        {
+            if (event.thread == GPU_THREAD)
+            {
+                int64_t offset = (int64_t)event.cpuSubmitUs * 1000 - (int64_t)event.begin;
+                gpuOffsetNs    = std::max(gpuOffsetNs, offset);
+            }
+            threads.insert(event.thread);
+        }
+
+        std::ofstream out(gPath);
+        if (!out)
+        {
+            std::cerr << "Failed to open trace file " << gPath << std::endl;
+            return false;
+        }
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        for (uint32_t thread : threads)
+        {
+            std::string name = thread == GPU_THREAD ? "GPU"
+                               : thread == 1        ? "Main"
+                                                    : "Thread " + std::to_string(thread);
+            out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                << "\"tid\":" << thread << ",\"args\":{\"name\":\"" << name << "\"}}";
+            first = false;
+        }
+
+        out.precision(3);
+        out << std::fixed;
+        for (const Event& event : gEvents)
+        {
+            double begin, duration;
+            if (event.thread == GPU_THREAD)
+            {
+                begin    = ((int64_t)event.begin + gpuOffsetNs) / 1000.0;
+                duration = (event.end - event.begin) / 1000.0;
+            }
+            else
+            {
+                begin    = (double)event.begin;
+                duration = (double)(event.end - event.begin);
+            }
+
+            out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"name\":\"" << event.name
+                << "\",\"cat\":\"" << (event.thread == GPU_THREAD ? "gpu" : "cpu")
+                << "\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << begin
+                << ",\"dur\":" << duration << "}";
+            first = false;
+        }
+        out << "\n]}\n";
+
+        std::cout << "Wrote " << gEvents.size() << " trace events to " << gPath << std::endl;
+        gEvents.clear();
+        return true;
+    }
+
+    uint64_t Now()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - gClockBase;
+        return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    }
+
+    void AddCPUZone(const char* name, uint64_t beginUs, uint64_t endUs)
+    {
+        if (!IsEnabled())
+        {
+            return;
+        }
+        uint32_t thread = GetThreadIndex();
+        std::lock_guard<std::mutex> lock(gMutex);
+        gEvents.push_back({name, beginUs, endUs, thread, 0});
+    }
+
+    void AddGPUZone(const char* name, uint64_t beginNs, uint64_t endNs, uint64_t cpuSubmitUs)
+    {
+        if (!IsEnabled())
+        {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(gMutex);
+        gEvents.push_back({name, beginNs, endNs, GPU_THREAD, cpuSubmitUs});
+    }
+}  // namespace Trace
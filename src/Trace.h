@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * Chrome trace (chrome://tracing, Perfetto) recorder for CPU zones and GPU pass timings.
+ * Disabled zones cost a single relaxed atomic load.
+ */
+namespace Trace
+{
+    extern std::atomic<bool> gEnabled;
+
+    inline bool IsEnabled()
+    {
+        return gEnabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Start recording, the events are written to `path` by Stop()
+     */
+    void Start(const std::string& path);
+    bool Stop();
+
+    // Microseconds on the steady clock
+    uint64_t Now();
+
+    void AddCPUZone(const char* name, uint64_t beginUs, uint64_t endUs);
+
+    /**
+     * GPU pass in GPU timestamp nanoseconds. `cpuSubmitUs` is a CPU time taken before the pass
+     * was submitted and is used to align the GPU clock with the CPU clock.
+     */
+    void AddGPUZone(const char* name, uint64_t beginNs, uint64_t endNs, uint64_t cpuSubmitUs);
+
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name) : mName(IsEnabled() ? name : nullptr)
+        {
+            if (mName)
+            {
+                mBegin = Now();
+            }
+        }
+
+        ~Scope()
+        {
+            if (mName)
+            {
+                AddCPUZone(mName, mBegin, Now());
+            }
+        }
+
+        Scope(const Scope&)            = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* mName;
+        uint64_t mBegin = 0;
+    };
+}  // namespace Trace
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b)       TRACE_CONCAT_INNER(a, b)
+
+// Record the enclosing scope as a CPU zone, `name` must be a string literal
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
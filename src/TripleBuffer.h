@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Lock-free handoff of the latest value from one writer thread to one reader thread. The writer
+ * never waits for the reader and the reader never sees a partially written value, values
+ * published faster than they are consumed are dropped, so T should hold state, not events.
+ *
+ * Three slots: one being written, one being read and the latest published one in between,
+ * which Publish() and Consume() swap with their own through a single atomic.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() = default;
+
+    TripleBuffer(const TripleBuffer&)            = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Writer thread only
+    void Publish(const T& value)
+    {
+        mSlots[mWriteIndex] = value;
+        uint8_t previous    = mMiddle.exchange(mWriteIndex | FRESH, std::memory_order_acq_rel);
+        mWriteIndex         = previous & INDEX_MASK;
+    }
+
+    // Reader thread only, returns false and leaves `value` alone when nothing new was published
+    bool Consume(T& value)
+    {
+        if (!(mMiddle.load(std::memory_order_relaxed) & FRESH))
+        {
+            return false;
+        }
+        uint8_t previous = mMiddle.exchange(mReadIndex, std::memory_order_acq_rel);
+        mReadIndex       = previous & INDEX_MASK;
+        value            = mSlots[mReadIndex];
+        return true;
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH      = 0x4;
+
+    T mSlots[3] {};
+    uint8_t mWriteIndex = 0;
+    uint8_t mReadIndex  = 1;
+    std::atomic<uint8_t> mMiddle {2};
+};
@@ -52,6 +52,20 @@ wgpu::Device WebGPUUtils::RequestDeviceSync(wgpu::Instance instance,
     return result;
 }
 
+void WebGPUUtils::WaitForSubmittedWork(wgpu::Instance instance, wgpu::Queue queue)
+{
+    wgpu::Future future =
+        queue.OnSubmittedWorkDone(wgpu::CallbackMode::WaitAnyOnly,
+                                  [](wgpu::QueueWorkDoneStatus status, auto&&...)
+                                  {
+                                      if (status != wgpu::QueueWorkDoneStatus::Success)
+                                      {
+                                          printf("Queue work done with status 0x%08X\n", status);
+                                      }
+                                  });
+    instance.WaitAny(future, UINT64_MAX);
+}
+
 void WebGPUUtils::InspectAdapter(wgpu::Adapter adapter)
 {
     wgpu::Limits supportedLimits = {};
@@ -18,6 +18,11 @@ namespace WebGPUUtils
                                    wgpu::Adapter adapter,
                                    wgpu::DeviceDescriptor const* descripter);
 
+    /**
+     * Block until all work submitted to the queue so far has completed
+     */
+    void WaitForSubmittedWork(wgpu::Instance instance, wgpu::Queue queue);
+
     /**
      * An example of how we can inspect the capabilities of the hardware through
      * the adapter object.
@@ -1,13 +1,19 @@
 #include "MlsMpmSimulator.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include "../WebGPUUtils.h"
+#include "../GPUMemory.h"
+#include "../PipelineBatch.h"
 #include "../ResourceManager.h"
 #include "../Application.h"
+#include "../GPUProfiler.h"
+#include "../Trace.h"
 
 MlsMpmSimulator::MlsMpmSimulator(wgpu::Buffer particleBuffer,
-                                 wgpu::Buffer posvelBuffer,
+                                 const std::array<wgpu::Buffer, 2>& posvelBuffers,
                                  float renderDiameter,
                                  wgpu::Device device)
 {
@@ -17,7 +23,7 @@ MlsMpmSimulator::MlsMpmSimulator(wgpu::Buffer particleBuffer,
     mConstants.stiffness            = 3.0f;
     mConstants.restDensity          = 4.0f;
     mConstants.dynamicViscosity     = 0.1f;
-    mConstants.dt                   = 0.2f;
+    mConstants.dt                   = DEFAULT_DT;
     mConstants.fixedPointMultiplier = 1e7;
 
     mParticleBuffer = particleBuffer;
@@ -26,6 +32,24 @@ MlsMpmSimulator::MlsMpmSimulator(wgpu::Buffer particleBuffer,
     CreateBuffers();
     WriteBuffers();
 
+    // The counting kernels keep a particle count per cell in the scratch buffer
+    uint64_t cellCountsSize = sizeof(uint32_t) * mMaxGridCount;
+    mCounters =
+        std::make_unique<GPUCounters>(mDevice, COUNTER_COUNT, cellCountsSize, "MlsMpmSimulator");
+
+    // Grid cells are unit sized. The equation of state is stiffness * ((rho / rho0)^5 - 1),
+    // c^2 = 5 * stiffness / rho0 at rest density
+    AdaptiveTimestep::Settings timestepSettings {
+        .frameTime   = DEFAULT_SUBSTEPS * DEFAULT_DT,
+        .cellSize    = 1.0f,
+        .courant     = 0.4f,
+        .soundSpeed  = std::sqrt(5.0f * mConstants.stiffness / mConstants.restDensity),
+        .minSubsteps = 1,
+        .maxSubsteps = 4,
+    };
+    mAdaptiveTimestep = std::make_unique<AdaptiveTimestep>(
+        mDevice, particleBuffer, sizeof(MlsMpmParticle), timestepSettings, "MlsMpmSimulator");
+
     // Pipelines
     InitializeClearGridPipeline();
     InitializeP2G1Pipeline();
@@ -40,58 +64,167 @@ MlsMpmSimulator::MlsMpmSimulator(wgpu::Buffer particleBuffer,
     InitializeP2G2BindGroups();
     InitializeUpdateGridBindGroups();
     InitializeG2PBindGroups();
-    InitializeCopyPositionBindGroups(posvelBuffer);
+    InitializeCopyPositionBindGroups(posvelBuffers);
 }
 
-void MlsMpmSimulator::Compute(wgpu::CommandEncoder commandEncoder)
+MlsMpmSimulator::~MlsMpmSimulator()
 {
-    wgpu::ComputePassDescriptor computePassDesc {
-        .timestampWrites = nullptr,
-    };
-    wgpu::ComputePassEncoder computePass = commandEncoder.BeginComputePass(&computePassDesc);
+    GPUMemory::Release(this);
+}
+
+uint64_t MlsMpmSimulator::EstimateMemory()
+{
+    // The cells and the per cell particle counts of the counting kernels
+    uint64_t maxGridCount = MAX_GRID_SIZE * MAX_GRID_SIZE * MAX_GRID_SIZE;
+    return (sizeof(Cell) + sizeof(uint32_t)) * maxGridCount;
+}
+
+void MlsMpmSimulator::Compute(wgpu::CommandEncoder commandEncoder, int steps)
+{
+    TRACE_SCOPE("MlsMpmSimulator::Compute");
+
+    UpdateTimestep();
 
-    for (int i = 0; i < 2; ++i)
+    mCounters->BeginFrame(commandEncoder, steps * mSubsteps);
+    mAdaptiveTimestep->BeginFrame(commandEncoder);
+
+    ProfiledComputePass computePass(commandEncoder, mProfiler);
+
+    for (int i = 0; i < steps * mSubsteps; ++i)
+    {
+        for (Stage stage : SUBSTEP_STAGES)
+        {
+            ComputeStage(stage, computePass.Stage(GetStageName(stage)));
+        }
+    }
+
+    if (mAdaptiveTimestep->IsEnabled())
     {
-        ComputeClearGrid(computePass);
-        ComputeP2G1(computePass);
-        ComputeP2G2(computePass);
-        ComputeUpdateGrid(computePass);
-        ComputeG2P(computePass);
-        ComputeCopyPosition(computePass);
+        mAdaptiveTimestep->Dispatch(computePass.Stage("MPM max velocity"), mNumParticles);
     }
 
     computePass.End();
+
+    mCounters->Resolve(commandEncoder);
+    mAdaptiveTimestep->Resolve(commandEncoder);
+}
+
+void MlsMpmSimulator::EndFrame()
+{
+    mCounters->EndFrame();
+    mAdaptiveTimestep->EndFrame();
+}
+
+void MlsMpmSimulator::UpdateTimestep()
+{
+    int substeps = DEFAULT_SUBSTEPS;
+    float dt     = DEFAULT_DT;
+    if (mAdaptiveTimestep->IsEnabled())
+    {
+        mAdaptiveTimestep->Select(substeps, dt);
+    }
+
+    mSubsteps = substeps;
+    if (dt != mConstants.dt)
+    {
+        mConstants.dt = dt;
+        WriteBuffers();
+    }
+}
+
+void MlsMpmSimulator::ComputeStage(Stage stage, wgpu::ComputePassEncoder& computePass)
+{
+    switch (stage)
+    {
+        case Stage::ClearGrid:
+            ComputeClearGrid(computePass);
+            break;
+        case Stage::P2G1:
+            ComputeP2G1(computePass);
+            break;
+        case Stage::P2G2:
+            ComputeP2G2(computePass);
+            break;
+        case Stage::UpdateGrid:
+            ComputeUpdateGrid(computePass);
+            break;
+        case Stage::G2P:
+            ComputeG2P(computePass);
+            break;
+        case Stage::CopyPosition:
+            ComputeCopyPosition(computePass);
+            break;
+    }
+}
+
+const char* MlsMpmSimulator::GetStageName(Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::ClearGrid:
+            return "MPM clear grid";
+        case Stage::P2G1:
+            return "MPM P2G1";
+        case Stage::P2G2:
+            return "MPM P2G2";
+        case Stage::UpdateGrid:
+            return "MPM update grid";
+        case Stage::G2P:
+            return "MPM G2P";
+        case Stage::CopyPosition:
+            return "MPM copy position";
+    }
+    return "";
+}
+
+void MlsMpmSimulator::SetProfiler(GPUProfiler* profiler)
+{
+    mProfiler = profiler;
 }
 
 void MlsMpmSimulator::Reset(int numParticles,
                             const glm::vec3& initHalfBoxSize,
                             RenderUniforms& renderUniforms)
 {
+    TRACE_SCOPE("MlsMpmSimulator::Reset");
+
     renderUniforms.sphereSize = mRenderDiameter;
+
+    Application::RestartRandom();
     auto particleData         = InitializeDamBreak(initHalfBoxSize, numParticles);
-    auto maxGridCount         = mMaxXGrids * mMaxYGrids * mMaxZGrids;
-    mGridCount                = std::ceil(initHalfBoxSize[0]) * std::ceil(initHalfBoxSize[1])
-                 * std::ceil(initHalfBoxSize[2]);
-    if (mGridCount > maxGridCount)
+    SetParticles(particleData, initHalfBoxSize);
+
+    std::cout << "MLS-MPM numParticle = " << mNumParticles << std::endl;
+}
+
+void MlsMpmSimulator::SetParticles(const std::vector<MlsMpmParticle>& particles,
+                                   const glm::vec3& boxSize)
+{
+    TRACE_SCOPE("MlsMpmSimulator::SetParticles");
+
+    auto maxGridCount = mMaxXGrids * mMaxYGrids * mMaxZGrids;
+    int gridCount     = std::ceil(boxSize[0]) * std::ceil(boxSize[1]) * std::ceil(boxSize[2]);
+    if (gridCount > maxGridCount)
     {
-        std::cout << "mGridCount " << mGridCount << " should be equal to or less than maxGridCount "
+        std::cout << "mGridCount " << gridCount << " should be equal to or less than maxGridCount "
                   << maxGridCount << std::endl;
         return;
     }
 
-    wgpu::Queue queue = mDevice.GetQueue();
-    queue.WriteBuffer(mInitBoxSizeBuffer, 0, glm::value_ptr(initHalfBoxSize), sizeof(glm::vec3));
-    queue.WriteBuffer(mRealBoxSizeBuffer, 0, glm::value_ptr(initHalfBoxSize), sizeof(glm::vec3));
-    queue.WriteBuffer(mParticleBuffer,
-                      0,
-                      particleData.data(),
-                      sizeof(MlsMpmParticle) * particleData.size());
+    size_t maxParticles = mParticleBuffer.GetSize() / sizeof(MlsMpmParticle);
+    mGridCount          = gridCount;
+    mNumParticles       = static_cast<int>(std::min(particles.size(), maxParticles));
 
-    std::cout << "MLS-MPM numParticle = " << mNumParticles << std::endl;
+    wgpu::Queue queue = mDevice.GetQueue();
+    queue.WriteBuffer(mInitBoxSizeBuffer, 0, glm::value_ptr(boxSize), sizeof(glm::vec3));
+    queue.WriteBuffer(mRealBoxSizeBuffer, 0, glm::value_ptr(boxSize), sizeof(glm::vec3));
+    queue.WriteBuffer(mParticleBuffer, 0, particles.data(), sizeof(MlsMpmParticle) * mNumParticles);
 }
 
 void MlsMpmSimulator::ChangeBoxSize(const glm::vec3& realBoxSize)
 {
+    TRACE_SCOPE("MlsMpmSimulator::ChangeBoxSize");
+
     wgpu::Queue queue = mDevice.GetQueue();
     queue.WriteBuffer(mRealBoxSizeBuffer, 0, glm::value_ptr(realBoxSize), sizeof(glm::vec3));
 }
@@ -106,7 +239,7 @@ void MlsMpmSimulator::CreateBuffers()
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage;
     bufferDesc.mappedAtCreation = false;
 
-    mCellBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mCellBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "MlsMpmSimulator", this);
 
     // real box size
     bufferDesc.label            = WebGPUUtils::GenerateString("real box size buffer");
@@ -114,7 +247,7 @@ void MlsMpmSimulator::CreateBuffers()
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
     bufferDesc.mappedAtCreation = false;
 
-    mRealBoxSizeBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mRealBoxSizeBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "MlsMpmSimulator", this);
 
     // init box size
     bufferDesc.label            = WebGPUUtils::GenerateString("init box size buffer");
@@ -122,7 +255,7 @@ void MlsMpmSimulator::CreateBuffers()
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
     bufferDesc.mappedAtCreation = false;
 
-    mInitBoxSizeBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mInitBoxSizeBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "MlsMpmSimulator", this);
 
     // constants
     bufferDesc.label            = WebGPUUtils::GenerateString("constants buffer");
@@ -130,7 +263,7 @@ void MlsMpmSimulator::CreateBuffers()
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
     bufferDesc.mappedAtCreation = false;
 
-    mConstantsBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mConstantsBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "MlsMpmSimulator", this);
 }
 
 void MlsMpmSimulator::WriteBuffers()
@@ -160,10 +293,14 @@ void MlsMpmSimulator::InitializeClearGridPipeline()
     bindGroupLayoutDesc.entries    = bindingLayoutEentries.data();
     mClearGridBindGroupLayout      = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
 
-    // Create the pipeline layout
+    // Create the pipeline layout, group 1 holds the algorithm counters
+    std::array<wgpu::BindGroupLayout, 2> bindGroupLayouts = {
+        mClearGridBindGroupLayout,
+        mCounters->GetBindGroupLayout(),
+    };
     wgpu::PipelineLayoutDescriptor layoutDesc {};
-    layoutDesc.bindGroupLayoutCount = 1;
-    layoutDesc.bindGroupLayouts     = &mClearGridBindGroupLayout;
+    layoutDesc.bindGroupLayoutCount = bindGroupLayouts.size();
+    layoutDesc.bindGroupLayouts     = bindGroupLayouts.data();
     mClearGridLayout                = mDevice.CreatePipelineLayout(&layoutDesc);
 
     // pipelines
@@ -177,7 +314,10 @@ void MlsMpmSimulator::InitializeClearGridPipeline()
             },
     };
 
-    mClearGridPipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mClearGridPipeline);
+    mCounters->AddCountingPipeline(computePipelineDesc,
+                                   "resources/shader/mls-mpm/clearGrid.wgsl",
+                                   mClearGridCountersPipeline);
 }
 
 void MlsMpmSimulator::InitializeClearGridBindGroups()
@@ -201,7 +341,9 @@ void MlsMpmSimulator::InitializeClearGridBindGroups()
 void MlsMpmSimulator::ComputeClearGrid(wgpu::ComputePassEncoder& computePass)
 {
     computePass.SetBindGroup(0, mClearGridBindGroup, 0, nullptr);
-    computePass.SetPipeline(mClearGridPipeline);
+    computePass.SetBindGroup(1, mCounters->GetBindGroup(), 0, nullptr);
+    computePass.SetPipeline(mCounters->IsSampling() ? mClearGridCountersPipeline
+                                                    : mClearGridPipeline);
     computePass.DispatchWorkgroups(std::ceil(mGridCount / 64.0f));
 }
 
@@ -243,10 +385,14 @@ void MlsMpmSimulator::InitializeP2G1Pipeline()
     bindGroupLayoutDesc.entries    = bindingLayoutEentries.data();
     mP2G1BindGroupLayout           = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
 
-    // Create the pipeline layout
+    // Create the pipeline layout, group 1 holds the algorithm counters
+    std::array<wgpu::BindGroupLayout, 2> bindGroupLayouts = {
+        mP2G1BindGroupLayout,
+        mCounters->GetBindGroupLayout(),
+    };
     wgpu::PipelineLayoutDescriptor layoutDesc {};
-    layoutDesc.bindGroupLayoutCount = 1;
-    layoutDesc.bindGroupLayouts     = &mP2G1BindGroupLayout;
+    layoutDesc.bindGroupLayoutCount = bindGroupLayouts.size();
+    layoutDesc.bindGroupLayouts     = bindGroupLayouts.data();
     mP2G1Layout                     = mDevice.CreatePipelineLayout(&layoutDesc);
 
     // pipelines
@@ -260,7 +406,10 @@ void MlsMpmSimulator::InitializeP2G1Pipeline()
             },
     };
 
-    mP2G1Pipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mP2G1Pipeline);
+    mCounters->AddCountingPipeline(computePipelineDesc,
+                                   "resources/shader/mls-mpm/p2g_1.wgsl",
+                                   mP2G1CountersPipeline);
 }
 
 void MlsMpmSimulator::InitializeP2G1BindGroups()
@@ -299,7 +448,8 @@ void MlsMpmSimulator::InitializeP2G1BindGroups()
 void MlsMpmSimulator::ComputeP2G1(wgpu::ComputePassEncoder& computePass)
 {
     computePass.SetBindGroup(0, mP2G1BindGroup, 0, nullptr);
-    computePass.SetPipeline(mP2G1Pipeline);
+    computePass.SetBindGroup(1, mCounters->GetBindGroup(), 0, nullptr);
+    computePass.SetPipeline(mCounters->IsSampling() ? mP2G1CountersPipeline : mP2G1Pipeline);
     computePass.DispatchWorkgroups(std::ceil(mNumParticles / 64.0f));
 }
 
@@ -341,10 +491,14 @@ void MlsMpmSimulator::InitializeP2G2Pipeline()
     bindGroupLayoutDesc.entries    = bindingLayoutEentries.data();
     mP2G2BindGroupLayout           = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
 
-    // Create the pipeline layout
+    // Create the pipeline layout, group 1 holds the algorithm counters
+    std::array<wgpu::BindGroupLayout, 2> bindGroupLayouts = {
+        mP2G2BindGroupLayout,
+        mCounters->GetBindGroupLayout(),
+    };
     wgpu::PipelineLayoutDescriptor layoutDesc {};
-    layoutDesc.bindGroupLayoutCount = 1;
-    layoutDesc.bindGroupLayouts     = &mP2G2BindGroupLayout;
+    layoutDesc.bindGroupLayoutCount = bindGroupLayouts.size();
+    layoutDesc.bindGroupLayouts     = bindGroupLayouts.data();
     mP2G2Layout                     = mDevice.CreatePipelineLayout(&layoutDesc);
 
     // pipelines
@@ -358,7 +512,10 @@ void MlsMpmSimulator::InitializeP2G2Pipeline()
             },
     };
 
-    mP2G2Pipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mP2G2Pipeline);
+    mCounters->AddCountingPipeline(computePipelineDesc,
+                                   "resources/shader/mls-mpm/p2g_2.wgsl",
+                                   mP2G2CountersPipeline);
 }
 
 void MlsMpmSimulator::InitializeP2G2BindGroups()
@@ -397,7 +554,8 @@ void MlsMpmSimulator::InitializeP2G2BindGroups()
 void MlsMpmSimulator::ComputeP2G2(wgpu::ComputePassEncoder& computePass)
 {
     computePass.SetBindGroup(0, mP2G2BindGroup, 0, nullptr);
-    computePass.SetPipeline(mP2G2Pipeline);
+    computePass.SetBindGroup(1, mCounters->GetBindGroup(), 0, nullptr);
+    computePass.SetPipeline(mCounters->IsSampling() ? mP2G2CountersPipeline : mP2G2Pipeline);
     computePass.DispatchWorkgroups(std::ceil(mNumParticles / 64.0f));
 }
 
@@ -456,7 +614,7 @@ void MlsMpmSimulator::InitializeUpdateGridPipeline()
             },
     };
 
-    mUpdateGridPipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mUpdateGridPipeline);
 }
 
 void MlsMpmSimulator::InitializeUpdateGridBindGroups()
@@ -560,7 +718,7 @@ void MlsMpmSimulator::InitializeG2PPipeline()
             },
     };
 
-    mG2PPipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mG2PPipeline);
 }
 
 void MlsMpmSimulator::InitializeG2PBindGroups()
@@ -651,35 +809,39 @@ void MlsMpmSimulator::InitializeCopyPositionPipeline()
             },
     };
 
-    mCopyPositionPipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mCopyPositionPipeline);
 }
 
-void MlsMpmSimulator::InitializeCopyPositionBindGroups(wgpu::Buffer posvelBuffer)
+void MlsMpmSimulator::InitializeCopyPositionBindGroups(
+    const std::array<wgpu::Buffer, 2>& posvelBuffers)
 {
-    std::vector<wgpu::BindGroupEntry> bindings(2);
-
-    bindings[0].binding = 0;
-    bindings[0].buffer  = mParticleBuffer;
-    bindings[0].offset  = 0;
-    bindings[0].size    = mParticleBuffer.GetSize();
-
-    bindings[1].binding = 1;
-    bindings[1].buffer  = posvelBuffer;
-    bindings[1].offset  = 0;
-    bindings[1].size    = posvelBuffer.GetSize();
-
-    wgpu::BindGroupDescriptor bindGroupDesc {
-        .label      = WebGPUUtils::GenerateString("copy position bind group"),
-        .layout     = mCopyPositionBindGroupLayout,
-        .entryCount = static_cast<uint32_t>(bindings.size()),
-        .entries    = bindings.data(),
-    };
-    mCopyPositionBindGroup = mDevice.CreateBindGroup(&bindGroupDesc);
+    for (uint32_t index = 0; index < 2; ++index)
+    {
+        std::vector<wgpu::BindGroupEntry> bindings(2);
+
+        bindings[0].binding = 0;
+        bindings[0].buffer  = mParticleBuffer;
+        bindings[0].offset  = 0;
+        bindings[0].size    = mParticleBuffer.GetSize();
+
+        bindings[1].binding = 1;
+        bindings[1].buffer  = posvelBuffers[index];
+        bindings[1].offset  = 0;
+        bindings[1].size    = posvelBuffers[index].GetSize();
+
+        wgpu::BindGroupDescriptor bindGroupDesc {
+            .label      = WebGPUUtils::GenerateString("copy position bind group"),
+            .layout     = mCopyPositionBindGroupLayout,
+            .entryCount = static_cast<uint32_t>(bindings.size()),
+            .entries    = bindings.data(),
+        };
+        mCopyPositionBindGroups[index] = mDevice.CreateBindGroup(&bindGroupDesc);
+    }
 }
 
 void MlsMpmSimulator::ComputeCopyPosition(wgpu::ComputePassEncoder& computePass)
 {
-    computePass.SetBindGroup(0, mCopyPositionBindGroup, 0, nullptr);
+    computePass.SetBindGroup(0, mCopyPositionBindGroups[mPosvelIndex], 0, nullptr);
     computePass.SetPipeline(mCopyPositionPipeline);
     computePass.DispatchWorkgroups(std::ceil(mNumParticles / 64.0f));
 }
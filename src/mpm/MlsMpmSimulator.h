@@ -6,7 +6,15 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/glm.hpp>
 
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "../AdaptiveTimestep.h"
+#include "../GPUCounters.h"
+
 struct RenderUniforms;
+class GPUProfiler;
 
 struct Cell
 {
@@ -39,24 +47,122 @@ struct MlsMpmParticle
     float _padding5;
 };
 
+// Layouts shared with resources/shader/include/mpm.wgsl, Cell in its plain variant
+static_assert(sizeof(Constants) == 20);
+static_assert(sizeof(MlsMpmParticle) == 80);
+
 class MlsMpmSimulator
 {
 public:
+    enum class Stage
+    {
+        ClearGrid,
+        P2G1,
+        P2G2,
+        UpdateGrid,
+        G2P,
+        CopyPosition,
+    };
+
+    // One substep in dispatch order
+    static constexpr std::array<Stage, 6> SUBSTEP_STAGES = {
+        Stage::ClearGrid,
+        Stage::P2G1,
+        Stage::P2G2,
+        Stage::UpdateGrid,
+        Stage::G2P,
+        Stage::CopyPosition,
+    };
+
+    static const char* GetStageName(Stage stage);
+
+    // Indices into the algorithm counters, must match include/mpmCounters.wgsl
+    enum Counter : uint32_t
+    {
+        MaxCellOccupancy,
+        MaxScatterFanIn,     // particles scattering into the cells touched by one particle
+        OccupancyHistogram,  // GPUCounters::HISTOGRAM_BINS entries
+    };
+
+    static constexpr uint32_t COUNTER_COUNT = OccupancyHistogram + GPUCounters::HISTOGRAM_BINS;
+
+    // Substeps and dt per frame unless the adaptive time step is enabled
+    static constexpr int DEFAULT_SUBSTEPS = 2;
+    static constexpr float DEFAULT_DT     = 0.2f;
+
     MlsMpmSimulator(wgpu::Buffer particleBuffer,
-                    wgpu::Buffer posvelBuffer,
+                    const std::array<wgpu::Buffer, 2>& posvelBuffers,
                     float renderDiameter,
                     wgpu::Device device);
+    ~MlsMpmSimulator();
+
+    // Bytes of the buffers that grow with the grid, known before creation
+    static uint64_t EstimateMemory();
+
+    // Run `steps` simulation steps of GetSubsteps() substeps each
+    void Compute(wgpu::CommandEncoder commandEncoder, int steps = 1);
+
+    void SetProfiler(GPUProfiler* profiler);
 
-    void Compute(wgpu::CommandEncoder commandEncoder);
+    // Select the posvel buffer the steps write, the renderers read the other one
+    void SetPosvelIndex(uint32_t index)
+    {
+        mPosvelIndex = index;
+    }
+
+    GPUCounters& GetCounters()
+    {
+        return *mCounters;
+    }
+
+    AdaptiveTimestep& GetAdaptiveTimestep()
+    {
+        return *mAdaptiveTimestep;
+    }
+
+    // Start the counters and max speed readbacks, call after the frame has been submitted
+    void EndFrame();
+
+    int GetSubsteps() const
+    {
+        return mSubsteps;
+    }
+
+    float GetDt() const
+    {
+        return mConstants.dt;
+    }
+
+    int GetGridCount() const
+    {
+        return mGridCount;
+    }
+
+    int GetNumParticles() const
+    {
+        return mNumParticles;
+    }
 
     void Reset(int numParticles, const glm::vec3& initHalfBoxSize, RenderUniforms& renderUniforms);
 
     void ChangeBoxSize(const glm::vec3& realBoxSize);
 
+    // Upload particles as they are, used by Reset and the kernel benchmarks
+    void SetParticles(const std::vector<MlsMpmParticle>& particles, const glm::vec3& boxSize);
+
+    // Record a single stage of a substep
+    void ComputeStage(Stage stage, wgpu::ComputePassEncoder& computePass);
+
 private:
+    // Grid cells per axis the buffers are sized for
+    static constexpr int MAX_GRID_SIZE = 64;
+
     void CreateBuffers();
     void WriteBuffers();
 
+    // Pick this frame's substeps and dt, writing dt when it changed
+    void UpdateTimestep();
+
     // clear grid
     void InitializeClearGridPipeline();
     void InitializeClearGridBindGroups();
@@ -84,7 +190,7 @@ private:
 
     // Copy position
     void InitializeCopyPositionPipeline();
-    void InitializeCopyPositionBindGroups(wgpu::Buffer posvelBuffer);
+    void InitializeCopyPositionBindGroups(const std::array<wgpu::Buffer, 2>& posvelBuffers);
     void ComputeCopyPosition(wgpu::ComputePassEncoder& computePass);
 
     std::vector<MlsMpmParticle> InitializeDamBreak(const glm::vec3& initHalfBoxSize,
@@ -95,18 +201,21 @@ private:
 
     // clear grid
     wgpu::ComputePipeline mClearGridPipeline;
+    wgpu::ComputePipeline mClearGridCountersPipeline;
     wgpu::PipelineLayout mClearGridLayout;
     wgpu::BindGroupLayout mClearGridBindGroupLayout;
     wgpu::BindGroup mClearGridBindGroup;
 
     // P2G #1 pipeline
     wgpu::ComputePipeline mP2G1Pipeline;
+    wgpu::ComputePipeline mP2G1CountersPipeline;
     wgpu::PipelineLayout mP2G1Layout;
     wgpu::BindGroupLayout mP2G1BindGroupLayout;
     wgpu::BindGroup mP2G1BindGroup;
 
     // P2G #2 pipeline
     wgpu::ComputePipeline mP2G2Pipeline;
+    wgpu::ComputePipeline mP2G2CountersPipeline;
     wgpu::PipelineLayout mP2G2Layout;
     wgpu::BindGroupLayout mP2G2BindGroupLayout;
     wgpu::BindGroup mP2G2BindGroup;
@@ -127,7 +236,7 @@ private:
     wgpu::ComputePipeline mCopyPositionPipeline;
     wgpu::PipelineLayout mCopyPositionLayout;
     wgpu::BindGroupLayout mCopyPositionBindGroupLayout;
-    wgpu::BindGroup mCopyPositionBindGroup;
+    wgpu::BindGroup mCopyPositionBindGroups[2];  // one per posvel buffer
 
     // buffers
     wgpu::Buffer mCellBuffer;
@@ -136,13 +245,19 @@ private:
     wgpu::Buffer mParticleBuffer;
     wgpu::Buffer mConstantsBuffer;
 
-    int mMaxXGrids    = 64;
-    int mMaxYGrids    = 64;
-    int mMaxZGrids    = 64;
+    int mMaxXGrids    = MAX_GRID_SIZE;
+    int mMaxYGrids    = MAX_GRID_SIZE;
+    int mMaxZGrids    = MAX_GRID_SIZE;
     int mMaxGridCount = mMaxXGrids * mMaxYGrids * mMaxZGrids;
     int mNumParticles = 0;
     int mGridCount    = 0;
+    int mSubsteps     = DEFAULT_SUBSTEPS;
     float mRenderDiameter;
+    uint32_t mPosvelIndex = 0;
 
     Constants mConstants;
+
+    GPUProfiler* mProfiler = nullptr;
+    std::unique_ptr<GPUCounters> mCounters;
+    std::unique_ptr<AdaptiveTimestep> mAdaptiveTimestep;
 };
@@ -1,47 +1,57 @@
 #include "SPHSimulator.h"
 
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <random>
 #include <iostream>
 
 #include "../WebGPUUtils.h"
+#include "../GPUMemory.h"
+#include "../PipelineBatch.h"
 #include "../ResourceManager.h"
 #include "../Application.h"
+#include "../GPUProfiler.h"
+#include "../Trace.h"
+
+namespace
+{
+    const glm::vec3 BOX_HALF_MAX(2.0f, 2.0f, 2.0f);
+}  // namespace
 
 SPHSimulator::SPHSimulator(wgpu::Device device,
                            wgpu::Buffer particleBuffer,
-                           wgpu::Buffer posvelBuffer,
-                           float renderDiameter)
+                           const std::array<wgpu::Buffer, 2>& posvelBuffers,
+                           float renderDiameter,
+                           uint32_t maxParticles)
 {
-    mDevice = device;
+    mDevice       = device;
+    mMaxParticles = maxParticles;
 
     mRenderDiameter = renderDiameter;
 
     float cellSize = 1.0f * mKernelRadius;
-    glm::vec3 halfMax(2.0f, 2.0f, 2.0f);
-    glm::vec3 length = halfMax * 2.0f;
-    float sentinel   = 4.0f * cellSize;
-    float gridX      = std::ceil((length.x + sentinel) / cellSize);
-    float gridY      = std::ceil((length.y + sentinel) / cellSize);
-    float gridZ      = std::ceil((length.z + sentinel) / cellSize);
-    mGridCount       = (int)(gridX * gridY * gridZ);
-    float offset     = sentinel / 2.0f;
+    glm::vec3 grid = GetGridSize(BOX_HALF_MAX, cellSize);
+    float gridX    = grid.x;
+    float gridY    = grid.y;
+    float gridZ    = grid.z;
+    mGridCount     = (int)(gridX * gridY * gridZ);
+    float offset   = 2.0f * cellSize;
 
     float stiffness     = 20.0f;
     float nearStiffness = 1.0f;
     float mass          = 1.0f;
     float restDensity   = 15000.0f;
     float viscosity     = 100.0f;
-    float dt            = 0.006f;
+    float dt            = DEFAULT_DT;
 
     Environment environment {
         .xGrids   = (int)gridX,
         .yGrids   = (int)gridY,
         .zGrids   = (int)gridZ,
         .cellSize = cellSize,
-        .xHalf    = halfMax.x,
-        .yHalf    = halfMax.y,
-        .zHalf    = halfMax.z,
+        .xHalf    = BOX_HALF_MAX.x,
+        .yHalf    = BOX_HALF_MAX.y,
+        .zHalf    = BOX_HALF_MAX.z,
         .offset   = offset,
     };
 
@@ -63,10 +73,25 @@ SPHSimulator::SPHSimulator(wgpu::Device device,
     CreateBuffers();
     WriteBuffers(environment, sphParams);
 
+    mCounters = std::make_unique<GPUCounters>(mDevice, COUNTER_COUNT, 0, "SPHSimulator");
+
+    // Both pressures are linear in the densities, c^2 = stiffness + nearStiffness
+    AdaptiveTimestep::Settings timestepSettings {
+        .frameTime   = DEFAULT_SUBSTEPS * DEFAULT_DT,
+        .cellSize    = mKernelRadius,
+        .courant     = 0.4f,
+        .soundSpeed  = std::sqrt(stiffness + nearStiffness),
+        .minSubsteps = 1,
+        .maxSubsteps = 4,
+    };
+    mAdaptiveTimestep = std::make_unique<AdaptiveTimestep>(
+        mDevice, particleBuffer, sizeof(SPHParticle), timestepSettings, "SPHSimulator");
+
     // Pipelines
     InitializeGridClearPipeline();
     InitializeGridBuildPipeline();
     InitializeReorderPipeline();
+    InitializeSortCellsPipeline();
     InitializeDensityPipeline();
     InitializeForcePipeline();
     InitializeIntegratePipeline();
@@ -76,10 +101,11 @@ SPHSimulator::SPHSimulator(wgpu::Device device,
     InitializeGridClearBindGroups();
     InitializeGridBuildBindGroups(particleBuffer);
     InitializeReorderBindGroups(particleBuffer);
+    InitializeSortCellsBindGroups();
     InitializeDensityBindGroups(particleBuffer);
     InitializeForceBindGroups(particleBuffer);
     InitializeIntegrateBindGroups(particleBuffer);
-    InitializeCopyPositionBindGroups(particleBuffer, posvelBuffer);
+    InitializeCopyPositionBindGroups(particleBuffer, posvelBuffers);
 
     mPrefixSumkernel =
         std::make_unique<PrefixSumKernel>(mDevice, mCellParticleCountBuffer, mGridCount + 1);
@@ -87,50 +113,178 @@ SPHSimulator::SPHSimulator(wgpu::Device device,
     mParticleBuffer = particleBuffer;
 }
 
-void SPHSimulator::Compute(wgpu::CommandEncoder commandEncoder)
+SPHSimulator::~SPHSimulator()
 {
-    wgpu::ComputePassDescriptor computePassDesc {
-        .timestampWrites = nullptr,
-    };
-    wgpu::ComputePassEncoder computePass = commandEncoder.BeginComputePass(&computePassDesc);
+    GPUMemory::Release(this);
+}
+
+uint64_t SPHSimulator::EstimateMemory(uint32_t maxParticles)
+{
+    glm::vec3 grid     = GetGridSize(BOX_HALF_MAX, KERNEL_RADIUS);
+    uint64_t gridCount = static_cast<uint64_t>(grid.x * grid.y * grid.z);
 
-    for (int i = 0; i < 2; ++i)
+    // Cell counts, per particle cell offsets and sorted indices, and the reordered particles
+    return sizeof(uint32_t) * (gridCount + 1) + 2 * sizeof(uint32_t) * maxParticles
+           + sizeof(SPHParticle) * maxParticles;
+}
+
+glm::vec3 SPHSimulator::GetGridSize(const glm::vec3& halfMax, float cellSize)
+{
+    // Two sentinel cells on either side
+    float sentinel = 4.0f * cellSize;
+    return glm::ceil((halfMax * 2.0f + sentinel) / cellSize);
+}
+
+void SPHSimulator::Compute(wgpu::CommandEncoder commandEncoder, int steps)
+{
+    TRACE_SCOPE("SPHSimulator::Compute");
+
+    UpdateTimestep();
+
+    mCounters->BeginFrame(commandEncoder, steps * mSubsteps);
+    mAdaptiveTimestep->BeginFrame(commandEncoder);
+
+    ProfiledComputePass computePass(commandEncoder, mProfiler);
+
+    for (int i = 0; i < steps * mSubsteps; ++i)
     {
-        ComputeGridClear(computePass);
-        ComputeGridBuild(computePass);
-        mPrefixSumkernel->Dispatch(computePass);
-        ComputeReorder(computePass);
-        ComputeDensity(computePass);
-        ComputeReorder(computePass);
-        ComputeForce(computePass);
-        ComputeIntegrate(computePass);
-        ComputeCopyPosition(computePass);
+        for (Stage stage : SUBSTEP_STAGES)
+        {
+            ComputeStage(stage, computePass.Stage(GetStageName(stage)));
+        }
+    }
+
+    if (mAdaptiveTimestep->IsEnabled())
+    {
+        mAdaptiveTimestep->Dispatch(computePass.Stage("SPH max velocity"), mNumParticles);
     }
 
     computePass.End();
+
+    mCounters->Resolve(commandEncoder);
+    mAdaptiveTimestep->Resolve(commandEncoder);
+}
+
+void SPHSimulator::EndFrame()
+{
+    mCounters->EndFrame();
+    mAdaptiveTimestep->EndFrame();
+}
+
+void SPHSimulator::UpdateTimestep()
+{
+    int substeps = DEFAULT_SUBSTEPS;
+    float dt     = DEFAULT_DT;
+    if (mAdaptiveTimestep->IsEnabled())
+    {
+        mAdaptiveTimestep->Select(substeps, dt);
+    }
+
+    mSubsteps = substeps;
+    if (dt != mDt)
+    {
+        mDt = dt;
+
+        wgpu::Queue queue = mDevice.GetQueue();
+        queue.WriteBuffer(mSPHParamsBuffer, offsetof(SPHParams, dt), &mDt, sizeof(float));
+    }
+}
+
+void SPHSimulator::ComputeStage(Stage stage, wgpu::ComputePassEncoder& computePass)
+{
+    switch (stage)
+    {
+        case Stage::GridClear:
+            ComputeGridClear(computePass);
+            break;
+        case Stage::GridBuild:
+            ComputeGridBuild(computePass);
+            break;
+        case Stage::PrefixSum:
+            mPrefixSumkernel->Dispatch(computePass);
+            break;
+        case Stage::Reorder:
+            ComputeReorder(computePass);
+            break;
+        case Stage::Density:
+            ComputeDensity(computePass);
+            break;
+        case Stage::Force:
+            ComputeForce(computePass);
+            break;
+        case Stage::Integrate:
+            ComputeIntegrate(computePass);
+            break;
+        case Stage::CopyPosition:
+            ComputeCopyPosition(computePass);
+            break;
+    }
+}
+
+const char* SPHSimulator::GetStageName(Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::GridClear:
+            return "SPH grid clear";
+        case Stage::GridBuild:
+            return "SPH grid build";
+        case Stage::PrefixSum:
+            return "SPH prefix sum";
+        case Stage::Reorder:
+            return "SPH reorder";
+        case Stage::Density:
+            return "SPH density";
+        case Stage::Force:
+            return "SPH force";
+        case Stage::Integrate:
+            return "SPH integrate";
+        case Stage::CopyPosition:
+            return "SPH copy position";
+    }
+    return "";
+}
+
+void SPHSimulator::SetProfiler(GPUProfiler* profiler)
+{
+    mProfiler = profiler;
 }
 
 void SPHSimulator::Reset(int numParticles,
                          const glm::vec3& initHalfBoxSize,
                          RenderUniforms& renderUniforms)
 {
+    TRACE_SCOPE("SPHSimulator::Reset");
+
     renderUniforms.sphereSize = mRenderDiameter;
 
+    Application::RestartRandom();
     std::vector<SPHParticle> particles = InitializeDamBreak(initHalfBoxSize, numParticles);
+    SetParticles(particles, initHalfBoxSize);
+
+    std::cout << "SPH numParticle = " << mNumParticles << std::endl;
+}
+
+void SPHSimulator::SetParticles(const std::vector<SPHParticle>& particles,
+                                const glm::vec3& realBoxSize)
+{
+    TRACE_SCOPE("SPHSimulator::SetParticles");
+
+    mNumParticles = std::min<uint32_t>(particles.size(), mMaxParticles);
 
     wgpu::Queue queue = mDevice.GetQueue();
     queue.WriteBuffer(mSPHParamsBuffer,
                       offsetof(SPHParams, n),
                       &mNumParticles,
                       sizeof(unsigned int));
-    queue.WriteBuffer(mParticleBuffer, 0, particles.data(), sizeof(SPHParticle) * particles.size());
-    queue.WriteBuffer(mRealBoxSizeBuffer, 0, glm::value_ptr(initHalfBoxSize), sizeof(glm::vec3));
-
-    std::cout << "SPH numParticle = " << mNumParticles << std::endl;
+    queue.WriteBuffer(mParticleBuffer, 0, particles.data(), sizeof(SPHParticle) * mNumParticles);
+    queue.WriteBuffer(mRealBoxSizeBuffer, 0, glm::value_ptr(realBoxSize), sizeof(glm::vec3));
 }
 
 void SPHSimulator::ChangeBoxSize(const glm::vec3& realBoxSize)
 {
+    TRACE_SCOPE("SPHSimulator::ChangeBoxSize");
+
     wgpu::Queue queue = mDevice.GetQueue();
     queue.WriteBuffer(mRealBoxSizeBuffer, 0, glm::value_ptr(realBoxSize), sizeof(glm::vec3));
 }
@@ -145,15 +299,15 @@ void SPHSimulator::CreateBuffers()
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage;
     bufferDesc.mappedAtCreation = false;
 
-    mCellParticleCountBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mCellParticleCountBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "SPHSimulator", this);
 
     // particle cell offset
     bufferDesc.label            = WebGPUUtils::GenerateString("particle cell offset buffer");
-    bufferDesc.size             = sizeof(uint32_t) * NUM_PARTICLES_MAX;
+    bufferDesc.size             = sizeof(uint32_t) * mMaxParticles;
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage;
     bufferDesc.mappedAtCreation = false;
 
-    mParticleCellOffsetBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mParticleCellOffsetBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "SPHSimulator", this);
 
     // environment
     bufferDesc.label            = WebGPUUtils::GenerateString("environment buffer");
@@ -161,7 +315,7 @@ void SPHSimulator::CreateBuffers()
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
     bufferDesc.mappedAtCreation = false;
 
-    mEnvironmentBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mEnvironmentBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "SPHSimulator", this);
 
     // SPH params
     bufferDesc.label            = WebGPUUtils::GenerateString("SPH params buffer");
@@ -169,15 +323,23 @@ void SPHSimulator::CreateBuffers()
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
     bufferDesc.mappedAtCreation = false;
 
-    mSPHParamsBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mSPHParamsBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "SPHSimulator", this);
 
     // target particles
     bufferDesc.label            = WebGPUUtils::GenerateString("target particles buffer");
-    bufferDesc.size             = sizeof(SPHParticle) * NUM_PARTICLES_MAX;
+    bufferDesc.size             = sizeof(SPHParticle) * mMaxParticles;
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage;
     bufferDesc.mappedAtCreation = false;
 
-    mTargetParticlesBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mTargetParticlesBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "SPHSimulator", this);
+
+    // sorted indices, deterministic mode only
+    bufferDesc.label            = WebGPUUtils::GenerateString("sorted indices buffer");
+    bufferDesc.size             = sizeof(uint32_t) * mMaxParticles;
+    bufferDesc.usage            = wgpu::BufferUsage::Storage;
+    bufferDesc.mappedAtCreation = false;
+
+    mSortedIndicesBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "SPHSimulator", this);
 
     // real box size
     bufferDesc.label            = WebGPUUtils::GenerateString("real box size buffer");
@@ -185,7 +347,7 @@ void SPHSimulator::CreateBuffers()
     bufferDesc.usage            = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform;
     bufferDesc.mappedAtCreation = false;
 
-    mRealBoxSizeBuffer = mDevice.CreateBuffer(&bufferDesc);
+    mRealBoxSizeBuffer = GPUMemory::CreateBuffer(mDevice, bufferDesc, "SPHSimulator", this);
 }
 
 void SPHSimulator::WriteBuffers(const Environment& environment, const SPHParams& sphParams)
@@ -232,7 +394,7 @@ void SPHSimulator::InitializeGridClearPipeline()
             },
     };
 
-    mGridClearPipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mGridClearPipeline);
 }
 
 void SPHSimulator::InitializeGridClearBindGroups()
@@ -304,10 +466,14 @@ void SPHSimulator::InitializeGridBuildPipeline()
     bindGroupLayoutDesc.entries    = bindingLayoutEentries.data();
     mGridBuildBindGroupLayout      = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
 
-    // Create the pipeline layout
+    // Create the pipeline layout, group 1 holds the algorithm counters
+    std::array<wgpu::BindGroupLayout, 2> bindGroupLayouts = {
+        mGridBuildBindGroupLayout,
+        mCounters->GetBindGroupLayout(),
+    };
     wgpu::PipelineLayoutDescriptor layoutDesc {};
-    layoutDesc.bindGroupLayoutCount = 1;
-    layoutDesc.bindGroupLayouts     = &mGridBuildBindGroupLayout;
+    layoutDesc.bindGroupLayoutCount = bindGroupLayouts.size();
+    layoutDesc.bindGroupLayouts     = bindGroupLayouts.data();
     mGridBuildLayout                = mDevice.CreatePipelineLayout(&layoutDesc);
 
     // pipelines
@@ -321,7 +487,10 @@ void SPHSimulator::InitializeGridBuildPipeline()
             },
     };
 
-    mGridBuildPipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mGridBuildPipeline);
+    mCounters->AddCountingPipeline(computePipelineDesc,
+                                   "resources/shader/sph/grid/gridBuild.wgsl",
+                                   mGridBuildCountersPipeline);
 }
 
 void SPHSimulator::InitializeGridBuildBindGroups(wgpu::Buffer particleBuffer)
@@ -365,7 +534,9 @@ void SPHSimulator::InitializeGridBuildBindGroups(wgpu::Buffer particleBuffer)
 void SPHSimulator::ComputeGridBuild(wgpu::ComputePassEncoder& computePass)
 {
     computePass.SetBindGroup(0, mGridBuildBindGroup, 0, nullptr);
-    computePass.SetPipeline(mGridBuildPipeline);
+    computePass.SetBindGroup(1, mCounters->GetBindGroup(), 0, nullptr);
+    computePass.SetPipeline(mCounters->IsSampling() ? mGridBuildCountersPipeline
+                                                    : mGridBuildPipeline);
     computePass.DispatchWorkgroups(std::ceil(mNumParticles / 64.0f));
 }
 
@@ -420,10 +591,25 @@ void SPHSimulator::InitializeReorderPipeline()
     bindGroupLayoutDesc.entries    = bindingLayoutEentries.data();
     mReorderBindGroupLayout        = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
 
+    // Group 1 holds the sorted indices written in deterministic mode
+    wgpu::BindGroupLayoutEntry sortedIndicesLayout;
+    WebGPUUtils::SetDefaultBindGroupLayout(sortedIndicesLayout);
+    sortedIndicesLayout.binding     = 0;
+    sortedIndicesLayout.visibility  = wgpu::ShaderStage::Compute;
+    sortedIndicesLayout.buffer.type = wgpu::BufferBindingType::Storage;
+
+    bindGroupLayoutDesc.entryCount = 1;
+    bindGroupLayoutDesc.entries    = &sortedIndicesLayout;
+    mSortedIndicesBindGroupLayout  = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
     // Create the pipeline layout
+    std::array<wgpu::BindGroupLayout, 2> bindGroupLayouts = {
+        mReorderBindGroupLayout,
+        mSortedIndicesBindGroupLayout,
+    };
     wgpu::PipelineLayoutDescriptor layoutDesc {};
-    layoutDesc.bindGroupLayoutCount = 1;
-    layoutDesc.bindGroupLayouts     = &mReorderBindGroupLayout;
+    layoutDesc.bindGroupLayoutCount = bindGroupLayouts.size();
+    layoutDesc.bindGroupLayouts     = bindGroupLayouts.data();
     mReorderLayout                  = mDevice.CreatePipelineLayout(&layoutDesc);
 
     // pipelines
@@ -437,7 +623,19 @@ void SPHSimulator::InitializeReorderPipeline()
             },
     };
 
-    mReorderPipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mReorderPipeline);
+
+    static const wgpu::ConstantEntry deterministic {
+        .key   = WebGPUUtils::GenerateString("DETERMINISTIC"),
+        .value = 1.0,
+    };
+    computePipelineDesc.label =
+        WebGPUUtils::GenerateString("deterministic reorder particles pipeline");
+    computePipelineDesc.compute.constantCount = 1;
+    computePipelineDesc.compute.constants     = &deterministic;
+
+    PipelineBatch::CreateComputePipeline(
+        mDevice, computePipelineDesc, mReorderDeterministicPipeline);
 }
 
 void SPHSimulator::InitializeReorderBindGroups(wgpu::Buffer particleBuffer)
@@ -481,13 +679,131 @@ void SPHSimulator::InitializeReorderBindGroups(wgpu::Buffer particleBuffer)
         .entries    = bindings.data(),
     };
     mReorderBindGroup = mDevice.CreateBindGroup(&bindGroupDesc);
+
+    wgpu::BindGroupEntry sortedIndices {
+        .binding = 0,
+        .buffer  = mSortedIndicesBuffer,
+        .offset  = 0,
+        .size    = mSortedIndicesBuffer.GetSize(),
+    };
+
+    bindGroupDesc.label      = WebGPUUtils::GenerateString("sorted indices bind group");
+    bindGroupDesc.layout     = mSortedIndicesBindGroupLayout;
+    bindGroupDesc.entryCount = 1;
+    bindGroupDesc.entries    = &sortedIndices;
+    mSortedIndicesBindGroup  = mDevice.CreateBindGroup(&bindGroupDesc);
 }
 
 void SPHSimulator::ComputeReorder(wgpu::ComputePassEncoder& computePass)
 {
     computePass.SetBindGroup(0, mReorderBindGroup, 0, nullptr);
-    computePass.SetPipeline(mReorderPipeline);
+    computePass.SetBindGroup(1, mSortedIndicesBindGroup, 0, nullptr);
+    computePass.SetPipeline(mDeterministic ? mReorderDeterministicPipeline : mReorderPipeline);
     computePass.DispatchWorkgroups(std::ceil(mNumParticles / 64.0f));
+
+    // Part of the reorder stage, the within-cell order is fixed before anything reads it
+    if (mDeterministic)
+    {
+        ComputeSortCells(computePass);
+    }
+}
+
+void SPHSimulator::InitializeSortCellsPipeline()
+{
+    wgpu::ShaderModule sortCellsModule =
+        ResourceManager::LoadShaderModule("resources/shader/sph/grid/sortCells.wgsl", mDevice);
+
+    // Create bind group entry
+    std::vector<wgpu::BindGroupLayoutEntry> bindingLayoutEentries(4);
+    // The sorted particles
+    wgpu::BindGroupLayoutEntry& bindingLayout0 = bindingLayoutEentries[0];
+    WebGPUUtils::SetDefaultBindGroupLayout(bindingLayout0);
+    bindingLayout0.binding     = 0;
+    bindingLayout0.visibility  = wgpu::ShaderStage::Compute;
+    bindingLayout0.buffer.type = wgpu::BufferBindingType::Storage;
+    // The sorted indices
+    wgpu::BindGroupLayoutEntry& bindingLayout1 = bindingLayoutEentries[1];
+    WebGPUUtils::SetDefaultBindGroupLayout(bindingLayout1);
+    bindingLayout1.binding     = 1;
+    bindingLayout1.visibility  = wgpu::ShaderStage::Compute;
+    bindingLayout1.buffer.type = wgpu::BufferBindingType::Storage;
+    // The prefix sum
+    wgpu::BindGroupLayoutEntry& bindingLayout2 = bindingLayoutEentries[2];
+    WebGPUUtils::SetDefaultBindGroupLayout(bindingLayout2);
+    bindingLayout2.binding     = 2;
+    bindingLayout2.visibility  = wgpu::ShaderStage::Compute;
+    bindingLayout2.buffer.type = wgpu::BufferBindingType::ReadOnlyStorage;
+    // The uniform buffer binding
+    wgpu::BindGroupLayoutEntry& bindingLayout3 = bindingLayoutEentries[3];
+    WebGPUUtils::SetDefaultBindGroupLayout(bindingLayout3);
+    bindingLayout3.binding     = 3;
+    bindingLayout3.visibility  = wgpu::ShaderStage::Compute;
+    bindingLayout3.buffer.type = wgpu::BufferBindingType::Uniform;
+
+    // Create a bind group layout
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc {};
+    bindGroupLayoutDesc.entryCount = static_cast<uint32_t>(bindingLayoutEentries.size());
+    bindGroupLayoutDesc.entries    = bindingLayoutEentries.data();
+    mSortCellsBindGroupLayout      = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
+
+    // Create the pipeline layout
+    wgpu::PipelineLayoutDescriptor layoutDesc {};
+    layoutDesc.bindGroupLayoutCount = 1;
+    layoutDesc.bindGroupLayouts     = &mSortCellsBindGroupLayout;
+    mSortCellsLayout                = mDevice.CreatePipelineLayout(&layoutDesc);
+
+    // pipelines
+    wgpu::ComputePipelineDescriptor computePipelineDesc {
+        .label  = WebGPUUtils::GenerateString("sort cells pipeline"),
+        .layout = mSortCellsLayout,
+        .compute =
+            {
+                .module     = sortCellsModule,
+                .entryPoint = "main",
+            },
+    };
+
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mSortCellsPipeline);
+}
+
+void SPHSimulator::InitializeSortCellsBindGroups()
+{
+    std::vector<wgpu::BindGroupEntry> bindings(4);
+
+    bindings[0].binding = 0;
+    bindings[0].buffer  = mTargetParticlesBuffer;
+    bindings[0].offset  = 0;
+    bindings[0].size    = mTargetParticlesBuffer.GetSize();
+
+    bindings[1].binding = 1;
+    bindings[1].buffer  = mSortedIndicesBuffer;
+    bindings[1].offset  = 0;
+    bindings[1].size    = mSortedIndicesBuffer.GetSize();
+
+    bindings[2].binding = 2;
+    bindings[2].buffer  = mCellParticleCountBuffer;
+    bindings[2].offset  = 0;
+    bindings[2].size    = mCellParticleCountBuffer.GetSize();
+
+    bindings[3].binding = 3;
+    bindings[3].buffer  = mEnvironmentBuffer;
+    bindings[3].offset  = 0;
+    bindings[3].size    = mEnvironmentBuffer.GetSize();
+
+    wgpu::BindGroupDescriptor bindGroupDesc {
+        .label      = WebGPUUtils::GenerateString("sort cells bind group"),
+        .layout     = mSortCellsBindGroupLayout,
+        .entryCount = static_cast<uint32_t>(bindings.size()),
+        .entries    = bindings.data(),
+    };
+    mSortCellsBindGroup = mDevice.CreateBindGroup(&bindGroupDesc);
+}
+
+void SPHSimulator::ComputeSortCells(wgpu::ComputePassEncoder& computePass)
+{
+    computePass.SetBindGroup(0, mSortCellsBindGroup, 0, nullptr);
+    computePass.SetPipeline(mSortCellsPipeline);
+    computePass.DispatchWorkgroups(std::ceil(mGridCount / 64.0f));
 }
 
 void SPHSimulator::InitializeDensityPipeline()
@@ -534,10 +850,14 @@ void SPHSimulator::InitializeDensityPipeline()
     bindGroupLayoutDesc.entries    = bindingLayoutEentries.data();
     mDensityBindGroupLayout        = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
 
-    // Create the pipeline layout
+    // Create the pipeline layout, group 1 holds the algorithm counters
+    std::array<wgpu::BindGroupLayout, 2> bindGroupLayouts = {
+        mDensityBindGroupLayout,
+        mCounters->GetBindGroupLayout(),
+    };
     wgpu::PipelineLayoutDescriptor layoutDesc {};
-    layoutDesc.bindGroupLayoutCount = 1;
-    layoutDesc.bindGroupLayouts     = &mDensityBindGroupLayout;
+    layoutDesc.bindGroupLayoutCount = bindGroupLayouts.size();
+    layoutDesc.bindGroupLayouts     = bindGroupLayouts.data();
     mDensityLayout                  = mDevice.CreatePipelineLayout(&layoutDesc);
 
     // pipelines
@@ -551,7 +871,10 @@ void SPHSimulator::InitializeDensityPipeline()
             },
     };
 
-    mDensityPipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mDensityPipeline);
+    mCounters->AddCountingPipeline(computePipelineDesc,
+                                   "resources/shader/sph/density.wgsl",
+                                   mDensityCountersPipeline);
 }
 
 void SPHSimulator::InitializeDensityBindGroups(wgpu::Buffer particleBuffer)
@@ -595,7 +918,8 @@ void SPHSimulator::InitializeDensityBindGroups(wgpu::Buffer particleBuffer)
 void SPHSimulator::ComputeDensity(wgpu::ComputePassEncoder& computePass)
 {
     computePass.SetBindGroup(0, mDensityBindGroup, 0, nullptr);
-    computePass.SetPipeline(mDensityPipeline);
+    computePass.SetBindGroup(1, mCounters->GetBindGroup(), 0, nullptr);
+    computePass.SetPipeline(mCounters->IsSampling() ? mDensityCountersPipeline : mDensityPipeline);
     computePass.DispatchWorkgroups(std::ceil(mNumParticles / 64.0f));
 }
 
@@ -643,10 +967,14 @@ void SPHSimulator::InitializeForcePipeline()
     bindGroupLayoutDesc.entries    = bindingLayoutEentries.data();
     mForceBindGroupLayout          = mDevice.CreateBindGroupLayout(&bindGroupLayoutDesc);
 
-    // Create the pipeline layout
+    // Create the pipeline layout, group 1 holds the algorithm counters
+    std::array<wgpu::BindGroupLayout, 2> bindGroupLayouts = {
+        mForceBindGroupLayout,
+        mCounters->GetBindGroupLayout(),
+    };
     wgpu::PipelineLayoutDescriptor layoutDesc {};
-    layoutDesc.bindGroupLayoutCount = 1;
-    layoutDesc.bindGroupLayouts     = &mForceBindGroupLayout;
+    layoutDesc.bindGroupLayoutCount = bindGroupLayouts.size();
+    layoutDesc.bindGroupLayouts     = bindGroupLayouts.data();
     mForceLayout                    = mDevice.CreatePipelineLayout(&layoutDesc);
 
     // pipelines
@@ -660,7 +988,10 @@ void SPHSimulator::InitializeForcePipeline()
             },
     };
 
-    mForcePipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mForcePipeline);
+    mCounters->AddCountingPipeline(computePipelineDesc,
+                                   "resources/shader/sph/force.wgsl",
+                                   mForceCountersPipeline);
 }
 
 void SPHSimulator::InitializeForceBindGroups(wgpu::Buffer particleBuffer)
@@ -704,7 +1035,8 @@ void SPHSimulator::InitializeForceBindGroups(wgpu::Buffer particleBuffer)
 void SPHSimulator::ComputeForce(wgpu::ComputePassEncoder& computePass)
 {
     computePass.SetBindGroup(0, mForceBindGroup, 0, nullptr);
-    computePass.SetPipeline(mForcePipeline);
+    computePass.SetBindGroup(1, mCounters->GetBindGroup(), 0, nullptr);
+    computePass.SetPipeline(mCounters->IsSampling() ? mForceCountersPipeline : mForcePipeline);
     computePass.DispatchWorkgroups(std::ceil(mNumParticles / 64.0f));
 }
 
@@ -757,7 +1089,7 @@ void SPHSimulator::InitializeIntegratePipeline()
             },
     };
 
-    mIntegratePipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mIntegratePipeline);
 }
 
 void SPHSimulator::InitializeIntegrateBindGroups(wgpu::Buffer particleBuffer)
@@ -844,41 +1176,44 @@ void SPHSimulator::InitializeCopyPositionPipeline()
             },
     };
 
-    mCopyPositionPipeline = mDevice.CreateComputePipeline(&computePipelineDesc);
+    PipelineBatch::CreateComputePipeline(mDevice, computePipelineDesc, mCopyPositionPipeline);
 }
 
-void SPHSimulator::InitializeCopyPositionBindGroups(wgpu::Buffer particleBuffer,
-                                                    wgpu::Buffer posvelBuffer)
+void SPHSimulator::InitializeCopyPositionBindGroups(
+    wgpu::Buffer particleBuffer, const std::array<wgpu::Buffer, 2>& posvelBuffers)
 {
-    std::vector<wgpu::BindGroupEntry> bindings(3);
-
-    bindings[0].binding = 0;
-    bindings[0].buffer  = particleBuffer;
-    bindings[0].offset  = 0;
-    bindings[0].size    = particleBuffer.GetSize();
-
-    bindings[1].binding = 1;
-    bindings[1].buffer  = posvelBuffer;
-    bindings[1].offset  = 0;
-    bindings[1].size    = posvelBuffer.GetSize();
-
-    bindings[2].binding = 2;
-    bindings[2].buffer  = mSPHParamsBuffer;
-    bindings[2].offset  = 0;
-    bindings[2].size    = mSPHParamsBuffer.GetSize();
-
-    wgpu::BindGroupDescriptor bindGroupDesc {
-        .label      = WebGPUUtils::GenerateString("copy position bind group"),
-        .layout     = mCopyPositionBindGroupLayout,
-        .entryCount = static_cast<uint32_t>(bindings.size()),
-        .entries    = bindings.data(),
-    };
-    mCopyPositionBindGroup = mDevice.CreateBindGroup(&bindGroupDesc);
+    for (uint32_t index = 0; index < 2; ++index)
+    {
+        std::vector<wgpu::BindGroupEntry> bindings(3);
+
+        bindings[0].binding = 0;
+        bindings[0].buffer  = particleBuffer;
+        bindings[0].offset  = 0;
+        bindings[0].size    = particleBuffer.GetSize();
+
+        bindings[1].binding = 1;
+        bindings[1].buffer  = posvelBuffers[index];
+        bindings[1].offset  = 0;
+        bindings[1].size    = posvelBuffers[index].GetSize();
+
+        bindings[2].binding = 2;
+        bindings[2].buffer  = mSPHParamsBuffer;
+        bindings[2].offset  = 0;
+        bindings[2].size    = mSPHParamsBuffer.GetSize();
+
+        wgpu::BindGroupDescriptor bindGroupDesc {
+            .label      = WebGPUUtils::GenerateString("copy position bind group"),
+            .layout     = mCopyPositionBindGroupLayout,
+            .entryCount = static_cast<uint32_t>(bindings.size()),
+            .entries    = bindings.data(),
+        };
+        mCopyPositionBindGroups[index] = mDevice.CreateBindGroup(&bindGroupDesc);
+    }
 }
 
 void SPHSimulator::ComputeCopyPosition(wgpu::ComputePassEncoder& computePass)
 {
-    computePass.SetBindGroup(0, mCopyPositionBindGroup, 0, nullptr);
+    computePass.SetBindGroup(0, mCopyPositionBindGroups[mPosvelIndex], 0, nullptr);
     computePass.SetPipeline(mCopyPositionPipeline);
     computePass.DispatchWorkgroups(std::ceil(mNumParticles / 64.0f));
 }
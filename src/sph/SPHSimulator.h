@@ -7,7 +7,15 @@
 #include <glm/glm.hpp>
 #include <PrefixSumKernel.h>
 
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "../AdaptiveTimestep.h"
+#include "../GPUCounters.h"
+
 struct RenderUniforms;
+class GPUProfiler;
 
 struct Environment
 {
@@ -50,24 +58,143 @@ struct SPHParticle
     float _padding4[2];
 };
 
+// Layouts shared with resources/shader/include/sph.wgsl
+static_assert(sizeof(Environment) == 32);
+static_assert(sizeof(SPHParams) == 48);
+static_assert(sizeof(SPHParticle) == 64);
+
 class SPHSimulator
 {
 public:
+    enum class Stage
+    {
+        GridClear,
+        GridBuild,
+        PrefixSum,
+        Reorder,
+        Density,
+        Force,
+        Integrate,
+        CopyPosition,
+    };
+
+    // One substep in dispatch order, particles are reordered before both density and force
+    static constexpr std::array<Stage, 9> SUBSTEP_STAGES = {
+        Stage::GridClear,
+        Stage::GridBuild,
+        Stage::PrefixSum,
+        Stage::Reorder,
+        Stage::Density,
+        Stage::Reorder,
+        Stage::Force,
+        Stage::Integrate,
+        Stage::CopyPosition,
+    };
+
+    static const char* GetStageName(Stage stage);
+
+    // Indices into the algorithm counters, must match include/sphCounters.wgsl
+    enum Counter : uint32_t
+    {
+        DensityCandidates,
+        DensityNeighbors,
+        ForceCandidates,
+        ForceNeighbors,
+        MaxCellOccupancy,
+        OccupancyHistogram,  // GPUCounters::HISTOGRAM_BINS entries
+    };
+
+    static constexpr uint32_t COUNTER_COUNT = OccupancyHistogram + GPUCounters::HISTOGRAM_BINS;
+
+    // Substeps and dt per frame unless the adaptive time step is enabled
+    static constexpr int DEFAULT_SUBSTEPS = 2;
+    static constexpr float DEFAULT_DT     = 0.006f;
+
     SPHSimulator(wgpu::Device device,
                  wgpu::Buffer particleBuffer,
-                 wgpu::Buffer posvelBuffer,
-                 float renderDiameter);
+                 const std::array<wgpu::Buffer, 2>& posvelBuffers,
+                 float renderDiameter,
+                 uint32_t maxParticles);
+    ~SPHSimulator();
+
+    // Bytes of the buffers that grow with the particles and the grid, known before creation
+    static uint64_t EstimateMemory(uint32_t maxParticles);
+
+    // Run `steps` simulation steps of GetSubsteps() substeps each
+    void Compute(wgpu::CommandEncoder commandEncoder, int steps = 1);
+
+    void SetProfiler(GPUProfiler* profiler);
+
+    // Select the posvel buffer the steps write, the renderers read the other one
+    void SetPosvelIndex(uint32_t index)
+    {
+        mPosvelIndex = index;
+    }
+
+    /**
+     * Sort every cell by particle index after the reorder so the neighbor sums, and therefore
+     * the simulation, are bitwise reproducible. Costs an extra pass per reorder.
+     */
+    void SetDeterministic(bool deterministic)
+    {
+        mDeterministic = deterministic;
+    }
 
-    void Compute(wgpu::CommandEncoder commandEncoder);
+    GPUCounters& GetCounters()
+    {
+        return *mCounters;
+    }
+
+    AdaptiveTimestep& GetAdaptiveTimestep()
+    {
+        return *mAdaptiveTimestep;
+    }
+
+    // Start the counters and max speed readbacks, call after the frame has been submitted
+    void EndFrame();
+
+    int GetSubsteps() const
+    {
+        return mSubsteps;
+    }
+
+    float GetDt() const
+    {
+        return mDt;
+    }
+
+    int GetGridCount() const
+    {
+        return mGridCount;
+    }
+
+    unsigned int GetNumParticles() const
+    {
+        return mNumParticles;
+    }
 
     void Reset(int numParticles, const glm::vec3& initHalfBoxSize, RenderUniforms& renderUniforms);
 
     void ChangeBoxSize(const glm::vec3& realBoxSize);
 
+    // Upload particles as they are, used by Reset and the kernel benchmarks
+    void SetParticles(const std::vector<SPHParticle>& particles, const glm::vec3& realBoxSize);
+
+    // Record a single stage of a substep
+    void ComputeStage(Stage stage, wgpu::ComputePassEncoder& computePass);
+
 private:
+    static constexpr float KERNEL_RADIUS = 0.07f;
+
+    // Cells per axis covering the box of half size `halfMax` plus a sentinel margin
+    static glm::vec3 GetGridSize(const glm::vec3& halfMax, float cellSize);
+
     void CreateBuffers();
     void WriteBuffers(const Environment& environment, const SPHParams& sphParams);
 
+    // Pick this frame's substeps and dt, writing dt when it changed
+    void UpdateTimestep();
+
     // Grid Clear
     void InitializeGridClearPipeline();
     void InitializeGridClearBindGroups();
@@ -83,6 +210,11 @@ private:
     void InitializeReorderBindGroups(wgpu::Buffer particleBuffer);
     void ComputeReorder(wgpu::ComputePassEncoder& computePass);
 
+    // Sort cells, deterministic mode only
+    void InitializeSortCellsPipeline();
+    void InitializeSortCellsBindGroups();
+    void ComputeSortCells(wgpu::ComputePassEncoder& computePass);
+
     // Density
     void InitializeDensityPipeline();
     void InitializeDensityBindGroups(wgpu::Buffer particleBuffer);
@@ -100,7 +232,8 @@ private:
 
     // Copy position
     void InitializeCopyPositionPipeline();
-    void InitializeCopyPositionBindGroups(wgpu::Buffer particleBuffer, wgpu::Buffer posvelBuffer);
+    void InitializeCopyPositionBindGroups(wgpu::Buffer particleBuffer,
+                                          const std::array<wgpu::Buffer, 2>& posvelBuffers);
     void ComputeCopyPosition(wgpu::ComputePassEncoder& computePass);
 
     std::vector<SPHParticle> InitializeDamBreak(const glm::vec3& initHalfBoxSize, int numParticles);
@@ -116,24 +249,36 @@ private:
 
     // Grid Build
     wgpu::ComputePipeline mGridBuildPipeline;
+    wgpu::ComputePipeline mGridBuildCountersPipeline;
     wgpu::PipelineLayout mGridBuildLayout;
     wgpu::BindGroupLayout mGridBuildBindGroupLayout;
     wgpu::BindGroup mGridBuildBindGroup;
 
     // Reorder
     wgpu::ComputePipeline mReorderPipeline;
+    wgpu::ComputePipeline mReorderDeterministicPipeline;
     wgpu::PipelineLayout mReorderLayout;
     wgpu::BindGroupLayout mReorderBindGroupLayout;
+    wgpu::BindGroupLayout mSortedIndicesBindGroupLayout;
     wgpu::BindGroup mReorderBindGroup;
+    wgpu::BindGroup mSortedIndicesBindGroup;
+
+    // Sort cells
+    wgpu::ComputePipeline mSortCellsPipeline;
+    wgpu::PipelineLayout mSortCellsLayout;
+    wgpu::BindGroupLayout mSortCellsBindGroupLayout;
+    wgpu::BindGroup mSortCellsBindGroup;
 
     // Density
     wgpu::ComputePipeline mDensityPipeline;
+    wgpu::ComputePipeline mDensityCountersPipeline;
     wgpu::PipelineLayout mDensityLayout;
     wgpu::BindGroupLayout mDensityBindGroupLayout;
     wgpu::BindGroup mDensityBindGroup;
 
     // Force
     wgpu::ComputePipeline mForcePipeline;
+    wgpu::ComputePipeline mForceCountersPipeline;
     wgpu::PipelineLayout mForceLayout;
     wgpu::BindGroupLayout mForceBindGroupLayout;
     wgpu::BindGroup mForceBindGroup;
@@ -148,7 +293,7 @@ private:
     wgpu::ComputePipeline mCopyPositionPipeline;
     wgpu::PipelineLayout mCopyPositionLayout;
     wgpu::BindGroupLayout mCopyPositionBindGroupLayout;
-    wgpu::BindGroup mCopyPositionBindGroup;
+    wgpu::BindGroup mCopyPositionBindGroups[2];  // one per posvel buffer
 
     // Buffers
     wgpu::Buffer mCellParticleCountBuffer;  // 累積和
@@ -156,13 +301,23 @@ private:
     wgpu::Buffer mEnvironmentBuffer;
     wgpu::Buffer mSPHParamsBuffer;
     wgpu::Buffer mTargetParticlesBuffer;
+    wgpu::Buffer mSortedIndicesBuffer;
     wgpu::Buffer mRealBoxSizeBuffer;
     wgpu::Buffer mParticleBuffer;
 
     std::unique_ptr<PrefixSumKernel> mPrefixSumkernel;
 
+    GPUProfiler* mProfiler = nullptr;
+    std::unique_ptr<GPUCounters> mCounters;
+    std::unique_ptr<AdaptiveTimestep> mAdaptiveTimestep;
+
     int mGridCount             = 0;
     unsigned int mNumParticles = 0;
-    float mKernelRadius        = 0.07;
+    uint32_t mMaxParticles     = 0;
+    float mKernelRadius        = KERNEL_RADIUS;
+    int mSubsteps              = DEFAULT_SUBSTEPS;
+    float mDt                  = DEFAULT_DT;
+    bool mDeterministic        = false;
+    uint32_t mPosvelIndex      = 0;
     float mRenderDiameter;
 };